@@ -16,8 +16,82 @@ Copyright (c) Microsoft Corporation All Rights Reserved
 #include "simple.h"
 #include "minwavert.h"
 #include "minwavertstream.h"
+#include "pcmtopwm.h"
 #define MINWAVERTSTREAM_POOLTAG 'SRWM'
 
+//=============================================================================
+#pragma code_seg("PAGE")
+static
+NTSTATUS
+GetPcmSampleFormat
+(
+    _In_  PWAVEFORMATEX         WaveFormat,
+    _Out_ PCM_SAMPLE_FORMAT*    SampleFormat
+)
+/*++
+
+Routine Description:
+
+    Maps a wave format to the sample format of the matching PWM conversion kernel.
+
+Arguments:
+
+    WaveFormat - format of the stream
+
+    SampleFormat - receives the sample format
+
+Return Value:
+
+    NT status code
+
+--*/
+{
+    PAGED_CODE();
+
+    BOOLEAN isFloat = FALSE;
+
+    if (WaveFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
+    {
+        PWAVEFORMATEXTENSIBLE waveFormatExt = reinterpret_cast<PWAVEFORMATEXTENSIBLE>(WaveFormat);
+
+        if (IsEqualGUIDAligned(waveFormatExt->SubFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT))
+        {
+            isFloat = TRUE;
+        }
+        else if (!IsEqualGUIDAligned(waveFormatExt->SubFormat, KSDATAFORMAT_SUBTYPE_PCM))
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+    }
+    else if (WaveFormat->wFormatTag == WAVE_FORMAT_IEEE_FLOAT)
+    {
+        isFloat = TRUE;
+    }
+    else if (WaveFormat->wFormatTag != WAVE_FORMAT_PCM)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (isFloat && WaveFormat->wBitsPerSample == 32)
+    {
+        *SampleFormat = PcmSampleFormatFloat32;
+    }
+    else if (!isFloat && WaveFormat->wBitsPerSample == 16)
+    {
+        *SampleFormat = PcmSampleFormat16;
+    }
+    else if (!isFloat && WaveFormat->wBitsPerSample == 32)
+    {
+        *SampleFormat = PcmSampleFormat24In32;
+    }
+    else
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
 //=============================================================================
 // CMiniportWaveRTStream
 //=============================================================================
@@ -124,6 +198,7 @@ Return Value:
     PAGED_CODE();
 
     PWAVEFORMATEX pWfEx = NULL;
+    PCM_SAMPLE_FORMAT sampleFormat;
     NTSTATUS ntStatus = STATUS_SUCCESS;
     PFILE_OBJECT fileObject = NULL;
 
@@ -142,6 +217,7 @@ Return Value:
     m_RestartInProgress = FALSE;
     m_ulNotificationsPerBuffer = 0;
     m_ulPacketsTransferred = 0;
+    m_pConvertToPwm = NULL;
     m_KsState = KSSTATE_STOP;
     m_pDpc = NULL;
     m_ullPlayPosition = 0;
@@ -160,6 +236,20 @@ Return Value:
         return STATUS_UNSUCCESSFUL; 
     }
 
+    //
+    // Select the conversion kernel for the stream format, so the audio engine does not
+    // have to convert the stream to 16 bit stereo before it reaches us.
+    //
+    ntStatus = GetPcmSampleFormat(pWfEx, &sampleFormat);
+    if (!NT_SUCCESS(ntStatus) || pWfEx->nChannels == 0 || pWfEx->nChannels > PWMCHANNELS)
+    {
+        DPF(D_ERROR, ("[CMiniportWaveRTStream::Init] Unsupported stream format"));
+        return STATUS_NOT_SUPPORTED;
+    }
+    m_pConvertToPwm = PcmToPwmConverters[g_PwmConversionMode][sampleFormat][pWfEx->nChannels - 1];
+    RtlZeroMemory(&m_PwmConversionState, sizeof(m_PwmConversionState));
+    m_PwmConversionState.DitherSeed = PCMTOPWM_DITHER_SEED;
+
     m_pMiniport = reinterpret_cast<CMiniportWaveRT*>(Miniport);
     if (m_pMiniport == NULL)
     {
@@ -387,7 +477,8 @@ Return Value:
         m_ulNotificationsPerBuffer = NotificationCount;
         m_ulDmaBufferSize = RequestedSize;
         m_ulBytesPerPacket = m_ulDmaBufferSize / m_ulNotificationsPerBuffer;
-        m_ulSamplesPerPacket = m_ulBytesPerPacket / PCMBYTESPERSAMPLE;
+        m_ulFramesPerPacket = m_ulBytesPerPacket / m_pWfExt->Format.nBlockAlign;
+        m_ulSamplesPerPacket = m_ulFramesPerPacket * PWMCHANNELS;
 
         *AudioBufferMdl = pBufferMdl;
         *ActualSize = RequestedSize;
@@ -449,6 +540,7 @@ Return Value:
     m_ulNotificationsPerBuffer = 0;
     m_ulDmaBufferSize = 0;
     m_ulBytesPerPacket = 0;
+    m_ulFramesPerPacket = 0;
     m_ulSamplesPerPacket = 0;
 
     return;
@@ -808,41 +900,6 @@ Return Value:
     return STATUS_NOT_IMPLEMENTED;
 }
 
-#pragma code_seg()
-VOID
-CMiniportWaveRTStream::ConvertPCMToPWM
-(
-    _In_reads_(SampleCount)       PINT16  InBuffer,
-    _Out_writes_all_(SampleCount) PUINT32 OutBuffer,
-    _In_                          DWORD   SampleCount
-)
-/*++
-
-Routine Description:
-
-    Converts 16 bit audio samples with 16-bit valid audio data from the audio stack to 32 bit PWM samples with 11 bit valid audio data.
-    Input buffer is the audio buffer filled by the audio stack, output buffer is the DMA buffer used by the PWM driver.
-
-Arguments:
-
-    InBuffer - 16 bit sample input buffer
-
-    OutBuffer - 32 bit sample output buffer
-
-    SampleCount - number of samples to convert
-
-Return Value:
-
-    None
-
---*/
-{
-    while (SampleCount--)
-    {
-        *OutBuffer++ = (*InBuffer++ / PCMTOPWMDIV) + PWMSILENCE;
-    }
-}
-
 #pragma code_seg()
 VOID
 CMiniportWaveRTStream::SilenceToPWM
@@ -869,6 +926,17 @@ Return Value:
 
 --*/
 {
+#ifdef PCMTOPWM_NEON
+    const uint32x4_t silence = vdupq_n_u32(PWMSILENCE);
+
+    while (SampleCount >= 4)
+    {
+        vst1q_u32(OutBuffer, silence);
+        OutBuffer += 4;
+        SampleCount -= 4;
+    }
+#endif
+
     while (SampleCount--)
     {
         *OutBuffer++ = PWMSILENCE;
@@ -1005,18 +1073,20 @@ Return Value:
         UpdatePosition();
     }
 
-    ULONG sampleCount = 0;
+    ULONG frameCount = 0;
 
     if (!(Flags & KSSTREAM_HEADER_OPTIONSF_ENDOFSTREAM))
     {
-        sampleCount = m_ulSamplesPerPacket;
+        frameCount = m_ulFramesPerPacket;
     }
     else
     {
-        sampleCount = EosPacketLength / PCMBYTESPERSAMPLE;
-        ASSERT(m_ulSamplesPerPacket >= sampleCount);
+        frameCount = EosPacketLength / m_pWfExt->Format.nBlockAlign;
+        ASSERT(m_ulFramesPerPacket >= frameCount);
     }
 
+    ULONG sampleCount = frameCount * PWMCHANNELS;
+
     //
     // Copy data into the PWM DMA buffer
     //
@@ -1081,7 +1151,7 @@ Return Value:
         // buffer before the current packet. This is important since we start DMA always at packet 0 and need the
         // packets in the DMA buffer linked together. 
         //
-        ULONG packetBaseIndex;
+        ULONG packetBaseOffset;
         ULONG dmaPacketBaseIndex;
         if (m_PwmState == KSSTATE_STOP)
         {
@@ -1101,10 +1171,10 @@ Return Value:
             InterlockedExchange((LONG*)m_PwmAudioConfig.DmaPacketsToPrime, m_PwmAudioConfig.DmaNumPackets / 2);
         }
 
-        packetBaseIndex = (orgPacketNumber % m_ulNotificationsPerBuffer) * m_ulSamplesPerPacket;
+        packetBaseOffset = (orgPacketNumber % m_ulNotificationsPerBuffer) * m_ulBytesPerPacket;
         dmaPacketBaseIndex = (PacketNumber % m_PwmAudioConfig.DmaNumPackets) * m_ulSamplesPerPacket;
 
-        ConvertPCMToPWM((PINT16)m_DataBuffer + packetBaseIndex, (PUINT32)m_PwmAudioConfig.DmaBuffer + dmaPacketBaseIndex, sampleCount);
+        m_pConvertToPwm(m_DataBuffer + packetBaseOffset, (PUINT32)m_PwmAudioConfig.DmaBuffer + dmaPacketBaseIndex, frameCount, &m_PwmConversionState);
 
         if ((Flags & KSSTREAM_HEADER_OPTIONSF_ENDOFSTREAM) &&
             (m_ulSamplesPerPacket > sampleCount))
@@ -1370,6 +1440,7 @@ Return Value:
             // Reset DMA
             m_ullPlayPosition = 0;
             m_ulPacketsTransferred = 0;
+            RtlZeroMemory(m_PwmConversionState.Error, sizeof(m_PwmConversionState.Error));
 
             //
             // Stop PWM
@@ -1480,7 +1551,7 @@ Return Value:
                     BCM_PWM_AUDIO_CONFIG audioConfig;
 
                     RtlZeroMemory(&audioConfig, sizeof(BCM_PWM_AUDIO_CONFIG));
-                    audioConfig.RequestedBufferSize = m_ulDmaBufferSize * 2;
+                    audioConfig.RequestedBufferSize = m_ulSamplesPerPacket * m_ulNotificationsPerBuffer * sizeof(UINT32);
                     audioConfig.NotificationsPerBuffer = m_ulNotificationsPerBuffer;
                     audioConfig.PwmRange = PWMRANGE;
                     ntStatus = PwmIoctlCall(IOCTL_BCM_PWM_INITIALIZE_AUDIO, &audioConfig, sizeof(BCM_PWM_AUDIO_CONFIG), &m_PwmAudioConfig, sizeof(BCM_PWM_AUDIO_CONFIG));
@@ -1490,11 +1561,6 @@ Return Value:
                         return ntStatus;
                     }
 
-                    //
-                    // Sanity check sample width.
-                    //
-                    ASSERT(PCMBYTESPERSAMPLE == m_pWfExt->Format.wBitsPerSample / 8);
-
                     m_PwmInitialized = TRUE;
                 }
             }
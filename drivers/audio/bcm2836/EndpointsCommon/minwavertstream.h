@@ -18,10 +18,43 @@ Abstract:
 #define PCMRANGE 0x10000
 #define PCMTOPWMDIV ((PCMRANGE / PWMRANGE) + 1)
 #define PWMSILENCE  (PWMRANGE / 2)
-#define PCMBYTESPERSAMPLE  2
 #define PCMFREQ 44100
 #define PWMFREQ 100000000
 
+//
+// Reciprocal of PCMTOPWMDIV used by the vectorized conversion. For all 16 bit input
+// values (x * PCMTOPWMMUL) >> PCMTOPWMSHIFT, corrected by one for negative input,
+// is identical to the truncating division by PCMTOPWMDIV.
+//
+
+#define PCMTOPWMSHIFT 19
+#define PCMTOPWMMUL (((1 << PCMTOPWMSHIFT) / PCMTOPWMDIV) + 1)
+
+//
+// Per stream state of the dithering conversion modes.
+//
+
+typedef struct _PCM_TO_PWM_STATE
+{
+    ULONG   DitherSeed;
+    INT32   Error[2];
+} PCM_TO_PWM_STATE, *PPCM_TO_PWM_STATE;
+
+#define PCMTOPWM_DITHER_SEED 0x2545F491
+
+//
+// Converts FrameCount frames of the stream format from InBuffer into PWM samples.
+// The kernels are defined in pcmtopwm.h.
+//
+
+typedef VOID (*PPCM_TO_PWM_CONVERTER)
+(
+    _In_ PVOID              InBuffer,
+    _Out_ PUINT32           OutBuffer,
+    _In_ ULONG              FrameCount,
+    _Inout_ PPCM_TO_PWM_STATE State
+);
+
 //=============================================================================
 // Referenced Forward
 //=============================================================================
@@ -83,7 +116,10 @@ protected:
     LARGE_INTEGER               m_LastSetWritePacket;
     LARGE_INTEGER               m_PerformanceCounterFrequency;
 
+    ULONG                       m_ulFramesPerPacket;
     ULONG                       m_ulSamplesPerPacket;
+    PPCM_TO_PWM_CONVERTER       m_pConvertToPwm;
+    PCM_TO_PWM_STATE            m_PwmConversionState;
     ULONG                       m_ulPacketsTransferred;
 
     KSSTATE                     m_KsState;
@@ -127,13 +163,6 @@ private:
         _In_                                ULONG   OutputBufferSize
     );
 
-    VOID ConvertPCMToPWM
-    (
-        _In_reads_(SampleCount)         PINT16  InBuffer,
-        _Out_writes_all_(SampleCount)   PUINT32 OutBuffer,
-        _In_                            DWORD   SampleCount
-    );
-
     VOID SilenceToPWM
     (
         _Out_writes_all_(SampleCount)   PUINT32 OutBuffer,
@@ -0,0 +1,273 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Abstract:
+    Format specialized conversion kernels from the audio stack sample formats
+    to the 32 bit PWM samples consumed by the PWM DMA.
+
+--*/
+
+#pragma once
+
+#if defined(_M_ARM) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PCMTOPWM_NEON
+#endif
+
+//
+// The PWM always plays stereo, so each input frame results in two PWM samples.
+//
+
+#define PWMCHANNELS 2
+
+//
+// The reciprocal must fit into a signed 16 bit multiplier and its rounding error must
+// not change the result for any 16 bit sample.
+//
+
+C_ASSERT(PCMTOPWMMUL <= SHRT_MAX);
+C_ASSERT((PCMTOPWMMUL * PCMTOPWMDIV - (1 << PCMTOPWMSHIFT)) * (-SHRT_MIN) < (1 << PCMTOPWMSHIFT));
+
+//
+// The dithering modes round to the nearest PWM level. Biasing the sample by the
+// silence level makes the value positive, so an unsigned division rounds correctly.
+// TPDF dither stays below one PWM step and the noise shaping error below two, so
+// neither can push the result out of the PWM range.
+//
+
+#define PCMTOPWMBIAS ((PWMSILENCE * PCMTOPWMDIV) + (PCMTOPWMDIV / 2))
+
+C_ASSERT(PCMTOPWMBIAS + SHRT_MIN - (3 * PCMTOPWMDIV) >= 0);
+C_ASSERT((PCMTOPWMBIAS + SHRT_MAX + (3 * PCMTOPWMDIV)) / PCMTOPWMDIV <= PWMRANGE);
+
+C_ASSERT(RTL_FIELD_SIZE(PCM_TO_PWM_STATE, Error) == PWMCHANNELS * sizeof(INT32));
+
+typedef enum _PCM_SAMPLE_FORMAT
+{
+    PcmSampleFormat16 = 0,
+    PcmSampleFormat24In32,
+    PcmSampleFormatFloat32,
+    PcmSampleFormatMax
+} PCM_SAMPLE_FORMAT;
+
+//
+// Sample readers. Each one reduces an input sample to the signed 16 bit range
+// used by the PCM to PWM scaling.
+//
+
+struct PCM_SAMPLE_16
+{
+    typedef INT16 SAMPLE;
+
+    static __forceinline INT32 ToPcm16(SAMPLE Sample)
+    {
+        return Sample;
+    }
+};
+
+struct PCM_SAMPLE_24IN32
+{
+    typedef INT32 SAMPLE;
+
+    static __forceinline INT32 ToPcm16(SAMPLE Sample)
+    {
+        //
+        // 24 bit samples are left aligned in the 32 bit container.
+        //
+        return Sample >> 16;
+    }
+};
+
+struct PCM_SAMPLE_FLOAT32
+{
+    typedef FLOAT SAMPLE;
+
+    static __forceinline INT32 ToPcm16(SAMPLE Sample)
+    {
+        FLOAT scaled = Sample * 32768.0f;
+
+        if (scaled >= (FLOAT)SHRT_MAX)
+        {
+            return SHRT_MAX;
+        }
+        if (scaled <= (FLOAT)SHRT_MIN)
+        {
+            return SHRT_MIN;
+        }
+        return (INT32)scaled;
+    }
+};
+
+__forceinline
+UINT32
+Pcm16ToPwm
+(
+    _In_ INT32 Sample
+)
+{
+    return (UINT32)((Sample / PCMTOPWMDIV) + PWMSILENCE);
+}
+
+__forceinline
+INT32
+NextTpdfDither
+(
+    _Inout_ PPCM_TO_PWM_STATE State
+)
+/*++
+
+Routine Description:
+
+    Returns triangular distributed dither of +/- one PWM step from two uniform
+    values taken from a xorshift generator.
+
+--*/
+{
+    ULONG seed = State->DitherSeed;
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    State->DitherSeed = seed;
+
+    return (INT32)(((seed >> 16) * PCMTOPWMDIV) >> 16) - (INT32)(((seed & 0xFFFF) * PCMTOPWMDIV) >> 16);
+}
+
+template <PWMCONVERSIONMODE Mode>
+__forceinline
+UINT32
+QuantizeToPwm
+(
+    _In_ INT32              Sample,
+    _Inout_ PPCM_TO_PWM_STATE State,
+    _In_ ULONG              Channel
+)
+{
+    if (Mode == PWMCONVERSIONMODE_TRUNCATE)
+    {
+        UNREFERENCED_PARAMETER(State);
+        UNREFERENCED_PARAMETER(Channel);
+
+        return Pcm16ToPwm(Sample);
+    }
+
+    //
+    // First-order noise shaping feeds the quantization error of the previous sample
+    // back, which moves the quantization noise towards high frequencies.
+    //
+    INT32 target = Sample;
+    if (Mode == PWMCONVERSIONMODE_NOISESHAPED)
+    {
+        target -= State->Error[Channel];
+    }
+
+    UINT32 pwmSample = (UINT32)(target + NextTpdfDither(State) + PCMTOPWMBIAS) / PCMTOPWMDIV;
+
+    if (Mode == PWMCONVERSIONMODE_NOISESHAPED)
+    {
+        State->Error[Channel] = (INT32)((pwmSample - PWMSILENCE) * PCMTOPWMDIV) - target;
+    }
+
+    return pwmSample;
+}
+
+template <typename SampleReader, ULONG Channels, PWMCONVERSIONMODE Mode>
+VOID
+ConvertToPwm
+(
+    _In_ PVOID              InBuffer,
+    _Out_ PUINT32           OutBuffer,
+    _In_ ULONG              FrameCount,
+    _Inout_ PPCM_TO_PWM_STATE State
+)
+{
+    C_ASSERT(Channels == 1 || Channels == PWMCHANNELS);
+
+    const typename SampleReader::SAMPLE* inSample = (const typename SampleReader::SAMPLE*)InBuffer;
+
+    while (FrameCount--)
+    {
+        INT32 left = SampleReader::ToPcm16(*inSample++);
+        INT32 right = left;
+
+        if (Channels == PWMCHANNELS)
+        {
+            right = SampleReader::ToPcm16(*inSample++);
+        }
+
+        *OutBuffer++ = QuantizeToPwm<Mode>(left, State, 0);
+        *OutBuffer++ = QuantizeToPwm<Mode>(right, State, 1);
+    }
+}
+
+//
+// 16 bit stereo is the native format of the audio engine and by far the most common one.
+// On ARM it is converted 8 samples at a time with NEON, replacing the division by
+// PCMTOPWMDIV with a multiplication by PCMTOPWMMUL. The result is bit-identical to the
+// generic kernel, which converts the remaining frames.
+//
+
+template <>
+inline
+VOID
+ConvertToPwm<PCM_SAMPLE_16, PWMCHANNELS, PWMCONVERSIONMODE_TRUNCATE>
+(
+    _In_ PVOID              InBuffer,
+    _Out_ PUINT32           OutBuffer,
+    _In_ ULONG              FrameCount,
+    _Inout_ PPCM_TO_PWM_STATE State
+)
+{
+    UNREFERENCED_PARAMETER(State);
+
+    const INT16* inSample = (const INT16*)InBuffer;
+    ULONG sampleCount = FrameCount * PWMCHANNELS;
+
+#ifdef PCMTOPWM_NEON
+    const int32x4_t silence = vdupq_n_s32(PWMSILENCE);
+
+    while (sampleCount >= 8)
+    {
+        int16x8_t samples = vld1q_s16(inSample);
+        int32x4_t productLow = vmull_n_s16(vget_low_s16(samples), PCMTOPWMMUL);
+        int32x4_t productHigh = vmull_n_s16(vget_high_s16(samples), PCMTOPWMMUL);
+
+        //
+        // Shifting the sign bit down yields -1 for negative products, subtracting it rounds towards zero.
+        //
+        productLow = vsubq_s32(vshrq_n_s32(productLow, PCMTOPWMSHIFT), vshrq_n_s32(productLow, 31));
+        productHigh = vsubq_s32(vshrq_n_s32(productHigh, PCMTOPWMSHIFT), vshrq_n_s32(productHigh, 31));
+
+        vst1q_u32(OutBuffer, vreinterpretq_u32_s32(vaddq_s32(productLow, silence)));
+        vst1q_u32(OutBuffer + 4, vreinterpretq_u32_s32(vaddq_s32(productHigh, silence)));
+
+        inSample += 8;
+        OutBuffer += 8;
+        sampleCount -= 8;
+    }
+#endif
+
+    while (sampleCount--)
+    {
+        *OutBuffer++ = Pcm16ToPwm(*inSample++);
+    }
+}
+
+//
+// Conversion kernels indexed by conversion mode, sample format and channel count - 1.
+//
+
+#define PCMTOPWM_CONVERTERS(Mode)                                                                   \
+    {                                                                                               \
+        { ConvertToPwm<PCM_SAMPLE_16, 1, Mode>,      ConvertToPwm<PCM_SAMPLE_16, 2, Mode>      },   \
+        { ConvertToPwm<PCM_SAMPLE_24IN32, 1, Mode>,  ConvertToPwm<PCM_SAMPLE_24IN32, 2, Mode>  },   \
+        { ConvertToPwm<PCM_SAMPLE_FLOAT32, 1, Mode>, ConvertToPwm<PCM_SAMPLE_FLOAT32, 2, Mode> },   \
+    }
+
+static const PPCM_TO_PWM_CONVERTER PcmToPwmConverters[PWMCONVERSIONMODE_MAX][PcmSampleFormatMax][PWMCHANNELS] =
+{
+    PCMTOPWM_CONVERTERS(PWMCONVERSIONMODE_TRUNCATE),
+    PCMTOPWM_CONVERTERS(PWMCONVERSIONMODE_DITHER),
+    PCMTOPWM_CONVERTERS(PWMCONVERSIONMODE_NOISESHAPED),
+};
@@ -9,13 +9,14 @@ Abstract:
 
 #pragma once
 
-// To keep the code simple assume device supports only 48KHz, 16-bit, stereo (PCM and NON-PCM)
+// The device plays 44.1KHz stereo. The stream converts 16-bit, 24-in-32-bit and float
+// mono or stereo input straight into the PWM DMA buffer.
 
 #define SPEAKERHP_DEVICE_MAX_CHANNELS                   2       // Max Channels.
 
 #define SPEAKERHP_HOST_MAX_CHANNELS                     2       // Max Channels.
 #define SPEAKERHP_HOST_MIN_BITS_PER_SAMPLE              16      // Min Bits Per Sample
-#define SPEAKERHP_HOST_MAX_BITS_PER_SAMPLE              16      // Max Bits Per Sample
+#define SPEAKERHP_HOST_MAX_BITS_PER_SAMPLE              32      // Max Bits Per Sample
 #define SPEAKERHP_HOST_MIN_SAMPLE_RATE                  44100   // Min Sample Rate
 #define SPEAKERHP_HOST_MAX_SAMPLE_RATE                  44100   // Max Sample Rate
 
@@ -27,7 +28,7 @@ Abstract:
 static 
 KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpeakerHpHostPinSupportedDeviceFormats[] =
 {
-    { // 2
+    { // 0
         {
             sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
             0,
@@ -52,6 +53,131 @@ KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpeakerHpHostPinSupportedDeviceFormats[] =
             STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
         }
     },
+    { // 1
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                1,
+                44100,
+                88200,
+                2,
+                16,
+                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
+            },
+            16,
+            KSAUDIO_SPEAKER_MONO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    },
+    { // 2
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                44100,
+                352800,
+                8,
+                32,
+                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
+            },
+            24,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    },
+    { // 3
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                1,
+                44100,
+                176400,
+                4,
+                32,
+                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
+            },
+            24,
+            KSAUDIO_SPEAKER_MONO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
+        }
+    },
+    { // 4
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                2,
+                44100,
+                352800,
+                8,
+                32,
+                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
+            },
+            32,
+            KSAUDIO_SPEAKER_STEREO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)
+        }
+    },
+    { // 5
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                1,
+                44100,
+                176400,
+                4,
+                32,
+                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
+            },
+            32,
+            KSAUDIO_SPEAKER_MONO,
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)
+        }
+    },
 };
 
 //
@@ -62,7 +188,7 @@ MODE_AND_DEFAULT_FORMAT SpeakerHpHostPinSupportedDeviceModes[] =
 {
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_RAW,
-        &SpeakerHpHostPinSupportedDeviceFormats[0].DataFormat // 44.1kHz
+        &SpeakerHpHostPinSupportedDeviceFormats[0].DataFormat // 44.1kHz, 16-bit, stereo
     },
 };
 
@@ -109,6 +235,22 @@ KSDATARANGE_AUDIO SpeakerHpPinDataRangesStream[] =
         SPEAKERHP_HOST_MIN_SAMPLE_RATE,            
         SPEAKERHP_HOST_MAX_SAMPLE_RATE             
     },
+    { // 1
+        {
+            sizeof(KSDATARANGE_AUDIO),
+            KSDATARANGE_ATTRIBUTES,         // An attributes list follows this data range
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT),
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        SPEAKERHP_HOST_MAX_CHANNELS,           
+        SPEAKERHP_HOST_MAX_BITS_PER_SAMPLE,    
+        SPEAKERHP_HOST_MAX_BITS_PER_SAMPLE,    
+        SPEAKERHP_HOST_MIN_SAMPLE_RATE,            
+        SPEAKERHP_HOST_MAX_SAMPLE_RATE             
+    },
 };
 
 
@@ -116,6 +258,8 @@ static
 PKSDATARANGE SpeakerHpPinDataRangePointersStream[] =
 {
     PKSDATARANGE(&SpeakerHpPinDataRangesStream[0]),
+    PKSDATARANGE(&PinDataRangeAttributeList),
+    PKSDATARANGE(&SpeakerHpPinDataRangesStream[1]),
     PKSDATARANGE(&PinDataRangeAttributeList)
 };
 
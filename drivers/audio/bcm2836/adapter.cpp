@@ -27,6 +27,8 @@ typedef void (*fnPcDriverUnload) (PDRIVER_OBJECT);
 fnPcDriverUnload gPCDriverUnloadRoutine = NULL;
 extern "C" DRIVER_UNLOAD DriverUnload;
 
+PWMCONVERSIONMODE g_PwmConversionMode = PWMCONVERSIONMODE_TRUNCATE;
+
 //-----------------------------------------------------------------------------
 // Referenced forward.
 //-----------------------------------------------------------------------------
@@ -160,6 +162,33 @@ Return Value:
         DPF(D_ERROR, ("WdfDriverCreate failed, 0x%x", ntStatus)),
         Done);
 
+    //
+    // Read the optional PCM to PWM conversion mode.
+    //
+    {
+        WDFKEY wdfKey;
+        NTSTATUS regStatus = WdfDriverOpenParametersRegistryKey(
+            WdfGetDriver(),
+            KEY_READ,
+            WDF_NO_OBJECT_ATTRIBUTES,
+            &wdfKey);
+
+        if (NT_SUCCESS(regStatus))
+        {
+            DECLARE_CONST_UNICODE_STRING(valueName, L"PwmConversionMode");
+            ULONG value;
+            regStatus = WdfRegistryQueryULong(wdfKey, &valueName, &value);
+            if (NT_SUCCESS(regStatus) && value < PWMCONVERSIONMODE_MAX)
+            {
+                g_PwmConversionMode = (PWMCONVERSIONMODE)value;
+            }
+
+            WdfRegistryClose(wdfKey);
+        }
+
+        DPF(D_TERSE, ("PWM conversion mode %d", g_PwmConversionMode));
+    }
+
     //
     // Tell the class driver to initialize the driver.
     //
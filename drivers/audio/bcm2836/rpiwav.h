@@ -134,6 +134,17 @@ typedef enum {
 // Typedefs
 //=============================================================================
 
+// Quantization used when reducing samples to the PWM resolution. Selected by the
+// PwmConversionMode value in the driver's Parameters registry key.
+typedef enum {
+    PWMCONVERSIONMODE_TRUNCATE          = 0,    // Plain division, no dither
+    PWMCONVERSIONMODE_DITHER            = 1,    // TPDF dither, rounded
+    PWMCONVERSIONMODE_NOISESHAPED       = 2,    // TPDF dither with first-order noise shaping
+    PWMCONVERSIONMODE_MAX
+} PWMCONVERSIONMODE;
+
+extern PWMCONVERSIONMODE g_PwmConversionMode;
+
 // Flags to identify stream processing mode
 typedef enum {
     CONNECTIONTYPE_TOPOLOGY_OUTPUT = 0,
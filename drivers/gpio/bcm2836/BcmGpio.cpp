@@ -15,6 +15,7 @@
 #pragma hdrstop
 
 #include "BcmUtility.hpp"
+#include "bcmgpio-ioctl.h"
 #include "BcmGpio.hpp"
 
 BCM_NONPAGED_SEGMENT_BEGIN; //=================================================
@@ -60,8 +61,28 @@ namespace { // static
         TIMER_CONTEXT,
         bcmGpioTimerContextFromWdfObject);
 
+    //
+    // Mask of the pins that exist in a bank
+    //
+    ULONG bankPinMask ( BANK_ID BankId )
+    {
+        const ULONG bankPinCount = min(
+            ULONG(BCM_GPIO_PINS_PER_BANK),
+            BCM_GPIO_PIN_COUNT - BankId * BCM_GPIO_PINS_PER_BANK);
+        return (bankPinCount == 32) ? ULONG(-1) : ((1UL << bankPinCount) - 1);
+    } // bankPinMask (...)
+
 } // namespace static
 
+BCM_GPIO::_STORM_MITIGATION_CONFIG BCM_GPIO::stormMitigationConfig = {
+    0,                                      // rate
+    BCM_GPIO::STORM_DEFAULT_BURST,
+    BCM_GPIO::STORM_DEFAULT_BACKOFF_MS,
+    BCM_GPIO::STORM_DEFAULT_MAX_BACKOFF_MS,
+};
+
+ULONG BCM_GPIO::edgeCapturePinMask[BCM_GPIO_BANK_COUNT] = { 0 };
+
 //
 // Register interrupt for pins in the supplied mask in the supplied mode
 //
@@ -116,25 +137,43 @@ NTSTATUS BCM_GPIO::PreProcessControllerInterrupt (
     _INTERRUPT_CONTEXT* interruptContextPtr =
         thisPtr->interruptContext + BankId;
 
-    const ULONG changedMask =
+    // stamp edges as early as possible
+    const LONGLONG timestamp = interruptContextPtr->captureMask ?
+        KeQueryPerformanceCounter(nullptr).QuadPart : 0;
+
+    ULONG changedMask =
         READ_REGISTER_NOFENCE_ULONG(&thisPtr->registersPtr->GPEDS[BankId]);
 
-    // do watchdog accounting and temporarily disable pins that are causing
-    // an interrupt storm
-    ULONG disableMask = 0;
-    ULONG i = 0;
-    ULONG firstSetIndex;
-    while (_BitScanForward(&firstSetIndex, changedMask >> i)) {
-        i += firstSetIndex;
-        NT_ASSERT(i < ARRAYSIZE(interruptContextPtr->watchdogCount));
-        NT_ASSERT(interruptContextPtr->watchdogCount[i] <= WATCHDOG_RESET);
-
-        if (--interruptContextPtr->watchdogCount[i] == 0) {
-            disableMask |= 1 << i;
-        }
-        ++i;
+    // captured edges are consumed here and never reach GpioClx
+    const ULONG capturedMask = changedMask & interruptContextPtr->captureMask;
+    if (capturedMask) {
+        thisPtr->captureEdges(interruptContextPtr, capturedMask, timestamp);
+        changedMask &= ~capturedMask;
+    }
+
+    // Stable edges confirmed by the debounce timer raised this interrupt
+    // through level detection. Switch the pins back to edge detection and
+    // leave GPEDS set for GpioClx.
+    const ULONG reportedMask = changedMask &
+        (interruptContextPtr->reportHighMask | interruptContextPtr->reportLowMask);
+    if (reportedMask) {
+        interruptContextPtr->reportHighMask &= ~reportedMask;
+        interruptContextPtr->reportLowMask &= ~reportedMask;
+        interruptContextPtr->enabledMask |= reportedMask;
+        thisPtr->programInterruptRegisters(BankId);
     }
 
+    // edges of debounced pins are consumed here until the debounce timer
+    // has sampled the pins
+    const ULONG debouncedMask = thisPtr->debounceEdges(
+            interruptContextPtr,
+            changedMask & ~reportedMask);
+    changedMask &= ~debouncedMask;
+
+    // temporarily disable pins that are causing an interrupt storm
+    const ULONG disableMask =
+        thisPtr->limitInterrupts(interruptContextPtr, changedMask);
+
     // move interrupts from the enabled list to the disabled list
     if (disableMask) {
         interruptContextPtr->enabledMask &= ~disableMask;
@@ -143,11 +182,322 @@ NTSTATUS BCM_GPIO::PreProcessControllerInterrupt (
         WRITE_REGISTER_NOFENCE_ULONG(&thisPtr->registersPtr->GPEDS[BankId], disableMask);
     }
 
-    WdfDpcEnqueue(interruptContextPtr->dpc);
+    // the DPC arms the reenable and debounce timers
+    if (disableMask || debouncedMask) {
+        WdfDpcEnqueue(interruptContextPtr->dpc);
+    }
 
     return STATUS_SUCCESS;
 }  // BCM_GPIO::PreProcessControllerInterrupt (...)
 
+//
+// Stamps edges on capture pins into the bank's edge ring and acknowledges
+// them. Called from the ISR with the bank interrupt lock held. If the ring
+// is full, the sample is dropped and counted.
+//
+void BCM_GPIO::captureEdges (
+    _INTERRUPT_CONTEXT* InterruptContextPtr,
+    ULONG EdgeMask,
+    LONGLONG Timestamp
+    )
+{
+    BCM_GPIO_REGISTERS* hw = this->registersPtr;
+    const ULONG bankId = InterruptContextPtr->bankId;
+    _EDGE_RING* ringPtr = &InterruptContextPtr->edgeRing;
+
+    const ULONG levels = READ_REGISTER_NOFENCE_ULONG(&hw->GPLEV[bankId]);
+    WRITE_REGISTER_NOFENCE_ULONG(&hw->GPEDS[bankId], EdgeMask);
+
+    const ULONG writeIndex = ringPtr->writeIndex;
+    const ULONG readIndex = *static_cast<volatile ULONG*>(&ringPtr->readIndex);
+    if ((writeIndex - readIndex) == BCM_GPIO_EDGE_RING_SAMPLES) {
+        ++ringPtr->droppedCount;
+        return;
+    }
+
+    BCM_GPIO_EDGE_SAMPLE* samplePtr =
+        &ringPtr->samples[writeIndex % BCM_GPIO_EDGE_RING_SAMPLES];
+    samplePtr->Timestamp = Timestamp;
+    samplePtr->EdgeMask = EdgeMask;
+    samplePtr->Levels = levels;
+
+    // publish the sample to the reader
+    KeMemoryBarrier();
+    *static_cast<volatile ULONG*>(&ringPtr->writeIndex) = writeIndex + 1;
+} // BCM_GPIO::captureEdges (...)
+
+//
+// Counts the interrupts of the pins in ChangedMask and charges them to the
+// token buckets of the limited pins. Returns the pins whose bucket is empty,
+// which must be disabled until their backoff delay has passed. Called from
+// the ISR with the bank interrupt lock held.
+//
+ULONG BCM_GPIO::limitInterrupts (
+    _INTERRUPT_CONTEXT* InterruptContextPtr,
+    ULONG ChangedMask
+    )
+{
+    const LONGLONG frequency = this->performanceFrequency;
+    const LONGLONG now = (ChangedMask & InterruptContextPtr->limitedMask) ?
+        KeQueryPerformanceCounter(nullptr).QuadPart : 0;
+
+    ULONG disableMask = 0;
+    ULONG mask = ChangedMask;
+    while (mask) {
+        ULONG i;
+        _BitScanForward(&i, mask);
+        mask &= mask - 1;
+
+        _PIN_STORM_STATE* pinStormPtr = InterruptContextPtr->pinStorm + i;
+        ++pinStormPtr->interruptCount;
+        if (!pinStormPtr->rate) {
+            continue;
+        }
+
+        // refill the bucket for the time since the last refill. Limiting
+        // the elapsed time to the capacity keeps the product from
+        // overflowing.
+        const LONGLONG capacity = LONGLONG(pinStormPtr->burst) * frequency;
+        const LONGLONG elapsed = min(now - pinStormPtr->lastTicks, capacity);
+        pinStormPtr->lastTicks = now;
+        pinStormPtr->tokens = min(
+            pinStormPtr->tokens + elapsed * pinStormPtr->rate,
+            capacity);
+
+        if (pinStormPtr->tokens >= frequency) {
+            pinStormPtr->tokens -= frequency;
+            continue;
+        }
+
+        // back off further if the pin storms again soon after it was
+        // reenabled, otherwise start over from the shortest delay
+        if ((now - pinStormPtr->reenableTicks) < this->stormBackoffResetTicks) {
+            if (pinStormPtr->backoffLevel < (STORM_BACKOFF_LEVELS - 1)) {
+                ++pinStormPtr->backoffLevel;
+            }
+        } else {
+            pinStormPtr->backoffLevel = 0;
+        }
+
+        pinStormPtr->reenableTicks =
+            now + this->stormBackoffTicks[pinStormPtr->backoffLevel];
+        ++pinStormPtr->suppressionCount;
+        disableMask |= 1 << i;
+    } // while (mask)
+
+    return disableMask;
+} // BCM_GPIO::limitInterrupts (...)
+
+//
+// Reenables the pending pins whose backoff delay has passed, and arms the
+// reenable timer for the earliest of the remaining ones. reenableTimerLock
+// is held throughout so that a concurrent caller that saw fewer pending
+// pins cannot rearm the timer for a later time.
+//
+_Use_decl_annotations_
+void BCM_GPIO::reenableInterrupts ( _INTERRUPT_CONTEXT* InterruptContextPtr )
+{
+    BCM_ASSERT_MAX_IRQL(DISPATCH_LEVEL);
+
+    const BANK_ID bankId = BANK_ID(InterruptContextPtr->bankId);
+    LONGLONG nextDueTicks = MAXLONGLONG;
+
+    KIRQL oldIrql;
+    KeAcquireSpinLock(&InterruptContextPtr->reenableTimerLock, &oldIrql);
+    const LONGLONG now = KeQueryPerformanceCounter(nullptr).QuadPart;
+
+    {
+        GPIO_CLX_AcquireInterruptLock(this, bankId);
+
+        ULONG reenableMask = 0;
+        ULONG mask = InterruptContextPtr->pendingReenableMask;
+        while (mask) {
+            ULONG i;
+            _BitScanForward(&i, mask);
+            mask &= mask - 1;
+
+            _PIN_STORM_STATE* pinStormPtr = InterruptContextPtr->pinStorm + i;
+            if (pinStormPtr->reenableTicks <= now) {
+                // start over with a full bucket
+                pinStormPtr->tokens =
+                    LONGLONG(pinStormPtr->burst) * this->performanceFrequency;
+                pinStormPtr->lastTicks = now;
+                reenableMask |= 1 << i;
+            } else if (pinStormPtr->reenableTicks < nextDueTicks) {
+                nextDueTicks = pinStormPtr->reenableTicks;
+            }
+        } // while (mask)
+
+        // move disabled interrupts back onto the enabled list
+        if (reenableMask) {
+            WRITE_REGISTER_NOFENCE_ULONG(
+                &this->registersPtr->GPEDS[bankId],
+                reenableMask);
+
+            InterruptContextPtr->enabledMask |= reenableMask;
+            InterruptContextPtr->pendingReenableMask &= ~reenableMask;
+
+            this->programInterruptRegisters(bankId);
+        } // if
+
+        GPIO_CLX_ReleaseInterruptLock(this, bankId);
+    } // release lock
+
+    if (nextDueTicks != MAXLONGLONG) {
+        const LONGLONG delayUs =
+            (nextDueTicks - now) * 1000000 / this->performanceFrequency + 1;
+
+        WdfTimerStart(
+            InterruptContextPtr->interruptReenableTimer,
+            WDF_REL_TIMEOUT_IN_US(delayUs));
+    } // if
+
+    KeReleaseSpinLock(&InterruptContextPtr->reenableTimerLock, oldIrql);
+} // BCM_GPIO::reenableInterrupts (...)
+
+//
+// Sets the rate limit of a pin and starts it over with a full bucket, no
+// backoff and cleared statistics. Called with the bank interrupt lock held.
+//
+void BCM_GPIO::resetPinStorm (
+    _PIN_STORM_STATE* PinStormPtr,
+    ULONG Rate,
+    ULONG Burst,
+    LONGLONG Now
+    )
+{
+    PinStormPtr->rate = Rate;
+    PinStormPtr->burst = Burst;
+    PinStormPtr->tokens = LONGLONG(Burst) * this->performanceFrequency;
+    PinStormPtr->lastTicks = Now;
+    PinStormPtr->reenableTicks = 0;
+    PinStormPtr->backoffLevel = 0;
+    PinStormPtr->interruptCount = 0;
+    PinStormPtr->suppressionCount = 0;
+    PinStormPtr->reportedInterruptCount = 0;
+} // BCM_GPIO::resetPinStorm (...)
+
+//
+// Masks the debounced pins of ChangedMask that are enabled for edge
+// triggered interrupts, and sets the time at which their debounce window
+// ends. Returns the pins that were masked. Called from the ISR with the bank
+// interrupt lock held.
+//
+ULONG BCM_GPIO::debounceEdges (
+    _INTERRUPT_CONTEXT* InterruptContextPtr,
+    ULONG ChangedMask
+    )
+{
+    const _INTERRUPT_REGISTERS* interruptRegistersPtr =
+        &InterruptContextPtr->registers;
+    const ULONG edgeMask = ChangedMask &
+        InterruptContextPtr->debounceMask &
+        InterruptContextPtr->enabledMask &
+        (interruptRegistersPtr->GPAREN | interruptRegistersPtr->GPAFEN);
+    if (!edgeMask) {
+        return 0;
+    }
+
+    const LONGLONG now = KeQueryPerformanceCounter(nullptr).QuadPart;
+    ULONG mask = edgeMask;
+    while (mask) {
+        ULONG i;
+        _BitScanForward(&i, mask);
+        mask &= mask - 1;
+
+        InterruptContextPtr->debounceDueTicks[i] =
+            now + InterruptContextPtr->debounceWindowTicks[i];
+    } // while (mask)
+
+    // mask the pins for the rest of the window
+    InterruptContextPtr->enabledMask &= ~edgeMask;
+    InterruptContextPtr->debouncingMask |= edgeMask;
+    this->programInterruptRegisters(InterruptContextPtr->bankId);
+    WRITE_REGISTER_NOFENCE_ULONG(
+        &this->registersPtr->GPEDS[InterruptContextPtr->bankId],
+        edgeMask);
+
+    return edgeMask;
+} // BCM_GPIO::debounceEdges (...)
+
+//
+// Samples the debounced pins whose window has ended, and arms the debounce
+// timer for the earliest of the remaining ones. A pin that is still at the
+// level its edge went to is reported through level detection; the other
+// pins go back to edge detection. debounceTimerLock is held throughout so
+// that a concurrent caller cannot rearm the timer for a later time.
+//
+_Use_decl_annotations_
+void BCM_GPIO::debouncePins ( _INTERRUPT_CONTEXT* InterruptContextPtr )
+{
+    BCM_ASSERT_MAX_IRQL(DISPATCH_LEVEL);
+
+    const BANK_ID bankId = BANK_ID(InterruptContextPtr->bankId);
+    LONGLONG nextDueTicks = MAXLONGLONG;
+
+    KIRQL oldIrql;
+    KeAcquireSpinLock(&InterruptContextPtr->debounceTimerLock, &oldIrql);
+    const LONGLONG now = KeQueryPerformanceCounter(nullptr).QuadPart;
+
+    {
+        GPIO_CLX_AcquireInterruptLock(this, bankId);
+
+        ULONG sampleMask = 0;
+        ULONG mask = InterruptContextPtr->debouncingMask;
+        while (mask) {
+            ULONG i;
+            _BitScanForward(&i, mask);
+            mask &= mask - 1;
+
+            const LONGLONG dueTicks = InterruptContextPtr->debounceDueTicks[i];
+            if (dueTicks <= now) {
+                sampleMask |= 1 << i;
+            } else if (dueTicks < nextDueTicks) {
+                nextDueTicks = dueTicks;
+            }
+        } // while (mask)
+
+        if (sampleMask) {
+            const _INTERRUPT_REGISTERS* interruptRegistersPtr =
+                &InterruptContextPtr->registers;
+            const ULONG levels = READ_REGISTER_NOFENCE_ULONG(
+                    &this->registersPtr->GPLEV[bankId]);
+
+            // A pin masked by GpioClx during the window no longer has its
+            // edge enabled, so it is not reported
+            const ULONG risingMask =
+                sampleMask & levels & interruptRegistersPtr->GPAREN;
+            const ULONG fallingMask =
+                sampleMask & ~levels & interruptRegistersPtr->GPAFEN;
+            const ULONG resumeMask = sampleMask & ~(risingMask | fallingMask);
+
+            InterruptContextPtr->debouncingMask &= ~sampleMask;
+            InterruptContextPtr->reportHighMask |= risingMask;
+            InterruptContextPtr->reportLowMask |= fallingMask;
+
+            WRITE_REGISTER_NOFENCE_ULONG(
+                &this->registersPtr->GPEDS[bankId],
+                resumeMask);
+            InterruptContextPtr->enabledMask |= resumeMask;
+
+            this->programInterruptRegisters(bankId);
+        } // if
+
+        GPIO_CLX_ReleaseInterruptLock(this, bankId);
+    } // release lock
+
+    if (nextDueTicks != MAXLONGLONG) {
+        const LONGLONG delayUs =
+            (nextDueTicks - now) * 1000000 / this->performanceFrequency + 1;
+
+        WdfTimerStart(
+            InterruptContextPtr->debounceTimer,
+            WDF_REL_TIMEOUT_IN_US(delayUs));
+    } // if
+
+    KeReleaseSpinLock(&InterruptContextPtr->debounceTimerLock, oldIrql);
+} // BCM_GPIO::debouncePins (...)
+
 _Use_decl_annotations_
 VOID BCM_GPIO::evtDpcFunc ( WDFDPC WdfDpc )
 {
@@ -155,39 +505,37 @@ VOID BCM_GPIO::evtDpcFunc ( WDFDPC WdfDpc )
     _INTERRUPT_CONTEXT* interruptContextPtr = dpcContextPtr->interruptContextPtr;
     BCM_GPIO* thisPtr = dpcContextPtr->thisPtr;
 
-    // must schedule timer outside of the interrupt spinlock
-    bool scheduleReenableTimer;
+    // move disabled interrupts onto the pending reenable list
     {
         GPIO_CLX_AcquireInterruptLock(
             thisPtr,
             BANK_ID(interruptContextPtr->bankId));
 
-        // move disabled interrupts onto the pending reenable list
-        if (interruptContextPtr->disabledMask) {
-            interruptContextPtr->pendingReenableMask |=
-                interruptContextPtr->disabledMask;
-            interruptContextPtr->disabledMask = 0;
-            scheduleReenableTimer = true;
-        } else {
-            scheduleReenableTimer = false;
-        }
-
-        interruptContextPtr->resetWatchdogCount();
+        interruptContextPtr->pendingReenableMask |=
+            interruptContextPtr->disabledMask;
+        interruptContextPtr->disabledMask = 0;
 
         GPIO_CLX_ReleaseInterruptLock(
             thisPtr,
             BANK_ID(interruptContextPtr->bankId));
     } // release lock
 
-    // Schedule a timer to reenable the interrupt after a delay. The delay is
-    // necessary to allow the storm to clear.
-    if (scheduleReenableTimer) {
-        WdfTimerStart(
-            interruptContextPtr->interruptReenableTimer,
-            WDF_REL_TIMEOUT_IN_MS(1));
-    }
+    // Schedule the timer to reenable the interrupts after their backoff
+    // delay. The delay is necessary to allow the storm to clear.
+    thisPtr->reenableInterrupts(interruptContextPtr);
+
+    thisPtr->debouncePins(interruptContextPtr);
 } // BCM_GPIO::evtDpcFunc (...)
 
+_Use_decl_annotations_
+VOID BCM_GPIO::evtDebounceTimerFunc ( WDFTIMER WdfTimer )
+{
+    TIMER_CONTEXT* timerContextPtr = bcmGpioTimerContextFromWdfObject(WdfTimer);
+
+    timerContextPtr->thisPtr->debouncePins(
+        timerContextPtr->interruptContextPtr);
+} // BCM_GPIO::evtDebounceTimerFunc (...)
+
 _Use_decl_annotations_
 NTSTATUS BCM_GPIO::MaskInterrupts (
     PVOID ContextPtr,
@@ -197,8 +545,17 @@ NTSTATUS BCM_GPIO::MaskInterrupts (
     auto thisPtr = static_cast<BCM_GPIO*>(ContextPtr);
     const BANK_ID bankId = MaskParametersPtr->BankId;
     const ULONG mask = ULONG(MaskParametersPtr->PinMask);
+    _INTERRUPT_CONTEXT* interruptContextPtr =
+        thisPtr->interruptContext + bankId;
+
+    // drop debounced edges that have not been reported yet
+    const ULONG reportMask = mask &
+        (interruptContextPtr->reportHighMask | interruptContextPtr->reportLowMask);
+    interruptContextPtr->reportHighMask &= ~reportMask;
+    interruptContextPtr->reportLowMask &= ~reportMask;
+    interruptContextPtr->enabledMask |= reportMask;
 
-    thisPtr->interruptContext[bankId].registers.Remove(mask);
+    interruptContextPtr->registers.Remove(mask);
     thisPtr->programInterruptRegisters(bankId);
     WRITE_REGISTER_NOFENCE_ULONG(&thisPtr->registersPtr->GPEDS[bankId], mask);
 
@@ -235,9 +592,12 @@ NTSTATUS BCM_GPIO::QueryActiveInterrupts (
     )
 {
     auto thisPtr = static_cast<BCM_GPIO*>(ContextPtr);
+    const BANK_ID bankId = QueryActiveParametersPtr->BankId;
 
+    // edges on capture pins are not reported to GpioClx
     QueryActiveParametersPtr->ActiveMask = READ_REGISTER_NOFENCE_ULONG(
-        &thisPtr->registersPtr->GPEDS[QueryActiveParametersPtr->BankId]);
+        &thisPtr->registersPtr->GPEDS[bankId]) &
+        ~thisPtr->interruptContext[bankId].captureMask;
 
     return STATUS_SUCCESS;
 } // BCM_GPIO::QueryActiveInterrupts (...)
@@ -322,6 +682,47 @@ NTSTATUS BCM_GPIO::WriteGpioPinsUsingMask (
     return STATUS_SUCCESS;
 } // BCM_GPIO::WriteGpioPinsUsingMask (...)
 
+_Use_decl_annotations_
+void BCM_GPIO::applyWriteVectors (
+    BANK_ID BankId,
+    const BCM_GPIO_WRITE_VECTOR* VectorsPtr,
+    ULONG VectorCount
+    )
+{
+    BCM_ASSERT_MAX_IRQL(DISPATCH_LEVEL);
+
+    // Keep the thread from being preempted between vectors
+    KIRQL oldIrql;
+    KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+
+    BCM_GPIO_REGISTERS* hw = this->registersPtr;
+    const BCM_GPIO_WRITE_VECTOR* const endPtr = VectorsPtr + VectorCount;
+    for (const BCM_GPIO_WRITE_VECTOR* vectorPtr = VectorsPtr;
+         vectorPtr != endPtr;
+         ++vectorPtr) {
+
+        if (vectorPtr->ClearMask) {
+            WRITE_REGISTER_NOFENCE_ULONG(
+                &hw->GPCLR[BankId],
+                vectorPtr->ClearMask);
+        } // if
+        if (vectorPtr->SetMask) {
+            WRITE_REGISTER_NOFENCE_ULONG(
+                &hw->GPSET[BankId],
+                vectorPtr->SetMask);
+        } // if
+
+        if (vectorPtr->DelayUs) {
+            // Read back so the posted writes reach the pins before the
+            // delay starts
+            (void)READ_REGISTER_NOFENCE_ULONG(&hw->GPLEV[BankId]);
+            KeStallExecutionProcessor(vectorPtr->DelayUs);
+        } // if
+    } // for (...)
+
+    KeLowerIrql(oldIrql);
+} // BCM_GPIO::applyWriteVectors (...)
+
 _Use_decl_annotations_
 NTSTATUS BCM_GPIO::StartController (
     PVOID ContextPtr,
@@ -391,14 +792,19 @@ void BCM_GPIO::programInterruptRegisters ( ULONG BankId )
     BCM_GPIO_REGISTERS* hw = this->registersPtr;
     const _INTERRUPT_REGISTERS* interruptRegistersPtr =
         &this->interruptContext[BankId].registers;
-    const ULONG enabledMask = this->interruptContext[BankId].enabledMask;
+    const _INTERRUPT_CONTEXT* interruptContextPtr =
+        this->interruptContext + BankId;
+    const ULONG enabledMask = interruptContextPtr->enabledMask;
 
+    // debounced edges being reported use level detection
     WRITE_REGISTER_NOFENCE_ULONG(
         &hw->GPHEN[BankId],
-        interruptRegistersPtr->GPHEN & enabledMask);
+        (interruptRegistersPtr->GPHEN & enabledMask) |
+        (interruptContextPtr->reportHighMask & interruptRegistersPtr->GPAREN));
     WRITE_REGISTER_NOFENCE_ULONG(
         &hw->GPLEN[BankId],
-        interruptRegistersPtr->GPLEN & enabledMask);
+        (interruptRegistersPtr->GPLEN & enabledMask) |
+        (interruptContextPtr->reportLowMask & interruptRegistersPtr->GPAFEN));
     WRITE_REGISTER_NOFENCE_ULONG(
         &hw->GPAREN[BankId],
         interruptRegistersPtr->GPAREN & enabledMask);
@@ -482,6 +888,12 @@ NTSTATUS BCM_GPIO::EnableInterrupt (
         thisPtr->interruptContext + bankId;
 
     NT_ASSERT(!(thisPtr->openInterruptPins[bankId] & mask));
+
+    // the pin's edges are being captured
+    if (interruptContextPtr->captureMask & mask) {
+        return STATUS_DEVICE_BUSY;
+    } // if
+
     thisPtr->openInterruptPins[bankId] |= mask;
 
     // Configure to GPIO input function if not already configured through
@@ -504,6 +916,14 @@ NTSTATUS BCM_GPIO::EnableInterrupt (
         NT_ASSERT(!(interruptContextPtr->enabledMask & mask));
         NT_ASSERT(!(interruptContextPtr->disabledMask & mask));
         NT_ASSERT(!(interruptContextPtr->pendingReenableMask & mask));
+        NT_ASSERT(!(interruptContextPtr->debouncingMask & mask));
+
+        _PIN_STORM_STATE* pinStormPtr = interruptContextPtr->pinStorm + pinNumber;
+        thisPtr->resetPinStorm(
+            pinStormPtr,
+            pinStormPtr->rate,
+            pinStormPtr->burst,
+            KeQueryPerformanceCounter(nullptr).QuadPart);
 
         interruptContextPtr->registers.Add(
             mask,
@@ -541,6 +961,9 @@ NTSTATUS BCM_GPIO::DisableInterrupt (
         interruptContextPtr->enabledMask &= ~mask;
         interruptContextPtr->disabledMask &= ~mask;
         interruptContextPtr->pendingReenableMask &= ~mask;
+        interruptContextPtr->debouncingMask &= ~mask;
+        interruptContextPtr->reportHighMask &= ~mask;
+        interruptContextPtr->reportLowMask &= ~mask;
         interruptContextPtr->registers.Remove(mask);
 
         thisPtr->programInterruptRegisters(bankId);
@@ -642,28 +1065,8 @@ VOID BCM_GPIO::evtReenableInterruptTimerFunc ( WDFTIMER WdfTimer )
     _INTERRUPT_CONTEXT* interruptContextPtr =
         timerContextPtr->interruptContextPtr;
     BCM_GPIO* thisPtr = timerContextPtr->thisPtr;
-    BCM_GPIO_REGISTERS* hw = thisPtr->registersPtr;
-
-    // move disabled interrupts back onto the enabled list
-    {
-        GPIO_CLX_AcquireInterruptLock(
-            thisPtr,
-            BANK_ID(interruptContextPtr->bankId));
-
-        WRITE_REGISTER_NOFENCE_ULONG(
-            &hw->GPEDS[interruptContextPtr->bankId],
-            interruptContextPtr->pendingReenableMask);
-
-        interruptContextPtr->enabledMask |=
-            interruptContextPtr->pendingReenableMask;
-        interruptContextPtr->pendingReenableMask = 0;
-
-        thisPtr->programInterruptRegisters(interruptContextPtr->bankId);
 
-        GPIO_CLX_ReleaseInterruptLock(
-            thisPtr,
-            BANK_ID(interruptContextPtr->bankId));
-    } // release lock
+    thisPtr->reenableInterrupts(interruptContextPtr);
 } // BCM_GPIO::evtReenableInterruptTimerFunc (...)
 
 BCM_NONPAGED_SEGMENT_END; //===================================================
@@ -770,12 +1173,580 @@ NTSTATUS BCM_GPIO::QueryControllerBasicInformation (
     return STATUS_SUCCESS;
 } // BCM_GPIO::QueryControllerBasicInformation (...)
 
+_Use_decl_annotations_
+NTSTATUS BCM_GPIO::ControllerSpecificFunction (
+    PVOID ContextPtr,
+    PGPIO_CLIENT_CONTROLLER_SPECIFIC_FUNCTION_PARAMETERS ParametersPtr
+    )
+{
+    PAGED_CODE();
+    BCM_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    auto thisPtr = static_cast<BCM_GPIO*>(ContextPtr);
+    ParametersPtr->BytesReturned = 0;
+
+    if (ParametersPtr->InputBufferLength < sizeof(BCM_GPIO_CONTROL_INPUT)) {
+        return STATUS_BUFFER_TOO_SMALL;
+    } // if
+
+    auto inputPtr =
+        static_cast<const BCM_GPIO_CONTROL_INPUT*>(ParametersPtr->InputBuffer);
+    if (inputPtr->BankId >= BCM_GPIO_BANK_COUNT) {
+        return STATUS_INVALID_PARAMETER;
+    } // if
+
+    NTSTATUS status;
+    WdfWaitLockAcquire(thisPtr->controlLock, nullptr);
+
+    switch (inputPtr->ControlCode) {
+    case BcmGpioControlStartEdgeCapture:
+        if (ParametersPtr->InputBufferLength <
+            sizeof(BCM_GPIO_START_EDGE_CAPTURE_INPUT)) {
+
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        } // if
+
+        status = thisPtr->startEdgeCapture(
+                static_cast<const BCM_GPIO_START_EDGE_CAPTURE_INPUT*>(
+                    ParametersPtr->InputBuffer));
+        break;
+    case BcmGpioControlStopEdgeCapture:
+        status = thisPtr->stopEdgeCapture(BANK_ID(inputPtr->BankId));
+        break;
+    case BcmGpioControlReadEdgeCapture:
+        if (ParametersPtr->OutputBufferLength < sizeof(BCM_GPIO_EDGE_SAMPLES)) {
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        } // if
+
+        status = thisPtr->readEdgeCapture(
+                BANK_ID(inputPtr->BankId),
+                static_cast<BCM_GPIO_EDGE_SAMPLES*>(ParametersPtr->OutputBuffer),
+                ParametersPtr->OutputBufferLength,
+                &ParametersPtr->BytesReturned);
+        break;
+    case BcmGpioControlWriteVectors:
+        if (ParametersPtr->InputBufferLength <
+            FIELD_OFFSET(BCM_GPIO_WRITE_VECTORS_INPUT, Vectors)) {
+
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        } // if
+
+        status = thisPtr->writeVectors(
+                static_cast<const BCM_GPIO_WRITE_VECTORS_INPUT*>(
+                    ParametersPtr->InputBuffer),
+                ParametersPtr->InputBufferLength);
+        break;
+    case BcmGpioControlSetStormLimit:
+        if (ParametersPtr->InputBufferLength <
+            sizeof(BCM_GPIO_SET_STORM_LIMIT_INPUT)) {
+
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        } // if
+
+        status = thisPtr->setStormLimit(
+                static_cast<const BCM_GPIO_SET_STORM_LIMIT_INPUT*>(
+                    ParametersPtr->InputBuffer));
+        break;
+    case BcmGpioControlSetDebounce:
+        if (ParametersPtr->InputBufferLength <
+            sizeof(BCM_GPIO_SET_DEBOUNCE_INPUT)) {
+
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        } // if
+
+        status = thisPtr->setDebounce(
+                static_cast<const BCM_GPIO_SET_DEBOUNCE_INPUT*>(
+                    ParametersPtr->InputBuffer));
+        break;
+    case BcmGpioControlQueryStormStatistics:
+        if (ParametersPtr->OutputBufferLength <
+            sizeof(BCM_GPIO_STORM_STATISTICS)) {
+
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        } // if
+
+        thisPtr->queryStormStatistics(
+            BANK_ID(inputPtr->BankId),
+            static_cast<BCM_GPIO_STORM_STATISTICS*>(ParametersPtr->OutputBuffer));
+        ParametersPtr->BytesReturned = sizeof(BCM_GPIO_STORM_STATISTICS);
+        status = STATUS_SUCCESS;
+        break;
+    default:
+        status = STATUS_NOT_SUPPORTED;
+    } // switch (inputPtr->ControlCode)
+
+    WdfWaitLockRelease(thisPtr->controlLock);
+    return status;
+} // BCM_GPIO::ControllerSpecificFunction (...)
+
+_Use_decl_annotations_
+NTSTATUS BCM_GPIO::startEdgeCapture (
+    const BCM_GPIO_START_EDGE_CAPTURE_INPUT* InputPtr
+    )
+{
+    PAGED_CODE();
+    BCM_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    const BANK_ID bankId = BANK_ID(InputPtr->BankId);
+    const ULONG pinMask = InputPtr->PinMask;
+
+    if (!pinMask || (pinMask & ~bankPinMask(bankId)) ||
+        !InputPtr->Edges || (InputPtr->Edges & ~BCM_GPIO_EDGE_BOTH)) {
+
+        return STATUS_INVALID_PARAMETER;
+    } // if
+
+    // Other pins may belong to other drivers or the firmware
+    if (pinMask & ~edgeCapturePinMask[bankId]) {
+        return STATUS_ACCESS_DENIED;
+    } // if
+
+    _INTERRUPT_CONTEXT* interruptContextPtr = this->interruptContext + bankId;
+    if (interruptContextPtr->captureMask ||
+        (this->openInterruptPins[bankId] & pinMask)) {
+
+        return STATUS_DEVICE_BUSY;
+    } // if
+
+    // capture pins that are opened for IO must be inputs
+    ULONG ioMask = pinMask & this->openIoPins[bankId];
+    while (ioMask) {
+        ULONG i;
+        _BitScanForward(&i, ioMask);
+        ioMask &= ioMask - 1;
+
+        if (this->gpfsel.Get(bankId * BCM_GPIO_PINS_PER_BANK + i) !=
+            BCM_GPIO_FUNCTION_INPUT) {
+
+            return STATUS_INVALID_DEVICE_STATE;
+        } // if
+    } // while
+
+    // The remaining pins must not be muxed to an alternate function
+    ULONG configureMask = 0;
+    ULONG otherMask = pinMask & ~this->openIoPins[bankId];
+    while (otherMask) {
+        ULONG i;
+        _BitScanForward(&i, otherMask);
+        otherMask &= otherMask - 1;
+
+        switch (this->gpfsel.Get(bankId * BCM_GPIO_PINS_PER_BANK + i)) {
+        case BCM_GPIO_FUNCTION_INPUT:
+            break;
+        case BCM_GPIO_FUNCTION_OUTPUT:
+            configureMask |= 1UL << i;
+            break;
+        default:
+            return STATUS_DEVICE_BUSY;
+        } // switch
+    } // while
+
+    // configure them as inputs, saving the function to restore
+    interruptContextPtr->captureInputMask = configureMask;
+    while (configureMask) {
+        ULONG i;
+        _BitScanForward(&i, configureMask);
+        configureMask &= configureMask - 1;
+
+        interruptContextPtr->captureSavedFunction[i] = UCHAR(
+            this->gpfsel.Get(bankId * BCM_GPIO_PINS_PER_BANK + i));
+        this->setDriveMode(
+            bankId,
+            PIN_NUMBER(i),
+            BCM_GPIO_FUNCTION_INPUT,
+            GPIO_PIN_PULL_CONFIGURATION_DEFAULT);
+    } // while
+
+    {
+        GPIO_CLX_AcquireInterruptLock(this, bankId);
+
+        _EDGE_RING* ringPtr = &interruptContextPtr->edgeRing;
+        ringPtr->writeIndex = 0;
+        ringPtr->readIndex = 0;
+        ringPtr->droppedCount = 0;
+        ringPtr->reportedDroppedCount = 0;
+
+        // use asynchronous edge detection so that edges shorter than
+        // the sampling clock are not missed
+        if (InputPtr->Edges & BCM_GPIO_EDGE_RISING) {
+            interruptContextPtr->registers.GPAREN |= pinMask;
+        } // if
+        if (InputPtr->Edges & BCM_GPIO_EDGE_FALLING) {
+            interruptContextPtr->registers.GPAFEN |= pinMask;
+        } // if
+
+        interruptContextPtr->captureMask = pinMask;
+        interruptContextPtr->enabledMask |= pinMask;
+        WRITE_REGISTER_NOFENCE_ULONG(&this->registersPtr->GPEDS[bankId], pinMask);
+        this->programInterruptRegisters(bankId);
+
+        GPIO_CLX_ReleaseInterruptLock(this, bankId);
+    } // release lock
+
+    return STATUS_SUCCESS;
+} // BCM_GPIO::startEdgeCapture (...)
+
+_Use_decl_annotations_
+NTSTATUS BCM_GPIO::stopEdgeCapture ( BANK_ID BankId )
+{
+    PAGED_CODE();
+    BCM_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    _INTERRUPT_CONTEXT* interruptContextPtr = this->interruptContext + BankId;
+    const ULONG pinMask = interruptContextPtr->captureMask;
+    if (!pinMask) {
+        return STATUS_INVALID_DEVICE_STATE;
+    } // if
+
+    {
+        GPIO_CLX_AcquireInterruptLock(this, BankId);
+
+        interruptContextPtr->captureMask = 0;
+        interruptContextPtr->enabledMask &= ~pinMask;
+        interruptContextPtr->registers.Remove(pinMask);
+        this->programInterruptRegisters(BankId);
+        WRITE_REGISTER_NOFENCE_ULONG(&this->registersPtr->GPEDS[BankId], pinMask);
+
+        GPIO_CLX_ReleaseInterruptLock(this, BankId);
+    } // release lock
+
+    // Restore the function of pins switched to inputs, unless they have
+    // been opened for IO since
+    ULONG revertMask =
+        interruptContextPtr->captureInputMask & ~this->openIoPins[BankId];
+    interruptContextPtr->captureInputMask = 0;
+    while (revertMask) {
+        ULONG i;
+        _BitScanForward(&i, revertMask);
+        revertMask &= revertMask - 1;
+
+        this->setDriveMode(
+            BankId,
+            PIN_NUMBER(i),
+            static_cast<BCM_GPIO_FUNCTION>(
+                interruptContextPtr->captureSavedFunction[i]),
+            GPIO_PIN_PULL_CONFIGURATION_DEFAULT);
+    } // while
+
+    return STATUS_SUCCESS;
+} // BCM_GPIO::stopEdgeCapture (...)
+
+_Use_decl_annotations_
+NTSTATUS BCM_GPIO::readEdgeCapture (
+    BANK_ID BankId,
+    BCM_GPIO_EDGE_SAMPLES* OutputPtr,
+    SIZE_T OutputBufferLength,
+    SIZE_T* BytesReturnedPtr
+    )
+{
+    PAGED_CODE();
+    BCM_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    _EDGE_RING* ringPtr = &this->interruptContext[BankId].edgeRing;
+
+    const SIZE_T capacity =
+        (OutputBufferLength - FIELD_OFFSET(BCM_GPIO_EDGE_SAMPLES, Samples)) /
+        sizeof(BCM_GPIO_EDGE_SAMPLE);
+
+    // consume samples published by the ISR
+    const ULONG writeIndex =
+        *static_cast<volatile ULONG*>(&ringPtr->writeIndex);
+    KeMemoryBarrier();
+
+    const ULONG readIndex = ringPtr->readIndex;
+    const ULONG sampleCount =
+        ULONG(min(capacity, SIZE_T(writeIndex - readIndex)));
+    for (ULONG i = 0; i < sampleCount; ++i) {
+        OutputPtr->Samples[i] =
+            ringPtr->samples[(readIndex + i) % BCM_GPIO_EDGE_RING_SAMPLES];
+    } // for (ULONG i = ...)
+
+    // release the slots back to the ISR
+    KeMemoryBarrier();
+    *static_cast<volatile ULONG*>(&ringPtr->readIndex) =
+        readIndex + sampleCount;
+
+    const ULONG droppedCount =
+        *static_cast<volatile ULONG*>(&ringPtr->droppedCount);
+
+    LARGE_INTEGER frequency;
+    KeQueryPerformanceCounter(&frequency);
+
+    OutputPtr->SampleCount = sampleCount;
+    OutputPtr->DroppedSamples = droppedCount - ringPtr->reportedDroppedCount;
+    OutputPtr->PerformanceFrequency = frequency.QuadPart;
+    ringPtr->reportedDroppedCount = droppedCount;
+
+    *BytesReturnedPtr = FIELD_OFFSET(BCM_GPIO_EDGE_SAMPLES, Samples) +
+        sampleCount * sizeof(BCM_GPIO_EDGE_SAMPLE);
+    return STATUS_SUCCESS;
+} // BCM_GPIO::readEdgeCapture (...)
+
+_Use_decl_annotations_
+NTSTATUS BCM_GPIO::writeVectors (
+    const BCM_GPIO_WRITE_VECTORS_INPUT* InputPtr,
+    SIZE_T InputBufferLength
+    )
+{
+    PAGED_CODE();
+    BCM_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    const ULONG vectorCount = InputPtr->VectorCount;
+    if (!vectorCount || (vectorCount > BCM_GPIO_WRITE_VECTORS_MAX_COUNT)) {
+        return STATUS_INVALID_PARAMETER;
+    } // if
+
+    if (InputBufferLength <
+        FIELD_OFFSET(BCM_GPIO_WRITE_VECTORS_INPUT, Vectors[vectorCount])) {
+
+        return STATUS_BUFFER_TOO_SMALL;
+    } // if
+
+    // Only pins connected for output may be written
+    const BANK_ID bankId = BANK_ID(InputPtr->BankId);
+    ULONG outputMask = 0;
+    ULONG ioMask = this->openIoPins[bankId];
+    while (ioMask) {
+        ULONG i;
+        _BitScanForward(&i, ioMask);
+        ioMask &= ioMask - 1;
+
+        if (this->gpfsel.Get(bankId * BCM_GPIO_PINS_PER_BANK + i) ==
+            BCM_GPIO_FUNCTION_OUTPUT) {
+
+            outputMask |= 1UL << i;
+        } // if
+    } // while
+
+    ULONG totalDelayUs = 0;
+    for (ULONG i = 0; i < vectorCount; ++i) {
+        const BCM_GPIO_WRITE_VECTOR& vector = InputPtr->Vectors[i];
+        if ((vector.SetMask | vector.ClearMask) & ~outputMask) {
+            return STATUS_INVALID_DEVICE_STATE;
+        } // if
+
+        if ((vector.DelayUs > BCM_GPIO_WRITE_VECTORS_MAX_VECTOR_DELAY_US) ||
+            (vector.DelayUs >
+             (BCM_GPIO_WRITE_VECTORS_MAX_DELAY_US - totalDelayUs))) {
+
+            return STATUS_INVALID_PARAMETER;
+        } // if
+        totalDelayUs += vector.DelayUs;
+    } // for (ULONG i = ...)
+
+    this->applyWriteVectors(bankId, InputPtr->Vectors, vectorCount);
+
+    return STATUS_SUCCESS;
+} // BCM_GPIO::writeVectors (...)
+
+_Use_decl_annotations_
+NTSTATUS BCM_GPIO::setStormLimit (
+    const BCM_GPIO_SET_STORM_LIMIT_INPUT* InputPtr
+    )
+{
+    PAGED_CODE();
+    BCM_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    const BANK_ID bankId = BANK_ID(InputPtr->BankId);
+    const ULONG pinMask = InputPtr->PinMask;
+    const ULONG rate = InputPtr->Rate;
+    const ULONG burst = InputPtr->Burst;
+
+    if (!pinMask || (pinMask & ~bankPinMask(bankId)) ||
+        (rate > BCM_GPIO_STORM_MAX_RATE) ||
+        (rate && (!burst || (burst > BCM_GPIO_STORM_MAX_BURST)))) {
+
+        return STATUS_INVALID_PARAMETER;
+    } // if
+
+    _INTERRUPT_CONTEXT* interruptContextPtr = this->interruptContext + bankId;
+    const LONGLONG now = KeQueryPerformanceCounter(nullptr).QuadPart;
+    {
+        GPIO_CLX_AcquireInterruptLock(this, bankId);
+
+        ULONG mask = pinMask;
+        while (mask) {
+            ULONG i;
+            _BitScanForward(&i, mask);
+            mask &= mask - 1;
+
+            this->resetPinStorm(
+                interruptContextPtr->pinStorm + i,
+                rate,
+                burst,
+                now);
+        } // while (mask)
+
+        if (rate) {
+            interruptContextPtr->limitedMask |= pinMask;
+        } else {
+            interruptContextPtr->limitedMask &= ~pinMask;
+        } // iff
+
+        GPIO_CLX_ReleaseInterruptLock(this, bankId);
+    } // release lock
+
+    // Pins that are waiting to be reenabled are now due. The DPC takes care
+    // of pins it has not moved to the pending list yet.
+    this->reenableInterrupts(interruptContextPtr);
+
+    return STATUS_SUCCESS;
+} // BCM_GPIO::setStormLimit (...)
+
+_Use_decl_annotations_
+void BCM_GPIO::queryStormStatistics (
+    BANK_ID BankId,
+    BCM_GPIO_STORM_STATISTICS* OutputPtr
+    )
+{
+    PAGED_CODE();
+    BCM_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    _INTERRUPT_CONTEXT* interruptContextPtr = this->interruptContext + BankId;
+    const LONGLONG now = KeQueryPerformanceCounter(nullptr).QuadPart;
+    const LONGLONG elapsed = now - interruptContextPtr->reportedTicks;
+    interruptContextPtr->reportedTicks = now;
+
+    // InterruptRate holds the interrupt count delta until the lock is
+    // released
+    UCHAR backoffLevels[BCM_GPIO_PINS_PER_BANK];
+    {
+        GPIO_CLX_AcquireInterruptLock(this, BankId);
+
+        const ULONG suppressedMask =
+            interruptContextPtr->disabledMask |
+            interruptContextPtr->pendingReenableMask;
+
+        for (ULONG i = 0; i < BCM_GPIO_PINS_PER_BANK; ++i) {
+            _PIN_STORM_STATE* pinStormPtr = interruptContextPtr->pinStorm + i;
+            BCM_GPIO_PIN_STORM_STATISTICS* pinStatsPtr = OutputPtr->Pins + i;
+
+            pinStatsPtr->InterruptCount = pinStormPtr->interruptCount;
+            pinStatsPtr->InterruptRate =
+                pinStormPtr->interruptCount -
+                pinStormPtr->reportedInterruptCount;
+            pinStatsPtr->SuppressionCount = pinStormPtr->suppressionCount;
+            pinStatsPtr->Suppressed = (suppressedMask >> i) & 1;
+            backoffLevels[i] = UCHAR(pinStormPtr->backoffLevel);
+            pinStatsPtr->Rate = pinStormPtr->rate;
+            pinStatsPtr->Burst = pinStormPtr->burst;
+
+            pinStormPtr->reportedInterruptCount = pinStormPtr->interruptCount;
+        } // for (ULONG i = ...)
+
+        GPIO_CLX_ReleaseInterruptLock(this, BankId);
+    } // release lock
+
+    for (ULONG i = 0; i < BCM_GPIO_PINS_PER_BANK; ++i) {
+        BCM_GPIO_PIN_STORM_STATISTICS* pinStatsPtr = OutputPtr->Pins + i;
+
+        pinStatsPtr->InterruptRate = (elapsed > 0) ?
+            ULONG(pinStatsPtr->InterruptRate * this->performanceFrequency /
+                  elapsed) : 0;
+
+        // only report a backoff for pins that were suppressed
+        pinStatsPtr->BackoffMs = pinStatsPtr->SuppressionCount ?
+            ULONG(this->stormBackoffTicks[backoffLevels[i]] * 1000 /
+                  this->performanceFrequency) : 0;
+    } // for (ULONG i = ...)
+} // BCM_GPIO::queryStormStatistics (...)
+
+_Use_decl_annotations_
+NTSTATUS BCM_GPIO::setDebounce ( const BCM_GPIO_SET_DEBOUNCE_INPUT* InputPtr )
+{
+    PAGED_CODE();
+    BCM_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    const BANK_ID bankId = BANK_ID(InputPtr->BankId);
+    const ULONG pinMask = InputPtr->PinMask;
+    const ULONG windowUs = InputPtr->WindowUs;
+
+    if (!pinMask || (pinMask & ~bankPinMask(bankId)) ||
+        (windowUs > BCM_GPIO_DEBOUNCE_MAX_WINDOW_US)) {
+
+        return STATUS_INVALID_PARAMETER;
+    } // if
+
+    const LONGLONG windowTicks =
+        LONGLONG(windowUs) * this->performanceFrequency / 1000000;
+
+    // Pins in a window keep the window they started with
+    _INTERRUPT_CONTEXT* interruptContextPtr = this->interruptContext + bankId;
+    {
+        GPIO_CLX_AcquireInterruptLock(this, bankId);
+
+        ULONG mask = pinMask;
+        while (mask) {
+            ULONG i;
+            _BitScanForward(&i, mask);
+            mask &= mask - 1;
+
+            interruptContextPtr->debounceWindowTicks[i] = windowTicks;
+        } // while (mask)
+
+        if (windowUs) {
+            interruptContextPtr->debounceMask |= pinMask;
+        } else {
+            interruptContextPtr->debounceMask &= ~pinMask;
+        } // iff
+
+        GPIO_CLX_ReleaseInterruptLock(this, bankId);
+    } // release lock
+
+    return STATUS_SUCCESS;
+} // BCM_GPIO::setDebounce (...)
+
 _Use_decl_annotations_
 NTSTATUS BCM_GPIO::initialize ( WDFDEVICE WdfDevice )
 {
     PAGED_CODE();
     BCM_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
 
+    // create controller-specific function lock
+    {
+        WDF_OBJECT_ATTRIBUTES wdfObjectAttributes;
+        WDF_OBJECT_ATTRIBUTES_INIT(&wdfObjectAttributes);
+        wdfObjectAttributes.ParentObject = WdfDevice;
+
+        NTSTATUS status = WdfWaitLockCreate(
+                &wdfObjectAttributes,
+                &this->controlLock);
+        switch (status) {
+        case STATUS_SUCCESS:
+            break;
+        case STATUS_INSUFFICIENT_RESOURCES:
+            return status;
+        default:
+            NT_ASSERT(!"Incorrect usage of WdfWaitLockCreate");
+            return STATUS_INTERNAL_ERROR;
+        }
+    } // controlLock
+
+    // convert the storm mitigation delays to performance counter ticks
+    LARGE_INTEGER frequency;
+    const LONGLONG now = KeQueryPerformanceCounter(&frequency).QuadPart;
+    {
+        const _STORM_MITIGATION_CONFIG& config = stormMitigationConfig;
+
+        this->performanceFrequency = frequency.QuadPart;
+        for (ULONG i = 0; i < ARRAYSIZE(this->stormBackoffTicks); ++i) {
+            const ULONGLONG backoffMs = min(
+                ULONGLONG(config.backoffMs) << i,
+                ULONGLONG(config.maxBackoffMs));
+            this->stormBackoffTicks[i] =
+                LONGLONG(backoffMs) * frequency.QuadPart / 1000;
+        } // for (ULONG i = ...)
+
+        this->stormBackoffResetTicks =
+            LONGLONG(STORM_BACKOFF_RESET_MS) * frequency.QuadPart / 1000;
+    } // storm mitigation
+
     for (ULONG bankId = 0;
          bankId < ARRAYSIZE(this->interruptContext);
          ++bankId)
@@ -844,7 +1815,55 @@ NTSTATUS BCM_GPIO::initialize ( WDFDEVICE WdfDevice )
             timerContextPtr->thisPtr = this;
         } // timer
 
-        interruptContextPtr->initialize(bankId, dpc, timer);
+        // create debounce timer. A high resolution timer is needed for
+        // debounce windows shorter than the system clock tick.
+        WDFTIMER debounceTimer;
+        {
+            WDF_TIMER_CONFIG timerConfig;
+            WDF_TIMER_CONFIG_INIT(&timerConfig, evtDebounceTimerFunc);
+            timerConfig.Period = 0;     // not periodic
+            timerConfig.AutomaticSerialization = FALSE;
+            timerConfig.UseHighResolutionTimer = WdfTrue;
+
+            WDF_OBJECT_ATTRIBUTES wdfObjectAttributes;
+            WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(
+                &wdfObjectAttributes,
+                TIMER_CONTEXT);
+            wdfObjectAttributes.ParentObject = WdfDevice;
+
+            NTSTATUS status = WdfTimerCreate(
+                &timerConfig,
+                &wdfObjectAttributes,
+                &debounceTimer);
+            switch (status) {
+            case STATUS_SUCCESS:
+                break;
+            case STATUS_INSUFFICIENT_RESOURCES:
+                return status;
+            default:
+                NT_ASSERT(!"Incorrect usage of WdfTimerCreate");
+                return STATUS_INTERNAL_ERROR;
+            }
+
+            auto timerContextPtr = bcmGpioTimerContextFromWdfObject(debounceTimer);
+            timerContextPtr->interruptContextPtr = interruptContextPtr;
+            timerContextPtr->thisPtr = this;
+        } // debounceTimer
+
+        interruptContextPtr->initialize(bankId, dpc, timer, debounceTimer);
+
+        // apply the default rate limit to all pins
+        const _STORM_MITIGATION_CONFIG& config = stormMitigationConfig;
+        for (ULONG i = 0; i < BCM_GPIO_PINS_PER_BANK; ++i) {
+            this->resetPinStorm(
+                interruptContextPtr->pinStorm + i,
+                config.rate,
+                config.burst,
+                now);
+        } // for (ULONG i = ...)
+
+        interruptContextPtr->limitedMask = config.rate ? ULONG(-1) : 0;
+        interruptContextPtr->reportedTicks = now;
     } // for (ULONG bankId = ...)
 
     return STATUS_SUCCESS;
@@ -1076,7 +2095,6 @@ NTSTATUS DriverEntry (
         } // if
     } // wdfDriver
 
-    bool stormMitigationEnabled = false;
     {
         WDFKEY wdfKey;
         status = WdfDriverOpenParametersRegistryKey(
@@ -1086,16 +2104,49 @@ NTSTATUS DriverEntry (
                 &wdfKey);
 
         if (NT_SUCCESS(status)) {
-            DECLARE_CONST_UNICODE_STRING(valueName, L"StormMitigationEnabled");
-            ULONG value;
-            status = WdfRegistryQueryULong(
-                    wdfKey,
-                    &valueName,
-                    &value);
-
-            if (NT_SUCCESS(status)) {
-                stormMitigationEnabled = (value != 0);
-            }
+            BCM_GPIO::_STORM_MITIGATION_CONFIG& config =
+                BCM_GPIO::stormMitigationConfig;
+            ULONG enabled = 0;
+            ULONG rate = BCM_GPIO::STORM_DEFAULT_RATE;
+
+            const struct {
+                UNICODE_STRING ValueName;
+                ULONG* ValuePtr;
+                ULONG Minimum;
+                ULONG Maximum;
+            } values[] = {
+                { RTL_CONSTANT_STRING(L"StormMitigationEnabled"),
+                  &enabled, 0, 1 },
+                { RTL_CONSTANT_STRING(L"StormMitigationRate"),
+                  &rate, 1, BCM_GPIO_STORM_MAX_RATE },
+                { RTL_CONSTANT_STRING(L"StormMitigationBurst"),
+                  &config.burst, 1, BCM_GPIO_STORM_MAX_BURST },
+                { RTL_CONSTANT_STRING(L"StormMitigationBackoffMs"),
+                  &config.backoffMs, 1, MAXUSHORT },
+                { RTL_CONSTANT_STRING(L"StormMitigationMaxBackoffMs"),
+                  &config.maxBackoffMs, 1, MAXUSHORT },
+                { RTL_CONSTANT_STRING(L"EdgeCapturePinMask0"),
+                  &BCM_GPIO::edgeCapturePinMask[0], 0, MAXULONG },
+                { RTL_CONSTANT_STRING(L"EdgeCapturePinMask1"),
+                  &BCM_GPIO::edgeCapturePinMask[1], 0, MAXULONG },
+            };
+
+            for (ULONG i = 0; i < ARRAYSIZE(values); ++i) {
+                ULONG value;
+                status = WdfRegistryQueryULong(
+                        wdfKey,
+                        &values[i].ValueName,
+                        &value);
+
+                if (NT_SUCCESS(status)) {
+                    *values[i].ValuePtr =
+                        min(max(value, values[i].Minimum), values[i].Maximum);
+                }
+            } // for (ULONG i = ...)
+
+            config.rate = enabled ? rate : 0;
+            config.maxBackoffMs = max(config.maxBackoffMs, config.backoffMs);
+            BCM_GPIO::edgeCapturePinMask[1] &= bankPinMask(1);
 
             WdfRegistryClose(wdfKey);
         }
@@ -1126,8 +2177,8 @@ NTSTATUS DriverEntry (
         nullptr,    // CLIENT_WriteGpioPins
         nullptr,    // CLIENT_SaveBankHardwareContext
         nullptr,    // CLIENT_RestoreBankHardwareContext
-        stormMitigationEnabled ? BCM_GPIO::PreProcessControllerInterrupt : nullptr,
-        nullptr,    // CLIENT_ControllerSpecificFunction
+        BCM_GPIO::PreProcessControllerInterrupt,
+        BCM_GPIO::ControllerSpecificFunction,
         BCM_GPIO::ReconfigureInterrupt,
         BCM_GPIO::QueryEnabledInterrupts,
         BCM_GPIO::ConnectFunctionConfigPins,
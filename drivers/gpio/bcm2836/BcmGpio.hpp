@@ -81,13 +81,39 @@ struct BCM_GPIO_REGISTERS {
 class BCM_GPIO {
 public: // NONPAGED
 
-    // Number of times a pin can cause the ISR to run without allowing the
-    // DPC to run before interrupts on that pin are temporarily disabled.
-    // This value is determined from experimentation.
-    enum : UCHAR {
-        WATCHDOG_RESET = 10
+    // Defaults of the interrupt storm mitigation settings. The default
+    // burst and initial backoff are determined from experimentation.
+    enum : ULONG {
+        STORM_DEFAULT_RATE = 2000,          // interrupts per second
+        STORM_DEFAULT_BURST = 10,
+        STORM_DEFAULT_BACKOFF_MS = 1,
+        STORM_DEFAULT_MAX_BACKOFF_MS = 1024,
+        STORM_BACKOFF_RESET_MS = 1000,
+        STORM_BACKOFF_LEVELS = 16,
     };
 
+    struct _STORM_MITIGATION_CONFIG {
+        ULONG rate;             // initial limit of every pin, 0 for none
+        ULONG burst;
+        ULONG backoffMs;        // delay of the first suppression
+        ULONG maxBackoffMs;
+    }; // struct _STORM_MITIGATION_CONFIG
+
+    // Token bucket and statistics of a pin. Tokens are counted in units of
+    // 1/frequency of an interrupt so that refilling needs no division.
+    // Owned by the ISR; other paths hold the bank interrupt lock.
+    struct _PIN_STORM_STATE {
+        ULONG rate;             // interrupts per second, 0 if not limited
+        ULONG burst;
+        LONGLONG tokens;
+        LONGLONG lastTicks;     // time of the last refill
+        LONGLONG reenableTicks; // time the pin is or was last reenabled
+        ULONG backoffLevel;
+        ULONG interruptCount;
+        ULONG suppressionCount;
+        ULONG reportedInterruptCount;
+    }; // struct _PIN_STORM_STATE
+
     // Shadows the hardware interrupt configuration registers. These values
     // are shadowed because read/modify/write sequences were observed to be
     // unreliable in testing.
@@ -120,27 +146,44 @@ public: // NONPAGED
         ULONG GPAFEN;
     }; // struct _INTERRUPT_REGISTERS
 
+    // Ring of captured edges. The ISR is the only producer and
+    // readEdgeCapture(), serialized by controlLock, is the only consumer,
+    // so no lock is needed. The indices and counters are free running.
+    struct _EDGE_RING {
+        BCM_GPIO_EDGE_SAMPLE samples[BCM_GPIO_EDGE_RING_SAMPLES];
+        ULONG writeIndex;
+        ULONG readIndex;
+        ULONG droppedCount;
+        ULONG reportedDroppedCount;
+    }; // struct _EDGE_RING
+
     class _INTERRUPT_CONTEXT {
         friend class BCM_GPIO;
 
         _INTERRUPT_CONTEXT () : bankId(ULONG(-1)) { }
 
-        void initialize (ULONG BankId, WDFDPC WdfDpc, WDFTIMER WdfTimer)
+        void initialize (
+            ULONG BankId,
+            WDFDPC WdfDpc,
+            WDFTIMER WdfTimer,
+            WDFTIMER WdfDebounceTimer
+            )
         {
             this->bankId = BankId;
             this->dpc = WdfDpc;
             this->interruptReenableTimer = WdfTimer;
-            this->resetWatchdogCount();
+            this->debounceTimer = WdfDebounceTimer;
+            this->captureMask = 0;
+            this->captureInputMask = 0;
+            this->limitedMask = 0;
+            this->debounceMask = 0;
+            this->debouncingMask = 0;
+            this->reportHighMask = 0;
+            this->reportLowMask = 0;
+            KeInitializeSpinLock(&this->reenableTimerLock);
+            KeInitializeSpinLock(&this->debounceTimerLock);
         } // initialize (...)
 
-        void resetWatchdogCount ()
-        {
-            RtlFillMemory(
-                this->watchdogCount,
-                sizeof(this->watchdogCount),
-                WATCHDOG_RESET);
-        } // resetWatchdogCount ()
-
         ULONG bankId;
         ULONG enabledMask;
         ULONG disabledMask;
@@ -148,7 +191,40 @@ public: // NONPAGED
         _INTERRUPT_REGISTERS registers;
         WDFDPC dpc;
         WDFTIMER interruptReenableTimer;
-        UCHAR watchdogCount[BCM_GPIO_PINS_PER_BANK];
+
+        // serializes starting interruptReenableTimer so it is always
+        // armed for the earliest pending reenable
+        KSPIN_LOCK reenableTimerLock;
+
+        // pins with a rate limit
+        ULONG limitedMask;
+        _PIN_STORM_STATE pinStorm[BCM_GPIO_PINS_PER_BANK];
+        LONGLONG reportedTicks;     // time of the last statistics query
+
+        // An edge on a debounced pin removes the pin from enabledMask until
+        // debounceTimer samples it at the end of the window. A stable edge
+        // is then reported by enabling level detection of the new level,
+        // which raises the interrupt again with GPEDS set for GpioClx.
+        ULONG debounceMask;         // pins with a debounce window
+        ULONG debouncingMask;       // pins waiting for the end of the window
+        ULONG reportHighMask;       // stable rising edges being reported
+        ULONG reportLowMask;        // stable falling edges being reported
+        LONGLONG debounceWindowTicks[BCM_GPIO_PINS_PER_BANK];
+        LONGLONG debounceDueTicks[BCM_GPIO_PINS_PER_BANK];
+        WDFTIMER debounceTimer;
+
+        // serializes starting debounceTimer
+        KSPIN_LOCK debounceTimerLock;
+
+        // pins whose edges are stamped by the ISR instead of being
+        // reported to GpioClx
+        ULONG captureMask;
+        _EDGE_RING edgeRing;
+
+        // capture pins that were switched to inputs, and the function they
+        // are restored to when capture stops
+        ULONG captureInputMask;
+        UCHAR captureSavedFunction[BCM_GPIO_PINS_PER_BANK];
     }; // class _INTERRUPT_CONTEXT
 
     class _DPC_CONTEXT {
@@ -179,12 +255,56 @@ public: // NONPAGED
     static GPIO_CLIENT_CONNECT_FUNCTION_CONFIG_PINS ConnectFunctionConfigPins;
     static GPIO_CLIENT_DISCONNECT_FUNCTION_CONFIG_PINS DisconnectFunctionConfigPins;
 
+    // Set from the StormMitigation* registry values in DriverEntry
+    static _STORM_MITIGATION_CONFIG stormMitigationConfig;
+
+    // Pins edge capture may use, set from the EdgeCapturePinMask* registry
+    // values in DriverEntry. None by default.
+    static ULONG edgeCapturePinMask[BCM_GPIO_BANK_COUNT];
+
 private: // NONPAGED
 
     static EVT_WDF_DPC evtDpcFunc;
+    static EVT_WDF_TIMER evtDebounceTimerFunc;
 
     void programInterruptRegisters ( ULONG BankId );
 
+    void captureEdges (
+        _INTERRUPT_CONTEXT* InterruptContextPtr,
+        ULONG EdgeMask,
+        LONGLONG Timestamp
+        );
+
+    ULONG limitInterrupts (
+        _INTERRUPT_CONTEXT* InterruptContextPtr,
+        ULONG ChangedMask
+        );
+
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    void reenableInterrupts ( _INTERRUPT_CONTEXT* InterruptContextPtr );
+
+    void resetPinStorm (
+        _PIN_STORM_STATE* PinStormPtr,
+        ULONG Rate,
+        ULONG Burst,
+        LONGLONG Now
+        );
+
+    ULONG debounceEdges (
+        _INTERRUPT_CONTEXT* InterruptContextPtr,
+        ULONG ChangedMask
+        );
+
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    void debouncePins ( _INTERRUPT_CONTEXT* InterruptContextPtr );
+
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    void applyWriteVectors (
+        BANK_ID BankId,
+        _In_reads_(VectorCount) const BCM_GPIO_WRITE_VECTOR* VectorsPtr,
+        ULONG VectorCount
+        );
+
     _IRQL_requires_max_(PASSIVE_LEVEL)
     void setDriveMode (
         BANK_ID BankId,
@@ -204,7 +324,14 @@ private: // NONPAGED
     BITFIELD_ARRAY<BCM_GPIO_PIN_COUNT, 2> defaultPullConfig;
     ULONG openIoPins[BCM_GPIO_BANK_COUNT];
     ULONG openInterruptPins[BCM_GPIO_BANK_COUNT];
-    
+
+    // serializes controller-specific functions
+    WDFWAITLOCK controlLock;
+
+    LONGLONG performanceFrequency;
+    LONGLONG stormBackoffTicks[STORM_BACKOFF_LEVELS];
+    LONGLONG stormBackoffResetTicks;
+
     ULONG registersLength;
     enum class _SIGNATURE {
         UNINITIALIZED = 0,
@@ -220,6 +347,8 @@ public: // PAGED
     static GPIO_CLIENT_QUERY_CONTROLLER_BASIC_INFORMATION
         QueryControllerBasicInformation;
 
+    static GPIO_CLIENT_CONTROLLER_SPECIFIC_FUNCTION ControllerSpecificFunction;
+
     static GPIO_CLIENT_PREPARE_CONTROLLER PrepareController;
     static GPIO_CLIENT_RELEASE_CONTROLLER ReleaseController;
 
@@ -237,6 +366,44 @@ private: // PAGED
         BCM_GPIO_PULL PullMode
         );
 
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    NTSTATUS startEdgeCapture (
+        const BCM_GPIO_START_EDGE_CAPTURE_INPUT* InputPtr
+        );
+
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    NTSTATUS stopEdgeCapture ( BANK_ID BankId );
+
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    NTSTATUS readEdgeCapture (
+        BANK_ID BankId,
+        _Out_writes_bytes_to_(OutputBufferLength, *BytesReturnedPtr)
+            BCM_GPIO_EDGE_SAMPLES* OutputPtr,
+        SIZE_T OutputBufferLength,
+        _Out_ SIZE_T* BytesReturnedPtr
+        );
+
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    NTSTATUS setStormLimit (
+        const BCM_GPIO_SET_STORM_LIMIT_INPUT* InputPtr
+        );
+
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    void queryStormStatistics (
+        BANK_ID BankId,
+        _Out_ BCM_GPIO_STORM_STATISTICS* OutputPtr
+        );
+
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    NTSTATUS setDebounce ( const BCM_GPIO_SET_DEBOUNCE_INPUT* InputPtr );
+
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    NTSTATUS writeVectors (
+        _In_reads_bytes_(InputBufferLength)
+            const BCM_GPIO_WRITE_VECTORS_INPUT* InputPtr,
+        SIZE_T InputBufferLength
+        );
+
     _IRQL_requires_max_(PASSIVE_LEVEL)
     _Must_inspect_result_
     NTSTATUS initialize ( WDFDEVICE WdfDevice );
@@ -0,0 +1,241 @@
+#ifndef _BCMGPIO_IOCTL_H_
+#define _BCMGPIO_IOCTL_H_
+//
+// Copyright (C) Microsoft.  All rights reserved.
+//
+//
+// Module Name:
+//
+//   bcmgpio-ioctl.h
+//
+// Abstract:
+//
+//   BCM GPIO public controller-specific function definitions. The requests
+//   are sent to the GPIO controller device with
+//   IOCTL_GPIO_CONTROLLER_SPECIFIC_FUNCTION. The input buffer starts with a
+//   BCM_GPIO_CONTROL_CODE that selects the function.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+typedef enum _BCM_GPIO_CONTROL_CODE {
+    //
+    // Start capturing edges on a set of pins of a bank
+    // The ISR stamps each edge with the performance counter and stores it
+    // in a per-bank ring, without going through GpioClx. The pins must be
+    // allowed by the EdgeCapturePinMask0/1 registry values. Pins that are
+    // not connected for IO must not be muxed to an alternate function; output
+    // pins are switched to inputs until capture stops. The pins must not be
+    // connected for interrupts. Capture must be stopped before it can be
+    // restarted on the same bank.
+    //
+    // Input buffer:
+    // BCM_GPIO_START_EDGE_CAPTURE_INPUT
+    //
+    // Output buffer:
+    // None
+    //
+    BcmGpioControlStartEdgeCapture = 1,
+
+    //
+    // Stop capturing edges on a bank. Samples that were not read remain in
+    // the ring until capture is restarted.
+    //
+    // Input buffer:
+    // BCM_GPIO_EDGE_CAPTURE_INPUT
+    //
+    // Output buffer:
+    // None
+    //
+    BcmGpioControlStopEdgeCapture = 2,
+
+    //
+    // Read captured edges of a bank
+    // Removes up to as many samples as fit in the output buffer from the
+    // ring, oldest first.
+    //
+    // Input buffer:
+    // BCM_GPIO_EDGE_CAPTURE_INPUT
+    //
+    // Output buffer:
+    // BCM_GPIO_EDGE_SAMPLES, FIELD_OFFSET(BCM_GPIO_EDGE_SAMPLES, Samples[n])
+    //
+    BcmGpioControlReadEdgeCapture = 3,
+
+    //
+    // Apply a sequence of writes to the output pins of a bank
+    // Each vector clears the pins of ClearMask, then sets the pins of
+    // SetMask, then waits DelayUs microseconds before the next vector is
+    // applied. The whole sequence runs at DISPATCH_LEVEL without returning
+    // to the caller, so the timing between vectors is not affected by
+    // thread scheduling. All pins of the masks must be connected for output.
+    //
+    // Input buffer:
+    // BCM_GPIO_WRITE_VECTORS_INPUT,
+    // FIELD_OFFSET(BCM_GPIO_WRITE_VECTORS_INPUT, Vectors[VectorCount])
+    //
+    // Output buffer:
+    // None
+    //
+    BcmGpioControlWriteVectors = 4,
+
+    //
+    // Set the interrupt rate limit of a set of pins of a bank
+    // Each pin has a token bucket that holds up to Burst interrupts and is
+    // refilled at Rate interrupts per second. A pin that interrupts with an
+    // empty bucket is disabled, then reenabled with a full bucket after a
+    // backoff delay. The delay doubles each time the pin is disabled again
+    // shortly after being reenabled, up to a maximum. A Rate of 0 removes
+    // the limit. The initial limit of all pins comes from the
+    // StormMitigation* registry values.
+    //
+    // Input buffer:
+    // BCM_GPIO_SET_STORM_LIMIT_INPUT
+    //
+    // Output buffer:
+    // None
+    //
+    BcmGpioControlSetStormLimit = 5,
+
+    //
+    // Query the interrupt statistics and rate limits of the pins of a bank
+    //
+    // Input buffer:
+    // BCM_GPIO_CONTROL_INPUT
+    //
+    // Output buffer:
+    // BCM_GPIO_STORM_STATISTICS
+    //
+    BcmGpioControlQueryStormStatistics = 6,
+
+    //
+    // Set the debounce window of a set of pins of a bank
+    // An edge on a debounced pin masks the pin for WindowUs microseconds.
+    // At the end of the window the driver samples the pin, and reports the
+    // interrupt only if the pin is still at the level the edge went to.
+    // Edges during the window are discarded. Only edge triggered interrupts
+    // are debounced. A WindowUs of 0 turns debouncing off.
+    //
+    // Input buffer:
+    // BCM_GPIO_SET_DEBOUNCE_INPUT
+    //
+    // Output buffer:
+    // None
+    //
+    BcmGpioControlSetDebounce = 7,
+} BCM_GPIO_CONTROL_CODE;
+
+//
+// Common header of all input buffers
+//
+typedef struct _BCM_GPIO_CONTROL_INPUT {
+    ULONG ControlCode;          // BCM_GPIO_CONTROL_CODE
+    ULONG BankId;               // 0 for pins 0-31, 1 for pins 32-53
+} BCM_GPIO_CONTROL_INPUT, *PBCM_GPIO_CONTROL_INPUT;
+
+#define BCM_GPIO_EDGE_RISING            0x1
+#define BCM_GPIO_EDGE_FALLING           0x2
+#define BCM_GPIO_EDGE_BOTH              (BCM_GPIO_EDGE_RISING | BCM_GPIO_EDGE_FALLING)
+
+#define BCM_GPIO_EDGE_RING_SAMPLES      1024    // per bank
+
+typedef struct _BCM_GPIO_START_EDGE_CAPTURE_INPUT {
+    ULONG ControlCode;          // BcmGpioControlStartEdgeCapture
+    ULONG BankId;               // 0 for pins 0-31, 1 for pins 32-53
+    ULONG PinMask;              // pins of the bank to capture
+    ULONG Edges;                // BCM_GPIO_EDGE_*
+} BCM_GPIO_START_EDGE_CAPTURE_INPUT, *PBCM_GPIO_START_EDGE_CAPTURE_INPUT;
+
+typedef struct _BCM_GPIO_EDGE_CAPTURE_INPUT {
+    ULONG ControlCode;          // BcmGpioControlStop/ReadEdgeCapture
+    ULONG BankId;
+} BCM_GPIO_EDGE_CAPTURE_INPUT, *PBCM_GPIO_EDGE_CAPTURE_INPUT;
+
+typedef struct _BCM_GPIO_EDGE_SAMPLE {
+    //
+    // Performance counter value when the ISR ran. This is the same time
+    // base as QueryPerformanceCounter.
+    //
+    LONGLONG Timestamp;
+
+    //
+    // Pins that saw an edge since the previous sample. The controller
+    // latches one edge per pin, so edges of a pin that occur before the
+    // ISR runs are merged.
+    //
+    ULONG EdgeMask;
+
+    ULONG Levels;               // level of all pins of the bank (GPLEV)
+} BCM_GPIO_EDGE_SAMPLE, *PBCM_GPIO_EDGE_SAMPLE;
+
+typedef struct _BCM_GPIO_EDGE_SAMPLES {
+    ULONG SampleCount;          // samples returned
+    ULONG DroppedSamples;       // samples lost to a full ring since the last read
+    LONGLONG PerformanceFrequency;
+    BCM_GPIO_EDGE_SAMPLE Samples[1];
+} BCM_GPIO_EDGE_SAMPLES, *PBCM_GPIO_EDGE_SAMPLES;
+
+//
+// A write vectors request runs at DISPATCH_LEVEL from start to end. The
+// limits keep it within 100us: at most 75us of delays plus the register
+// writes of the vectors.
+//
+#define BCM_GPIO_WRITE_VECTORS_MAX_COUNT            256
+#define BCM_GPIO_WRITE_VECTORS_MAX_VECTOR_DELAY_US  50      // DelayUs of a vector
+#define BCM_GPIO_WRITE_VECTORS_MAX_DELAY_US         75      // sum of DelayUs
+
+typedef struct _BCM_GPIO_WRITE_VECTOR {
+    ULONG SetMask;
+    ULONG ClearMask;
+    ULONG DelayUs;              // delay after the write, 0 for none, at most
+                                // BCM_GPIO_WRITE_VECTORS_MAX_VECTOR_DELAY_US
+} BCM_GPIO_WRITE_VECTOR, *PBCM_GPIO_WRITE_VECTOR;
+
+typedef struct _BCM_GPIO_WRITE_VECTORS_INPUT {
+    ULONG ControlCode;          // BcmGpioControlWriteVectors
+    ULONG BankId;
+    ULONG VectorCount;          // 1 - BCM_GPIO_WRITE_VECTORS_MAX_COUNT
+    BCM_GPIO_WRITE_VECTOR Vectors[1];
+} BCM_GPIO_WRITE_VECTORS_INPUT, *PBCM_GPIO_WRITE_VECTORS_INPUT;
+
+#define BCM_GPIO_STORM_MAX_RATE        100000  // interrupts per second
+#define BCM_GPIO_STORM_MAX_BURST       1000
+
+typedef struct _BCM_GPIO_SET_STORM_LIMIT_INPUT {
+    ULONG ControlCode;          // BcmGpioControlSetStormLimit
+    ULONG BankId;
+    ULONG PinMask;
+    ULONG Rate;                 // 0 - BCM_GPIO_STORM_MAX_RATE
+    ULONG Burst;                // 1 - BCM_GPIO_STORM_MAX_BURST
+} BCM_GPIO_SET_STORM_LIMIT_INPUT, *PBCM_GPIO_SET_STORM_LIMIT_INPUT;
+
+typedef struct _BCM_GPIO_PIN_STORM_STATISTICS {
+    ULONG InterruptCount;       // interrupts since the pin was enabled
+    ULONG InterruptRate;        // interrupts per second since the previous query
+    ULONG SuppressionCount;     // times the pin was disabled by its limit
+    ULONG Suppressed;           // nonzero while the pin is disabled by its limit
+    ULONG BackoffMs;            // delay of the last suppression
+    ULONG Rate;
+    ULONG Burst;
+} BCM_GPIO_PIN_STORM_STATISTICS, *PBCM_GPIO_PIN_STORM_STATISTICS;
+
+typedef struct _BCM_GPIO_STORM_STATISTICS {
+    BCM_GPIO_PIN_STORM_STATISTICS Pins[32];     // indexed by pin of the bank
+} BCM_GPIO_STORM_STATISTICS, *PBCM_GPIO_STORM_STATISTICS;
+
+#define BCM_GPIO_DEBOUNCE_MAX_WINDOW_US        100000
+
+typedef struct _BCM_GPIO_SET_DEBOUNCE_INPUT {
+    ULONG ControlCode;          // BcmGpioControlSetDebounce
+    ULONG BankId;
+    ULONG PinMask;
+    ULONG WindowUs;             // 0 - BCM_GPIO_DEBOUNCE_MAX_WINDOW_US
+} BCM_GPIO_SET_DEBOUNCE_INPUT, *PBCM_GPIO_SET_DEBOUNCE_INPUT;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // _BCMGPIO_IOCTL_H_
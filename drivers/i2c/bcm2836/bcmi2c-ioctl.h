@@ -0,0 +1,114 @@
+#ifndef _BCMI2C_IOCTL_H_
+#define _BCMI2C_IOCTL_H_
+//
+// Copyright (C) Microsoft.  All rights reserved.
+//
+//
+// Module Name:
+//
+//   bcmi2c-ioctl.h
+//
+// Abstract:
+//
+//   BCM I2C public IOCTL definitions. The IOCTLs are sent to an SPB target
+//   (i.e. a connection opened through the resource hub) and are handled by
+//   the controller between transfers.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//
+// IOCTL codes
+//
+
+#define FILE_DEVICE_BCM_I2C_PERIPHERAL 0x400
+
+//
+// Start a scan
+// The controller reads each entry of the scan table periodically, between
+// the transfers of SPB requests, and stores the results in a sample ring.
+// Each read is a write of the register address followed by a restart and a
+// read, addressed to the entry's slave address at the connection speed of
+// the target. The slave address of every entry must be the address of the
+// target. A scan started by another target must be stopped first.
+//
+// Input buffer:
+// lpInBuffer - pointer to a BCM_I2C_SCAN_TABLE
+// nInBufferSize - FIELD_OFFSET(BCM_I2C_SCAN_TABLE, Entries[EntryCount])
+//
+// Output buffer:
+// None
+//
+#define IOCTL_BCM_I2C_START_SCAN                CTL_CODE(FILE_DEVICE_BCM_I2C_PERIPHERAL, 0x700, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+//
+// Stop the scan started by this target. Samples that were not read are
+// discarded.
+//
+// Input buffer:
+// None
+//
+// Output buffer:
+// None
+//
+#define IOCTL_BCM_I2C_STOP_SCAN                 CTL_CODE(FILE_DEVICE_BCM_I2C_PERIPHERAL, 0x701, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+//
+// Read samples of the scan started by this target
+// Removes up to as many samples as fit in the output buffer from the sample
+// ring, oldest first.
+//
+// Input buffer:
+// None
+//
+// Output buffer:
+// lpOutBuffer - pointer to a BCM_I2C_SCAN_SAMPLES
+// nOutBufferSize - FIELD_OFFSET(BCM_I2C_SCAN_SAMPLES, Samples[n])
+//
+#define IOCTL_BCM_I2C_READ_SCAN_SAMPLES         CTL_CODE(FILE_DEVICE_BCM_I2C_PERIPHERAL, 0x702, METHOD_BUFFERED, FILE_READ_DATA)
+
+#define BCM_I2C_SCAN_MAX_ENTRIES        32
+#define BCM_I2C_SCAN_MAX_READ_LENGTH    16      // one FIFO
+#define BCM_I2C_SCAN_MIN_PERIOD_US      1000
+#define BCM_I2C_SCAN_RING_SAMPLES       256
+
+typedef struct _BCM_I2C_SCAN_ENTRY {
+    USHORT Address;             // 7-bit slave address of the target
+    UCHAR Register;
+    UCHAR ReadLength;           // 1 - BCM_I2C_SCAN_MAX_READ_LENGTH
+    ULONG PeriodUs;             // at least BCM_I2C_SCAN_MIN_PERIOD_US
+} BCM_I2C_SCAN_ENTRY, *PBCM_I2C_SCAN_ENTRY;
+
+typedef struct _BCM_I2C_SCAN_TABLE {
+    ULONG EntryCount;           // 1 - BCM_I2C_SCAN_MAX_ENTRIES
+    BCM_I2C_SCAN_ENTRY Entries[1];
+} BCM_I2C_SCAN_TABLE, *PBCM_I2C_SCAN_TABLE;
+
+typedef struct _BCM_I2C_SCAN_SAMPLE {
+    //
+    // Performance counter value when the read completed. This is the same
+    // time base as QueryPerformanceCounter.
+    //
+    LONGLONG Timestamp;
+
+    LONG Status;                // NTSTATUS of the read
+    USHORT EntryIndex;
+    UCHAR ReadLength;
+    UCHAR Reserved;
+    UCHAR Data[BCM_I2C_SCAN_MAX_READ_LENGTH];
+} BCM_I2C_SCAN_SAMPLE, *PBCM_I2C_SCAN_SAMPLE;
+
+typedef struct _BCM_I2C_SCAN_SAMPLES {
+    ULONG SampleCount;          // samples returned
+    ULONG DroppedSamples;       // samples lost to a full ring since the last read
+    LONGLONG PerformanceFrequency;
+    BCM_I2C_SCAN_SAMPLE Samples[1];
+} BCM_I2C_SCAN_SAMPLES, *PBCM_I2C_SCAN_SAMPLES;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // _BCMI2C_IOCTL_H_
@@ -86,6 +86,14 @@ struct BCM_I2C_REGISTERS {
 //
 #define BCM_I2C_REG_FIFO_MASK               0x000000FF
 
+//
+// I2C.FIFO depth. RXR is set when the FIFO is at least 3/4 full and TXW when
+// it is less than 1/4 full, so either one guarantees a burst of
+// BCM_I2C_FIFO_THRESHOLD_BURST bytes can be moved without polling RXD/TXD.
+//
+#define BCM_I2C_FIFO_DEPTH                  16
+#define BCM_I2C_FIFO_THRESHOLD_BURST        12
+
 //
 // I2C.DIV ClockDivider Register bit fields
 //
@@ -112,5 +120,21 @@ struct BCM_I2C_REGISTERS {
 #define BCM_I2C_REG_CDIV_DEFAULT            ((BCM_I2C_CORE_CLOCK / 100000) & BCM_I2C_REG_CDIV_MASK)
 
 
+//
+// Register access. All hardware access in the driver goes through these
+// routines.
+//
+__forceinline ULONG ReadBscRegister (_In_ volatile ULONG* RegisterPtr)
+{
+    return READ_REGISTER_NOFENCE_ULONG(RegisterPtr);
+}
+
+__forceinline void WriteBscRegister (
+    _In_ volatile ULONG* RegisterPtr,
+    ULONG Value
+    )
+{
+    WRITE_REGISTER_NOFENCE_ULONG(RegisterPtr, Value);
+}
 
 #endif // _BCMI2C_H_
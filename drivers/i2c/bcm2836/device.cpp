@@ -23,6 +23,7 @@ Revision History:
 
 #include "i2ctrace.h"
 #include "bcmi2c.h"
+#include "bcmi2c-ioctl.h"
 #include "driver.h"
 #include "device.h"
 
@@ -34,41 +35,6 @@ Revision History:
 
 BCM_I2C_NONPAGED_SEGMENT_BEGIN; //=============================================
 
-//
-// Returns when the transfer becomes active, aborts due to an error,
-// or times out.
-//
-// Returns:
-//
-//    STATUS_SUCCESS - The TA bit was set before the timeout.
-//    STATUS_IO_TIMEOUT - A clock stretch timeout occurred.
-//    STATUS_NO_SUCH_DEVICE - The slave address was not acknowledged.
-//    STATUS_IO_DEVICE_ERROR - An unexpected hardware error occurred.
-//
-NTSTATUS WaitForTransferActive ( BCM_I2C_REGISTERS* RegistersPtr )
-{
-    ULONG count = 10000;  // maximum spin count
-    do {
-        ULONG statusReg = READ_REGISTER_NOFENCE_ULONG(&RegistersPtr->Status);
-        if (statusReg & BCM_I2C_REG_STATUS_TA) {
-            return STATUS_SUCCESS;
-        } else if (statusReg & BCM_I2C_REG_STATUS_CLKT) {
-            BSC_LOG_ERROR(
-                L"CLKT was asserted while waiting for transfer to become active. (statusReg = 0x%lx)",
-                statusReg);
-            return STATUS_IO_TIMEOUT;
-        } else if (statusReg & BCM_I2C_REG_STATUS_ERR) {
-            BSC_LOG_ERROR(
-                L"ERR was asserted while waiting for transfer to become active. (statusReg = 0x%lx)",
-                statusReg);
-            return STATUS_NO_SUCH_DEVICE;
-        }
-    } while (--count);
-
-    BSC_LOG_ERROR(L"Maximum spin count reached waiting for transfer to become active.");
-    return STATUS_IO_TIMEOUT;
-}
-
 //
 // Enables request for cancellation and writes a new value into the control
 // register (potentially enabling interrupts) under the cancellation
@@ -101,7 +67,7 @@ static NTSTATUS MarkRequestCancelableAndUpdateControlRegisterSynchronized (
     // be done under the cancel lock because the cancel routine also
     // modifies hardware state.
     //
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &InterruptContextPtr->RegistersPtr->Control,
         ControlRegValue);
 
@@ -118,13 +84,13 @@ static void ResetHardwareAndRequestContext (
     InterruptContextPtr->TargetPtr = nullptr;
 
     BCM_I2C_REGISTERS* registersPtr = InterruptContextPtr->RegistersPtr;
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->Control,
         BCM_I2C_REG_CONTROL_I2CEN | BCM_I2C_REG_CONTROL_CLEAR);
 
-    WRITE_REGISTER_NOFENCE_ULONG(&registersPtr->DataLength, 0);
+    WriteBscRegister(&registersPtr->DataLength, 0);
 
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->Status,
         BCM_I2C_REG_STATUS_ERR |
         BCM_I2C_REG_STATUS_CLKT |
@@ -137,12 +103,12 @@ void InitializeTransfer (
     ULONG DataLength
     )
 {
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &RegistersPtr->Control,
         BCM_I2C_REG_CONTROL_CLEAR);
 
     // Clear error and done
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &RegistersPtr->Status,
         BCM_I2C_REG_STATUS_CLKT |
         BCM_I2C_REG_STATUS_ERR |
@@ -155,7 +121,7 @@ void InitializeTransfer (
     ULONG clockDivider =
         (BCM_I2C_CORE_CLOCK / TargetPtr->ConnectionSpeed) &
          BCM_I2C_REG_CDIV_MASK;
-    WRITE_REGISTER_NOFENCE_ULONG(&RegistersPtr->ClockDivider, clockDivider);
+    WriteBscRegister(&RegistersPtr->ClockDivider, clockDivider);
 
     //
     // The rising edge data delay sets how long the controller waits after
@@ -167,7 +133,7 @@ void InitializeTransfer (
     // 50 is a safety margin to ensure REDL is less than CDIV / 2.
     //
     NT_ASSERT((clockDivider / 2) > 50);
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &RegistersPtr->DataDelay,
         (BCM_I2C_REG_DEL_FEDL << 16) | (clockDivider / 2 - 50));
 
@@ -176,7 +142,7 @@ void InitializeTransfer (
         (I2C_MAX_ADDRESS & ~BCM_I2C_REG_ADDRESS_MASK) == 0,
         "Verifying that I2C_MAX_ADDRESS will fit in Address register");
     NT_ASSERT(TargetPtr->Address <= I2C_MAX_ADDRESS);
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &RegistersPtr->SlaveAddress,
         TargetPtr->Address);
 
@@ -192,13 +158,15 @@ void InitializeTransfer (
         (BCM_I2C_MAX_TRANSFER_LENGTH & ~BCM_I2C_REG_DLEN_MASK) == 0,
         "Verifying that BCM_I2C_MAX_TRANSFER_LENGTH will fit in DLEN register");
     NT_ASSERT(DataLength <= BCM_I2C_MAX_TRANSFER_LENGTH);
-    WRITE_REGISTER_NOFENCE_ULONG(&RegistersPtr->DataLength, DataLength);
+    WriteBscRegister(&RegistersPtr->DataLength, DataLength);
 }
 
 //
 // Reads up to the specified number of bytes from the data FIFO. Returns when
 // either all available bytes have been read or all requested bytes have
-// been read. Returns the number of bytes read.
+// been read. Returns the number of bytes read. RXF and RXR guarantee that a
+// burst of bytes is available, which is read without polling RXD for each
+// byte.
 //
 ULONG ReadFifo (
     BCM_I2C_REGISTERS* RegistersPtr,
@@ -208,15 +176,27 @@ ULONG ReadFifo (
     )
 {
     BYTE* dataPtr = BufferPtr;
-    ULONG statusReg = 0;
-    while (dataPtr != (BufferPtr + BufferSize)) {
-        statusReg = READ_REGISTER_NOFENCE_ULONG(&RegistersPtr->Status);
-        if (!(statusReg & BCM_I2C_REG_STATUS_RXD)) {
+    const BYTE* const endPtr = BufferPtr + BufferSize;
+    ULONG statusReg = ReadBscRegister(&RegistersPtr->Status);
+    while (dataPtr != endPtr) {
+        ULONG burstLength;
+        if (statusReg & BCM_I2C_REG_STATUS_RXF) {
+            burstLength = BCM_I2C_FIFO_DEPTH;
+        } else if (statusReg & BCM_I2C_REG_STATUS_RXR) {
+            burstLength = BCM_I2C_FIFO_THRESHOLD_BURST;
+        } else if (statusReg & BCM_I2C_REG_STATUS_RXD) {
+            burstLength = 1;
+        } else {
             break;
         }
 
-        *dataPtr++ = static_cast<BYTE>(
-            READ_REGISTER_NOFENCE_ULONG(&RegistersPtr->DataFIFO));
+        burstLength = min(burstLength, ULONG(endPtr - dataPtr));
+        do {
+            *dataPtr++ = static_cast<BYTE>(
+                ReadBscRegister(&RegistersPtr->DataFIFO));
+        } while (--burstLength);
+
+        statusReg = ReadBscRegister(&RegistersPtr->Status);
     }
 
     ULONG bytesRead = dataPtr - BufferPtr;
@@ -251,7 +231,9 @@ ULONG ReadFifoMdl (
 //
 // Writes up to the specified number of bytes to the data FIFO. Returns when
 // either the FIFO is full or the entire buffer has been written. Returns
-// the number of bytes written to the FIFO.
+// the number of bytes written to the FIFO. TXE and TXW guarantee that a
+// burst of entries is free, which is written without polling TXD for each
+// byte.
 //
 ULONG WriteFifo (
     BCM_I2C_REGISTERS* RegistersPtr,
@@ -260,22 +242,601 @@ ULONG WriteFifo (
     )
 {
     const BYTE* dataPtr = BufferPtr;
-    while (dataPtr != (BufferPtr + BufferSize)) {
-        ULONG statusReg = READ_REGISTER_NOFENCE_ULONG(&RegistersPtr->Status);
-        if (!(statusReg & BCM_I2C_REG_STATUS_TXD)) {
+    const BYTE* const endPtr = BufferPtr + BufferSize;
+    ULONG statusReg = ReadBscRegister(&RegistersPtr->Status);
+    while (dataPtr != endPtr) {
+        ULONG burstLength;
+        if (statusReg & BCM_I2C_REG_STATUS_TXE) {
+            burstLength = BCM_I2C_FIFO_DEPTH;
+        } else if (statusReg & BCM_I2C_REG_STATUS_TXW) {
+            burstLength = BCM_I2C_FIFO_THRESHOLD_BURST;
+        } else if (statusReg & BCM_I2C_REG_STATUS_TXD) {
+            burstLength = 1;
+        } else {
+            break;
+        }
+
+        burstLength = min(burstLength, ULONG(endPtr - dataPtr));
+        do {
+            WriteBscRegister(&RegistersPtr->DataFIFO, *dataPtr++);
+        } while (--burstLength);
+
+        statusReg = ReadBscRegister(&RegistersPtr->Status);
+    }
+
+    ULONG bytesWritten = dataPtr - BufferPtr;
+    BSC_LOG_TRACE(
+        "Wrote %d of %d bytes to TX FIFO",
+        bytesWritten,
+        BufferSize);
+
+    return bytesWritten;
+}
+
+//
+// Writes up to BytesToWrite bytes of the current sequence transfer to the
+// data FIFO, advancing through its MDL chain. Returns the number of bytes
+// written, which is less than BytesToWrite if the FIFO became full.
+//
+ULONG WriteFifoSequence (
+    BCM_I2C_REGISTERS* RegistersPtr,
+    BCM_I2C_INTERRUPT_CONTEXT::SEQUENCE_CONTEXT* SequenceContextPtr,
+    ULONG BytesToWrite
+    )
+{
+    NT_ASSERT(BytesToWrite <= SequenceContextPtr->BytesRemaining);
+
+    ULONG bytesWritten = 0;
+    while (bytesWritten != BytesToWrite) {
+        const PMDL currentMdl = SequenceContextPtr->CurrentMdl;
+        NT_ASSERT(
+            currentMdl->MdlFlags &
+            (MDL_MAPPED_TO_SYSTEM_VA | MDL_SOURCE_IS_NONPAGED_POOL));
+        NT_ASSERT(
+            SequenceContextPtr->CurrentMdlOffset <
+            MmGetMdlByteCount(currentMdl));
+
+        const ULONG mdlBytesToWrite = min(
+            MmGetMdlByteCount(currentMdl) -
+                SequenceContextPtr->CurrentMdlOffset,
+            BytesToWrite - bytesWritten);
+        const ULONG mdlBytesWritten = WriteFifo(
+            RegistersPtr,
+            static_cast<const BYTE*>(currentMdl->MappedSystemVa) +
+                SequenceContextPtr->CurrentMdlOffset,
+            mdlBytesToWrite);
+
+        bytesWritten += mdlBytesWritten;
+        SequenceContextPtr->CurrentMdlOffset += mdlBytesWritten;
+        if (SequenceContextPtr->CurrentMdlOffset ==
+            MmGetMdlByteCount(currentMdl)) {
+
+            SequenceContextPtr->CurrentMdl = currentMdl->Next;
+            SequenceContextPtr->CurrentMdlOffset = 0;
+        }
+
+        if (mdlBytesWritten != mdlBytesToWrite) {
+            break;
+        }
+    }
+
+    SequenceContextPtr->BytesRemaining -= bytesWritten;
+    return bytesWritten;
+}
+
+//
+// Records the result of the current scan entry in the sample ring. On
+// success, the data is read from the FIFO. If the ring is full, the sample
+// is dropped and counted.
+//
+static void RecordScanSample (
+    BCM_I2C_REGISTERS* RegistersPtr,
+    BCM_I2C_SCAN_CONTEXT* ScanContextPtr,
+    NTSTATUS Status,
+    LONGLONG TimestampTicks
+    )
+{
+    if (ScanContextPtr->SampleCount == BCM_I2C_SCAN_RING_SAMPLES) {
+        ++ScanContextPtr->DroppedSamples;
+        return;
+    }
+
+    const BCM_I2C_SCAN_CONTEXT::ENTRY* entryPtr =
+        &ScanContextPtr->Entries[ScanContextPtr->CurrentEntry];
+    BCM_I2C_SCAN_SAMPLE* samplePtr = &ScanContextPtr->Samples[
+        (ScanContextPtr->SampleHead + ScanContextPtr->SampleCount) %
+        BCM_I2C_SCAN_RING_SAMPLES];
+
+    samplePtr->Timestamp = TimestampTicks;
+    samplePtr->Status = Status;
+    samplePtr->EntryIndex = static_cast<USHORT>(ScanContextPtr->CurrentEntry);
+    samplePtr->ReadLength = 0;
+    samplePtr->Reserved = 0;
+
+    if (NT_SUCCESS(Status)) {
+        ULONG statusReg;
+        const ULONG bytesRead = ReadFifo(
+                RegistersPtr,
+                samplePtr->Data,
+                entryPtr->ReadLength,
+                &statusReg);
+
+        NT_ASSERT(bytesRead == entryPtr->ReadLength);
+        samplePtr->ReadLength = static_cast<UCHAR>(bytesRead);
+    }
+
+    ++ScanContextPtr->SampleCount;
+}
+
+//
+// Starts the read of the first scan entry at or after CurrentEntry that is
+// due. Returns false if no remaining entry is due.
+//
+static bool StartNextScanEntry (
+    BCM_I2C_INTERRUPT_CONTEXT* InterruptContextPtr,
+    LONGLONG NowTicks
+    )
+{
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr = &InterruptContextPtr->ScanContext;
+    BCM_I2C_REGISTERS* registersPtr = InterruptContextPtr->RegistersPtr;
+
+    ULONG entryIndex = scanContextPtr->CurrentEntry;
+    while ((entryIndex < scanContextPtr->EntryCount) &&
+           (scanContextPtr->Entries[entryIndex].NextDueTicks > NowTicks)) {
+
+        ++entryIndex;
+    }
+
+    scanContextPtr->CurrentEntry = entryIndex;
+    if (entryIndex == scanContextPtr->EntryCount) {
+        return false;
+    }
+
+    const BCM_I2C_SCAN_CONTEXT::ENTRY* entryPtr =
+        &scanContextPtr->Entries[entryIndex];
+    InitializeTransfer(registersPtr, &entryPtr->Target, 1);
+
+    //
+    // Start the write of the register address with an empty FIFO. TXW
+    // asserts once the write is active, at which point the ISR programs the
+    // restart and queues the register address.
+    //
+    InterruptContextPtr->State = TRANSFER_STATE::SCAN_WRITE;
+    WriteBscRegister(
+        &registersPtr->Control,
+        BCM_I2C_REG_CONTROL_I2CEN |
+        BCM_I2C_REG_CONTROL_ST |
+        BCM_I2C_REG_CONTROL_INTT |
+        BCM_I2C_REG_CONTROL_INTD);
+
+    return true;
+}
+
+//
+// Arms the scan timer for the earliest entry that is due.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static void ArmScanTimer ( BCM_I2C_SCAN_CONTEXT* ScanContextPtr )
+{
+    NT_ASSERT(ScanContextPtr->EntryCount != 0);
+
+    LONGLONG nextDueTicks = ScanContextPtr->Entries[0].NextDueTicks;
+    for (ULONG i = 1; i < ScanContextPtr->EntryCount; ++i) {
+        nextDueTicks = min(nextDueTicks, ScanContextPtr->Entries[i].NextDueTicks);
+    }
+
+    const LONGLONG nowTicks = KeQueryPerformanceCounter(nullptr).QuadPart;
+    LONGLONG dueTime100ns = 1;
+    if (nextDueTicks > nowTicks) {
+        dueTime100ns = max(
+            (nextDueTicks - nowTicks) * 10000000LL /
+            ScanContextPtr->PerformanceFrequency,
+            1LL);
+    }
+
+    // negative due time is relative
+    WdfTimerStart(ScanContextPtr->Timer, -dueTime100ns);
+}
+
+//
+// Dispatches a request that arrived while a scan burst owned the controller.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static void DispatchDeferredRequest (
+    WDFDEVICE WdfDevice,
+    SPBTARGET SpbTarget,
+    SPBREQUEST SpbRequest
+    )
+{
+    SPB_REQUEST_PARAMETERS params;
+    SPB_REQUEST_PARAMETERS_INIT(&params);
+    SpbRequestGetParameters(SpbRequest, &params);
+
+    BSC_LOG_TRACE(
+        "Dispatching deferred request. (SpbRequest = %p, params.Type = %d)",
+        SpbRequest,
+        params.Type);
+
+    switch (params.Type) {
+    case SpbRequestTypeRead:
+        OnRead(WdfDevice, SpbTarget, SpbRequest, params.Length);
+        return;
+    case SpbRequestTypeWrite:
+        OnWrite(WdfDevice, SpbTarget, SpbRequest, params.Length);
+        return;
+    case SpbRequestTypeSequence:
+        OnSequence(
+            WdfDevice,
+            SpbTarget,
+            SpbRequest,
+            params.SequenceTransferCount);
+        return;
+    case SpbRequestTypeOther:
+    {
+        WDF_REQUEST_PARAMETERS wdfParams;
+        WDF_REQUEST_PARAMETERS_INIT(&wdfParams);
+        WdfRequestGetParameters(SpbRequest, &wdfParams);
+
+        OnOther(
+            WdfDevice,
+            SpbTarget,
+            SpbRequest,
+            wdfParams.Parameters.DeviceIoControl.OutputBufferLength,
+            wdfParams.Parameters.DeviceIoControl.InputBufferLength,
+            wdfParams.Parameters.DeviceIoControl.IoControlCode);
+        return;
+    }
+    default:
+        NT_ASSERT(!"Unexpected deferred request type");
+        SpbRequestComplete(SpbRequest, STATUS_INTERNAL_ERROR);
+        return;
+    }
+}
+
+//
+// Releases the controller at the end of a scan burst, arms the scan timer
+// for the next entry that is due, and dispatches the request that arrived
+// during the burst, if any.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static void FinishScanBurst ( BCM_I2C_INTERRUPT_CONTEXT* InterruptContextPtr )
+{
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr = &InterruptContextPtr->ScanContext;
+
+    SPBTARGET deferredTarget;
+    SPBREQUEST deferredRequest;
+    NTSTATUS status = STATUS_SUCCESS;
+    {
+        KLOCK_QUEUE_HANDLE lockHandle;
+        KeAcquireInStackQueuedSpinLock(&scanContextPtr->Lock, &lockHandle);
+
+        NT_ASSERT(scanContextPtr->BurstActive && !scanContextPtr->RequestActive);
+        scanContextPtr->BurstActive = FALSE;
+
+        deferredTarget = scanContextPtr->DeferredTarget;
+        deferredRequest = scanContextPtr->DeferredRequest;
+        if (deferredRequest != WDF_NO_HANDLE) {
+            status = WdfRequestUnmarkCancelable(deferredRequest);
+            if (status == STATUS_CANCELLED) {
+                // the cancellation routine completes the request
+                deferredRequest = WDF_NO_HANDLE;
+            } else {
+                scanContextPtr->DeferredTarget = WDF_NO_HANDLE;
+                scanContextPtr->DeferredRequest = WDF_NO_HANDLE;
+            }
+        }
+
+        if (scanContextPtr->OwnerTarget != WDF_NO_HANDLE) {
+            ArmScanTimer(scanContextPtr);
+        }
+
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+    }
+
+    if (deferredRequest == WDF_NO_HANDLE) {
+        return;
+    }
+
+    if (!NT_SUCCESS(status)) {
+        BSC_LOG_ERROR(
+            "WdfRequestUnmarkCancelable(...) failed. (status = %!STATUS!, deferredRequest = 0x%p)",
+            status,
+            deferredRequest);
+        SpbRequestComplete(deferredRequest, status);
+        return;
+    }
+
+    DispatchDeferredRequest(
+        WdfInterruptGetDevice(InterruptContextPtr->WdfInterrupt),
+        deferredTarget,
+        deferredRequest);
+}
+
+//
+// Completes the request deferred behind a scan burst that will never
+// finish because the device is leaving D0.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static void CancelDeferredRequest ( BCM_I2C_SCAN_CONTEXT* ScanContextPtr )
+{
+    SPBREQUEST deferredRequest;
+    {
+        KLOCK_QUEUE_HANDLE lockHandle;
+        KeAcquireInStackQueuedSpinLock(&ScanContextPtr->Lock, &lockHandle);
+
+        deferredRequest = ScanContextPtr->DeferredRequest;
+        if ((deferredRequest == WDF_NO_HANDLE) ||
+            (WdfRequestUnmarkCancelable(deferredRequest) == STATUS_CANCELLED)) {
+
+            // the cancellation routine completes the request
+            KeReleaseInStackQueuedSpinLock(&lockHandle);
+            return;
+        }
+
+        ScanContextPtr->DeferredTarget = WDF_NO_HANDLE;
+        ScanContextPtr->DeferredRequest = WDF_NO_HANDLE;
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+    }
+
+    BSC_LOG_INFORMATION(
+        "Cancelling deferred request. (deferredRequest = %p)",
+        deferredRequest);
+    SpbRequestComplete(deferredRequest, STATUS_CANCELLED);
+}
+
+//
+// Starts reading the scan entries that are due. If a request owns the
+// controller, the burst is started when the request releases it.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static void StartScanBurst ( BCM_I2C_INTERRUPT_CONTEXT* InterruptContextPtr )
+{
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr = &InterruptContextPtr->ScanContext;
+
+    {
+        KLOCK_QUEUE_HANDLE lockHandle;
+        KeAcquireInStackQueuedSpinLock(&scanContextPtr->Lock, &lockHandle);
+
+        if ((scanContextPtr->OwnerTarget == WDF_NO_HANDLE) ||
+            scanContextPtr->BurstActive) {
+
+            KeReleaseInStackQueuedSpinLock(&lockHandle);
+            return;
+        }
+
+        if (scanContextPtr->RequestActive) {
+            scanContextPtr->BurstPending = TRUE;
+            KeReleaseInStackQueuedSpinLock(&lockHandle);
+            return;
+        }
+
+        scanContextPtr->BurstActive = TRUE;
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+    }
+
+    //
+    // Synchronize with the ISR, which continues the burst once the first
+    // read has been started.
+    //
+    WdfInterruptAcquireLock(InterruptContextPtr->WdfInterrupt);
+    NT_ASSERT(InterruptContextPtr->State == TRANSFER_STATE::INVALID);
+    scanContextPtr->CurrentEntry = 0;
+    const bool started = StartNextScanEntry(
+            InterruptContextPtr,
+            KeQueryPerformanceCounter(nullptr).QuadPart);
+    WdfInterruptReleaseLock(InterruptContextPtr->WdfInterrupt);
+
+    if (!started) {
+        BSC_LOG_TRACE("No scan entry is due yet.");
+        FinishScanBurst(InterruptContextPtr);
+    }
+}
+
+//
+// Claims the controller for an SPB request. If a scan burst is running, the
+// request is deferred and dispatched again when the burst completes, and
+// false is returned. SpbCx dispatches requests one at a time, so at most one
+// request is deferred. The deferred request stays cancelable while it waits.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static bool AcquireControllerForRequest (
+    BCM_I2C_INTERRUPT_CONTEXT* InterruptContextPtr,
+    SPBTARGET SpbTarget,
+    SPBREQUEST SpbRequest
+    )
+{
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr = &InterruptContextPtr->ScanContext;
+
+    KLOCK_QUEUE_HANDLE lockHandle;
+    KeAcquireInStackQueuedSpinLock(&scanContextPtr->Lock, &lockHandle);
+
+    NT_ASSERT(!scanContextPtr->RequestActive);
+    if (scanContextPtr->BurstActive) {
+        BSC_LOG_TRACE(
+            "Scan burst is running, deferring request. (SpbRequest = %p)",
+            SpbRequest);
+
+        NT_ASSERT(scanContextPtr->DeferredRequest == WDF_NO_HANDLE);
+        NTSTATUS status = WdfRequestMarkCancelableEx(
+                SpbRequest,
+                OnDeferredRequestCancel);
+        if (!NT_SUCCESS(status)) {
+            KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+            BSC_LOG_INFORMATION(
+                "Failed to mark deferred request cancelable. (SpbRequest = %p, status = %!STATUS!)",
+                SpbRequest,
+                status);
+            SpbRequestComplete(SpbRequest, status);
+            return false;
+        }
+
+        scanContextPtr->DeferredTarget = SpbTarget;
+        scanContextPtr->DeferredRequest = SpbRequest;
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+        return false;
+    }
+
+    scanContextPtr->RequestActive = TRUE;
+    KeReleaseInStackQueuedSpinLock(&lockHandle);
+    return true;
+}
+
+//
+// Releases the controller after the hardware has been reset at the end of
+// an SPB request, and starts a scan burst that came due in the meantime.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static void ReleaseControllerFromRequest (
+    BCM_I2C_INTERRUPT_CONTEXT* InterruptContextPtr
+    )
+{
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr = &InterruptContextPtr->ScanContext;
+
+    bool startBurst;
+    {
+        KLOCK_QUEUE_HANDLE lockHandle;
+        KeAcquireInStackQueuedSpinLock(&scanContextPtr->Lock, &lockHandle);
+
+        NT_ASSERT(scanContextPtr->RequestActive);
+        scanContextPtr->RequestActive = FALSE;
+        startBurst = scanContextPtr->BurstPending != FALSE;
+        scanContextPtr->BurstPending = FALSE;
+
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+    }
+
+    if (startBurst) {
+        StartScanBurst(InterruptContextPtr);
+    }
+}
+
+//
+// Handles interrupts during a scan burst. Each entry is a write of the
+// register address followed by a restart and a read. Entries are chained
+// from the ISR; the DPC only runs once no remaining entry is due.
+//
+static BOOLEAN HandleScanInterrupt (
+    WDFINTERRUPT WdfInterrupt,
+    BCM_I2C_INTERRUPT_CONTEXT* InterruptContextPtr,
+    ULONG StatusReg
+    )
+{
+    BCM_I2C_REGISTERS* registersPtr = InterruptContextPtr->RegistersPtr;
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr = &InterruptContextPtr->ScanContext;
+    BCM_I2C_SCAN_CONTEXT::ENTRY* entryPtr =
+        &scanContextPtr->Entries[scanContextPtr->CurrentEntry];
+    const ULONG transferState = InterruptContextPtr->State;
+
+    switch (transferState) {
+    case TRANSFER_STATE::SCAN_WRITE:
+    case TRANSFER_STATE::SCAN_READ:
+    {
+        if ((StatusReg & (BCM_I2C_REG_STATUS_CLKT | BCM_I2C_REG_STATUS_ERR)) != 0) {
+            BSC_LOG_TRACE(
+                "Scan entry failed. (CurrentEntry = %lu, statusReg = 0x%lx)",
+                scanContextPtr->CurrentEntry,
+                StatusReg);
+
+            RecordScanSample(
+                registersPtr,
+                scanContextPtr,
+                ((StatusReg & BCM_I2C_REG_STATUS_CLKT) != 0) ?
+                    STATUS_IO_TIMEOUT : STATUS_NO_SUCH_DEVICE,
+                KeQueryPerformanceCounter(nullptr).QuadPart);
+
+            if ((StatusReg & BCM_I2C_REG_STATUS_DONE) != 0) {
+
+                // See HandleInterrupt for why TA must be clear before
+                // writing to the control register.
+                WriteBscRegister(
+                    &registersPtr->Status,
+                    BCM_I2C_REG_STATUS_DONE);
+
+                const ULONG tempStatusReg =
+                    ReadBscRegister(&registersPtr->Status);
+
+                if ((tempStatusReg & BCM_I2C_REG_STATUS_TA) != 0) {
+                    InterruptContextPtr->State = TRANSFER_STATE::SCAN_RECOVERING;
+                    return TRUE;
+                }
+            }
             break;
         }
 
-        WRITE_REGISTER_NOFENCE_ULONG(&RegistersPtr->DataFIFO, *dataPtr++);
+        if (transferState == TRANSFER_STATE::SCAN_WRITE) {
+            NT_ASSERT((StatusReg & BCM_I2C_REG_STATUS_TXW) != 0);
+
+            //
+            // Program the read while the write is active, then queue the
+            // register address. The controller issues a restart when the
+            // write completes.
+            //
+            WriteBscRegister(
+                &registersPtr->DataLength,
+                entryPtr->ReadLength);
+            WriteBscRegister(
+                &registersPtr->Control,
+                BCM_I2C_REG_CONTROL_I2CEN |
+                BCM_I2C_REG_CONTROL_ST |
+                BCM_I2C_REG_CONTROL_INTD |
+                BCM_I2C_REG_CONTROL_READ);
+            WriteBscRegister(
+                &registersPtr->DataFIFO,
+                entryPtr->Register);
+
+            InterruptContextPtr->State = TRANSFER_STATE::SCAN_READ;
+            return TRUE;
+        }
+
+        if ((StatusReg & BCM_I2C_REG_STATUS_DONE) == 0) {
+            NT_ASSERT(!"Expecting DONE to be set in SCAN_READ state");
+            return TRUE;
+        }
+
+        RecordScanSample(
+            registersPtr,
+            scanContextPtr,
+            STATUS_SUCCESS,
+            KeQueryPerformanceCounter(nullptr).QuadPart);
+        break;
+    }
+    case TRANSFER_STATE::SCAN_RECOVERING:
+        NT_ASSERT((StatusReg & BCM_I2C_REG_STATUS_TA) == 0);
+        break;
+    default:
+        NT_ASSERT(!"Invalid scan TRANSFER_STATE");
+        break;
+    }
+
+    WriteBscRegister(
+        &registersPtr->Control,
+        BCM_I2C_REG_CONTROL_I2CEN |
+        BCM_I2C_REG_CONTROL_CLEAR);
+    WriteBscRegister(
+        &registersPtr->Status,
+        BCM_I2C_REG_STATUS_ERR |
+        BCM_I2C_REG_STATUS_CLKT |
+        BCM_I2C_REG_STATUS_DONE);
+
+    //
+    // Schedule the entry's next read. If the bus could not keep up, skip
+    // the missed periods rather than reading back to back.
+    //
+    const LONGLONG nowTicks = KeQueryPerformanceCounter(nullptr).QuadPart;
+    entryPtr->NextDueTicks += entryPtr->PeriodTicks;
+    if (entryPtr->NextDueTicks <= nowTicks) {
+        entryPtr->NextDueTicks = nowTicks + entryPtr->PeriodTicks;
     }
 
-    ULONG bytesWritten = dataPtr - BufferPtr;
-    BSC_LOG_TRACE(
-        "Wrote %d of %d bytes to TX FIFO",
-        bytesWritten,
-        BufferSize);
+    ++scanContextPtr->CurrentEntry;
+    if (StartNextScanEntry(InterruptContextPtr, nowTicks)) {
+        return TRUE;
+    }
 
-    return bytesWritten;
+    InterruptContextPtr->State = TRANSFER_STATE::SCAN_COMPLETE;
+    WdfInterruptQueueDpcForIsr(WdfInterrupt);
+    return TRUE;
 }
 
 _Use_decl_annotations_
@@ -338,10 +899,19 @@ VOID OnRead (
         readBufferPtr,
         bytesToRead);
 
+    // wait for a running scan burst to complete
+    if (!AcquireControllerForRequest(
+            devicePtr->InterruptContextPtr,
+            SpbTarget,
+            SpbRequest)) {
+
+        return;
+    }
+
     InitializeTransfer(registersPtr, targetPtr, bytesToRead);
 
     // Start transfer
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->Control,
         BCM_I2C_REG_CONTROL_I2CEN |
         BCM_I2C_REG_CONTROL_ST |
@@ -380,6 +950,7 @@ VOID OnRead (
             status);
 
         ResetHardwareAndRequestContext(interruptContextPtr);
+        ReleaseControllerFromRequest(interruptContextPtr);
         SpbRequestComplete(SpbRequest, status);
         return;
     }
@@ -445,10 +1016,19 @@ VOID OnWrite (
         writeBufferPtr,
         bytesToWrite);
 
+    // wait for a running scan burst to complete
+    if (!AcquireControllerForRequest(
+            devicePtr->InterruptContextPtr,
+            SpbTarget,
+            SpbRequest)) {
+
+        return;
+    }
+
     InitializeTransfer(registersPtr, targetPtr, bytesToWrite);
 
     // Start transfer
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->Control,
         BCM_I2C_REG_CONTROL_I2CEN |
         BCM_I2C_REG_CONTROL_ST |
@@ -495,334 +1075,553 @@ VOID OnWrite (
             status);
 
         ResetHardwareAndRequestContext(interruptContextPtr);
+        ReleaseControllerFromRequest(interruptContextPtr);
         SpbRequestComplete(SpbRequest, status);
         return;
     }
 }
 
 //
-// Does the initial write of a sequence transfer.
+// Starts the first transfer of a sequence. The rest of the sequence is
+// streamed from the ISR.
 //
 _IRQL_requires_max_(DISPATCH_LEVEL)
-NTSTATUS StartSequenceWrite ( BCM_I2C_INTERRUPT_CONTEXT* InterruptContextPtr )
+NTSTATUS StartSequence ( BCM_I2C_INTERRUPT_CONTEXT* InterruptContextPtr )
 {
     BCM_I2C_ASSERT_MAX_IRQL(DISPATCH_LEVEL);
 
-    NTSTATUS status;
     BCM_I2C_INTERRUPT_CONTEXT::SEQUENCE_CONTEXT* sequenceContextPtr =
         &InterruptContextPtr->SequenceContext;
     BCM_I2C_REGISTERS* registersPtr = InterruptContextPtr->RegistersPtr;
-    SPBREQUEST spbRequest = InterruptContextPtr->SpbRequest;
+    const BCM_I2C_INTERRUPT_CONTEXT::SEQUENCE_TRANSFER* transferPtr =
+        &sequenceContextPtr->Transfers[0];
 
-    NT_ASSERT(InterruptContextPtr->State == TRANSFER_STATE::SENDING_SEQUENCE);
-    NT_ASSERT(sequenceContextPtr->BytesToWrite != 0);
+    NT_ASSERT(sequenceContextPtr->CurrentTransfer == 0);
+    NT_ASSERT(sequenceContextPtr->BytesRemaining == transferPtr->Length);
 
-    if (sequenceContextPtr->BytesToWrite == 1) {
-        BSC_LOG_TRACE(
-            "Transmit buffer is length 1; waiting for transfer to become active and then setting up the read. (bytesToRead = %lu)",
-            sequenceContextPtr->BytesToRead);
-
-        //
-        // Synchronize with the cancellation routine which also modifies
-        // hardware state
-        //
-        KLOCK_QUEUE_HANDLE lockHandle;
-        KeAcquireInStackQueuedSpinLock(
-            &InterruptContextPtr->CancelLock,
-            &lockHandle);
+    InitializeTransfer(
+        registersPtr,
+        InterruptContextPtr->TargetPtr,
+        transferPtr->Length);
 
-        status = WaitForTransferActive(registersPtr);
-        if (!NT_SUCCESS(status)) {
-            BSC_LOG_ERROR(
-                "The transfer failed to become active. (status = %!STATUS!)",
-                status);
+    if (transferPtr->IsRead) {
+        NT_ASSERT(sequenceContextPtr->TransferCount == 1);
+        BSC_LOG_TRACE("Sequence is a single read, enabling RXR interrupt.");
 
-            KeReleaseInStackQueuedSpinLock(&lockHandle);
-            return status;
-        }
+        InterruptContextPtr->State = TRANSFER_STATE::RECEIVING_SEQUENCE;
 
-        //
-        // This lock prevents preemption by the ISR when queuing the first
-        // byte to the data FIFO. The control register cannot be written to
-        // again after the read is programmed, so interrupts must be enabled in
-        // the same register operation.
-        //
-        {
-            WdfInterruptAcquireLock(InterruptContextPtr->WdfInterrupt);
+        // start transfer
+        WriteBscRegister(
+            &registersPtr->Control,
+            BCM_I2C_REG_CONTROL_I2CEN |
+            BCM_I2C_REG_CONTROL_ST |
+            BCM_I2C_REG_CONTROL_CLEAR |
+            BCM_I2C_REG_CONTROL_READ);
 
-            WRITE_REGISTER_NOFENCE_ULONG(
-                &registersPtr->DataLength,
-                sequenceContextPtr->BytesToRead);
-            WRITE_REGISTER_NOFENCE_ULONG(
-                &registersPtr->Control,
+        return MarkRequestCancelableAndUpdateControlRegisterSynchronized(
+                InterruptContextPtr,
+                InterruptContextPtr->SpbRequest,
                 BCM_I2C_REG_CONTROL_I2CEN |
-                BCM_I2C_REG_CONTROL_ST |
                 BCM_I2C_REG_CONTROL_INTR |
                 BCM_I2C_REG_CONTROL_INTD |
                 BCM_I2C_REG_CONTROL_READ);
+    }
 
-            // write first and only byte to FIFO
-            NT_ASSERT(
-                sequenceContextPtr->CurrentWriteMdl->MdlFlags &
-               (MDL_MAPPED_TO_SYSTEM_VA | MDL_SOURCE_IS_NONPAGED_POOL));
-            WRITE_REGISTER_NOFENCE_ULONG(
-                &registersPtr->DataFIFO,
-                *static_cast<const BYTE*>(
-                    sequenceContextPtr->CurrentWriteMdl->MappedSystemVa));
-            ++sequenceContextPtr->BytesWritten;
-            ++sequenceContextPtr->CurrentWriteMdlOffset;
+    // start transfer
+    WriteBscRegister(
+        &registersPtr->Control,
+        BCM_I2C_REG_CONTROL_I2CEN |
+        BCM_I2C_REG_CONTROL_ST |
+        BCM_I2C_REG_CONTROL_CLEAR);
 
-            NT_ASSERT(
-                sequenceContextPtr->BytesWritten ==
-                sequenceContextPtr->BytesToWrite);
-            NT_ASSERT(sequenceContextPtr->CurrentWriteMdlOffset == 1);
+    //
+    // The next transfer is programmed from the TXW interrupt, which is only
+    // asserted while the write is active and needs more data. Holding back
+    // the last byte of the write guarantees that it is still active when the
+    // restart is programmed. This also covers a write of length 1, for which
+    // nothing is queued here and the first TXW interrupt indicates that the
+    // transfer has become active.
+    //
+    const ULONG bytesToQueue = (sequenceContextPtr->TransferCount == 1) ?
+        sequenceContextPtr->BytesRemaining :
+        (sequenceContextPtr->BytesRemaining - 1);
+
+    if (bytesToQueue != 0) {
+        WriteFifoSequence(registersPtr, sequenceContextPtr, bytesToQueue);
+    }
+
+    BSC_LOG_TRACE(
+        "Queued initial write of sequence, enabling TXW interrupt. (BytesRemaining = %lu)",
+        sequenceContextPtr->BytesRemaining);
+
+    InterruptContextPtr->State = (sequenceContextPtr->BytesRemaining == 0) ?
+        TRANSFER_STATE::SENDING_SEQUENCE_WAIT_FOR_DONE :
+        TRANSFER_STATE::SENDING_SEQUENCE;
+
+    return MarkRequestCancelableAndUpdateControlRegisterSynchronized(
+            InterruptContextPtr,
+            InterruptContextPtr->SpbRequest,
+            BCM_I2C_REG_CONTROL_I2CEN |
+            BCM_I2C_REG_CONTROL_INTT |
+            BCM_I2C_REG_CONTROL_INTD);
+}
+
+//
+// The Broadcom I2C controller can only issue a restart while a write is
+// active, so any number of writes can be chained but a read must be the last
+// transfer of a sequence.
+//
+_Use_decl_annotations_
+VOID OnSequence (
+    WDFDEVICE WdfDevice,
+    SPBTARGET SpbTarget,
+    SPBREQUEST SpbRequest,
+    ULONG TransferCount
+    )
+{
+    BCM_I2C_ASSERT_MAX_IRQL(DISPATCH_LEVEL);
+
+    if ((TransferCount == 0) ||
+        (TransferCount > BCM_I2C_MAX_SEQUENCE_TRANSFERS)) {
+
+        BSC_LOG_ERROR(
+            "Unsupported sequence attempted. (TransferCount = %lu, BCM_I2C_MAX_SEQUENCE_TRANSFERS = %lu)",
+            TransferCount,
+            BCM_I2C_MAX_SEQUENCE_TRANSFERS);
+        SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
+        return;
+    }
+
+    BCM_I2C_DEVICE_CONTEXT* devicePtr = GetDeviceContext(WdfDevice);
+    BCM_I2C_INTERRUPT_CONTEXT* interruptContextPtr =
+        devicePtr->InterruptContextPtr;
+    BCM_I2C_INTERRUPT_CONTEXT::SEQUENCE_CONTEXT* sequenceContextPtr =
+        &interruptContextPtr->SequenceContext;
+
+    for (ULONG i = 0; i < TransferCount; ++i) {
+        SPB_TRANSFER_DESCRIPTOR descriptor;
+        PMDL mdl;
+        SPB_TRANSFER_DESCRIPTOR_INIT(&descriptor);
+        SpbRequestGetTransferParameters(
+            SpbRequest,
+            i,
+            &descriptor,
+            &mdl);
+
+        const bool isRead =
+            descriptor.Direction == SpbTransferDirectionFromDevice;
+        if (isRead && ((i + 1) != TransferCount)) {
+            BSC_LOG_ERROR(
+                "Unsupported sequence attempted. Only the last transfer can be a read. (i = %lu, TransferCount = %lu)",
+                i,
+                TransferCount);
+            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
+            return;
+        }
+
+        if (descriptor.TransferLength > BCM_I2C_MAX_TRANSFER_LENGTH) {
+            BSC_LOG_ERROR(
+                "Transfer is too large for DataLength register. (SpbRequest = %p, i = %lu, descriptor.TransferLength = %lu, BCM_I2C_MAX_TRANSFER_LENGTH = %lu)",
+                SpbRequest,
+                i,
+                descriptor.TransferLength,
+                BCM_I2C_MAX_TRANSFER_LENGTH);
+            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
+            return;
+        }
+
+        if (descriptor.DelayInUs != 0) {
+            BSC_LOG_ERROR(
+                "Delays are not supported. (i = %lu, descriptor.DelayInUs = %lu)",
+                i,
+                descriptor.DelayInUs);
+            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
+            return;
+        }
+
+        if ((i != 0) &&
+            ((i + 1) != TransferCount) &&
+            (descriptor.TransferLength < BCM_I2C_MIN_CHAINED_WRITE_LENGTH)) {
+
+            BSC_LOG_ERROR(
+                "Write between two restarts is too short. (i = %lu, descriptor.TransferLength = %lu, BCM_I2C_MIN_CHAINED_WRITE_LENGTH = %lu)",
+                i,
+                descriptor.TransferLength,
+                BCM_I2C_MIN_CHAINED_WRITE_LENGTH);
+            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
+            return;
+        }
+
+        ULONG length = 0;
+        for (PMDL currentMdl = mdl;
+             currentMdl;
+             currentMdl = currentMdl->Next) {
 
-            NT_ASSERT(!sequenceContextPtr->CurrentWriteMdl->Next);
-            sequenceContextPtr->CurrentWriteMdl = nullptr;
-            InterruptContextPtr->State = TRANSFER_STATE::RECEIVING_SEQUENCE;
+            const PVOID ptr = MmGetSystemAddressForMdlSafe(
+                currentMdl,
+                isRead ?
+                (NormalPagePriority | MdlMappingNoExecute) :
+                (NormalPagePriority | MdlMappingNoWrite | MdlMappingNoExecute));
+            if (!ptr) {
+                BSC_LOG_LOW_MEMORY(
+                    "MmGetSystemAddressForMdlSafe() failed. (currentMdl = %p)",
+                    currentMdl);
+                SpbRequestComplete(SpbRequest, STATUS_INSUFFICIENT_RESOURCES);
+                return;
+            }
 
-            WdfInterruptReleaseLock(InterruptContextPtr->WdfInterrupt);
+            NT_ASSERT(MmGetMdlByteCount(currentMdl) != 0);
+            length += MmGetMdlByteCount(currentMdl);
         }
 
-        status = WdfRequestMarkCancelableEx(spbRequest, OnRequestCancel);
+        NT_ASSERT(length == descriptor.TransferLength);
+
+        BCM_I2C_INTERRUPT_CONTEXT::SEQUENCE_TRANSFER* transferPtr =
+            &sequenceContextPtr->Transfers[i];
+        transferPtr->Mdl = mdl;
+        transferPtr->Length = length;
+        transferPtr->IsRead = isRead;
+    }
+
+    //
+    // The transfers are captured into the interrupt context even while a
+    // scan burst is running, since bursts do not use the sequence context.
+    // A deferred request captures them again when it is dispatched.
+    //
+    if (!AcquireControllerForRequest(
+            interruptContextPtr,
+            SpbTarget,
+            SpbRequest)) {
+
+        return;
+    }
+
+    NT_ASSERT(interruptContextPtr->State == TRANSFER_STATE::INVALID);
+
+    {
+        interruptContextPtr->SpbRequest = SpbRequest;
+        interruptContextPtr->TargetPtr = GetTargetContext(SpbTarget);
+        interruptContextPtr->CapturedStatus = 0;
+        interruptContextPtr->CapturedDataLength = 0;
+
+        sequenceContextPtr->TransferCount = TransferCount;
+        sequenceContextPtr->CurrentTransfer = 0;
+        sequenceContextPtr->CurrentMdl = sequenceContextPtr->Transfers[0].Mdl;
+        sequenceContextPtr->CurrentMdlOffset = 0;
+        sequenceContextPtr->BytesRemaining =
+            sequenceContextPtr->Transfers[0].Length;
+        sequenceContextPtr->BytesTransferred = 0;
+    }
+
+    BSC_LOG_TRACE(
+        "Setting up and starting sequence. (Address = 0x%x, ConnectionSpeed = %lu, TransferCount = %lu)",
+        interruptContextPtr->TargetPtr->Address,
+        interruptContextPtr->TargetPtr->ConnectionSpeed,
+        TransferCount);
+
+    NTSTATUS status = StartSequence(interruptContextPtr);
+    if (!NT_SUCCESS(status)) {
+        BSC_LOG_ERROR(
+            "Failed to start the sequence transfer. (status = %!STATUS!)",
+            status);
+
+        ResetHardwareAndRequestContext(interruptContextPtr);
+        ReleaseControllerFromRequest(interruptContextPtr);
+        SpbRequestComplete(SpbRequest, status);
+        return;
+    }
+}
+
+//
+// Replaces the scan table with the one in the request. All entries are due
+// immediately. Called while the request owns the controller, so no burst is
+// using the table.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static NTSTATUS StartScan (
+    BCM_I2C_INTERRUPT_CONTEXT* InterruptContextPtr,
+    SPBTARGET SpbTarget,
+    SPBREQUEST SpbRequest
+    )
+{
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr = &InterruptContextPtr->ScanContext;
+
+    const BCM_I2C_SCAN_TABLE* tablePtr;
+    {
+        PVOID inputBufferPtr;
+        size_t inputBufferLength;
+        NTSTATUS status = WdfRequestRetrieveInputBuffer(
+                SpbRequest,
+                sizeof(BCM_I2C_SCAN_TABLE),
+                &inputBufferPtr,
+                &inputBufferLength);
         if (!NT_SUCCESS(status)) {
-            BSC_LOG_INFORMATION(
-                "Failed to mark request cancelable. (spbRequest = %p, status = %!STATUS!)",
-                spbRequest,
+            BSC_LOG_ERROR(
+                "Failed to retrieve input buffer from request. (SpbRequest = %p, status = %!STATUS!)",
+                SpbRequest,
                 status);
+            return status;
+        }
+
+        tablePtr = static_cast<const BCM_I2C_SCAN_TABLE*>(inputBufferPtr);
+        if ((tablePtr->EntryCount == 0) ||
+            (tablePtr->EntryCount > BCM_I2C_SCAN_MAX_ENTRIES) ||
+            (inputBufferLength < (FIELD_OFFSET(BCM_I2C_SCAN_TABLE, Entries) +
+                tablePtr->EntryCount * sizeof(BCM_I2C_SCAN_ENTRY)))) {
+
+            BSC_LOG_ERROR(
+                "Invalid scan table size. (EntryCount = %lu, inputBufferLength = %lu, BCM_I2C_SCAN_MAX_ENTRIES = %lu)",
+                tablePtr->EntryCount,
+                inputBufferLength,
+                BCM_I2C_SCAN_MAX_ENTRIES);
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    //
+    // A connection may only poll its own slave, like any other request made
+    // through it.
+    //
+    const BCM_I2C_TARGET_CONTEXT* targetPtr = GetTargetContext(SpbTarget);
+
+    for (ULONG i = 0; i < tablePtr->EntryCount; ++i) {
+        const BCM_I2C_SCAN_ENTRY* entryPtr = &tablePtr->Entries[i];
+        if ((entryPtr->Address != targetPtr->Address) ||
+            (entryPtr->ReadLength == 0) ||
+            (entryPtr->ReadLength > BCM_I2C_SCAN_MAX_READ_LENGTH) ||
+            (entryPtr->PeriodUs < BCM_I2C_SCAN_MIN_PERIOD_US)) {
+
+            BSC_LOG_ERROR(
+                "Invalid scan entry. (i = %lu, Address = 0x%x, ReadLength = %lu, PeriodUs = %lu)",
+                i,
+                entryPtr->Address,
+                entryPtr->ReadLength,
+                entryPtr->PeriodUs);
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    {
+        KLOCK_QUEUE_HANDLE lockHandle;
+        KeAcquireInStackQueuedSpinLock(&scanContextPtr->Lock, &lockHandle);
+
+        const SPBTARGET ownerTarget = scanContextPtr->OwnerTarget;
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+        if ((ownerTarget != WDF_NO_HANDLE) && (ownerTarget != SpbTarget)) {
+            BSC_LOG_ERROR(
+                "A scan started by another target is running. (OwnerTarget = %p)",
+                ownerTarget);
+            return STATUS_DEVICE_BUSY;
+        }
+    }
+
+    // stop the current scan, if any, before replacing the table
+    WdfTimerStop(scanContextPtr->Timer, FALSE);
+
+    LARGE_INTEGER frequency;
+    const LONGLONG nowTicks = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+    for (ULONG i = 0; i < tablePtr->EntryCount; ++i) {
+        const BCM_I2C_SCAN_ENTRY* entryPtr = &tablePtr->Entries[i];
+        BCM_I2C_SCAN_CONTEXT::ENTRY* scanEntryPtr = &scanContextPtr->Entries[i];
+
+        scanEntryPtr->Target.Address = entryPtr->Address;
+        scanEntryPtr->Target.ConnectionSpeed = targetPtr->ConnectionSpeed;
+        scanEntryPtr->Register = entryPtr->Register;
+        scanEntryPtr->ReadLength = entryPtr->ReadLength;
+        scanEntryPtr->PeriodTicks =
+            LONGLONG(entryPtr->PeriodUs) * frequency.QuadPart / 1000000;
+        scanEntryPtr->NextDueTicks = nowTicks;
+    }
+
+    scanContextPtr->EntryCount = tablePtr->EntryCount;
+    scanContextPtr->CurrentEntry = 0;
+    scanContextPtr->PerformanceFrequency = frequency.QuadPart;
+    scanContextPtr->SampleHead = 0;
+    scanContextPtr->SampleCount = 0;
+    scanContextPtr->DroppedSamples = 0;
+
+    BSC_LOG_INFORMATION(
+        "Starting scan. (SpbTarget = %p, EntryCount = %lu)",
+        SpbTarget,
+        scanContextPtr->EntryCount);
 
+    //
+    // The first burst starts as soon as this request releases the
+    // controller.
+    //
+    KLOCK_QUEUE_HANDLE lockHandle;
+    KeAcquireInStackQueuedSpinLock(&scanContextPtr->Lock, &lockHandle);
+    scanContextPtr->OwnerTarget = SpbTarget;
+    scanContextPtr->BurstPending = TRUE;
+    KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Stops the scan. Returns false if SpbTarget does not own the scan.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static bool StopScan (
+    BCM_I2C_SCAN_CONTEXT* ScanContextPtr,
+    SPBTARGET SpbTarget
+    )
+{
+    {
+        KLOCK_QUEUE_HANDLE lockHandle;
+        KeAcquireInStackQueuedSpinLock(&ScanContextPtr->Lock, &lockHandle);
+
+        if (ScanContextPtr->OwnerTarget != SpbTarget) {
             KeReleaseInStackQueuedSpinLock(&lockHandle);
-            return status;
+            return false;
         }
 
+        ScanContextPtr->OwnerTarget = WDF_NO_HANDLE;
+        ScanContextPtr->BurstPending = FALSE;
         KeReleaseInStackQueuedSpinLock(&lockHandle);
-    } else {
-        NT_ASSERT(sequenceContextPtr->BytesToWrite > 1);
-        BSC_LOG_TRACE("Transmit buffer is 2 or greater, writing first byte and enabling TXW interrupt.");
+    }
 
-        // write first byte to FIFO
-        WRITE_REGISTER_NOFENCE_ULONG(
-            &registersPtr->DataFIFO,
-            *static_cast<const BYTE*>(
-                sequenceContextPtr->CurrentWriteMdl->MappedSystemVa));
-        ++sequenceContextPtr->BytesWritten;
-        ++sequenceContextPtr->CurrentWriteMdlOffset;
+    //
+    // A timer callback that is already running finds no owner and returns,
+    // and a burst that is already running does not rearm the timer.
+    //
+    WdfTimerStop(ScanContextPtr->Timer, FALSE);
+
+    BSC_LOG_INFORMATION("Stopped scan. (SpbTarget = %p)", SpbTarget);
+    return true;
+}
+
+//
+// Moves samples from the ring to the request's output buffer, oldest first.
+// Called while the request owns the controller, so the ISR is not writing
+// to the ring.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+static NTSTATUS ReadScanSamples (
+    BCM_I2C_SCAN_CONTEXT* ScanContextPtr,
+    SPBREQUEST SpbRequest,
+    ULONG* InformationPtr
+    )
+{
+    *InformationPtr = 0;
+
+    PVOID outputBufferPtr;
+    size_t outputBufferLength;
+    NTSTATUS status = WdfRequestRetrieveOutputBuffer(
+            SpbRequest,
+            sizeof(BCM_I2C_SCAN_SAMPLES),
+            &outputBufferPtr,
+            &outputBufferLength);
+    if (!NT_SUCCESS(status)) {
+        BSC_LOG_ERROR(
+            "Failed to retrieve output buffer from request. (SpbRequest = %p, status = %!STATUS!)",
+            SpbRequest,
+            status);
+        return status;
+    }
 
-        NT_ASSERT(sequenceContextPtr->BytesWritten == 1);
-        NT_ASSERT(sequenceContextPtr->CurrentWriteMdlOffset == 1);
+    auto samplesPtr = static_cast<BCM_I2C_SCAN_SAMPLES*>(outputBufferPtr);
+    const size_t capacity =
+        (outputBufferLength - FIELD_OFFSET(BCM_I2C_SCAN_SAMPLES, Samples)) /
+        sizeof(BCM_I2C_SCAN_SAMPLE);
+    const ULONG sampleCount = static_cast<ULONG>(
+        min(capacity, size_t(ScanContextPtr->SampleCount)));
 
-        status = MarkRequestCancelableAndUpdateControlRegisterSynchronized(
-                InterruptContextPtr,
-                spbRequest,
-                BCM_I2C_REG_CONTROL_I2CEN |
-                BCM_I2C_REG_CONTROL_INTT |
-                BCM_I2C_REG_CONTROL_INTD);
+    for (ULONG i = 0; i < sampleCount; ++i) {
+        samplesPtr->Samples[i] = ScanContextPtr->Samples[
+            (ScanContextPtr->SampleHead + i) % BCM_I2C_SCAN_RING_SAMPLES];
+    }
 
-        if (!NT_SUCCESS(status)) {
-            BSC_LOG_ERROR(
-                "MarkRequestCancelableAndUpdateControlRegisterSynchronized(...) failed. (SpbRequest = %p, status = %!STATUS!)",
-                spbRequest,
-                status);
+    ScanContextPtr->SampleHead =
+        (ScanContextPtr->SampleHead + sampleCount) % BCM_I2C_SCAN_RING_SAMPLES;
+    ScanContextPtr->SampleCount -= sampleCount;
 
-            return status;
-        }
-    }
+    samplesPtr->SampleCount = sampleCount;
+    samplesPtr->DroppedSamples = ScanContextPtr->DroppedSamples;
+    samplesPtr->PerformanceFrequency = ScanContextPtr->PerformanceFrequency;
+    ScanContextPtr->DroppedSamples = 0;
 
+    *InformationPtr = ULONG(
+        FIELD_OFFSET(BCM_I2C_SCAN_SAMPLES, Samples) +
+        sampleCount * sizeof(BCM_I2C_SCAN_SAMPLE));
     return STATUS_SUCCESS;
 }
 
-//
-// The Broadcom I2C controller does not support arbitrary restarts; it only
-// supports a single WriteRead sequence.
-//
 _Use_decl_annotations_
-VOID OnSequence (
+VOID OnOther (
     WDFDEVICE WdfDevice,
     SPBTARGET SpbTarget,
     SPBREQUEST SpbRequest,
-    ULONG TransferCount
+    size_t /*OutputBufferLength*/,
+    size_t /*InputBufferLength*/,
+    ULONG IoControlCode
     )
 {
     BCM_I2C_ASSERT_MAX_IRQL(DISPATCH_LEVEL);
 
-    if (TransferCount != 2) {
+    switch (IoControlCode) {
+    case IOCTL_BCM_I2C_START_SCAN:
+    case IOCTL_BCM_I2C_STOP_SCAN:
+    case IOCTL_BCM_I2C_READ_SCAN_SAMPLES:
+        break;
+    default:
         BSC_LOG_ERROR(
-            "Unsupported sequence attempted. Broadcom I2C controller only supports WriteRead sequences. (TransferCount = %lu)",
-            TransferCount);
+            "Unsupported IOCTL. (IoControlCode = 0x%lx)",
+            IoControlCode);
         SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
         return;
     }
 
-    SPB_TRANSFER_DESCRIPTOR writeDescriptor;
-    SPB_TRANSFER_DESCRIPTOR readDescriptor;
-    PMDL writeMdl;
-    ULONG bytesToWrite;
-    PMDL readMdl;
-    ULONG bytesToRead;
-    {
-        SPB_TRANSFER_DESCRIPTOR_INIT(&writeDescriptor);
-        SpbRequestGetTransferParameters(
-            SpbRequest,
-            0,
-            &writeDescriptor,
-            &writeMdl);
-
-        // validate first transfer descriptor to make sure it's a write
-        if ((writeDescriptor.Direction != SpbTransferDirectionToDevice)) {
-            BSC_LOG_ERROR(
-                "Unsupported sequence attempted. The first transfer must be a write. (writeDescriptor.Direction = %d)",
-                writeDescriptor.Direction);
-            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
-            return;
-        }
-
-        if (writeDescriptor.TransferLength > BCM_I2C_MAX_TRANSFER_LENGTH) {
-            BSC_LOG_ERROR(
-                "Write buffer is too large. (SpbRequest = %p, writeDescriptor.TransferLength = %lu, BCM_I2C_MAX_TRANSFER_LENGTH = %lu)",
-                SpbRequest,
-                writeDescriptor.TransferLength,
-                BCM_I2C_MAX_TRANSFER_LENGTH);
-            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
-            return;
-        }
-
-        if (writeDescriptor.DelayInUs != 0) {
-            BSC_LOG_ERROR(
-                "Delays are not supported. (writeDescriptor.DelayInUs = %lu)",
-                writeDescriptor.DelayInUs);
-            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
-            return;
-        }
-
-        // validate second transfer descriptor to make sure it's a read
-        SPB_TRANSFER_DESCRIPTOR_INIT(&readDescriptor);
-        SpbRequestGetTransferParameters(
-            SpbRequest,
-            1,
-            &readDescriptor,
-            &readMdl);
-        if (readDescriptor.Direction != SpbTransferDirectionFromDevice) {
-            BSC_LOG_ERROR(
-                "Unsupported sequence attempted. The second transfer must be a read. (readDescriptor.Direction = %d)",
-                readDescriptor.Direction);
-            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
-            return;
-        }
-
-        if (readDescriptor.TransferLength > BCM_I2C_MAX_TRANSFER_LENGTH) {
-            BSC_LOG_ERROR(
-                "Read buffer is too large for DataLength register. (SpbRequest = %p, readDescriptor.TransferLength= %lu, BCM_I2C_MAX_TRANSFER_LENGTH = %lu)",
-                SpbRequest,
-                readDescriptor.TransferLength,
-                BCM_I2C_MAX_TRANSFER_LENGTH);
-            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
-            return;
-        }
-
-        if (readDescriptor.DelayInUs != 0) {
-            BSC_LOG_ERROR(
-                "BCM I2C controller is not capable of having a delay in a read transaction. (readDescriptor.DelayInUs = %lu)",
-                readDescriptor.DelayInUs);
-            SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
-            return;
-        }
-
-        bytesToWrite = 0;
-        for (PMDL currentMdl = writeMdl;
-             currentMdl;
-             currentMdl = currentMdl->Next) {
-
-            const PVOID ptr = MmGetSystemAddressForMdlSafe(
-                currentMdl,
-                NormalPagePriority | MdlMappingNoWrite | MdlMappingNoExecute);
-            if (!ptr) {
-                BSC_LOG_LOW_MEMORY(
-                    "MmGetSystemAddressForMdlSafe() failed. (currentMdl = %p)",
-                    currentMdl);
-                SpbRequestComplete(SpbRequest, STATUS_INSUFFICIENT_RESOURCES);
-                return;
-            }
-            NT_ASSERT(MmGetMdlByteCount(currentMdl) != 0);
-            bytesToWrite += MmGetMdlByteCount(currentMdl);
-        }
-
-        NT_ASSERT(bytesToWrite == writeDescriptor.TransferLength);
-
-        bytesToRead = 0;
-        for (PMDL currentMdl = readMdl;
-             currentMdl;
-             currentMdl = currentMdl->Next) {
-
-            PVOID ptr = MmGetSystemAddressForMdlSafe(
-                currentMdl,
-                NormalPagePriority | MdlMappingNoExecute);
-            if (!ptr) {
-                BSC_LOG_LOW_MEMORY(
-                    "MmGetSystemAddressForMdlSafe() failed. (currentMdl = %p)",
-                    currentMdl);
-                SpbRequestComplete(SpbRequest, STATUS_INSUFFICIENT_RESOURCES);
-                return;
-            }
+    BCM_I2C_INTERRUPT_CONTEXT* interruptContextPtr =
+        GetDeviceContext(WdfDevice)->InterruptContextPtr;
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr = &interruptContextPtr->ScanContext;
 
-            NT_ASSERT(MmGetMdlByteCount(currentMdl) != 0);
-            bytesToRead += MmGetMdlByteCount(currentMdl);
-        }
+    // the scan table and sample ring are only accessed between bursts
+    if (!AcquireControllerForRequest(
+            interruptContextPtr,
+            SpbTarget,
+            SpbRequest)) {
 
-        NT_ASSERT(bytesToRead == readDescriptor.TransferLength);
+        return;
     }
 
-    BCM_I2C_DEVICE_CONTEXT* devicePtr = GetDeviceContext(WdfDevice);
-    BCM_I2C_INTERRUPT_CONTEXT* interruptContextPtr;
-    {
-        interruptContextPtr = devicePtr->InterruptContextPtr;
-        interruptContextPtr->SpbRequest = SpbRequest;
-        interruptContextPtr->TargetPtr = GetTargetContext(SpbTarget);
-        interruptContextPtr->State = TRANSFER_STATE::SENDING_SEQUENCE;
-        interruptContextPtr->CapturedStatus = 0;
-        interruptContextPtr->CapturedDataLength = 0;
-
-        BCM_I2C_INTERRUPT_CONTEXT::SEQUENCE_CONTEXT* sequenceContextPtr =
-            &interruptContextPtr->SequenceContext;
-        sequenceContextPtr->CurrentWriteMdl = writeMdl;
-        sequenceContextPtr->BytesToWrite = bytesToWrite;
-        sequenceContextPtr->BytesWritten = 0;
-        sequenceContextPtr->CurrentWriteMdlOffset = 0;
-
-        sequenceContextPtr->CurrentReadMdl = readMdl;
-        sequenceContextPtr->BytesToRead = bytesToRead;
-        sequenceContextPtr->BytesRead = 0;
-        sequenceContextPtr->CurrentReadMdlOffset = 0;
+    NTSTATUS status;
+    ULONG information = 0;
+    switch (IoControlCode) {
+    case IOCTL_BCM_I2C_START_SCAN:
+        status = StartScan(interruptContextPtr, SpbTarget, SpbRequest);
+        break;
+    case IOCTL_BCM_I2C_STOP_SCAN:
+        status = StopScan(scanContextPtr, SpbTarget) ?
+            STATUS_SUCCESS : STATUS_INVALID_DEVICE_STATE;
+        break;
+    case IOCTL_BCM_I2C_READ_SCAN_SAMPLES:
+        if (scanContextPtr->OwnerTarget != SpbTarget) {
+            status = STATUS_INVALID_DEVICE_STATE;
+            break;
+        }
+        status = ReadScanSamples(scanContextPtr, SpbRequest, &information);
+        break;
+    default:
+        NT_ASSERT(!"Unexpected IOCTL");
+        status = STATUS_NOT_SUPPORTED;
     }
 
-    BSC_LOG_TRACE(
-        "Setting up and starting Write portion of WriteRead transfer. (Address = 0x%x, ConnectionSpeed = %lu, bytesToWrite = %lu)",
-        interruptContextPtr->TargetPtr->Address,
-        interruptContextPtr->TargetPtr->ConnectionSpeed,
-        bytesToWrite);
-
-    BCM_I2C_REGISTERS* registersPtr = devicePtr->RegistersPtr;
-    InitializeTransfer(
-        registersPtr,
-        interruptContextPtr->TargetPtr,
-        bytesToWrite);
+    ReleaseControllerFromRequest(interruptContextPtr);
 
-    // start transfer
-    WRITE_REGISTER_NOFENCE_ULONG(
-        &registersPtr->Control,
-        BCM_I2C_REG_CONTROL_I2CEN |
-        BCM_I2C_REG_CONTROL_ST |
-        BCM_I2C_REG_CONTROL_CLEAR);
+    WdfRequestSetInformation(SpbRequest, information);
+    SpbRequestComplete(SpbRequest, status);
+}
 
-    NTSTATUS status = StartSequenceWrite(interruptContextPtr);
-    if (!NT_SUCCESS(status)) {
-        BSC_LOG_ERROR(
-            "Failed to do initial write of the sequence transfer. (status = %!STATUS!)",
-            status);
+_Use_decl_annotations_
+VOID OnScanTimer ( WDFTIMER WdfTimer )
+{
+    BCM_I2C_DEVICE_CONTEXT* devicePtr =
+        GetDeviceContext(WdfTimerGetParentObject(WdfTimer));
 
-        ResetHardwareAndRequestContext(interruptContextPtr);
-        SpbRequestComplete(SpbRequest, status);
-        return;
-    }
+    StartScanBurst(devicePtr->InterruptContextPtr);
 }
 
 _Use_decl_annotations_
@@ -868,6 +1667,35 @@ VOID OnRequestCancel ( WDFREQUEST  WdfRequest )
     NT_ASSERT(interruptContextPtr->SpbRequest == WDF_NO_HANDLE);
     WdfInterruptReleaseLock(interruptContextPtr->WdfInterrupt);
 
+    KeReleaseInStackQueuedSpinLock(&lockHandle);
+    ReleaseControllerFromRequest(interruptContextPtr);
+    SpbRequestComplete(static_cast<SPBREQUEST>(WdfRequest), STATUS_CANCELLED);
+}
+
+//
+// Cancels a request while it is deferred behind a scan burst. It does not
+// own the controller yet, so there is no hardware state to reset.
+//
+VOID OnDeferredRequestCancel ( WDFREQUEST WdfRequest )
+{
+    BCM_I2C_ASSERT_MAX_IRQL(DISPATCH_LEVEL);
+
+    BCM_I2C_DEVICE_CONTEXT* devicePtr = GetDeviceContext(WdfFileObjectGetDevice(
+        WdfRequestGetFileObject(WdfRequest)));
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr =
+        &devicePtr->InterruptContextPtr->ScanContext;
+
+    BSC_LOG_INFORMATION(
+        "Cancellation of deferred request requested. (WdfRequest = %p)",
+        WdfRequest);
+
+    KLOCK_QUEUE_HANDLE lockHandle;
+    KeAcquireInStackQueuedSpinLock(&scanContextPtr->Lock, &lockHandle);
+
+    NT_ASSERT(scanContextPtr->DeferredRequest == WdfRequest);
+    scanContextPtr->DeferredTarget = WDF_NO_HANDLE;
+    scanContextPtr->DeferredRequest = WDF_NO_HANDLE;
+
     KeReleaseInStackQueuedSpinLock(&lockHandle);
     SpbRequestComplete(static_cast<SPBREQUEST>(WdfRequest), STATUS_CANCELLED);
 }
@@ -878,7 +1706,7 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
         GetInterruptContext(WdfInterrupt);
     BCM_I2C_REGISTERS* registersPtr = interruptContextPtr->RegistersPtr;
 
-    const ULONG statusReg = READ_REGISTER_NOFENCE_ULONG(&registersPtr->Status);
+    const ULONG statusReg = ReadBscRegister(&registersPtr->Status);
 
 #ifdef DBG
     BSC_LOG_TRACE("Interrupt occurred. (statusReg = 0x%lx)", statusReg);
@@ -902,6 +1730,15 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
         return TRUE;
     }
 
+    if ((transferState >= TRANSFER_STATE::SCAN_WRITE) &&
+        (transferState <= TRANSFER_STATE::SCAN_COMPLETE)) {
+
+        return HandleScanInterrupt(
+            WdfInterrupt,
+            interruptContextPtr,
+            statusReg);
+    }
+
     NT_ASSERTMSG(
         "Expecting a current request",
         interruptContextPtr->SpbRequest != WDF_NO_HANDLE);
@@ -920,11 +1757,11 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
                 statusReg);
         }
 
-        WRITE_REGISTER_NOFENCE_ULONG(
+        WriteBscRegister(
             &registersPtr->Control,
             BCM_I2C_REG_CONTROL_I2CEN);
 
-        WRITE_REGISTER_NOFENCE_ULONG(
+        WriteBscRegister(
             &registersPtr->Status,
             BCM_I2C_REG_STATUS_ERR |
             BCM_I2C_REG_STATUS_CLKT |
@@ -936,7 +1773,7 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
 
     // capture data length before writing to any registers
     const ULONG dataLength =
-            READ_REGISTER_NOFENCE_ULONG(&registersPtr->DataLength);
+            ReadBscRegister(&registersPtr->DataLength);
 
     if ((statusReg & (BCM_I2C_REG_STATUS_CLKT | BCM_I2C_REG_STATUS_ERR)) != 0) {
         BSC_LOG_ERROR(
@@ -960,12 +1797,12 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
             // clearing DONE, wait for DONE to be set again, at which point
             // TA should be cleared.
             //
-            WRITE_REGISTER_NOFENCE_ULONG(
+            WriteBscRegister(
                 &registersPtr->Status,
                 BCM_I2C_REG_STATUS_DONE);
 
             const ULONG tempStatusReg =
-                READ_REGISTER_NOFENCE_ULONG(&registersPtr->Status);
+                ReadBscRegister(&registersPtr->Status);
 
             if ((tempStatusReg & BCM_I2C_REG_STATUS_TA) != 0) {
                 BSC_LOG_TRACE(
@@ -980,11 +1817,11 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
                 tempStatusReg);
         }
 
-        WRITE_REGISTER_NOFENCE_ULONG(
+        WriteBscRegister(
             &registersPtr->Control,
             BCM_I2C_REG_CONTROL_I2CEN);
 
-        WRITE_REGISTER_NOFENCE_ULONG(
+        WriteBscRegister(
             &registersPtr->Status,
             BCM_I2C_REG_STATUS_ERR |
             BCM_I2C_REG_STATUS_CLKT |
@@ -1010,20 +1847,12 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
             "The TXD bit should be set if we're still in the SENDING state",
             (statusReg & BCM_I2C_REG_STATUS_TXD) != 0);
 
-        do {
-            const ULONG tempStatusReg =
-                READ_REGISTER_NOFENCE_ULONG(&registersPtr->Status);
-
-            if ((tempStatusReg & BCM_I2C_REG_STATUS_TXD) == 0) {
-                writeContextPtr->CurrentWriteBufferPtr = dataPtr;
-                return TRUE; // remain in SENDING state
-            }
-
-            WRITE_REGISTER_NOFENCE_ULONG(&registersPtr->DataFIFO, *dataPtr);
-            ++dataPtr;
-        } while (dataPtr != endPtr);
-
+        dataPtr += WriteFifo(registersPtr, dataPtr, ULONG(endPtr - dataPtr));
         writeContextPtr->CurrentWriteBufferPtr = dataPtr;
+        if (dataPtr != endPtr) {
+            return TRUE; // remain in SENDING state
+        }
+
         interruptContextPtr->State = TRANSFER_STATE::SENDING_WAIT_FOR_DONE;
         BSC_LOG_TRACE("Queued all bytes to TX FIFO, advancing to SENDING_WAIT_FOR_DONE state.");
         return TRUE;
@@ -1044,20 +1873,17 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
             (statusReg & BCM_I2C_REG_STATUS_RXD) != 0);
 
         ULONG tempStatusReg;
-        do {
-            tempStatusReg = READ_REGISTER_NOFENCE_ULONG(&registersPtr->Status);
-            if ((tempStatusReg & BCM_I2C_REG_STATUS_RXD) == 0) {
-                readContextPtr->CurrentReadBufferPtr = dataPtr;
-                return TRUE; // remain in RECEIVING state
-            }
-
-            *dataPtr = static_cast<BYTE>(
-                READ_REGISTER_NOFENCE_ULONG(&registersPtr->DataFIFO));
-
-            ++dataPtr;
-        } while (dataPtr != endPtr);
+        dataPtr += ReadFifo(
+            registersPtr,
+            dataPtr,
+            ULONG(endPtr - dataPtr),
+            &tempStatusReg);
 
         readContextPtr->CurrentReadBufferPtr = dataPtr;
+        if (dataPtr != endPtr) {
+            return TRUE; // remain in RECEIVING state
+        }
+
         interruptContextPtr->State = TRANSFER_STATE::RECEIVING_WAIT_FOR_DONE;
         BSC_LOG_TRACE(
             "Read all bytes, advancing to RECEIVING_WAIT_FOR_DONE state (tempStatusReg = 0x%x).",
@@ -1071,80 +1897,54 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
             &interruptContextPtr->SequenceContext;
 
         NT_ASSERTMSG(
-            "CurrentWriteMdl can only be NULL after transitioning to RECEIVING_SEQUENCE state",
-            sequenceContextPtr->CurrentWriteMdl);
+            "The current transfer should be a write in the SENDING_SEQUENCE state",
+            !sequenceContextPtr->Transfers[
+                sequenceContextPtr->CurrentTransfer].IsRead);
 
         NT_ASSERTMSG(
             "The TXD or TXW bit should be set if we're in the SENDING_SEQUENCE state",
             (statusReg & (BCM_I2C_REG_STATUS_TXD | BCM_I2C_REG_STATUS_TXW)) != 0);
 
-        for (;;) {
-            const PMDL currentWriteMdl = sequenceContextPtr->CurrentWriteMdl;
-            NT_ASSERT(sequenceContextPtr->CurrentWriteMdlOffset <=
-                      MmGetMdlByteCount(currentWriteMdl));
-            const ULONG currentMdlBytesRemaining =
-                MmGetMdlByteCount(currentWriteMdl) -
-                sequenceContextPtr->CurrentWriteMdlOffset;
-
-            // if this is the last MDL, write all but the last byte
-            ULONG currentMdlBytesToWrite = currentWriteMdl->Next ?
-                currentMdlBytesRemaining : (currentMdlBytesRemaining - 1);
-            NT_ASSERT(
-                currentWriteMdl->MdlFlags &
-                (MDL_MAPPED_TO_SYSTEM_VA | MDL_SOURCE_IS_NONPAGED_POOL));
-            ULONG bytesWritten = WriteFifo(
-                registersPtr,
-                static_cast<const BYTE*>(currentWriteMdl->MappedSystemVa) +
-                    sequenceContextPtr->CurrentWriteMdlOffset,
-                currentMdlBytesToWrite);
-            sequenceContextPtr->BytesWritten += bytesWritten;
-            sequenceContextPtr->CurrentWriteMdlOffset += bytesWritten;
-
-            if (bytesWritten != currentMdlBytesToWrite) {
-                BSC_LOG_TRACE("More bytes exist in current MDL, remaining in SENDING_SEQUENCE state.");
-                NT_ASSERT(
-                    sequenceContextPtr->CurrentWriteMdlOffset <
-                    MmGetMdlByteCount(currentWriteMdl));
-                return TRUE;
-            }
+        const ULONG nextTransfer = sequenceContextPtr->CurrentTransfer + 1;
+        const bool isLastTransfer =
+            nextTransfer == sequenceContextPtr->TransferCount;
 
-            // when there is exactly one byte left to write, program the read
-            if ((sequenceContextPtr->BytesWritten + 1) ==
-                 sequenceContextPtr->BytesToWrite) {
+        // if another transfer follows, write all but the last byte
+        const ULONG bytesToQueue = isLastTransfer ?
+            sequenceContextPtr->BytesRemaining :
+            (sequenceContextPtr->BytesRemaining - 1);
 
-                NT_ASSERT(
-                    (sequenceContextPtr->CurrentWriteMdlOffset + 1) ==
-                    MmGetMdlByteCount(currentWriteMdl));
-                NT_ASSERT(!currentWriteMdl->Next);
-                break;
-            }
+        if ((bytesToQueue != 0) &&
+            (WriteFifoSequence(
+                registersPtr,
+                sequenceContextPtr,
+                bytesToQueue) != bytesToQueue)) {
 
-            BSC_LOG_TRACE(
-                "Exhausted current MDL, advancing to next MDL. (currentWriteMdl = %p, currentWriteMdl->Next = %p)",
-                currentWriteMdl,
-                currentWriteMdl->Next);
-            NT_ASSERT(
-                sequenceContextPtr->CurrentWriteMdlOffset ==
-                MmGetMdlByteCount(currentWriteMdl));
-            NT_ASSERT(currentWriteMdl->Next);
-            sequenceContextPtr->CurrentWriteMdl = currentWriteMdl->Next;
-            sequenceContextPtr->CurrentWriteMdlOffset = 0;
+            BSC_LOG_TRACE("TX FIFO is full, remaining in SENDING_SEQUENCE state.");
+            return TRUE;
+        }
+
+        if (isLastTransfer) {
+            NT_ASSERT(sequenceContextPtr->BytesRemaining == 0);
+            BSC_LOG_TRACE("Queued all bytes to TX FIFO, advancing to SENDING_SEQUENCE_WAIT_FOR_DONE state.");
+            interruptContextPtr->State =
+                TRANSFER_STATE::SENDING_SEQUENCE_WAIT_FOR_DONE;
+            return TRUE;
         }
 
         NT_ASSERTMSG(
             "There should be exactly one more byte to write",
-            (sequenceContextPtr->BytesWritten + 1) ==
-             sequenceContextPtr->BytesToWrite);
+            sequenceContextPtr->BytesRemaining == 1);
 
         BSC_LOG_TRACE("1 byte left to write, checking TXW.");
 
         //
-        // If TXW is not asserted, do not program the read.
-        // Programming the read before TXW is asserted messes up the
+        // If TXW is not asserted, do not program the next transfer.
+        // Programming the next transfer before TXW is asserted messes up the
         // controller's state machine.
         //
         const ULONG tempStatusReg =
-                READ_REGISTER_NOFENCE_ULONG(&registersPtr->Status);
+                ReadBscRegister(&registersPtr->Status);
 
         if ((tempStatusReg & BCM_I2C_REG_STATUS_TXW) == 0) {
             BSC_LOG_TRACE(
@@ -1154,43 +1954,63 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
             return TRUE;
         }
 
+        const BCM_I2C_INTERRUPT_CONTEXT::SEQUENCE_TRANSFER* nextTransferPtr =
+            &sequenceContextPtr->Transfers[nextTransfer];
+
         BSC_LOG_TRACE(
-            "TXW is asserted, programming the Read. (tempStatusReg = 0x%lx)",
-            tempStatusReg);
+            "TXW is asserted, programming the next transfer. (tempStatusReg = 0x%lx, nextTransfer = %lu, IsRead = %d, Length = %lu)",
+            tempStatusReg,
+            nextTransfer,
+            nextTransferPtr->IsRead,
+            nextTransferPtr->Length);
 
-        WRITE_REGISTER_NOFENCE_ULONG(
+        WriteBscRegister(
             &registersPtr->DataLength,
-            sequenceContextPtr->BytesToRead);
+            nextTransferPtr->Length);
 
-        WRITE_REGISTER_NOFENCE_ULONG(
+        //
+        // The control register cannot be written to again until the restart
+        // has taken effect, so the interrupts for the next transfer must be
+        // enabled in the same register operation.
+        //
+        WriteBscRegister(
             &registersPtr->Control,
             BCM_I2C_REG_CONTROL_I2CEN |
             BCM_I2C_REG_CONTROL_ST |
-            BCM_I2C_REG_CONTROL_INTR |
             BCM_I2C_REG_CONTROL_INTD |
-            BCM_I2C_REG_CONTROL_READ);
+            (nextTransferPtr->IsRead ?
+             (BCM_I2C_REG_CONTROL_INTR | BCM_I2C_REG_CONTROL_READ) :
+             BCM_I2C_REG_CONTROL_INTT));
 
         // write the last byte
-        WRITE_REGISTER_NOFENCE_ULONG(
+        WriteBscRegister(
             &registersPtr->DataFIFO,
             *(static_cast<const BYTE*>(
-                sequenceContextPtr->CurrentWriteMdl->MappedSystemVa) +
-            sequenceContextPtr->CurrentWriteMdlOffset));
-
-        ++sequenceContextPtr->BytesWritten;
-        ++sequenceContextPtr->CurrentWriteMdlOffset;
+                sequenceContextPtr->CurrentMdl->MappedSystemVa) +
+            sequenceContextPtr->CurrentMdlOffset));
 
         NT_ASSERT(
-            sequenceContextPtr->BytesWritten ==
-            sequenceContextPtr->BytesToWrite);
-        NT_ASSERT(
-            sequenceContextPtr->CurrentWriteMdlOffset ==
-            MmGetMdlByteCount(sequenceContextPtr->CurrentWriteMdl));
+            (sequenceContextPtr->CurrentMdlOffset + 1) ==
+            MmGetMdlByteCount(sequenceContextPtr->CurrentMdl));
+        NT_ASSERT(!sequenceContextPtr->CurrentMdl->Next);
+
+        sequenceContextPtr->BytesTransferred +=
+            sequenceContextPtr->Transfers[
+                sequenceContextPtr->CurrentTransfer].Length;
+        sequenceContextPtr->CurrentTransfer = nextTransfer;
+        sequenceContextPtr->CurrentMdl = nextTransferPtr->Mdl;
+        sequenceContextPtr->CurrentMdlOffset = 0;
+        sequenceContextPtr->BytesRemaining = nextTransferPtr->Length;
+
+        //
+        // The bytes of a following write are queued from the next TXW
+        // interrupt, so at most one restart is programmed per interrupt.
+        //
+        if (nextTransferPtr->IsRead) {
+            BSC_LOG_TRACE("Transitioning to RECEIVING_SEQUENCE state");
+            interruptContextPtr->State = TRANSFER_STATE::RECEIVING_SEQUENCE;
+        }
 
-        BSC_LOG_TRACE("Transitioning to RECEIVING_SEQUENCE state");
-        NT_ASSERT(!sequenceContextPtr->CurrentWriteMdl->Next);
-        sequenceContextPtr->CurrentWriteMdl = nullptr;
-        interruptContextPtr->State = TRANSFER_STATE::RECEIVING_SEQUENCE;
         return TRUE;
     }
     case TRANSFER_STATE::RECEIVING_SEQUENCE:
@@ -1199,8 +2019,9 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
             &interruptContextPtr->SequenceContext;
 
         NT_ASSERT(
-            !sequenceContextPtr->CurrentWriteMdl &&
-            sequenceContextPtr->CurrentReadMdl);
+            sequenceContextPtr->Transfers[
+                sequenceContextPtr->CurrentTransfer].IsRead &&
+            sequenceContextPtr->CurrentMdl);
 
         NT_ASSERTMSG(
             "The RXD bit should be set if we're in the RECEIVING_SEQUENCE state",
@@ -1210,31 +2031,30 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
         do {
             ULONG bytesRead = ReadFifoMdl(
                 registersPtr,
-                sequenceContextPtr->CurrentReadMdl,
-                sequenceContextPtr->CurrentReadMdlOffset,
+                sequenceContextPtr->CurrentMdl,
+                sequenceContextPtr->CurrentMdlOffset,
                 &tempStatusReg);
-            sequenceContextPtr->BytesRead += bytesRead;
-            sequenceContextPtr->CurrentReadMdlOffset += bytesRead;
+            sequenceContextPtr->BytesRemaining -= bytesRead;
+            sequenceContextPtr->CurrentMdlOffset += bytesRead;
 
-            if (sequenceContextPtr->CurrentReadMdlOffset !=
-                MmGetMdlByteCount(sequenceContextPtr->CurrentReadMdl)) {
+            if (sequenceContextPtr->CurrentMdlOffset !=
+                MmGetMdlByteCount(sequenceContextPtr->CurrentMdl)) {
 
                 BSC_LOG_TRACE("More bytes exist in current MDL, remaining in RECEIVING_SEQUENCE state");
                 return TRUE;
             }
 
             BSC_LOG_TRACE(
-                "Read all bytes in current MDL, advancing to next MDL. (interruptContextPtr->CurrentReadMdl = %p, interruptContextPtr->CurrentReadMdl->Next = %p)",
-                sequenceContextPtr->CurrentReadMdl,
-                sequenceContextPtr->CurrentReadMdl->Next);
+                "Read all bytes in current MDL, advancing to next MDL. (CurrentMdl = %p, CurrentMdl->Next = %p)",
+                sequenceContextPtr->CurrentMdl,
+                sequenceContextPtr->CurrentMdl->Next);
 
-            NT_ASSERT(sequenceContextPtr->CurrentReadMdlOffset ==
-                      MmGetMdlByteCount(sequenceContextPtr->CurrentReadMdl));
-            sequenceContextPtr->CurrentReadMdl =
-                sequenceContextPtr->CurrentReadMdl->Next;
-            sequenceContextPtr->CurrentReadMdlOffset = 0;
-        } while (sequenceContextPtr->CurrentReadMdl);
+            sequenceContextPtr->CurrentMdl =
+                sequenceContextPtr->CurrentMdl->Next;
+            sequenceContextPtr->CurrentMdlOffset = 0;
+        } while (sequenceContextPtr->CurrentMdl);
 
+        NT_ASSERT(sequenceContextPtr->BytesRemaining == 0);
         BSC_LOG_TRACE(
             "All bytes were received, going to RECEIVING_SEQUENCE_WAIT_FOR_DONE state. (tempStatusReg = 0x%x)",
             tempStatusReg);
@@ -1244,6 +2064,7 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
     }
     case TRANSFER_STATE::SENDING_WAIT_FOR_DONE:
     case TRANSFER_STATE::RECEIVING_WAIT_FOR_DONE:
+    case TRANSFER_STATE::SENDING_SEQUENCE_WAIT_FOR_DONE:
     case TRANSFER_STATE::RECEIVING_SEQUENCE_WAIT_FOR_DONE:
     {
         if ((statusReg & BCM_I2C_REG_STATUS_DONE) == 0) {
@@ -1259,11 +2080,11 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
     }
     default:
         NT_ASSERT(!"Invalid TRANSFER_STATE");
-        WRITE_REGISTER_NOFENCE_ULONG(
+        WriteBscRegister(
             &registersPtr->Control,
             BCM_I2C_REG_CONTROL_I2CEN |
             BCM_I2C_REG_CONTROL_CLEAR);
-        WRITE_REGISTER_NOFENCE_ULONG(
+        WriteBscRegister(
             &registersPtr->Status,
             BCM_I2C_REG_STATUS_ERR |
             BCM_I2C_REG_STATUS_CLKT |
@@ -1292,8 +2113,8 @@ BOOLEAN HandleInterrupt ( WDFINTERRUPT WdfInterrupt )
         break;
     }
 
-    WRITE_REGISTER_NOFENCE_ULONG(&registersPtr->Control, controlReg);
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(&registersPtr->Control, controlReg);
+    WriteBscRegister(
         &registersPtr->Status,
         BCM_I2C_REG_STATUS_ERR |
         BCM_I2C_REG_STATUS_CLKT |
@@ -1340,17 +2161,11 @@ NTSTATUS ProcessRequestCompletion (
 
     switch (transferState) {
     case TRANSFER_STATE::SENDING: __fallthrough;
-    case TRANSFER_STATE::SENDING_WAIT_FOR_DONE: __fallthrough;
-    case TRANSFER_STATE::SENDING_SEQUENCE:
+    case TRANSFER_STATE::SENDING_WAIT_FOR_DONE:
     {
-        ULONG bytesToWrite;
-        if (transferState == TRANSFER_STATE::SENDING_SEQUENCE) {
-            bytesToWrite = InterruptContextPtr->SequenceContext.BytesToWrite;
-        } else {
-            bytesToWrite =
-                InterruptContextPtr->WriteContext.EndPtr -
-                InterruptContextPtr->WriteContext.WriteBufferPtr;
-        }
+        const ULONG bytesToWrite =
+            InterruptContextPtr->WriteContext.EndPtr -
+            InterruptContextPtr->WriteContext.WriteBufferPtr;
 
         if (InterruptContextPtr->CapturedDataLength > bytesToWrite) {
             BSC_LOG_ERROR(
@@ -1434,41 +2249,75 @@ NTSTATUS ProcessRequestCompletion (
             readContextPtr->ReadBufferPtr;
         return STATUS_SUCCESS;
     }
+    case TRANSFER_STATE::SENDING_SEQUENCE:
+    case TRANSFER_STATE::SENDING_SEQUENCE_WAIT_FOR_DONE:
     case TRANSFER_STATE::RECEIVING_SEQUENCE:
     case TRANSFER_STATE::RECEIVING_SEQUENCE_WAIT_FOR_DONE:
     {
         const BCM_I2C_INTERRUPT_CONTEXT::SEQUENCE_CONTEXT* sequenceContextPtr =
                 &InterruptContextPtr->SequenceContext;
+        const BCM_I2C_INTERRUPT_CONTEXT::SEQUENCE_TRANSFER* transferPtr =
+                &sequenceContextPtr->Transfers[
+                    sequenceContextPtr->CurrentTransfer];
 
-        NT_ASSERTMSG(
-            "We should only reach the RECEIVING_SEQUENCE state if the entire write buffer was queued",
-            !sequenceContextPtr->CurrentWriteMdl &&
-            (sequenceContextPtr->BytesWritten ==
-             sequenceContextPtr->BytesToWrite));
-
-        //
-        // Due to the requirement that the read must be queued before the write
-        // completes, the write FIFO could still have data in it that was never
-        // sent, and reading from the FIFO would give us back our unsent write
-        // buffer. We must check for this condition before reading from the
-        // FIFO. If one of the error bits is set, the transfer most likely
-        // failed during the write portion.
-        //
         if (capturedStatus & BCM_I2C_REG_STATUS_CLKT) {
             BSC_LOG_ERROR("CLKT was set - completing request with STATUS_IO_TIMEOUT.");
             *RequestInformationPtr = 0;
             return STATUS_IO_TIMEOUT;
+        } else if ((capturedStatus & BCM_I2C_REG_STATUS_ERR) &&
+                   (sequenceContextPtr->CurrentTransfer == 0)) {
+
+            //
+            // No restart was programmed, so DataLength still counts the
+            // first transfer.
+            //
+            if (transferPtr->IsRead) {
+                BSC_LOG_ERROR("ERR bit was set - completing request with STATUS_NO_SUCH_DEVICE.");
+                *RequestInformationPtr = 0;
+                return STATUS_NO_SUCH_DEVICE;
+            }
+
+            if (InterruptContextPtr->CapturedDataLength > transferPtr->Length) {
+                BSC_LOG_ERROR(
+                    "Controller reported more bytes remaining than we programmed into the DataLength register. (InterruptContextPtr->CapturedDataLength = %lu, transferPtr->Length = %lu)",
+                    InterruptContextPtr->CapturedDataLength,
+                    transferPtr->Length);
+                *RequestInformationPtr = 0;
+                return STATUS_INTERNAL_ERROR;
+            }
+
+            const ULONG bytesSent =
+                transferPtr->Length - InterruptContextPtr->CapturedDataLength;
+            if (bytesSent == 0) {
+                BSC_LOG_ERROR(
+                    "Error bit of status register is set and no bytes were transferred, completing request with STATUS_NO_SUCH_DEVICE. (statusReg = 0x%lx)",
+                    capturedStatus);
+                *RequestInformationPtr = 0;
+                return STATUS_NO_SUCH_DEVICE;
+            }
+
+            BSC_LOG_ERROR("The slave NACKed the first write before all bytes were sent - partial transfer.");
+            *RequestInformationPtr = bytesSent - 1;
+            return STATUS_SUCCESS;
         } else if (capturedStatus & BCM_I2C_REG_STATUS_ERR) {
+
+            //
+            // Due to the requirement that the next transfer must be queued
+            // before the previous write completes, the write FIFO could still
+            // have data in it that was never sent, and reading from the FIFO
+            // would give us back our unsent write buffer. If one of the error
+            // bits is set, the transfer most likely failed during a write.
+            //
             if (!(capturedStatus & BCM_I2C_REG_STATUS_DONE) ||
                  (InterruptContextPtr->CapturedDataLength == 0)) {
 
                 //
                 // It is not possible to tell exactly how many bytes were
                 // transferred in this case because DataLength was
-                // necessarily clobberred when the read was queued.
+                // necessarily clobberred when the next transfer was queued.
                 // Report a partial transfer of 0 bytes.
                 //
-                BSC_LOG_ERROR("The write was NAKed before all bytes could be transmitted - partial transfer.");
+                BSC_LOG_ERROR("A write was NAKed before all bytes could be transmitted - partial transfer.");
                 *RequestInformationPtr = 0;
                 return STATUS_SUCCESS;
             } else {
@@ -1479,11 +2328,13 @@ NTSTATUS ProcessRequestCompletion (
         }
 
         NT_ASSERTMSG(
-            "If none of the error bits were set, all bytes should have been received",
-            sequenceContextPtr->BytesRead == sequenceContextPtr->BytesToRead);
+            "If none of the error bits were set, all transfers should have completed",
+            ((sequenceContextPtr->CurrentTransfer + 1) ==
+             sequenceContextPtr->TransferCount) &&
+            (sequenceContextPtr->BytesRemaining == 0));
 
-        *RequestInformationPtr = sequenceContextPtr->BytesWritten +
-            sequenceContextPtr->BytesRead;
+        *RequestInformationPtr =
+            sequenceContextPtr->BytesTransferred + transferPtr->Length;
         return STATUS_SUCCESS;
     }
     default:
@@ -1507,12 +2358,18 @@ VOID OnInterruptDpc (WDFINTERRUPT WdfInterrupt, WDFOBJECT /*WdfDevice*/)
 
     NT_ASSERTMSG(
         "Interrupts should be disabled when the DPC is invoked",
-        (READ_REGISTER_NOFENCE_ULONG(
+        (ReadBscRegister(
             &interruptContextPtr->RegistersPtr->Control) &
          (BCM_I2C_REG_CONTROL_INTD |
           BCM_I2C_REG_CONTROL_INTT |
           BCM_I2C_REG_CONTROL_INTR)) == 0);
 
+    if (interruptContextPtr->State == TRANSFER_STATE::SCAN_COMPLETE) {
+        interruptContextPtr->State = TRANSFER_STATE::INVALID;
+        FinishScanBurst(interruptContextPtr);
+        return;
+    }
+
     //
     // Synchronize with cancellation routine which may also be trying to
     // complete the request.
@@ -1549,6 +2406,8 @@ VOID OnInterruptDpc (WDFINTERRUPT WdfInterrupt, WDFOBJECT /*WdfDevice*/)
 
             interruptContextPtr->SpbRequest = WDF_NO_HANDLE;
             KeReleaseInStackQueuedSpinLock(&lockHandle);
+            ResetHardwareAndRequestContext(interruptContextPtr);
+            ReleaseControllerFromRequest(interruptContextPtr);
             SpbRequestComplete(spbRequest, status);
             return;
         }
@@ -1568,6 +2427,7 @@ VOID OnInterruptDpc (WDFINTERRUPT WdfInterrupt, WDFOBJECT /*WdfDevice*/)
     // error recovery and to prevent data leakage.
     //
     ResetHardwareAndRequestContext(interruptContextPtr);
+    ReleaseControllerFromRequest(interruptContextPtr);
 
     BSC_LOG_INFORMATION(
         "Completing request. (spbRequest = %p, information = %lu, status = %!STATUS!)",
@@ -1643,10 +2503,10 @@ NTSTATUS OnPrepareHardware (
 
     // Disable and acknowledge interrupts before entering D0 state to prevent
     // spurious interrupts.
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->Control,
         BCM_I2C_REG_CONTROL_CLEAR);
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->Status,
         BCM_I2C_REG_STATUS_DONE |
         BCM_I2C_REG_STATUS_ERR |
@@ -1695,26 +2555,26 @@ NTSTATUS OnD0Entry (
     BCM_I2C_DEVICE_CONTEXT* devicePtr = GetDeviceContext(WdfDevice);
     BCM_I2C_REGISTERS* registersPtr = devicePtr->RegistersPtr;
 
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->Control,
         BCM_I2C_REG_CONTROL_I2CEN |
         BCM_I2C_REG_CONTROL_CLEAR);
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->Status,
         BCM_I2C_REG_STATUS_DONE |
         BCM_I2C_REG_STATUS_ERR |
         BCM_I2C_REG_STATUS_CLKT);
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->ClockDivider,
         BCM_I2C_REG_CDIV_DEFAULT);
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->DataDelay,
         BCM_I2C_REG_DEL_DEFAULT);
 
     NT_ASSERT(
         (devicePtr->ClockStretchTimeout & BCM_I2C_REG_CLKT_TOUT_MASK) ==
          devicePtr->ClockStretchTimeout);
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->ClockStretchTimeout,
         devicePtr->ClockStretchTimeout);
 
@@ -1733,10 +2593,40 @@ NTSTATUS OnD0Exit (
     BCM_I2C_DEVICE_CONTEXT* devicePtr = GetDeviceContext(WdfDevice);
     BCM_I2C_REGISTERS* registersPtr = devicePtr->RegistersPtr;
 
-    WRITE_REGISTER_NOFENCE_ULONG(
+    //
+    // Stop the scan. A burst that was cut off by the interrupt being
+    // disconnected will never complete, so release the controller from it.
+    //
+    {
+        BCM_I2C_INTERRUPT_CONTEXT* interruptContextPtr =
+            devicePtr->InterruptContextPtr;
+        BCM_I2C_SCAN_CONTEXT* scanContextPtr =
+            &interruptContextPtr->ScanContext;
+
+        KLOCK_QUEUE_HANDLE lockHandle;
+        KeAcquireInStackQueuedSpinLock(&scanContextPtr->Lock, &lockHandle);
+        scanContextPtr->OwnerTarget = WDF_NO_HANDLE;
+        scanContextPtr->BurstPending = FALSE;
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+        WdfTimerStop(scanContextPtr->Timer, TRUE);
+
+        CancelDeferredRequest(scanContextPtr);
+
+        KeAcquireInStackQueuedSpinLock(&scanContextPtr->Lock, &lockHandle);
+        scanContextPtr->BurstActive = FALSE;
+        if ((interruptContextPtr->State >= TRANSFER_STATE::SCAN_WRITE) &&
+            (interruptContextPtr->State <= TRANSFER_STATE::SCAN_COMPLETE)) {
+
+            interruptContextPtr->State = TRANSFER_STATE::INVALID;
+        }
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+    }
+
+    WriteBscRegister(
         &registersPtr->Control,
         BCM_I2C_REG_CONTROL_CLEAR);
-    WRITE_REGISTER_NOFENCE_ULONG(
+    WriteBscRegister(
         &registersPtr->Status,
         BCM_I2C_REG_STATUS_DONE |
         BCM_I2C_REG_STATUS_ERR |
@@ -1832,4 +2722,20 @@ NTSTATUS OnTargetConnect (WDFDEVICE /*WdfDevice*/, SPBTARGET SpbTarget)
     return STATUS_SUCCESS;
 }
 
+_Use_decl_annotations_
+VOID OnTargetDisconnect (WDFDEVICE WdfDevice, SPBTARGET SpbTarget)
+{
+    PAGED_CODE();
+    BCM_I2C_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    BCM_I2C_DEVICE_CONTEXT* devicePtr = GetDeviceContext(WdfDevice);
+    BCM_I2C_SCAN_CONTEXT* scanContextPtr =
+        &devicePtr->InterruptContextPtr->ScanContext;
+
+    // stop the scan if this target started it
+    if (StopScan(scanContextPtr, SpbTarget)) {
+        WdfTimerStop(scanContextPtr->Timer, TRUE);
+    }
+}
+
 BCM_I2C_PAGED_SEGMENT_END; //==================================================
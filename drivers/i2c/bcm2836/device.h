@@ -26,6 +26,19 @@ Revision History:
 #define I2C_SLV_BIT                                 0x01    // 0=initiated by controller, 1=by device
 #define I2C_MAX_ADDRESS                             0x7f
 
+//
+// Maximum number of transfers in a sequence request
+//
+#define BCM_I2C_MAX_SEQUENCE_TRANSFERS              16
+
+//
+// Minimum length of a write that both follows and precedes a restart. Queued
+// behind the held back byte of the previous write, it must keep TXW deasserted
+// until the restart has taken effect, as the control register cannot be
+// written to again before then.
+//
+#define BCM_I2C_MIN_CHAINED_WRITE_LENGTH            (BCM_I2C_FIFO_DEPTH / 4 + 1)
+
 //
 // Optional Device Parameters REG_DWORD value to set clock stretch timeout
 // in SCL clock cycles. Setting this to 0 disables clock stretch timeout.
@@ -63,6 +76,11 @@ enum TRANSFER_STATE : ULONG {
     SENDING_WAIT_FOR_DONE,
     RECEIVING_WAIT_FOR_DONE,
     RECEIVING_SEQUENCE_WAIT_FOR_DONE,
+    SENDING_SEQUENCE_WAIT_FOR_DONE,
+    SCAN_WRITE,
+    SCAN_READ,
+    SCAN_RECOVERING,
+    SCAN_COMPLETE,
     ERROR_FLAG = 0x80000000UL,
 };
 
@@ -83,6 +101,40 @@ struct BCM_I2C_TARGET_CONTEXT {
     USHORT Address;
 };
 
+//
+// State of the periodic register scan. Scan bursts and SPB requests take
+// turns on the controller; the flags at the end are protected by Lock.
+//
+struct BCM_I2C_SCAN_CONTEXT {
+    struct ENTRY {
+        BCM_I2C_TARGET_CONTEXT Target;
+        UCHAR Register;
+        UCHAR ReadLength;
+        LONGLONG PeriodTicks;       // in performance counter ticks
+        LONGLONG NextDueTicks;
+    };
+
+    ENTRY Entries[BCM_I2C_SCAN_MAX_ENTRIES];
+    ULONG EntryCount;
+    ULONG CurrentEntry;             // entry being read by the current burst
+    LONGLONG PerformanceFrequency;
+    WDFTIMER Timer;
+
+    // sample ring, written by the ISR during a burst
+    BCM_I2C_SCAN_SAMPLE Samples[BCM_I2C_SCAN_RING_SAMPLES];
+    ULONG SampleHead;               // index of the oldest sample
+    ULONG SampleCount;
+    ULONG DroppedSamples;
+
+    KSPIN_LOCK Lock;
+    SPBTARGET OwnerTarget;          // WDF_NO_HANDLE when no scan is running
+    BOOLEAN RequestActive;          // an SPB request owns the controller
+    BOOLEAN BurstActive;            // a scan burst owns the controller
+    BOOLEAN BurstPending;           // start a burst when the request is done
+    SPBTARGET DeferredTarget;       // request that arrived during a burst
+    SPBREQUEST DeferredRequest;
+};
+
 struct BCM_I2C_INTERRUPT_CONTEXT {
     struct WRITE_CONTEXT {
         const BYTE* WriteBufferPtr;
@@ -96,16 +148,24 @@ struct BCM_I2C_INTERRUPT_CONTEXT {
         const BYTE* EndPtr;
     };
 
+    struct SEQUENCE_TRANSFER {
+        PMDL Mdl;
+        ULONG Length;
+        BOOLEAN IsRead;
+    };
+
     struct SEQUENCE_CONTEXT {
-        PMDL CurrentWriteMdl;
-        ULONG BytesToWrite;
-        ULONG BytesWritten;
-        ULONG CurrentWriteMdlOffset;
-
-        PMDL CurrentReadMdl;
-        ULONG BytesToRead;
-        ULONG BytesRead;
-        ULONG CurrentReadMdlOffset;
+        SEQUENCE_TRANSFER Transfers[BCM_I2C_MAX_SEQUENCE_TRANSFERS];
+        ULONG TransferCount;
+
+        // transfer currently being moved through the FIFO
+        ULONG CurrentTransfer;
+        PMDL CurrentMdl;
+        ULONG CurrentMdlOffset;
+        ULONG BytesRemaining;
+
+        // bytes in the transfers preceding CurrentTransfer
+        ULONG BytesTransferred;
     };
 
     BCM_I2C_REGISTERS* RegistersPtr;
@@ -116,6 +176,7 @@ struct BCM_I2C_INTERRUPT_CONTEXT {
     KSPIN_LOCK CancelLock;
     const BCM_I2C_TARGET_CONTEXT* TargetPtr;
     WDFINTERRUPT WdfInterrupt;
+    BCM_I2C_SCAN_CONTEXT ScanContext;
 
     union {
         WRITE_CONTEXT WriteContext;
@@ -140,12 +201,16 @@ WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(
 EVT_SPB_CONTROLLER_READ OnRead;
 EVT_SPB_CONTROLLER_WRITE OnWrite;
 EVT_SPB_CONTROLLER_SEQUENCE OnSequence;
+EVT_SPB_CONTROLLER_OTHER OnOther;
+EVT_WDF_TIMER OnScanTimer;
 EVT_WDF_REQUEST_CANCEL OnRequestCancel;
+EVT_WDF_REQUEST_CANCEL OnDeferredRequestCancel;
 EVT_WDF_INTERRUPT_ISR OnInterruptIsr;
 EVT_WDF_INTERRUPT_DPC OnInterruptDpc;
 
 // PAGED
 EVT_SPB_TARGET_CONNECT OnTargetConnect;
+EVT_SPB_TARGET_DISCONNECT OnTargetDisconnect;
 EVT_WDF_WORKITEM EvtSampleStatusWorkItem;
 
 EVT_WDF_DEVICE_D0_ENTRY OnD0Entry;
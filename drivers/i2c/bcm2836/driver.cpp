@@ -22,6 +22,7 @@ Revision History:
 
 #include "i2ctrace.h"
 #include "bcmi2c.h"
+#include "bcmi2c-ioctl.h"
 #include "device.h"
 #include "driver.h"
 
@@ -174,11 +175,12 @@ NTSTATUS OnDeviceAdd (WDFDRIVER /*WdfDriver*/, WDFDEVICE_INIT* DeviceInitPtr)
         SPB_CONTROLLER_CONFIG_INIT(&spbConfig);
 
         //
-        // Register for target connect callback.  The driver
-        // does not need to respond to target disconnect.
+        // Register for target connect and disconnect callbacks. A scan
+        // started by a target is stopped when the target disconnects.
         //
 
         spbConfig.EvtSpbTargetConnect = OnTargetConnect;
+        spbConfig.EvtSpbTargetDisconnect = OnTargetDisconnect;
 
         //
         // Register for IO callbacks.
@@ -197,6 +199,12 @@ NTSTATUS OnDeviceAdd (WDFDRIVER /*WdfDriver*/, WDFDEVICE_INIT* DeviceInitPtr)
                 status);
             return status;
         }
+
+        //
+        // Register for IOCTL callback to handle the scan IOCTLs.
+        //
+
+        SpbControllerSetIoOtherCallback(wdfDevice, OnOther, nullptr);
     }
 
     //
@@ -243,9 +251,37 @@ NTSTATUS OnDeviceAdd (WDFDRIVER /*WdfDriver*/, WDFDEVICE_INIT* DeviceInitPtr)
         interruptContextPtr = GetInterruptContext(devicePtr->WdfInterrupt);
         KeInitializeSpinLock(&interruptContextPtr->CancelLock);
         interruptContextPtr->WdfInterrupt = devicePtr->WdfInterrupt;
+        KeInitializeSpinLock(&interruptContextPtr->ScanContext.Lock);
     }
     devicePtr->InterruptContextPtr = interruptContextPtr;
 
+    //
+    // Create the scan timer. A high resolution timer is needed for scan
+    // periods shorter than the system clock tick.
+    //
+    {
+        WDF_TIMER_CONFIG timerConfig;
+        WDF_TIMER_CONFIG_INIT(&timerConfig, OnScanTimer);
+        timerConfig.AutomaticSerialization = FALSE;
+        timerConfig.UseHighResolutionTimer = WdfTrue;
+
+        WDF_OBJECT_ATTRIBUTES timerAttributes;
+        WDF_OBJECT_ATTRIBUTES_INIT(&timerAttributes);
+        timerAttributes.ParentObject = wdfDevice;
+
+        status = WdfTimerCreate(
+            &timerConfig,
+            &timerAttributes,
+            &interruptContextPtr->ScanContext.Timer);
+        if (!NT_SUCCESS(status)) {
+            BSC_LOG_ERROR(
+                "Failed to create scan timer. (wdfDevice = %p, status = %!STATUS!)",
+                wdfDevice,
+                status);
+            return status;
+        }
+    }
+
     NT_ASSERT(NT_SUCCESS(status));
     return STATUS_SUCCESS;
 }
@@ -0,0 +1,412 @@
+//
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+// Module Name:
+//
+//     cache.c
+//
+// Abstract:
+//
+//    Property response cache. Responses of property tags returning static or
+//    slowly changing values are cached so that a request made only of cached
+//    tags is completed without a firmware round trip.
+//
+
+#include "precomp.h"
+
+#include "trace.h"
+#include "cache.tmh"
+
+#include "register.h"
+#include "cache.h"
+#include "device.h"
+#include "mailbox.h"
+
+// Tags that are served from the cache, any other tag is always sent to the
+// firmware
+static const RPIQ_CACHE_POLICY RpiqCachePolicy[] = {
+    { TAG_ID_GET_FIRMWARE_REVISION, 0, RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_BOARD_MODEL, 0, RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_BOARD_REVISION, 0, RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_BOARD_MAC_ADDRESS, 0, RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_BOARD_SERIAL, 0, RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_ARM_MEMORY, 0, RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_VC_MEMORY, 0, RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_POWER_STATE, sizeof(ULONG), 100 },
+    { TAG_ID_GET_TIMING, sizeof(ULONG), RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_CLOCK_STATE, sizeof(ULONG), 100 },
+    { TAG_ID_GET_CLOCK_RATE, sizeof(ULONG), 100 },
+    { TAG_ID_GET_VOLTAGE, sizeof(ULONG), 100 },
+    { TAG_ID_GET_MAX_CLOCK_RATE, sizeof(ULONG), RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_MAX_VOLTAGE, sizeof(ULONG), RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_TEMPERATURE, sizeof(ULONG), 250 },
+    { TAG_ID_GET_MIN_CLOCK_RATE, sizeof(ULONG), RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_MIN_VOLTAGE, sizeof(ULONG), RPIQ_CACHE_STATIC },
+    { TAG_ID_GET_TURBO, sizeof(ULONG), 100 },
+    { TAG_ID_GET_MAX_TEMPERATURE, sizeof(ULONG), RPIQ_CACHE_STATIC },
+};
+
+RPIQ_NONPAGED_SEGMENT_BEGIN
+
+/*++
+
+Routine Description:
+
+    Initialize the property cache.
+
+Arguments:
+
+    CachePtr - Pointer to the property cache
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqCacheInit (
+    RPIQ_CACHE* CachePtr
+    )
+{
+    RtlZeroMemory(CachePtr, sizeof(*CachePtr));
+    KeInitializeSpinLock(&CachePtr->Lock);
+}
+
+/*++
+
+Routine Description:
+
+    Advance to the next tag of a property message.
+
+Arguments:
+
+    PropertyPtr - Pointer to property message
+
+    PropertySize - Size of the property message buffer
+
+    OffsetPtr - Offset of the current tag, updated to the next tag
+
+    TagPtrPtr - Receives pointer to the current tag
+
+Return Value:
+
+    STATUS_NO_MORE_ENTRIES when reaching the end tag, STATUS_INVALID_PARAMETER
+    if the message is malformed.
+
+--*/
+static NTSTATUS RpiqCacheNextTag (
+    _In_reads_bytes_(PropertySize) const MAILBOX_HEADER* PropertyPtr,
+    _In_ ULONG PropertySize,
+    _Inout_ ULONG* OffsetPtr,
+    _Out_ ULONG** TagPtrPtr
+    )
+{
+    ULONG offset = *OffsetPtr;
+    ULONG* tagPtr;
+
+    if (offset + sizeof(ULONG) > PropertySize) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    tagPtr = (ULONG*)((UCHAR*)PropertyPtr + offset);
+    if (tagPtr[0] == RPIQ_PROPERTY_END_TAG) {
+        return STATUS_NO_MORE_ENTRIES;
+    }
+
+    if ((offset + RPIQ_PROPERTY_TAG_HEADER_SIZE > PropertySize) ||
+        (tagPtr[1] > PropertySize - offset - RPIQ_PROPERTY_TAG_HEADER_SIZE)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *OffsetPtr = offset + RPIQ_PROPERTY_TAG_HEADER_SIZE +
+        ALIGN_UP_BY(tagPtr[1], sizeof(ULONG));
+    *TagPtrPtr = tagPtr;
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+
+Routine Description:
+
+    Return the cache policy of a tag.
+
+Arguments:
+
+    TagId - Property tag
+
+Return Value:
+
+    Pointer to the policy, NULL if the tag is not cached.
+
+--*/
+static const RPIQ_CACHE_POLICY* RpiqCacheGetPolicy (
+    _In_ ULONG TagId
+    )
+{
+    for (ULONG policyCount = 0;
+        policyCount < ARRAYSIZE(RpiqCachePolicy);
+        ++policyCount) {
+        if (RpiqCachePolicy[policyCount].TagId == TagId) {
+            return &RpiqCachePolicy[policyCount];
+        }
+    }
+
+    return NULL;
+}
+
+/*++
+
+Routine Description:
+
+    Find the cache entry of a tag. Cache lock must be held.
+
+Arguments:
+
+    CachePtr - Pointer to the property cache
+
+    TagPtr - Pointer to the tag
+
+    CurrentTime - Current interrupt time
+
+Return Value:
+
+    Pointer to the cache entry, NULL if the tag has no valid cached response.
+
+--*/
+static RPIQ_CACHE_ENTRY* RpiqCacheFind (
+    _In_ RPIQ_CACHE* CachePtr,
+    _In_ const ULONG* TagPtr,
+    _In_ ULONGLONG CurrentTime
+    )
+{
+    const RPIQ_CACHE_POLICY* policyPtr = RpiqCacheGetPolicy(TagPtr[0]);
+    ULONG key;
+
+    if (policyPtr == NULL || TagPtr[1] < policyPtr->KeySize) {
+        return NULL;
+    }
+
+    key = policyPtr->KeySize ? TagPtr[3] : 0;
+
+    for (ULONG entryCount = 0; entryCount < RPIQ_CACHE_ENTRY_MAX; ++entryCount) {
+        RPIQ_CACHE_ENTRY* entryPtr = &CachePtr->Entry[entryCount];
+
+        if (entryPtr->TagId == TagPtr[0] &&
+            entryPtr->Key == key &&
+            entryPtr->ExpiryTime > CurrentTime &&
+            (entryPtr->Response & ~RESPONSE_SUCCESS) <= TagPtr[1]) {
+            return entryPtr;
+        }
+    }
+
+    return NULL;
+}
+
+/*++
+
+Routine Description:
+
+    Complete a property message from the cache. The message is only updated
+    if every tag has a valid cached response.
+
+Arguments:
+
+    CachePtr - Pointer to the property cache
+
+    PropertyPtr - Pointer to property message, updated with the response
+
+    PropertySize - Size of the property message buffer
+
+Return Value:
+
+    TRUE if the message has been completed from the cache.
+
+--*/
+_Use_decl_annotations_
+BOOLEAN RpiqCacheLookup (
+    RPIQ_CACHE* CachePtr,
+    MAILBOX_HEADER* PropertyPtr,
+    ULONG PropertySize
+    )
+{
+    NTSTATUS status;
+    KIRQL irql;
+    ULONG offset;
+    ULONG* tagPtr;
+    ULONG tagCount = 0;
+    BOOLEAN hit = FALSE;
+    ULONGLONG currentTime = KeQueryInterruptTime();
+
+    KeAcquireSpinLock(&CachePtr->Lock, &irql);
+
+    // Make sure every tag could be served before touching the message
+    offset = RPIQ_PROPERTY_HEADER_SIZE;
+    while ((status = RpiqCacheNextTag(
+                PropertyPtr,
+                PropertySize,
+                &offset,
+                &tagPtr)) == STATUS_SUCCESS) {
+        if (RpiqCacheFind(CachePtr, tagPtr, currentTime) == NULL) {
+            goto End;
+        }
+        ++tagCount;
+    }
+
+    if (status != STATUS_NO_MORE_ENTRIES || tagCount == 0) {
+        goto End;
+    }
+
+    offset = RPIQ_PROPERTY_HEADER_SIZE;
+    while (RpiqCacheNextTag(
+                PropertyPtr,
+                PropertySize,
+                &offset,
+                &tagPtr) == STATUS_SUCCESS) {
+        RPIQ_CACHE_ENTRY* entryPtr =
+            RpiqCacheFind(CachePtr, tagPtr, currentTime);
+
+        tagPtr[2] = entryPtr->Response;
+        RtlCopyMemory(
+            &tagPtr[3],
+            entryPtr->Value,
+            entryPtr->Response & ~RESPONSE_SUCCESS);
+    }
+
+    PropertyPtr->RequestResponse = RESPONSE_SUCCESS;
+    hit = TRUE;
+
+End:
+    KeReleaseSpinLock(&CachePtr->Lock, irql);
+
+    if (hit) {
+        InterlockedIncrement(&CachePtr->HitCount);
+    } else {
+        InterlockedIncrement(&CachePtr->MissCount);
+    }
+
+    return hit;
+}
+
+/*++
+
+Routine Description:
+
+    Update the cache with the response of a property message. Tags are
+    processed in order so a set type tag invalidates the cached responses
+    returned earlier in the message. As setting a clock, voltage or power
+    state may change other values of the same tag group all non static
+    responses of the group are invalidated.
+
+Arguments:
+
+    CachePtr - Pointer to the property cache
+
+    PropertyPtr - Pointer to property message response
+
+    PropertySize - Size of the property message buffer
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqCacheUpdate (
+    RPIQ_CACHE* CachePtr,
+    const MAILBOX_HEADER* PropertyPtr,
+    ULONG PropertySize
+    )
+{
+    KIRQL irql;
+    ULONG offset;
+    ULONG* tagPtr;
+    ULONGLONG currentTime = KeQueryInterruptTime();
+
+    if (PropertyPtr->RequestResponse != RESPONSE_SUCCESS) {
+        return;
+    }
+
+    KeAcquireSpinLock(&CachePtr->Lock, &irql);
+
+    offset = RPIQ_PROPERTY_HEADER_SIZE;
+    while (RpiqCacheNextTag(
+                PropertyPtr,
+                PropertySize,
+                &offset,
+                &tagPtr) == STATUS_SUCCESS) {
+        const RPIQ_CACHE_POLICY* policyPtr;
+        RPIQ_CACHE_ENTRY* entryPtr = NULL;
+        ULONG responseSize;
+        ULONG key;
+
+        if (tagPtr[0] & RPIQ_CACHE_SET_TAG) {
+            for (ULONG entryCount = 0;
+                entryCount < RPIQ_CACHE_ENTRY_MAX;
+                ++entryCount) {
+                RPIQ_CACHE_ENTRY* invalidEntryPtr = &CachePtr->Entry[entryCount];
+
+                if (invalidEntryPtr->TagId != 0 &&
+                    invalidEntryPtr->ExpiryTime != MAXULONGLONG &&
+                    ((invalidEntryPtr->TagId ^ tagPtr[0]) &
+                        RPIQ_CACHE_TAG_GROUP_MASK) == 0) {
+                    invalidEntryPtr->TagId = 0;
+                    InterlockedIncrement(&CachePtr->InvalidateCount);
+                }
+            }
+            continue;
+        }
+
+        policyPtr = RpiqCacheGetPolicy(tagPtr[0]);
+        if (policyPtr == NULL || tagPtr[1] < policyPtr->KeySize) {
+            continue;
+        }
+
+        // Only cache complete responses
+        responseSize = tagPtr[2] & ~RESPONSE_SUCCESS;
+        if (!(tagPtr[2] & RESPONSE_SUCCESS) ||
+            responseSize > tagPtr[1] ||
+            responseSize > RPIQ_CACHE_VALUE_MAX) {
+            continue;
+        }
+
+        key = policyPtr->KeySize ? tagPtr[3] : 0;
+
+        // Reuse the entry of the same query or an empty entry, otherwise
+        // replace entries in round robin
+        for (ULONG entryCount = 0;
+            entryCount < RPIQ_CACHE_ENTRY_MAX;
+            ++entryCount) {
+            RPIQ_CACHE_ENTRY* freeEntryPtr = &CachePtr->Entry[entryCount];
+
+            if (freeEntryPtr->TagId == tagPtr[0] && freeEntryPtr->Key == key) {
+                entryPtr = freeEntryPtr;
+                break;
+            }
+
+            if (entryPtr == NULL &&
+                (freeEntryPtr->TagId == 0 ||
+                    freeEntryPtr->ExpiryTime <= currentTime)) {
+                entryPtr = freeEntryPtr;
+            }
+        }
+
+        if (entryPtr == NULL) {
+            entryPtr = &CachePtr->Entry[CachePtr->NextEntry];
+            CachePtr->NextEntry =
+                (CachePtr->NextEntry + 1) % RPIQ_CACHE_ENTRY_MAX;
+        }
+
+        entryPtr->TagId = tagPtr[0];
+        entryPtr->Key = key;
+        entryPtr->Response = tagPtr[2];
+        entryPtr->ExpiryTime = (policyPtr->TtlMs == RPIQ_CACHE_STATIC) ?
+            MAXULONGLONG :
+            currentTime + WDF_ABS_TIMEOUT_IN_MS(policyPtr->TtlMs);
+        RtlCopyMemory(entryPtr->Value, &tagPtr[3], responseSize);
+    }
+
+    KeReleaseSpinLock(&CachePtr->Lock, irql);
+}
+
+RPIQ_NONPAGED_SEGMENT_END
@@ -0,0 +1,86 @@
+//
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+// Module Name:
+//
+//    cache.h
+//
+// Abstract:
+//
+//    Property response cache definition.
+//
+
+#pragma once
+
+EXTERN_C_START
+
+// Property tags without a message definition in rpiq.h
+#define TAG_ID_GET_POWER_STATE      0x00020001
+#define TAG_ID_GET_TIMING           0x00020002
+#define TAG_ID_GET_CLOCK_STATE      0x00030001
+#define TAG_ID_GET_VOLTAGE          0x00030003
+#define TAG_ID_GET_MAX_VOLTAGE      0x00030005
+#define TAG_ID_GET_TEMPERATURE      0x00030006
+#define TAG_ID_GET_MIN_VOLTAGE      0x00030008
+#define TAG_ID_GET_TURBO            0x00030009
+#define TAG_ID_GET_MAX_TEMPERATURE  0x0003000A
+
+// Set type tags have this bit set, the upper 16 bits identify the tag group
+#define RPIQ_CACHE_SET_TAG          0x00008000
+#define RPIQ_CACHE_TAG_GROUP_MASK   0xFFFF0000
+
+#define RPIQ_CACHE_ENTRY_MAX        32
+#define RPIQ_CACHE_VALUE_MAX        16
+
+// Cached response of a tag that never changes
+#define RPIQ_CACHE_STATIC           MAXULONG
+
+typedef struct _RPIQ_CACHE_POLICY {
+    ULONG TagId;
+
+    // Size of the request value identifying the query, e.g. clock id
+    ULONG KeySize;
+
+    // Time in ms a response stays valid or RPIQ_CACHE_STATIC
+    ULONG TtlMs;
+} RPIQ_CACHE_POLICY, *PRPIQ_CACHE_POLICY;
+
+typedef struct _RPIQ_CACHE_ENTRY {
+    ULONG TagId;
+    ULONG Key;
+    ULONG Response;
+    ULONGLONG ExpiryTime;
+    UCHAR Value[RPIQ_CACHE_VALUE_MAX];
+} RPIQ_CACHE_ENTRY, *PRPIQ_CACHE_ENTRY;
+
+typedef struct _RPIQ_CACHE {
+    KSPIN_LOCK Lock;
+    ULONG NextEntry;
+    RPIQ_CACHE_ENTRY Entry[RPIQ_CACHE_ENTRY_MAX];
+
+    // Statistic
+    volatile LONG HitCount;
+    volatile LONG MissCount;
+    volatile LONG InvalidateCount;
+} RPIQ_CACHE, *PRPIQ_CACHE;
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID RpiqCacheInit (
+    _Out_ RPIQ_CACHE* CachePtr
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN RpiqCacheLookup (
+    _In_ RPIQ_CACHE* CachePtr,
+    _Inout_updates_bytes_(PropertySize) MAILBOX_HEADER* PropertyPtr,
+    _In_ ULONG PropertySize
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID RpiqCacheUpdate (
+    _In_ RPIQ_CACHE* CachePtr,
+    _In_reads_bytes_(PropertySize) const MAILBOX_HEADER* PropertyPtr,
+    _In_ ULONG PropertySize
+    );
+
+EXTERN_C_END
@@ -17,6 +17,7 @@
 
 #include "register.h"
 #include "ioctl.h"
+#include "cache.h"
 #include "device.h"
 #include "interrupt.h"
 #include "mailbox.h"
@@ -101,14 +102,13 @@ NTSTATUS RpiqCreateDevice (
     deviceContextPtr->VersionMajor = RPIQ_VERSION_MAJOR;
     deviceContextPtr->VersionMinor = RPIQ_VERSION_MINOR;
 
-    // Initialize IO Queue, the IO queue is initialize as sequential queue
-    // for stability purposes. This could be expanded to multiple queue 
-    // for each channel as other channel usage comes online to improve
-    // performance. The power and frame buffer channel are channels that 
-    // has some documentation and would be consider for further expansion.
+    // Initialize IO Queue, the IO queue is a parallel queue. Request are
+    // forwarded to the queue of their mailbox channel once written to the
+    // mailbox so request on different channels are processed concurrently
+    // and multiple request could be in flight on each channel.
     WDF_IO_QUEUE_CONFIG_INIT_DEFAULT_QUEUE(
         &queueConfig,
-        WdfIoQueueDispatchSequential);
+        WdfIoQueueDispatchParallel);
     queueConfig.EvtIoDeviceControl = RpiqProcessChannel;
     queueConfig.EvtIoStop = RpiqIoStop;
 
@@ -191,6 +191,18 @@ NTSTATUS RpiqCreateDevice (
                 goto End;
             }
         }
+
+        status = WdfIoQueueCreate(
+            device,
+            &ioQueueConfig,
+            &ioQueueConfigAttributes,
+            &deviceContextPtr->PropertyQueue);
+        if (!NT_SUCCESS(status)) {
+            RPIQ_LOG_ERROR(
+                "WdfIoQueueCreate for property queue failed %!STATUS!)",
+                status);
+            goto End;
+        }
     }
 
 End:
@@ -396,6 +408,15 @@ NTSTATUS RpiqReleaseHardware (
         deviceContextPtr->NdisNotificationHandle = NULL;
     }
 
+    // Stop packing new property message before purging the channel queues
+    if (deviceContextPtr->PropertyQueue) {
+        WdfIoQueuePurgeSynchronously(deviceContextPtr->PropertyQueue);
+    }
+
+    if (deviceContextPtr->PropertyWorkItem) {
+        WdfWorkItemFlush(deviceContextPtr->PropertyWorkItem);
+    }
+
     for (ULONG queueCount = 0; queueCount < MAILBOX_CHANNEL_MAX; ++queueCount) {
         if (deviceContextPtr->ChannelQueue[queueCount]) {
             WdfIoQueuePurgeSynchronously(
@@ -405,6 +426,8 @@ NTSTATUS RpiqReleaseHardware (
         }
     }
 
+    RpiqMailboxRelease(deviceContextPtr);
+
     return STATUS_SUCCESS;
 }
 
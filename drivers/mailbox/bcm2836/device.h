@@ -52,10 +52,28 @@ typedef struct _DEVICE_CONTEXT {
     ULONG MailboxMmioLength;
 
     // Lock
-    WDFWAITLOCK WriteLock;
+    KSPIN_LOCK MailboxLock;
+    WDFWAITLOCK ChannelLock[MAILBOX_CHANNEL_MAX];
 
     // Mailbox channel wdf queue object
     WDFQUEUE ChannelQueue[MAILBOX_CHANNEL_MAX];
+
+    // Property request waiting to be packed into the next property message
+    WDFQUEUE PropertyQueue;
+    WDFWORKITEM PropertyWorkItem;
+    volatile LONG PropertyInFlight;
+
+    // Contiguous property buffer pool
+    VOID* PropertyPoolMemory;
+    SINGLE_LIST_ENTRY PropertyPoolFreeList;
+    KSPIN_LOCK PropertyPoolLock;
+
+    // Property buffers of request cancelled while in flight, protected by
+    // PropertyPoolLock. Buffers are released once the firmware responds.
+    LIST_ENTRY PropertyOrphanList;
+
+    // Property response cache
+    RPIQ_CACHE PropertyCache;
     
     // Interrupt
     WDFINTERRUPT MailboxIntObj;
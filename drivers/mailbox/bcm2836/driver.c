@@ -17,6 +17,7 @@
 
 #include "driver.h"
 #include "register.h"
+#include "cache.h"
 #include "device.h"
 
 RPIQ_INIT_SEGMENT_BEGIN
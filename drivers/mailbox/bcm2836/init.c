@@ -17,6 +17,7 @@
 #include "init.tmh"
 
 #include "register.h"
+#include "cache.h"
 #include "device.h"
 #include "interrupt.h"
 #include "mailbox.h"
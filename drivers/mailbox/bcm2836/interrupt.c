@@ -16,6 +16,7 @@
 #include "interrupt.tmh"
 
 #include "register.h"
+#include "cache.h"
 #include "device.h"
 #include "interrupt.h"
 #include "mailbox.h"
@@ -171,6 +172,7 @@ VOID RpiqMailboxDpc (
 {
     DEVICE_CONTEXT* deviceContextPtr;
     ULONG value, channel, reg;
+    BOOLEAN propertyCompleted = FALSE;
 
     UNREFERENCED_PARAMETER(AssociatedObject);
 
@@ -189,42 +191,45 @@ VOID RpiqMailboxDpc (
         }
 
         WDFREQUEST nextRequest;
-        NTSTATUS status = WdfIoQueueRetrieveNextRequest(
-            deviceContextPtr->ChannelQueue[channel],
-            &nextRequest);
-        if (!NT_SUCCESS(status)) {
-            RPIQ_LOG_ERROR(
-                "WdfIoQueueRetrieveNextRequest failed  %!STATUS!",
-                status);
-            continue;
-        }
-
-        RPIQ_REQUEST_CONTEXT* requestContextPtr = 
-            RpiqGetRequestContext(nextRequest);
-        MAILBOX_HEADER* outputBufferPtr;
-
-        status = WdfRequestRetrieveOutputBuffer(
-            nextRequest,
-            requestContextPtr->PropertyMemorySize,
-            &outputBufferPtr,
-            NULL);
-        if (!NT_SUCCESS(status)) {
-            RPIQ_LOG_ERROR(
-                "WdfRequestRetrieveOutputBuffer failed %!STATUS!",
-                status);
-            WdfRequestComplete(nextRequest, status);
-            continue;
+        NTSTATUS status;
+
+        switch (channel) {
+        case MAILBOX_CHANNEL_PROPERTY_ARM_VC:
+            // Several property messages may be in flight and any of them
+            // cancelled, match the response to its message address
+            status = RpiqMailboxPropertyFind(
+                deviceContextPtr,
+                value,
+                &nextRequest);
+            if (NT_SUCCESS(status)) {
+                RpiqMailboxPropertyComplete(nextRequest, STATUS_SUCCESS);
+            } else {
+                RpiqMailboxPropertyOrphanResponded(deviceContextPtr, value);
+            }
+            InterlockedDecrement(&deviceContextPtr->PropertyInFlight);
+            propertyCompleted = TRUE;
+            break;
+        default:
+            // Each channel queue holds the request in the order they were
+            // written to the channel so the response belongs to the first one
+            status = WdfIoQueueRetrieveNextRequest(
+                deviceContextPtr->ChannelQueue[channel],
+                &nextRequest);
+            if (NT_SUCCESS(status)) {
+                RpiqMailboxValueComplete(nextRequest, value);
+            } else {
+                RPIQ_LOG_ERROR(
+                    "WdfIoQueueRetrieveNextRequest failed  %!STATUS!",
+                    status);
+            }
+            break;
         }
+    }
 
-        RtlCopyMemory(
-            outputBufferPtr,
-            requestContextPtr->PropertyMemory, 
-            requestContextPtr->PropertyMemorySize);
-
-        WdfRequestCompleteWithInformation(
-            nextRequest, 
-            STATUS_SUCCESS, 
-            requestContextPtr->PropertyMemorySize);
+    // Property messages are no longer in flight, send the property request
+    // that queued up in the meantime
+    if (propertyCompleted) {
+        WdfWorkItemEnqueue(deviceContextPtr->PropertyWorkItem);
     }
 
     WdfInterruptAcquireLock(Interrupt);
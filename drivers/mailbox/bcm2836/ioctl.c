@@ -17,6 +17,7 @@
 
 #include "register.h"
 #include "ioctl.h"
+#include "cache.h"
 #include "device.h"
 #include "mailbox.h"
 
@@ -151,22 +152,79 @@ VOID RpiqProcessChannel (
                 goto CompleteRequest;
             }
 
-            status = RpiqMailboxProperty(
+            // Complete the request right away if every tag has a valid
+            // cached response
+            if (RpiqCacheLookup(
+                    &deviceContextPtr->PropertyCache,
+                    inputBufferPtr,
+                    (ULONG)sizeInput)) {
+                WdfRequestCompleteWithInformation(
+                    Request,
+                    STATUS_SUCCESS,
+                    sizeInput);
+                break;
+            }
+
+            // Property request waiting on the property queue are packed
+            // together into a single property message
+            status = WdfRequestForwardToIoQueue(
+                Request,
+                deviceContextPtr->PropertyQueue);
+            if(!NT_SUCCESS(status)) {
+                RPIQ_LOG_ERROR(
+                    "WdfRequestForwardToIoQueue failed %!STATUS!\n",
+                    status);
+                goto CompleteRequest;
+            }
+
+            RpiqMailboxPropertyFlush(deviceContextPtr);
+        }
+        break;
+    case IOCTL_MAILBOX_POWER_MANAGEMENT:
+        {
+            ULONG* inputBufferPtr;
+            ULONG* outputBufferPtr;
+
+            status = WdfRequestRetrieveInputBuffer(
+                Request,
+                sizeof(*inputBufferPtr),
+                &inputBufferPtr,
+                NULL);
+            if (!NT_SUCCESS(status)) {
+                RPIQ_LOG_ERROR(
+                    "WdfRequestRetrieveInputBuffer failed: %!STATUS!\n",
+                    status);
+                goto CompleteRequest;
+            }
+
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(*outputBufferPtr),
+                &outputBufferPtr,
+                NULL);
+            if (!NT_SUCCESS(status)) {
+                RPIQ_LOG_ERROR(
+                    "WdfRequestRetrieveOutputBuffer failed : %!STATUS!\n",
+                    status);
+                goto CompleteRequest;
+            }
+
+            // Request completes in the DPC with the firmware response while
+            // other channels keep going
+            status = RpiqMailboxWrite(
                 deviceContextPtr,
-                inputBufferPtr,
-                sizeInput,
-                MAILBOX_CHANNEL_PROPERTY_ARM_VC,
+                MAILBOX_CHANNEL_POWER_MGMT,
+                *inputBufferPtr,
                 Request);
-            if(!NT_SUCCESS(status)) {
+            if (!NT_SUCCESS(status)) {
                 RPIQ_LOG_ERROR(
-                    "RpiqMailboxProperty failed %!STATUS!\n",
+                    "RpiqMailboxWrite failed %!STATUS!\n",
                     status);
                 goto CompleteRequest;
             }
         }
         break;
     // Currently no support for unused mailbox channel
-    case IOCTL_MAILBOX_POWER_MANAGEMENT:
     case IOCTL_MAILBOX_FRAME_BUFFER:
     case IOCTL_MAILBOX_VIRT_UART:
     case IOCTL_MAILBOX_LED:
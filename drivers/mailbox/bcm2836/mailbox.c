@@ -16,6 +16,7 @@
 #include "Mailbox.tmh"
 
 #include "register.h"
+#include "cache.h"
 #include "device.h"
 #include "mailbox.h"
 
@@ -41,7 +42,7 @@ NTSTATUS RpiqMailboxInit (
     WDFDEVICE Device
     )
 {
-    NTSTATUS status;
+    NTSTATUS status = STATUS_SUCCESS;
     WDF_OBJECT_ATTRIBUTES attributes;
     DEVICE_CONTEXT *deviceContextPtr = RpiqGetContext(Device);
 
@@ -50,15 +51,82 @@ NTSTATUS RpiqMailboxInit (
     WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
     attributes.ParentObject = Device;
 
-    // Serialize write to mailbox
-    status = WdfWaitLockCreate(
-        &attributes,
-        &deviceContextPtr->WriteLock);
-    if (!NT_SUCCESS(status)) {
-        RPIQ_LOG_ERROR(
-            "Failed to allocate lock resources for mailbox status = %!STATUS!",
-            status);
-        return status;
+    // Serialize write of each channel so that request are queued in the same
+    // order the firmware responds. Writes to different channels only
+    // synchronize on the mailbox register access.
+    KeInitializeSpinLock(&deviceContextPtr->MailboxLock);
+
+    for (ULONG channel = 0; channel < MAILBOX_CHANNEL_MAX; ++channel) {
+        if (deviceContextPtr->ChannelLock[channel] != NULL) {
+            continue;
+        }
+
+        status = WdfWaitLockCreate(
+            &attributes,
+            &deviceContextPtr->ChannelLock[channel]);
+        if (!NT_SUCCESS(status)) {
+            RPIQ_LOG_ERROR(
+                "Failed to allocate lock resources for mailbox status = %!STATUS!",
+                status);
+            return status;
+        }
+    }
+
+    // Work item to send property request that queued up while a property
+    // message was in flight
+    if (deviceContextPtr->PropertyWorkItem == NULL) {
+        WDF_WORKITEM_CONFIG workItemConfig;
+
+        WDF_WORKITEM_CONFIG_INIT(&workItemConfig, RpiqMailboxPropertyWorkItem);
+
+        status = WdfWorkItemCreate(
+            &workItemConfig,
+            &attributes,
+            &deviceContextPtr->PropertyWorkItem);
+        if (!NT_SUCCESS(status)) {
+            RPIQ_LOG_ERROR(
+                "Failed to create property work item status = %!STATUS!",
+                status);
+            return status;
+        }
+    }
+
+    RpiqCacheInit(&deviceContextPtr->PropertyCache);
+
+    // Preallocate the contiguous property buffer pool. Firmware expects
+    // mailbox request to be in contiguous memory.
+    KeInitializeSpinLock(&deviceContextPtr->PropertyPoolLock);
+    deviceContextPtr->PropertyPoolFreeList.Next = NULL;
+    InitializeListHead(&deviceContextPtr->PropertyOrphanList);
+
+    if (deviceContextPtr->PropertyPoolMemory == NULL) {
+        PHYSICAL_ADDRESS highAddress;
+        PHYSICAL_ADDRESS lowAddress = { 0 };
+        PHYSICAL_ADDRESS boundaryAddress = { 0 };
+
+        highAddress.QuadPart = HEX_1_G;
+
+        deviceContextPtr->PropertyPoolMemory = MmAllocateContiguousNodeMemory(
+            RPIQ_PROPERTY_POOL_COUNT * RPIQ_PROPERTY_BUFFER_SIZE,
+            lowAddress,
+            highAddress,
+            boundaryAddress,
+            PAGE_NOCACHE | PAGE_READWRITE,
+            MM_ANY_NODE_OK);
+        if (deviceContextPtr->PropertyPoolMemory == NULL) {
+            // Not fatal, property request would allocate their own memory
+            RPIQ_LOG_WARNING("Fail to allocate property buffer pool");
+            return STATUS_SUCCESS;
+        }
+    }
+
+    for (ULONG bufferCount = 0;
+        bufferCount < RPIQ_PROPERTY_POOL_COUNT;
+        ++bufferCount) {
+        PushEntryList(
+            &deviceContextPtr->PropertyPoolFreeList,
+            (SINGLE_LIST_ENTRY*)((UCHAR*)deviceContextPtr->PropertyPoolMemory +
+                (bufferCount * RPIQ_PROPERTY_BUFFER_SIZE)));
     }
 
     return status;
@@ -68,7 +136,48 @@ NTSTATUS RpiqMailboxInit (
 
 Routine Description:
 
-    Write to mail box in a serialize manner
+    Release mailbox resources allocated in RpiqMailboxInit. All property
+    request should be completed at this point.
+
+Arguments:
+
+    DeviceContextPtr - Pointer to device context
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqMailboxRelease (
+    DEVICE_CONTEXT* DeviceContextPtr
+    )
+{
+    PAGED_CODE();
+
+    RPIQ_LOG_INFORMATION(
+        "Property cache hit %d miss %d invalidate %d",
+        DeviceContextPtr->PropertyCache.HitCount,
+        DeviceContextPtr->PropertyCache.MissCount,
+        DeviceContextPtr->PropertyCache.InvalidateCount);
+
+    RpiqMailboxPropertyOrphanFree(DeviceContextPtr, FALSE);
+
+    if (DeviceContextPtr->PropertyPoolMemory) {
+        MmFreeContiguousMemory(DeviceContextPtr->PropertyPoolMemory);
+        DeviceContextPtr->PropertyPoolMemory = NULL;
+    }
+
+    DeviceContextPtr->PropertyPoolFreeList.Next = NULL;
+}
+
+/*++
+
+Routine Description:
+
+    Write to mail box in a serialize manner. Writes on the same channel are
+    serialized while different channels may be written concurrently, the
+    response is routed to the request through the channel queue.
 
 Arguments:
 
@@ -95,21 +204,32 @@ NTSTATUS RpiqMailboxWrite (
     )
 {
     NTSTATUS status;
-    ULONG count = 0, reg;
+    ULONG count = 0;
     LARGE_INTEGER timeOut = { 0 };
 
     PAGED_CODE();
+
+    if (Channel >= MAILBOX_CHANNEL_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
     
-    WdfWaitLockAcquire(DeviceContextPtr->WriteLock, NULL);
+    WdfWaitLockAcquire(DeviceContextPtr->ChannelLock[Channel], NULL);
 
     timeOut.QuadPart = WDF_REL_TIMEOUT_IN_MS(1);
 
-    reg = READ_REGISTER_NOFENCE_ULONG(&DeviceContextPtr->Mailbox->Status);
-
     // Poll until mailbox is available. It doesn't seem like
     // the mailbox is full often so polling is sufficient for now
     // rather than enable mailbox empty interrupt
-    while (reg & MAILBOX_STATUS_FULL) {
+    for (;;) {
+        status = RpiqMailboxTryWrite(
+            DeviceContextPtr,
+            Channel,
+            Value,
+            Request);
+        if (status != STATUS_DEVICE_BUSY) {
+            break;
+        }
+
         if (count > MAX_POLL) {
             RPIQ_LOG_ERROR(
                 "Exit Fail Status 0x%08x", 
@@ -119,31 +239,113 @@ NTSTATUS RpiqMailboxWrite (
         }
 
         KeDelayExecutionThread(KernelMode, FALSE, &timeOut);
-        reg = READ_REGISTER_NOFENCE_ULONG(&DeviceContextPtr->Mailbox->Status);
         ++count;
     }
 
-    if (Request) {
-        status = WdfRequestForwardToIoQueue(
+End:
+    WdfWaitLockRelease(DeviceContextPtr->ChannelLock[Channel]);
+
+    return status;
+}
+
+/*++
+
+Routine Description:
+
+    Allocate the request context and the contiguous memory for a property
+    message. Memory is taken from the property buffer pool when available.
+
+Arguments:
+
+    DeviceContextPtr - Pointer to device context
+
+    Request - WDF request object associated with the property message
+
+    DataSize - Size of the property message
+
+    RequestContextPtrPtr - Receives pointer to the request context
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+_Use_decl_annotations_
+NTSTATUS RpiqAllocatePropertyMemory (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    WDFREQUEST Request,
+    ULONG DataSize,
+    RPIQ_REQUEST_CONTEXT** RequestContextPtrPtr
+    )
+{
+    NTSTATUS status;
+    RPIQ_REQUEST_CONTEXT* requestContextPtr;
+
+    PAGED_CODE();
+
+    {
+        WDF_OBJECT_ATTRIBUTES wdfObjectAttributes;
+
+        WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(
+            &wdfObjectAttributes,
+            RPIQ_REQUEST_CONTEXT);
+        wdfObjectAttributes.EvtCleanupCallback =
+            RpiqRequestContextCleanup;
+
+        status = WdfObjectAllocateContext(
             Request,
-            DeviceContextPtr->ChannelQueue[Channel]);
+            &wdfObjectAttributes,
+            &requestContextPtr);
         if (!NT_SUCCESS(status)) {
-            RPIQ_LOG_ERROR(
-                "WdfRequestForwardToIoQueue failed ( %!STATUS!)",
+            RPIQ_LOG_WARNING(
+                "WdfObjectAllocateContext() failed %!STATUS!)",
                 status);
             goto End;
         }
     }
 
-    WRITE_REGISTER_NOFENCE_ULONG(
-        &DeviceContextPtr->Mailbox->Write, 
-        (Value & ~MAILBOX_CHANNEL_MASK) | Channel);
+    requestContextPtr->DeviceContextPtr = DeviceContextPtr;
+
+    if (DataSize <= RPIQ_PROPERTY_BUFFER_SIZE) {
+        requestContextPtr->PropertyMemory = ExInterlockedPopEntryList(
+            &DeviceContextPtr->PropertyPoolFreeList,
+            &DeviceContextPtr->PropertyPoolLock);
+        if (requestContextPtr->PropertyMemory) {
+            requestContextPtr->PropertyMemoryPooled = TRUE;
+            requestContextPtr->PropertyMemorySize = DataSize;
+            *RequestContextPtrPtr = requestContextPtr;
+            status = STATUS_SUCCESS;
+            goto End;
+        }
+    }
+
+    // Firmware expects mailbox request to be in contiguous memory
+    {
+        PHYSICAL_ADDRESS highAddress;
+        PHYSICAL_ADDRESS lowAddress = { 0 };
+        PHYSICAL_ADDRESS boundaryAddress = { 0 };
+
+        highAddress.QuadPart = HEX_1_G;
+
+        requestContextPtr->PropertyMemory = MmAllocateContiguousNodeMemory(
+            DataSize,
+            lowAddress,
+            highAddress,
+            boundaryAddress,
+            PAGE_NOCACHE | PAGE_READWRITE,
+            MM_ANY_NODE_OK);
+        if (requestContextPtr->PropertyMemory == NULL) {
+            RPIQ_LOG_ERROR("RpiqAllocatePropertyMemory fail to allocate memory");
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            goto End;
+        }
+    }
 
+    requestContextPtr->PropertyMemorySize = DataSize;
+    *RequestContextPtrPtr = requestContextPtr;
     status = STATUS_SUCCESS;
 
 End:
-    WdfWaitLockRelease(DeviceContextPtr->WriteLock);
-
     return status;
 }
 
@@ -179,15 +381,10 @@ NTSTATUS RpiqMailboxProperty (
     )
 {
     NTSTATUS status;
-    PHYSICAL_ADDRESS highAddress;
-    PHYSICAL_ADDRESS lowAddress = { 0 };
-    PHYSICAL_ADDRESS boundaryAddress = { 0 };
     PHYSICAL_ADDRESS addrProperty;
     RPIQ_REQUEST_CONTEXT* requestContextPtr;
 
     PAGED_CODE();
-    
-    highAddress.QuadPart = HEX_1_G;
 
     if (DataInPtr == NULL ||
         DataSize < sizeof(MAILBOX_HEADER)) {
@@ -195,45 +392,21 @@ NTSTATUS RpiqMailboxProperty (
         goto End;
     }    
 
-    {
-        WDF_OBJECT_ATTRIBUTES wdfObjectAttributes;
-
-        WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(
-            &wdfObjectAttributes,
-            RPIQ_REQUEST_CONTEXT);
-        wdfObjectAttributes.EvtCleanupCallback =
-            RpiqRequestContextCleanup;
-
-        status = WdfObjectAllocateContext(
-            Request,
-            &wdfObjectAttributes,
-            &requestContextPtr);
-        if (!NT_SUCCESS(status)) {
-            RPIQ_LOG_WARNING(
-                "WdfObjectAllocateContext() failed %!STATUS!)",
-                status);
-            goto End;
-        }
-    }
-
-    // Firmware expects mailbox request to be in contiguous memory
-    requestContextPtr->PropertyMemory = MmAllocateContiguousNodeMemory(
+    status = RpiqAllocatePropertyMemory(
+        DeviceContextPtr,
+        Request,
         DataSize,
-        lowAddress,
-        highAddress,
-        boundaryAddress,
-        PAGE_NOCACHE | PAGE_READWRITE,
-        MM_ANY_NODE_OK);
-    if (requestContextPtr->PropertyMemory == NULL) {
-        RPIQ_LOG_ERROR("RpiqMailboxProperty fail to allocate memory");
-        status = STATUS_INSUFFICIENT_RESOURCES;
+        &requestContextPtr);
+    if (!NT_SUCCESS(status)) {
         goto End;
     }
 
-    requestContextPtr->PropertyMemorySize = DataSize;
     addrProperty = MmGetPhysicalAddress(requestContextPtr->PropertyMemory);
 
     RtlCopyMemory(requestContextPtr->PropertyMemory, DataInPtr, DataSize);
+    requestContextPtr->PropertyMailboxValue =
+        (addrProperty.LowPart + OFFSET_DIRECT_SDRAM) & ~MAILBOX_CHANNEL_MASK;
+    requestContextPtr->PropertyMemoryInFlight = TRUE;
     
     status = RpiqMailboxWrite(
         DeviceContextPtr, 
@@ -242,6 +415,7 @@ NTSTATUS RpiqMailboxProperty (
         Request);
     if (!NT_SUCCESS(status)) {
         RPIQ_LOG_ERROR("RpiqMailboxWrite failed %!STATUS!", status);
+        requestContextPtr->PropertyMemoryInFlight = FALSE;
         goto End;
     }
 
@@ -249,37 +423,892 @@ End:
     return status;
 }
 
-RPIQ_PAGED_SEGMENT_END
+/*++
 
-RPIQ_NONPAGED_SEGMENT_BEGIN
+Routine Description:
+
+    Validate the tags of a property message and return the size of the tags
+    excluding the message header and end tag.
+
+Arguments:
+
+    PropertyPtr - Pointer to property message
+
+    PropertySize - Size of the property message buffer
+
+    TagSizePtr - Receives the size of the tags
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+_Use_decl_annotations_
+NTSTATUS RpiqMailboxPropertyTagSize (
+    const MAILBOX_HEADER* PropertyPtr,
+    ULONG PropertySize,
+    ULONG* TagSizePtr
+    )
+{
+    const UCHAR* propertyPtr = (const UCHAR*)PropertyPtr;
+    ULONG offset = RPIQ_PROPERTY_HEADER_SIZE;
+
+    PAGED_CODE();
+
+    while (offset + sizeof(ULONG) <= PropertySize) {
+        const ULONG* tagPtr = (const ULONG*)(propertyPtr + offset);
+        ULONG valueSize;
+
+        if (tagPtr[0] == RPIQ_PROPERTY_END_TAG) {
+            *TagSizePtr = offset - RPIQ_PROPERTY_HEADER_SIZE;
+            return STATUS_SUCCESS;
+        }
+
+        if (offset + RPIQ_PROPERTY_TAG_HEADER_SIZE > PropertySize) {
+            break;
+        }
+
+        valueSize = tagPtr[1];
+        if (valueSize > PropertySize - offset - RPIQ_PROPERTY_TAG_HEADER_SIZE) {
+            break;
+        }
+
+        offset += RPIQ_PROPERTY_TAG_HEADER_SIZE +
+            ALIGN_UP_BY(valueSize, sizeof(ULONG));
+    }
+
+    return STATUS_INVALID_PARAMETER;
+}
 
 /*++
 
 Routine Description:
 
-    RpiqRequestContextCleanup would perform cleanup
-        when request object is delete.
+    Retrieve the next pending property request and validate that its tags
+    could be packed into a property message.
 
 Arguments:
 
-    WdfObject - A handle to a framework object in this case
-         a WDFRequest
+    DeviceContextPtr - Pointer to device context
+
+    RequestPtr - Receives the property request
+
+    PropertyPtrPtr - Receives pointer to the property message of the request
+
+    PropertySizePtr - Receives the size of the property message
+
+    TagSizePtr - Receives the size of the tags, only valid if the function
+        return STATUS_SUCCESS
 
 Return Value:
 
-    VOID
+    STATUS_NO_MORE_ENTRIES if there is no pending property request,
+    STATUS_NOT_SUPPORTED if the request has to be sent as is.
 
 --*/
 _Use_decl_annotations_
-VOID RpiqRequestContextCleanup (
-    WDFOBJECT WdfObject
+NTSTATUS RpiqMailboxPropertyNext (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    WDFREQUEST* RequestPtr,
+    MAILBOX_HEADER** PropertyPtrPtr,
+    ULONG* PropertySizePtr,
+    ULONG* TagSizePtr
     )
 {
-    RPIQ_REQUEST_CONTEXT* requestContextPtr =
-        RpiqGetRequestContext(WdfObject);
-    
-    if (requestContextPtr->PropertyMemory) {
-        MmFreeContiguousMemory(requestContextPtr->PropertyMemory);
+    NTSTATUS status;
+    size_t inputSize;
+
+    PAGED_CODE();
+
+    status = WdfIoQueueRetrieveNextRequest(
+        DeviceContextPtr->PropertyQueue,
+        RequestPtr);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    // Request has been validated in RpiqProcessChannel
+    status = WdfRequestRetrieveInputBuffer(
+        *RequestPtr,
+        sizeof(MAILBOX_HEADER),
+        PropertyPtrPtr,
+        &inputSize);
+    if (!NT_SUCCESS(status)) {
+        RPIQ_LOG_ERROR(
+            "WdfRequestRetrieveInputBuffer failed: %!STATUS!",
+            status);
+        WdfRequestComplete(*RequestPtr, status);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *PropertySizePtr = (ULONG)inputSize;
+
+    if (inputSize > RPIQ_PROPERTY_BUFFER_SIZE) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    status = RpiqMailboxPropertyTagSize(
+        *PropertyPtrPtr,
+        (ULONG)inputSize,
+        TagSizePtr);
+    if (!NT_SUCCESS(status)) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+
+Routine Description:
+
+    Pack the tags of pending property request into a single property message
+    and send it to the firmware. Request that can not be packed, because their
+    tags are malformed or too large, are sent on their own.
+
+Arguments:
+
+    DeviceContextPtr - Pointer to device context
+
+Return Value:
+
+    STATUS_SUCCESS if a property message has been sent
+
+--*/
+_Use_decl_annotations_
+NTSTATUS RpiqMailboxPropertyBatch (
+    DEVICE_CONTEXT* DeviceContextPtr
+    )
+{
+    NTSTATUS status;
+    WDFREQUEST request;
+    MAILBOX_HEADER* propertyPtr;
+    ULONG propertySize;
+    ULONG tagSize;
+    RPIQ_REQUEST_CONTEXT* requestContextPtr;
+    UCHAR* messagePtr;
+    ULONG messageSize;
+    PHYSICAL_ADDRESS addrProperty;
+
+    PAGED_CODE();
+
+    status = RpiqMailboxPropertyNext(
+        DeviceContextPtr,
+        &request,
+        &propertyPtr,
+        &propertySize,
+        &tagSize);
+    if (status == STATUS_NOT_SUPPORTED) {
+        status = RpiqMailboxProperty(
+            DeviceContextPtr,
+            propertyPtr,
+            propertySize,
+            MAILBOX_CHANNEL_PROPERTY_ARM_VC,
+            request);
+        if (!NT_SUCCESS(status)) {
+            RPIQ_LOG_ERROR("RpiqMailboxProperty failed %!STATUS!", status);
+            WdfRequestComplete(request, status);
+        }
+        return status;
+    } else if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    status = RpiqAllocatePropertyMemory(
+        DeviceContextPtr,
+        request,
+        RPIQ_PROPERTY_BUFFER_SIZE,
+        &requestContextPtr);
+    if (!NT_SUCCESS(status)) {
+        WdfRequestComplete(request, status);
+        return status;
+    }
+
+    messagePtr = (UCHAR*)requestContextPtr->PropertyMemory;
+    messageSize = RPIQ_PROPERTY_HEADER_SIZE;
+
+    for (;;) {
+        ULONG batchCount = requestContextPtr->BatchCount;
+
+        RtlCopyMemory(
+            messagePtr + messageSize,
+            (UCHAR*)propertyPtr + RPIQ_PROPERTY_HEADER_SIZE,
+            tagSize);
+
+        requestContextPtr->BatchRequest[batchCount] = request;
+        requestContextPtr->BatchTagOffset[batchCount] = messageSize;
+        requestContextPtr->BatchTagSize[batchCount] = tagSize;
+        ++requestContextPtr->BatchCount;
+        messageSize += tagSize;
+
+        if (requestContextPtr->BatchCount == RPIQ_PROPERTY_BATCH_MAX) {
+            break;
+        }
+
+        // Skip over request completed because of an invalid buffer
+        do {
+            status = RpiqMailboxPropertyNext(
+                DeviceContextPtr,
+                &request,
+                &propertyPtr,
+                &propertySize,
+                &tagSize);
+        } while (status == STATUS_INVALID_PARAMETER);
+
+        if (status == STATUS_NO_MORE_ENTRIES) {
+            break;
+        } else if (!NT_SUCCESS(status) ||
+            (messageSize + tagSize + sizeof(ULONG)) > RPIQ_PROPERTY_BUFFER_SIZE) {
+            // Leave it at the head of the queue for the next property message
+            WdfRequestRequeue(request);
+            break;
+        }
+    }
+
+    *(ULONG*)(messagePtr + messageSize) = RPIQ_PROPERTY_END_TAG;
+    messageSize += sizeof(ULONG);
+
+    ((MAILBOX_HEADER*)messagePtr)->TotalBuffer = messageSize;
+    ((MAILBOX_HEADER*)messagePtr)->RequestResponse = TAG_REQUEST;
+    requestContextPtr->PropertyMemorySize = messageSize;
+    requestContextPtr->PropertyMemoryInFlight = TRUE;
+
+    RPIQ_LOG_INFORMATION(
+        "Property message %d bytes with %d request",
+        messageSize,
+        requestContextPtr->BatchCount);
+
+    addrProperty = MmGetPhysicalAddress(messagePtr);
+    requestContextPtr->PropertyMailboxValue =
+        (addrProperty.LowPart + OFFSET_DIRECT_SDRAM) & ~MAILBOX_CHANNEL_MASK;
+
+    // The first request carries the property message
+    status = RpiqMailboxWrite(
+        DeviceContextPtr,
+        MAILBOX_CHANNEL_PROPERTY_ARM_VC,
+        addrProperty.LowPart + OFFSET_DIRECT_SDRAM,
+        requestContextPtr->BatchRequest[0]);
+    if (!NT_SUCCESS(status)) {
+        RPIQ_LOG_ERROR("RpiqMailboxWrite failed %!STATUS!", status);
+        RpiqMailboxPropertyComplete(requestContextPtr->BatchRequest[0], status);
+    }
+
+    return status;
+}
+
+/*++
+
+Routine Description:
+
+    Send pending property request unless RPIQ_PROPERTY_INFLIGHT_MAX property
+    messages are already in flight, in that case the request would be sent
+    once a property message completes. Request issued in the meantime are
+    packed into the next property message.
+
+Arguments:
+
+    DeviceContextPtr - Pointer to device context
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqMailboxPropertyFlush (
+    DEVICE_CONTEXT* DeviceContextPtr
+    )
+{
+    NTSTATUS status;
+    LONG inFlight;
+    ULONG queueRequests;
+
+    PAGED_CODE();
+
+    for (;;) {
+        inFlight = DeviceContextPtr->PropertyInFlight;
+        if (inFlight >= RPIQ_PROPERTY_INFLIGHT_MAX) {
+            break;
+        }
+
+        if (InterlockedCompareExchange(
+                &DeviceContextPtr->PropertyInFlight,
+                inFlight + 1,
+                inFlight) != inFlight) {
+            continue;
+        }
+
+        status = RpiqMailboxPropertyBatch(DeviceContextPtr);
+        if (NT_SUCCESS(status)) {
+            continue;
+        }
+
+        // Nothing was sent, check again for request queued before the in
+        // flight count is released
+        InterlockedDecrement(&DeviceContextPtr->PropertyInFlight);
+
+        WdfIoQueueGetState(
+            DeviceContextPtr->PropertyQueue,
+            &queueRequests,
+            NULL);
+        if (queueRequests == 0) {
+            break;
+        }
+    }
+}
+
+/*++
+
+Routine Description:
+
+    Work item queued by the mailbox DPC to send property request that queued
+    up while the previous property message was in flight.
+
+Arguments:
+
+    WorkItem - A handle to a framework work item object.
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqMailboxPropertyWorkItem (
+    WDFWORKITEM WorkItem
+    )
+{
+    DEVICE_CONTEXT* deviceContextPtr =
+        RpiqGetContext(WdfWorkItemGetParentObject(WorkItem));
+
+    PAGED_CODE();
+
+    RpiqMailboxPropertyOrphanFree(deviceContextPtr, TRUE);
+
+    RpiqMailboxPropertyFlush(deviceContextPtr);
+}
+
+/*++
+
+Routine Description:
+
+    Release the property buffers of cancelled request. Buffers the firmware
+    has not responded to yet are kept unless the mailbox is being released.
+
+Arguments:
+
+    DeviceContextPtr - Pointer to device context
+
+    RespondedOnly - Only release the buffers the firmware responded to
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqMailboxPropertyOrphanFree (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    BOOLEAN RespondedOnly
+    )
+{
+    KIRQL irql;
+    LIST_ENTRY freeList;
+    LIST_ENTRY* entryPtr;
+
+    PAGED_CODE();
+
+    InitializeListHead(&freeList);
+
+    KeAcquireSpinLock(&DeviceContextPtr->PropertyPoolLock, &irql);
+
+    entryPtr = DeviceContextPtr->PropertyOrphanList.Flink;
+    while (entryPtr != &DeviceContextPtr->PropertyOrphanList) {
+        RPIQ_PROPERTY_ORPHAN* orphanPtr =
+            CONTAINING_RECORD(entryPtr, RPIQ_PROPERTY_ORPHAN, ListEntry);
+
+        entryPtr = entryPtr->Flink;
+
+        if (RespondedOnly && !orphanPtr->Responded) {
+            continue;
+        }
+
+        RemoveEntryList(&orphanPtr->ListEntry);
+        InsertTailList(&freeList, &orphanPtr->ListEntry);
+    }
+
+    KeReleaseSpinLock(&DeviceContextPtr->PropertyPoolLock, irql);
+
+    // Pooled buffers are released along with the pool
+    while (!IsListEmpty(&freeList)) {
+        RPIQ_PROPERTY_ORPHAN* orphanPtr = CONTAINING_RECORD(
+            RemoveHeadList(&freeList),
+            RPIQ_PROPERTY_ORPHAN,
+            ListEntry);
+
+        if (!orphanPtr->PropertyMemoryPooled) {
+            MmFreeContiguousMemory(orphanPtr->PropertyMemory);
+        }
+        ExFreePoolWithTag(orphanPtr, RpiqTag);
+    }
+}
+
+RPIQ_PAGED_SEGMENT_END
+
+RPIQ_NONPAGED_SEGMENT_BEGIN
+
+/*++
+
+Routine Description:
+
+    Write to the mailbox if it is not full. The request is queued to the
+    channel queue before the write so the DPC finds it once the firmware
+    responds.
+
+Arguments:
+
+    DeviceContextPtr - Pointer to device context
+
+    Channel - Mailbox Channel
+
+    Value - Value to be written
+
+    Request - Optional WDF request object associated with this mailbox
+        transaction
+
+Return Value:
+
+    STATUS_DEVICE_BUSY if the mailbox is full
+
+--*/
+_Use_decl_annotations_
+NTSTATUS RpiqMailboxTryWrite (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    ULONG Channel,
+    ULONG Value,
+    WDFREQUEST Request
+    )
+{
+    NTSTATUS status;
+    KIRQL irql;
+    ULONG reg;
+
+    KeAcquireSpinLock(&DeviceContextPtr->MailboxLock, &irql);
+
+    reg = READ_REGISTER_NOFENCE_ULONG(&DeviceContextPtr->Mailbox->Status);
+    if (reg & MAILBOX_STATUS_FULL) {
+        status = STATUS_DEVICE_BUSY;
+        goto End;
+    }
+
+    if (Request) {
+        status = WdfRequestForwardToIoQueue(
+            Request,
+            DeviceContextPtr->ChannelQueue[Channel]);
+        if (!NT_SUCCESS(status)) {
+            RPIQ_LOG_ERROR(
+                "WdfRequestForwardToIoQueue failed ( %!STATUS!)",
+                status);
+            goto End;
+        }
+    }
+
+    WRITE_REGISTER_NOFENCE_ULONG(
+        &DeviceContextPtr->Mailbox->Write, 
+        (Value & ~MAILBOX_CHANNEL_MASK) | Channel);
+
+    status = STATUS_SUCCESS;
+
+End:
+    KeReleaseSpinLock(&DeviceContextPtr->MailboxLock, irql);
+
+    return status;
+}
+
+/*++
+
+Routine Description:
+
+    Complete a mailbox value request with the value the firmware responded.
+
+Arguments:
+
+    Request - WDF request object associated with the mailbox transaction
+
+    Value - Value read from the mailbox
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqMailboxValueComplete (
+    WDFREQUEST Request,
+    ULONG Value
+    )
+{
+    NTSTATUS status;
+    ULONG* outputBufferPtr;
+
+    status = WdfRequestRetrieveOutputBuffer(
+        Request,
+        sizeof(*outputBufferPtr),
+        &outputBufferPtr,
+        NULL);
+    if (!NT_SUCCESS(status)) {
+        RPIQ_LOG_ERROR(
+            "WdfRequestRetrieveOutputBuffer failed %!STATUS!",
+            status);
+        WdfRequestComplete(Request, status);
+        return;
+    }
+
+    *outputBufferPtr = Value & ~MAILBOX_CHANNEL_MASK;
+
+    WdfRequestCompleteWithInformation(
+        Request,
+        STATUS_SUCCESS,
+        sizeof(*outputBufferPtr));
+}
+
+/*++
+
+Routine Description:
+
+    Complete a property request, if the property message holds packed request
+    the response of each tags are copied back to the request they belong to.
+
+Arguments:
+
+    Request - WDF request object that carried the property message
+
+    Status - Status of the property message
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqMailboxPropertyComplete (
+    WDFREQUEST Request,
+    NTSTATUS Status
+    )
+{
+    NTSTATUS status;
+    RPIQ_REQUEST_CONTEXT* requestContextPtr = RpiqGetRequestContext(Request);
+    const UCHAR* messagePtr = (const UCHAR*)requestContextPtr->PropertyMemory;
+    MAILBOX_HEADER* outputBufferPtr;
+    size_t outputSize;
+
+    requestContextPtr->PropertyMemoryInFlight = FALSE;
+
+    if (NT_SUCCESS(Status)) {
+        RpiqCacheUpdate(
+            &requestContextPtr->DeviceContextPtr->PropertyCache,
+            (const MAILBOX_HEADER*)messagePtr,
+            requestContextPtr->PropertyMemorySize);
+    }
+
+    if (requestContextPtr->BatchCount == 0) {
+        if (!NT_SUCCESS(Status)) {
+            WdfRequestComplete(Request, Status);
+            return;
+        }
+
+        status = WdfRequestRetrieveOutputBuffer(
+            Request,
+            requestContextPtr->PropertyMemorySize,
+            &outputBufferPtr,
+            NULL);
+        if (!NT_SUCCESS(status)) {
+            RPIQ_LOG_ERROR(
+                "WdfRequestRetrieveOutputBuffer failed %!STATUS!",
+                status);
+            WdfRequestComplete(Request, status);
+            return;
+        }
+
+        RtlCopyMemory(
+            outputBufferPtr,
+            messagePtr,
+            requestContextPtr->PropertyMemorySize);
+
+        WdfRequestCompleteWithInformation(
+            Request,
+            STATUS_SUCCESS,
+            requestContextPtr->PropertyMemorySize);
+        return;
+    }
+
+    // Complete the carrying request last as its completion releases the
+    // property message memory
+    for (ULONG batchCount = requestContextPtr->BatchCount;
+        batchCount-- > 0;) {
+        WDFREQUEST batchRequest = requestContextPtr->BatchRequest[batchCount];
+
+        requestContextPtr->BatchRequest[batchCount] = NULL;
+
+        if (!NT_SUCCESS(Status)) {
+            WdfRequestComplete(batchRequest, Status);
+            continue;
+        }
+
+        // Input and output share the same buffer so only the response code
+        // and the tags needs to be copied back
+        status = WdfRequestRetrieveOutputBuffer(
+            batchRequest,
+            RPIQ_PROPERTY_HEADER_SIZE +
+                requestContextPtr->BatchTagSize[batchCount],
+            &outputBufferPtr,
+            &outputSize);
+        if (!NT_SUCCESS(status)) {
+            RPIQ_LOG_ERROR(
+                "WdfRequestRetrieveOutputBuffer failed %!STATUS!",
+                status);
+            WdfRequestComplete(batchRequest, status);
+            continue;
+        }
+
+        outputBufferPtr->RequestResponse =
+            ((const MAILBOX_HEADER*)messagePtr)->RequestResponse;
+
+        RtlCopyMemory(
+            (UCHAR*)outputBufferPtr + RPIQ_PROPERTY_HEADER_SIZE,
+            messagePtr + requestContextPtr->BatchTagOffset[batchCount],
+            requestContextPtr->BatchTagSize[batchCount]);
+
+        WdfRequestCompleteWithInformation(
+            batchRequest,
+            STATUS_SUCCESS,
+            outputSize);
+    }
+}
+
+/*++
+
+Routine Description:
+
+    Retrieve the property request the firmware responded to. The firmware
+    responds with the address of the property message so the response is
+    matched to the request sent with it rather than to the oldest request,
+    which may have been cancelled in the meantime.
+
+Arguments:
+
+    DeviceContextPtr - Pointer to device context
+
+    Value - Value read from the mailbox
+
+    RequestPtr - Receives the property request
+
+Return Value:
+
+    STATUS_NOT_FOUND if no pending request was sent with the value
+
+--*/
+_Use_decl_annotations_
+NTSTATUS RpiqMailboxPropertyFind (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    ULONG Value,
+    WDFREQUEST* RequestPtr
+    )
+{
+    NTSTATUS status;
+    WDFQUEUE queue =
+        DeviceContextPtr->ChannelQueue[MAILBOX_CHANNEL_PROPERTY_ARM_VC];
+    WDFREQUEST previousRequest = NULL;
+    WDFREQUEST foundRequest;
+
+    for (;;) {
+        RPIQ_REQUEST_CONTEXT* requestContextPtr;
+
+        status = WdfIoQueueFindRequest(
+            queue,
+            previousRequest,
+            NULL,
+            NULL,
+            &foundRequest);
+        if (previousRequest != NULL) {
+            WdfObjectDereference(previousRequest);
+            previousRequest = NULL;
+        }
+        if (status == STATUS_NOT_FOUND) {
+            // Previous request got cancelled, start over
+            continue;
+        } else if (!NT_SUCCESS(status)) {
+            return STATUS_NOT_FOUND;
+        }
+
+        requestContextPtr = RpiqGetRequestContext(foundRequest);
+        if (requestContextPtr == NULL ||
+            requestContextPtr->PropertyMailboxValue !=
+                (Value & ~MAILBOX_CHANNEL_MASK)) {
+            previousRequest = foundRequest;
+            continue;
+        }
+
+        status = WdfIoQueueRetrieveFoundRequest(
+            queue,
+            foundRequest,
+            RequestPtr);
+        WdfObjectDereference(foundRequest);
+
+        // STATUS_NOT_FOUND if the request got cancelled in the meantime, its
+        // buffer is then released as an orphan
+        return status;
+    }
+}
+
+/*++
+
+Routine Description:
+
+    Release the property buffer of a cancelled request once the firmware
+    responded to it. Pooled buffers return to the pool right away, others
+    are freed by the property work item.
+
+Arguments:
+
+    DeviceContextPtr - Pointer to device context
+
+    Value - Value read from the mailbox
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqMailboxPropertyOrphanResponded (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    ULONG Value
+    )
+{
+    KIRQL irql;
+    LIST_ENTRY* entryPtr;
+    RPIQ_PROPERTY_ORPHAN* orphanPtr = NULL;
+
+    KeAcquireSpinLock(&DeviceContextPtr->PropertyPoolLock, &irql);
+
+    for (entryPtr = DeviceContextPtr->PropertyOrphanList.Flink;
+        entryPtr != &DeviceContextPtr->PropertyOrphanList;
+        entryPtr = entryPtr->Flink) {
+        RPIQ_PROPERTY_ORPHAN* candidatePtr =
+            CONTAINING_RECORD(entryPtr, RPIQ_PROPERTY_ORPHAN, ListEntry);
+
+        if (!candidatePtr->Responded &&
+            candidatePtr->PropertyMailboxValue ==
+                (Value & ~MAILBOX_CHANNEL_MASK)) {
+            orphanPtr = candidatePtr;
+            break;
+        }
+    }
+
+    if (orphanPtr == NULL) {
+        KeReleaseSpinLock(&DeviceContextPtr->PropertyPoolLock, irql);
+        RPIQ_LOG_WARNING("Property response without request 0x%08x", Value);
+        return;
+    }
+
+    if (orphanPtr->PropertyMemoryPooled) {
+        RemoveEntryList(&orphanPtr->ListEntry);
+        PushEntryList(
+            &DeviceContextPtr->PropertyPoolFreeList,
+            (SINGLE_LIST_ENTRY*)orphanPtr->PropertyMemory);
+    } else {
+        orphanPtr->Responded = TRUE;
+        orphanPtr = NULL;
+    }
+
+    KeReleaseSpinLock(&DeviceContextPtr->PropertyPoolLock, irql);
+
+    if (orphanPtr != NULL) {
+        ExFreePoolWithTag(orphanPtr, RpiqTag);
+    }
+}
+
+/*++
+
+Routine Description:
+
+    RpiqRequestContextCleanup would perform cleanup
+        when request object is delete.
+
+Arguments:
+
+    WdfObject - A handle to a framework object in this case
+         a WDFRequest
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID RpiqRequestContextCleanup (
+    WDFOBJECT WdfObject
+    )
+{
+    RPIQ_REQUEST_CONTEXT* requestContextPtr =
+        RpiqGetRequestContext(WdfObject);
+    
+    // Carrying request got cancelled, cancel the request packed along
+    for (ULONG batchCount = 1;
+        batchCount < requestContextPtr->BatchCount;
+        ++batchCount) {
+        if (requestContextPtr->BatchRequest[batchCount]) {
+            WdfRequestComplete(
+                requestContextPtr->BatchRequest[batchCount],
+                STATUS_CANCELLED);
+            requestContextPtr->BatchRequest[batchCount] = NULL;
+        }
+    }
+
+    if (requestContextPtr->PropertyMemory) {
+        if (requestContextPtr->PropertyMemoryInFlight) {
+            DEVICE_CONTEXT* deviceContextPtr =
+                requestContextPtr->DeviceContextPtr;
+            RPIQ_PROPERTY_ORPHAN* orphanPtr;
+
+            // Request cancelled before the firmware responded, the firmware
+            // may still write to the buffer so it is kept until the response
+            // arrives
+            orphanPtr = ExAllocatePoolWithTag(
+                NonPagedPoolNx,
+                sizeof(*orphanPtr),
+                RpiqTag);
+            if (orphanPtr == NULL) {
+                // Leaked rather than reused while the firmware owns it
+                RPIQ_LOG_ERROR("Fail to allocate property orphan");
+                requestContextPtr->PropertyMemory = NULL;
+                return;
+            }
+
+            RtlZeroMemory(orphanPtr, sizeof(*orphanPtr));
+            orphanPtr->PropertyMemory = requestContextPtr->PropertyMemory;
+            orphanPtr->PropertyMailboxValue =
+                requestContextPtr->PropertyMailboxValue;
+            orphanPtr->PropertyMemoryPooled =
+                requestContextPtr->PropertyMemoryPooled;
+
+            ExInterlockedInsertTailList(
+                &deviceContextPtr->PropertyOrphanList,
+                &orphanPtr->ListEntry,
+                &deviceContextPtr->PropertyPoolLock);
+        } else if (requestContextPtr->PropertyMemoryPooled) {
+            DEVICE_CONTEXT* deviceContextPtr =
+                requestContextPtr->DeviceContextPtr;
+
+            ExInterlockedPushEntryList(
+                &deviceContextPtr->PropertyPoolFreeList,
+                (SINGLE_LIST_ENTRY*)requestContextPtr->PropertyMemory,
+                &deviceContextPtr->PropertyPoolLock);
+        } else {
+            MmFreeContiguousMemory(requestContextPtr->PropertyMemory);
+        }
+        requestContextPtr->PropertyMemory = NULL;
     }
 }
 
@@ -16,20 +16,74 @@ EXTERN_C_START
 
 #define MAX_POLL        50
 
+// Property message layout, a message starts with the total buffer size and
+// request/response code followed by the tags and a terminating end tag. Each
+// tag starts with its id, value buffer size and request/response code.
+#define RPIQ_PROPERTY_HEADER_SIZE       (2 * sizeof(ULONG))
+#define RPIQ_PROPERTY_TAG_HEADER_SIZE   (3 * sizeof(ULONG))
+#define RPIQ_PROPERTY_END_TAG           0x00000000
+
+// Preallocated contiguous property buffers. Property request that fit in a
+// pool buffer avoid a contiguous memory allocation per request. The lower
+// bits of the mailbox value carry the channel so buffers needs to be aligned.
+#define RPIQ_PROPERTY_POOL_COUNT        8
+#define RPIQ_PROPERTY_BUFFER_SIZE       1024
+
+C_ASSERT((RPIQ_PROPERTY_BUFFER_SIZE & MAILBOX_CHANNEL_MASK) == 0);
+
+// Maximum number of property request packed into a single property message
+#define RPIQ_PROPERTY_BATCH_MAX         8
+
+// Maximum number of property message in flight. Having the next message
+// queued in the mailbox hides the latency between a response and the next
+// request, further message are better off being packed.
+#define RPIQ_PROPERTY_INFLIGHT_MAX      2
+
+C_ASSERT(RPIQ_PROPERTY_INFLIGHT_MAX <= RPIQ_PROPERTY_POOL_COUNT);
+
 typedef struct _RPIQ_REQUEST_CONTEXT {
+    DEVICE_CONTEXT* DeviceContextPtr;
     VOID* PropertyMemory;
     ULONG PropertyMemorySize;
+    BOOLEAN PropertyMemoryPooled;
+    BOOLEAN PropertyMemoryInFlight;
+
+    // Mailbox value of the property message without the channel. The
+    // firmware responds with the same value, which identifies the request.
+    ULONG PropertyMailboxValue;
+
+    // Requests packed into the property message, the first entry is the
+    // request carrying the message. Zero if the message was sent as is.
+    ULONG BatchCount;
+    WDFREQUEST BatchRequest[RPIQ_PROPERTY_BATCH_MAX];
+    ULONG BatchTagOffset[RPIQ_PROPERTY_BATCH_MAX];
+    ULONG BatchTagSize[RPIQ_PROPERTY_BATCH_MAX];
 } RPIQ_REQUEST_CONTEXT, *PRPIQ_REQUEST_CONTEXT;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(
     RPIQ_REQUEST_CONTEXT,
     RpiqGetRequestContext);
 
+// Property buffer the firmware may still write to after its request got
+// cancelled
+typedef struct _RPIQ_PROPERTY_ORPHAN {
+    LIST_ENTRY ListEntry;
+    VOID* PropertyMemory;
+    ULONG PropertyMailboxValue;
+    BOOLEAN PropertyMemoryPooled;
+    BOOLEAN Responded;
+} RPIQ_PROPERTY_ORPHAN, *PRPIQ_PROPERTY_ORPHAN;
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS RpiqMailboxInit (
     _In_ WDFDEVICE Device
     );
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID RpiqMailboxRelease (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr
+    );
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS RpiqMailboxWrite (
     _In_ DEVICE_CONTEXT* DeviceContextPtr,
@@ -38,6 +92,20 @@ NTSTATUS RpiqMailboxWrite (
     _In_opt_ WDFREQUEST Request
     );
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS RpiqMailboxTryWrite (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ ULONG Channel,
+    _In_ ULONG Value,
+    _In_opt_ WDFREQUEST Request
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID RpiqMailboxValueComplete (
+    _In_ WDFREQUEST Request,
+    _In_ ULONG Value
+    );
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS RpiqMailboxProperty (
     _In_ DEVICE_CONTEXT* DeviceContextPtr,
@@ -47,6 +115,67 @@ NTSTATUS RpiqMailboxProperty (
     _In_ WDFREQUEST Request
     );
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS RpiqAllocatePropertyMemory (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ WDFREQUEST Request,
+    _In_ ULONG DataSize,
+    _Out_ RPIQ_REQUEST_CONTEXT** RequestContextPtrPtr
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS RpiqMailboxPropertyTagSize (
+    _In_reads_bytes_(PropertySize) const MAILBOX_HEADER* PropertyPtr,
+    _In_ ULONG PropertySize,
+    _Out_ ULONG* TagSizePtr
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS RpiqMailboxPropertyNext (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _Out_ WDFREQUEST* RequestPtr,
+    _Out_ MAILBOX_HEADER** PropertyPtrPtr,
+    _Out_ ULONG* PropertySizePtr,
+    _Out_ ULONG* TagSizePtr
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS RpiqMailboxPropertyBatch (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID RpiqMailboxPropertyFlush (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID RpiqMailboxPropertyComplete (
+    _In_ WDFREQUEST Request,
+    _In_ NTSTATUS Status
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS RpiqMailboxPropertyFind (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ ULONG Value,
+    _Out_ WDFREQUEST* RequestPtr
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID RpiqMailboxPropertyOrphanResponded (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ ULONG Value
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID RpiqMailboxPropertyOrphanFree (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ BOOLEAN RespondedOnly
+    );
+
+EVT_WDF_WORKITEM RpiqMailboxPropertyWorkItem;
+
 EVT_WDF_OBJECT_CONTEXT_CLEANUP RpiqRequestContextCleanup;
 
 EXTERN_C_END
@@ -99,16 +99,46 @@ typedef struct _DEVICE_CONTEXT {
     BOOLEAN VCConnected;
     BOOLEAN DeviceInterfaceEnabled;
 
-    // Tx slot info
+    // Tx slot info. CurrentTxPos is the end of the last reserved message,
+    // TxPublishedPos the end of the last message made visible to VC.
     ULONG CurrentTxPos;
+    volatile LONG TxPublishedPos;
+    KEVENT TxPublishedEvent;
     ULONG RecycleTxSlotIndex;
     KSEMAPHORE AvailableTxSlot;
     volatile LONG AvailableTxSlotCount;
 
+    // Bulk receive fragments. Free fragments are linked through their first
+    // pointer, FragmentLock protects FreeFragmentPtr.
+    FRAGMENTS* FragmentBasePtr;
+    FRAGMENTS* FreeFragmentPtr;
+    KSPIN_LOCK FragmentLock;
+
+    // Doorbell coalescing. VC is only signalled once DoorbellBatchCount
+    // published messages are pending or DoorbellTimer expires.
+    ULONG DoorbellBatchCount;
+    LARGE_INTEGER DoorbellBatchTimeout;
+    volatile LONG DoorbellPendingCount;
+    EX_TIMER* DoorbellTimer;
+
     // Rx slot info
     ULONG CurrentRxPos;
     SLOT_INFO RxSlotInfo[VCHIQ_MAX_SLOTS];
 
+    // Number of polls for new messages before the trigger interrupt is
+    // armed again
+    ULONG RxPollCount;
+
+#if VCHIQ_ENABLE_STATS
+    // Message and interrupt counters, reported when the slots are released
+    struct {
+        volatile LONG64 TxMsgCount;
+        volatile LONG64 TxDoorbellCount;
+        ULONG64 RxMsgCount;
+        volatile LONG64 RxInterruptCount;
+    } Stats;
+#endif
+
     //VHIQ system thread
     KEVENT VchiqThreadEvent[THREAD_TOTAL];
     HANDLE VchiqThreadHandle[THREAD_TOTAL];
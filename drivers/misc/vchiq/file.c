@@ -19,6 +19,7 @@
 #include "device.h"
 #include "file.h"
 #include "slots.h"
+#include "memory.h"
 
 VCHIQ_PAGED_SEGMENT_BEGIN
 
@@ -106,40 +107,32 @@ NTSTATUS VchiqAllocateFileObjContext (
         }
     }
 
-    // Initialize lookaside memory for pending data message
+    // Initialize record pools for pending data message
     // and pending bulk done message
-    {
-        WDF_OBJECT_ATTRIBUTES_INIT(&wdfObjectAttributes);
-        wdfObjectAttributes.ParentObject = WdfFileObject;
-        status = WdfLookasideListCreate(
-            &wdfObjectAttributes,
-            sizeof(VCHIQ_PENDING_MSG),
-            PagedPool,
-            &wdfObjectAttributes,
-            VCHIQ_ALLOC_TAG_PENDING_MSG,
-            &(*VchiqFileContextPPtr)->PendingMsgLookAsideMemory);
-        if (!NT_SUCCESS(status)) {
-            VCHIQ_LOG_ERROR(
-                "WdfLookasideListCreate failed %!STATUS!)",
-                status);
-            goto End;
-        }
+    status = VchiqInitMsgPool(
+        WdfFileObject,
+        &(*VchiqFileContextPPtr)->PendingMsgPool,
+        sizeof(VCHIQ_PENDING_MSG),
+        VCHIQ_PENDING_MSG_POOL_SIZE,
+        VCHIQ_ALLOC_TAG_PENDING_MSG);
+    if (!NT_SUCCESS(status)) {
+        VCHIQ_LOG_ERROR(
+            "VchiqInitMsgPool failed %!STATUS!)",
+            status);
+        goto End;
+    }
 
-        WDF_OBJECT_ATTRIBUTES_INIT(&wdfObjectAttributes);
-        wdfObjectAttributes.ParentObject = WdfFileObject;
-        status = WdfLookasideListCreate(
-            &wdfObjectAttributes,
-            sizeof(VCHIQ_PENDING_BULK_MSG),
-            PagedPool,
-            &wdfObjectAttributes,
-            VCHIQ_ALLOC_TAG_PENDING_BULK_MSG,
-            &(*VchiqFileContextPPtr)->PendingBulkMsgLookAsideMemory);
-        if (!NT_SUCCESS(status)) {
-            VCHIQ_LOG_ERROR(
-                "WdfLookasideListCreate failed %!STATUS!)",
-                status);
-            goto End;
-        }
+    status = VchiqInitMsgPool(
+        WdfFileObject,
+        &(*VchiqFileContextPPtr)->PendingBulkMsgPool,
+        sizeof(VCHIQ_PENDING_BULK_MSG),
+        VCHIQ_PENDING_BULK_MSG_POOL_SIZE,
+        VCHIQ_ALLOC_TAG_PENDING_BULK_MSG);
+    if (!NT_SUCCESS(status)) {
+        VCHIQ_LOG_ERROR(
+            "VchiqInitMsgPool failed %!STATUS!)",
+            status);
+        goto End;
     }
 
     InitializeListHead(&(*VchiqFileContextPPtr)->PendingDataMsgList);
@@ -305,6 +298,17 @@ VOID VchiqFileClose (
 
     ExReleaseFastMutex(&vchiqFileContextPtr->PendingVchiMsgMutex);
 
+#if VCHIQ_ENABLE_STATS
+    VCHIQ_LOG_INFORMATION(
+        "Port %d pending message records high water %d lookaside %d, \
+        bulk records high water %d lookaside %d",
+        vchiqFileContextPtr->ArmPortNumber,
+        vchiqFileContextPtr->PendingMsgPool.HighWaterMark,
+        vchiqFileContextPtr->PendingMsgPool.LookAsideAllocCount,
+        vchiqFileContextPtr->PendingBulkMsgPool.HighWaterMark,
+        vchiqFileContextPtr->PendingBulkMsgPool.LookAsideAllocCount);
+#endif
+
     if (vchiqFileContextPtr->DmaAdapterPtr) {
         vchiqFileContextPtr->DmaAdapterPtr->DmaOperations->PutDmaAdapter(
             vchiqFileContextPtr->DmaAdapterPtr);
@@ -39,14 +39,21 @@ typedef enum _SERVICE_STATE {
     SERVICE_STATE_CLOSE = 2,
 }_ERVICE_STATE;
 
+// Pending message records preallocated per file handle. Every VC slot
+// holds at least one message and the firmware can fill all of them before
+// the client dequeues. Pending bulk transfers are limited per service.
+#define VCHIQ_PENDING_MSG_POOL_SIZE       VCHIQ_MAX_SLOTS_PER_SIDE
+#define VCHIQ_PENDING_BULK_MSG_POOL_SIZE  \
+    (VCHIQ_NUM_SERVICE_BULKS * MSG_BULK_MAX)
+
 typedef struct _VCHIQ_FILE_CONTEXT {
     ULONG    ArmPortNumber;
     ULONG    VCHIQPortNumber;
     
-    // Lookaside memory per file handle to take advantage
+    // Record pools per file handle to take advantage
     // of WDF memory cleanup by parenting to file object
-    WDFLOOKASIDE PendingMsgLookAsideMemory;
-    WDFLOOKASIDE PendingBulkMsgLookAsideMemory;
+    VCHIQ_MSG_POOL PendingMsgPool;
+    VCHIQ_MSG_POOL PendingBulkMsgPool;
 
     LIST_ENTRY PendingDataMsgList;
     FAST_MUTEX PendingDataMsgMutex;
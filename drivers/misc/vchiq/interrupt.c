@@ -169,6 +169,10 @@ VOID VchiqDpc (
     if (slotZeroPtr->Slave.Trigger.Armed &&
         slotZeroPtr->Slave.Trigger.Fired) {
 
+#if VCHIQ_ENABLE_STATS
+        InterlockedIncrement64(&deviceContextPtr->Stats.RxInterruptCount);
+#endif
+
         slotZeroPtr->Slave.Trigger.Armed = 0;
         KeSetEvent(
             &deviceContextPtr->VchiqThreadEvent[THREAD_TRIGGER], 
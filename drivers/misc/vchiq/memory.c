@@ -136,6 +136,276 @@ End:
     return status;
 }
 
+/*++
+
+Routine Description:
+
+    Initializes a pending message record pool. The slab and the lookaside
+        list are parented to ParentObject and released with it.
+
+Arguments:
+
+    ParentObject - Framework object that owns the pool memory
+
+    MsgPoolPtr - Pool to be initialized
+
+    RecordSize - Size of a single record, at least the size of a pointer
+
+    RecordCount - Number of records allocated up front
+
+    PoolTag - Pool tag for the slab and lookaside allocations
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+_Use_decl_annotations_
+NTSTATUS VchiqInitMsgPool (
+    WDFOBJECT ParentObject,
+    VCHIQ_MSG_POOL* MsgPoolPtr,
+    size_t RecordSize,
+    ULONG RecordCount,
+    ULONG PoolTag
+    )
+{
+    NTSTATUS status;
+    WDF_OBJECT_ATTRIBUTES wdfObjectAttributes;
+    WDFMEMORY slabWdfMemory;
+    UCHAR* slabPtr;
+
+    PAGED_CODE();
+
+    NT_ASSERT(RecordSize >= sizeof(VOID*));
+
+    RtlZeroMemory(MsgPoolPtr, sizeof(*MsgPoolPtr));
+    ExInitializeFastMutex(&MsgPoolPtr->Mutex);
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&wdfObjectAttributes);
+    wdfObjectAttributes.ParentObject = ParentObject;
+    status = WdfLookasideListCreate(
+        &wdfObjectAttributes,
+        RecordSize,
+        PagedPool,
+        &wdfObjectAttributes,
+        PoolTag,
+        &MsgPoolPtr->LookAsideMemory);
+    if (!NT_SUCCESS(status)) {
+        VCHIQ_LOG_ERROR(
+            "WdfLookasideListCreate failed %!STATUS!)",
+            status);
+        goto End;
+    }
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&wdfObjectAttributes);
+    wdfObjectAttributes.ParentObject = ParentObject;
+    status = WdfMemoryCreate(
+        &wdfObjectAttributes,
+        PagedPool,
+        PoolTag,
+        RecordSize * RecordCount,
+        &slabWdfMemory,
+        &slabPtr);
+    if (!NT_SUCCESS(status)) {
+        VCHIQ_LOG_ERROR(
+            "WdfMemoryCreate for record slab failed %!STATUS!)",
+            status);
+        goto End;
+    }
+
+    for (ULONG recordCount = 0; recordCount < RecordCount; ++recordCount) {
+        VOID* recordPtr = slabPtr + (recordCount * RecordSize);
+
+        *(VOID**)recordPtr = MsgPoolPtr->FreeListPtr;
+        MsgPoolPtr->FreeListPtr = recordPtr;
+    }
+
+End:
+    return status;
+}
+
+/*++
+
+Routine Description:
+
+    Takes a record from the pool, falling back to the lookaside list
+        when the slab is exhausted.
+
+Arguments:
+
+    MsgPoolPtr - Pool to allocate from
+
+    RecordPPtr - Pointer to the allocated record
+
+    WdfMemoryPtr - Memory object backing the record or NULL if the record
+        came from the slab
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+_Use_decl_annotations_
+NTSTATUS VchiqAllocMsgPoolRecord (
+    VCHIQ_MSG_POOL* MsgPoolPtr,
+    VOID** RecordPPtr,
+    WDFMEMORY* WdfMemoryPtr
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    VOID* recordPtr;
+
+    PAGED_CODE();
+
+    *WdfMemoryPtr = NULL;
+
+    ExAcquireFastMutex(&MsgPoolPtr->Mutex);
+
+    recordPtr = MsgPoolPtr->FreeListPtr;
+    if (recordPtr != NULL) {
+        MsgPoolPtr->FreeListPtr = *(VOID**)recordPtr;
+    } else {
+        ++MsgPoolPtr->LookAsideAllocCount;
+    }
+
+    ++MsgPoolPtr->InUseCount;
+    if (MsgPoolPtr->InUseCount > MsgPoolPtr->HighWaterMark) {
+        MsgPoolPtr->HighWaterMark = MsgPoolPtr->InUseCount;
+    }
+
+    ExReleaseFastMutex(&MsgPoolPtr->Mutex);
+
+    if (recordPtr == NULL) {
+        status = WdfMemoryCreateFromLookaside(
+            MsgPoolPtr->LookAsideMemory,
+            WdfMemoryPtr);
+        if (!NT_SUCCESS(status)) {
+            VCHIQ_LOG_ERROR(
+                "WdfMemoryCreateFromLookaside failed %!STATUS!)",
+                status);
+
+            ExAcquireFastMutex(&MsgPoolPtr->Mutex);
+            --MsgPoolPtr->InUseCount;
+            ExReleaseFastMutex(&MsgPoolPtr->Mutex);
+
+            *WdfMemoryPtr = NULL;
+            goto End;
+        }
+
+        recordPtr = WdfMemoryGetBuffer(*WdfMemoryPtr, NULL);
+    }
+
+    *RecordPPtr = recordPtr;
+
+End:
+    return status;
+}
+
+/*++
+
+Routine Description:
+
+    Returns a record to the pool.
+
+Arguments:
+
+    MsgPoolPtr - Pool the record was allocated from
+
+    RecordPtr - Record to be released
+
+    WdfMemory - Memory object returned with the record
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID VchiqFreeMsgPoolRecord (
+    VCHIQ_MSG_POOL* MsgPoolPtr,
+    VOID* RecordPtr,
+    WDFMEMORY WdfMemory
+    )
+{
+    PAGED_CODE();
+
+    ExAcquireFastMutex(&MsgPoolPtr->Mutex);
+
+    --MsgPoolPtr->InUseCount;
+    if (WdfMemory == NULL) {
+        *(VOID**)RecordPtr = MsgPoolPtr->FreeListPtr;
+        MsgPoolPtr->FreeListPtr = RecordPtr;
+    }
+
+    ExReleaseFastMutex(&MsgPoolPtr->Mutex);
+
+    if (WdfMemory != NULL) {
+        WdfObjectDelete(WdfMemory);
+    }
+}
+
+/*++
+
+Routine Description:
+
+    Returns a pending data message record to the file pool.
+
+Arguments:
+
+    VchiqFileContextPtr - File context the record belongs to
+
+    PendingMsgPtr - Record to be released
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID VchiqFreePendingMsg (
+    VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    VCHIQ_PENDING_MSG* PendingMsgPtr
+    )
+{
+    PAGED_CODE();
+
+    VchiqFreeMsgPoolRecord(
+        &VchiqFileContextPtr->PendingMsgPool,
+        PendingMsgPtr,
+        PendingMsgPtr->WdfMemory);
+}
+
+/*++
+
+Routine Description:
+
+    Returns a pending bulk message record to the file pool.
+
+Arguments:
+
+    VchiqFileContextPtr - File context the record belongs to
+
+    PendingBulkMsgPtr - Record to be released
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID VchiqFreePendingBulkMsg (
+    VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    VCHIQ_PENDING_BULK_MSG* PendingBulkMsgPtr
+    )
+{
+    PAGED_CODE();
+
+    VchiqFreeMsgPoolRecord(
+        &VchiqFileContextPtr->PendingBulkMsgPool,
+        PendingBulkMsgPtr,
+        PendingBulkMsgPtr->WdfMemory);
+}
+
 VCHIQ_PAGED_SEGMENT_END
 
 VCHIQ_NONPAGED_SEGMENT_BEGIN
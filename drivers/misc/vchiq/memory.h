@@ -39,6 +39,41 @@ NTSTATUS VchiqFreeCommonBuffer (
     _In_ VOID* BufferPtr
     );
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS VchiqInitMsgPool (
+    _In_ WDFOBJECT ParentObject,
+    _Out_ VCHIQ_MSG_POOL* MsgPoolPtr,
+    _In_ size_t RecordSize,
+    _In_ ULONG RecordCount,
+    _In_ ULONG PoolTag
+    );
+
+_IRQL_requires_max_(APC_LEVEL)
+NTSTATUS VchiqAllocMsgPoolRecord (
+    _In_ VCHIQ_MSG_POOL* MsgPoolPtr,
+    _Outptr_ VOID** RecordPPtr,
+    _Out_ WDFMEMORY* WdfMemoryPtr
+    );
+
+_IRQL_requires_max_(APC_LEVEL)
+VOID VchiqFreeMsgPoolRecord (
+    _In_ VCHIQ_MSG_POOL* MsgPoolPtr,
+    _In_ VOID* RecordPtr,
+    _In_opt_ WDFMEMORY WdfMemory
+    );
+
+_IRQL_requires_max_(APC_LEVEL)
+VOID VchiqFreePendingMsg (
+    _In_ VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    _In_ VCHIQ_PENDING_MSG* PendingMsgPtr
+    );
+
+_IRQL_requires_max_(APC_LEVEL)
+VOID VchiqFreePendingBulkMsg (
+    _In_ VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    _In_ VCHIQ_PENDING_BULK_MSG* PendingBulkMsgPtr
+    );
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 NTSTATUS VchiqFreePhyContiguous (
     _In_ DEVICE_CONTEXT* DeviceContextPtr,
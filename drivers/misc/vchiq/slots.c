@@ -49,7 +49,7 @@ NTSTATUS VchiqInit (
     ULONG slotMemorySize = (VCHIQ_DEFAULT_TOTAL_SLOTS * VCHIQ_SLOT_SIZE);
     // 2 * (cache line size) * (max fragments)
     // cache line is based on cache-line-size = <32> at bcm2835-rpi.dtsi
-    ULONG fragMemorySize = 2 * 32 * VCHIQ_MAX_FRAGMENTS;
+    ULONG fragMemorySize = sizeof(FRAGMENTS) * VCHIQ_MAX_FRAGMENTS;
     ULONG totalMemorySize = slotMemorySize + fragMemorySize;
 
     PAGED_CODE();
@@ -141,20 +141,45 @@ NTSTATUS VchiqInit (
     slotZeroPtr->PlatformData[VCHIQ_PLATFORM_FRAGMENTS_COUNT_IDX] =
         VCHIQ_MAX_FRAGMENTS;
     {
-        UCHAR* fragmentBasePtr =
+        FRAGMENTS* fragmentBasePtr = (FRAGMENTS*)
             ((UCHAR*)DeviceContextPtr->SlotZeroPtr + slotMemorySize);
 
         ULONG i;
         for (i = 0; i < (VCHIQ_MAX_FRAGMENTS - 1); ++i) {
-            *(UCHAR **)&fragmentBasePtr[i * 2 * 32] =
-                &fragmentBasePtr[(i + 1) * (2 * 32)];
+            *(FRAGMENTS**)&fragmentBasePtr[i] = &fragmentBasePtr[i + 1];
         }
-        *(char **)&fragmentBasePtr[i * (2 * 32)] = NULL;
+        *(FRAGMENTS**)&fragmentBasePtr[i] = NULL;
+
+        DeviceContextPtr->FragmentBasePtr = fragmentBasePtr;
+        DeviceContextPtr->FreeFragmentPtr = fragmentBasePtr;
+        KeInitializeSpinLock(&DeviceContextPtr->FragmentLock);
     }
 
     // Initialize all the slot processing threads and locks
     ExInitializeFastMutex(&DeviceContextPtr->TxSlotMutex);
     ExInitializeFastMutex(&DeviceContextPtr->RecycleSlotMutex);
+    KeInitializeEvent(
+        &DeviceContextPtr->TxPublishedEvent,
+        NotificationEvent,
+        FALSE);
+
+    // Initialize doorbell coalescing
+    VchiqReadCoalescingParameters(DeviceContextPtr);
+    DeviceContextPtr->DoorbellPendingCount = 0;
+
+    // The batch timeout is in the hundreds of microseconds, well below the
+    // system clock resolution, so the doorbell needs a high resolution timer.
+    DeviceContextPtr->DoorbellTimer = ExAllocateTimer(
+        VchiqDoorbellTimerCallback,
+        DeviceContextPtr,
+        EX_TIMER_HIGH_RESOLUTION);
+    if (DeviceContextPtr->DoorbellTimer == NULL) {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        VCHIQ_LOG_ERROR(
+            "Failed to allocate doorbell timer %!STATUS!",
+            status);
+        goto End;
+    }
 
     // Initialize event and thread objects
     KeInitializeEvent(
@@ -228,6 +253,85 @@ End:
 
 /*++
 
+Routine Description:
+
+     Read the doorbell and interrupt coalescing settings from the driver
+     Parameters registry key. Missing or out of range values fall back to
+     the defaults.
+
+Arguments:
+
+     DeviceContextPtr - A pointer to the device context.
+
+Return Value:
+
+     VOID
+
+--*/
+_Use_decl_annotations_
+VOID VchiqReadCoalescingParameters (
+    DEVICE_CONTEXT* DeviceContextPtr
+    )
+{
+    NTSTATUS status;
+    WDFKEY parametersKey;
+    ULONG batchCount = VCHIQ_DOORBELL_BATCH_COUNT_DEFAULT;
+    ULONG batchTimeoutUs = VCHIQ_DOORBELL_BATCH_TIMEOUT_US_DEFAULT;
+    ULONG rxPollCount = VCHIQ_RX_POLL_COUNT_DEFAULT;
+
+    PAGED_CODE();
+
+    status = WdfDriverOpenParametersRegistryKey(
+        WdfGetDriver(),
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &parametersKey);
+    if (NT_SUCCESS(status)) {
+        DECLARE_CONST_UNICODE_STRING(
+            batchCountName,
+            VCHIQ_REG_DOORBELL_BATCH_COUNT);
+        DECLARE_CONST_UNICODE_STRING(
+            batchTimeoutName,
+            VCHIQ_REG_DOORBELL_BATCH_TIMEOUT_US);
+        DECLARE_CONST_UNICODE_STRING(
+            rxPollCountName,
+            VCHIQ_REG_RX_POLL_COUNT);
+        ULONG value;
+
+        status = WdfRegistryQueryULong(parametersKey, &batchCountName, &value);
+        if (NT_SUCCESS(status) &&
+            (value != 0) &&
+            (value <= VCHIQ_DOORBELL_BATCH_COUNT_MAX)) {
+            batchCount = value;
+        }
+
+        status = WdfRegistryQueryULong(parametersKey, &batchTimeoutName, &value);
+        if (NT_SUCCESS(status) && (value != 0)) {
+            batchTimeoutUs = value;
+        }
+
+        status = WdfRegistryQueryULong(parametersKey, &rxPollCountName, &value);
+        if (NT_SUCCESS(status) && (value <= VCHIQ_RX_POLL_COUNT_MAX)) {
+            rxPollCount = value;
+        }
+
+        WdfRegistryClose(parametersKey);
+    }
+
+    DeviceContextPtr->DoorbellBatchCount = batchCount;
+    DeviceContextPtr->DoorbellBatchTimeout.QuadPart =
+        WDF_REL_TIMEOUT_IN_US(batchTimeoutUs);
+    DeviceContextPtr->RxPollCount = rxPollCount;
+
+    VCHIQ_LOG_INFORMATION(
+        "Doorbell batch %d timeout %dus, Rx poll count %d",
+        batchCount,
+        batchTimeoutUs,
+        rxPollCount);
+}
+
+/*++
+
 Routine Description:
 
      Release VCHIQ related resource.
@@ -248,6 +352,21 @@ NTSTATUS VchiqRelease (
 {
     PAGED_CODE();
 
+    // Make sure the doorbell timer no longer touches slot memory
+    if (DeviceContextPtr->DoorbellTimer != NULL) {
+        (void)ExDeleteTimer(DeviceContextPtr->DoorbellTimer, TRUE, TRUE, NULL);
+        DeviceContextPtr->DoorbellTimer = NULL;
+    }
+
+#if VCHIQ_ENABLE_STATS
+    VCHIQ_LOG_INFORMATION(
+        "Tx messages %I64d doorbells %I64d, Rx messages %I64u interrupts %I64d",
+        DeviceContextPtr->Stats.TxMsgCount,
+        DeviceContextPtr->Stats.TxDoorbellCount,
+        DeviceContextPtr->Stats.RxMsgCount,
+        DeviceContextPtr->Stats.RxInterruptCount);
+#endif
+
     VchiqFreePhyContiguous(
         DeviceContextPtr,
         &DeviceContextPtr->SlotZeroPtr);
@@ -290,43 +409,6 @@ NTSTATUS VchiqRelease (
     return STATUS_SUCCESS;
 }
 
-/*++
-
-Routine Description:
-
-     Signals VC that there is a pending slot to be processed.
-
-Arguments:
-
-     DeviceContextPtr - A pointer to the device context.
-
-     EventPtr - Pointer to the event to be signalled
-
-Return Value:
-
-     NTSTATUS
-
---*/
-_Use_decl_annotations_
-NTSTATUS VchiqSignalVC (
-    DEVICE_CONTEXT* DeviceContextPtr,
-    VCHIQ_REMOTE_EVENT* EventPtr
-    )
-{
-    PAGED_CODE();
-
-    // Indicate that we to VC side that the event has been triggered
-    EventPtr->Fired = 1;
-
-    if (EventPtr->Armed) {
-        WRITE_REGISTER_NOFENCE_ULONG(
-            (ULONG*)(DeviceContextPtr->VchiqRegisterPtr + BELL2), 0);
-    }
-
-    return STATUS_SUCCESS;
-}
-
-
 /*++
 
 Routine Description:
@@ -440,6 +522,162 @@ End:
 
 /*++
 
+Routine Description:
+
+     Reserve space for a message in the transfer slots. Only the
+     reservation is serialized by TxSlotMutex, so producers can copy
+     their messages into the reserved space in parallel. Every successful
+     reservation has to be made visible to VC with VchiqPublishTxSpace.
+
+Arguments:
+
+     DeviceContextPtr - A pointer to the device context.
+
+     VchiqFileContextPtr - File context pointer returned to caller
+
+     RequestSize - Message size including the header
+
+     HeaderPPtr - Pointer to the reserved message location
+
+     ReserveStartPtr - Transfer position before the reservation
+
+     ReserveEndPtr - Transfer position after the reservation
+
+Return Value:
+
+     NTSTATUS
+
+--*/
+_Use_decl_annotations_
+NTSTATUS VchiqReserveTxSpace (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    ULONG RequestSize,
+    VCHIQ_HEADER** HeaderPPtr,
+    ULONG* ReserveStartPtr,
+    ULONG* ReserveEndPtr
+    )
+{
+    NTSTATUS status;
+    ULONG reserveStart;
+    ULONG reserveEnd;
+
+    PAGED_CODE();
+
+    ExAcquireFastMutex(&DeviceContextPtr->TxSlotMutex);
+
+    reserveStart = DeviceContextPtr->CurrentTxPos;
+
+    status = VchiqAcquireTxSpace(
+        DeviceContextPtr,
+        VchiqFileContextPtr,
+        RequestSize,
+        FALSE,
+        HeaderPPtr);
+
+    reserveEnd = DeviceContextPtr->CurrentTxPos;
+
+    ExReleaseFastMutex(&DeviceContextPtr->TxSlotMutex);
+
+    // A failed reservation may still have padded out the current slot.
+    // Publish the padding so later reservations do not wait on it.
+    if (!NT_SUCCESS(status) && (reserveStart != reserveEnd)) {
+        (void)VchiqPublishTxSpace(
+            DeviceContextPtr,
+            reserveStart,
+            reserveEnd);
+    }
+
+    *ReserveStartPtr = reserveStart;
+    *ReserveEndPtr = reserveEnd;
+
+    return status;
+}
+
+/*++
+
+Routine Description:
+
+     Make a filled reservation visible to VC and signal it. Reservations
+     are published in the order they were made, so this waits until all
+     earlier reservations have been published. With doorbell coalescing
+     enabled the signal may be deferred to a later message or the doorbell
+     timer.
+
+Arguments:
+
+     DeviceContextPtr - A pointer to the device context.
+
+     ReserveStart - Transfer position before the reservation
+
+     ReserveEnd - Transfer position after the reservation
+
+Return Value:
+
+     NTSTATUS
+
+--*/
+_Use_decl_annotations_
+NTSTATUS VchiqPublishTxSpace (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    ULONG ReserveStart,
+    ULONG ReserveEnd
+    )
+{
+    VCHIQ_SLOT_ZERO* slotZeroPtr = DeviceContextPtr->SlotZeroPtr;
+    ULONG spinCount = 0;
+    LONG pendingCount;
+
+    PAGED_CODE();
+
+    // Earlier producers are only copying their message, so spin briefly
+    // before blocking until one of them publishes. Blocking lets a
+    // preempted lower priority producer run.
+    while ((ULONG)DeviceContextPtr->TxPublishedPos != ReserveStart) {
+        if (++spinCount < VCHIQ_TX_PUBLISH_SPIN_COUNT) {
+            YieldProcessor();
+        } else {
+            LARGE_INTEGER waitTimeout;
+            waitTimeout.QuadPart = WDF_REL_TIMEOUT_IN_US(VCHIQ_TX_PUBLISH_WAIT_US);
+            (void)KeWaitForSingleObject(
+                &DeviceContextPtr->TxPublishedEvent,
+                Executive,
+                KernelMode,
+                FALSE,
+                &waitTimeout);
+        }
+    }
+
+    // Only the owner of the oldest unpublished reservation gets here, so
+    // the transfer position only ever moves forward.
+    MemoryBarrier();
+    slotZeroPtr->Slave.TxPos = ReserveEnd;
+    InterlockedExchange(&DeviceContextPtr->TxPublishedPos, (LONG)ReserveEnd);
+    (void)KePulseEvent(&DeviceContextPtr->TxPublishedEvent, IO_NO_INCREMENT, FALSE);
+
+#if VCHIQ_ENABLE_STATS
+    InterlockedIncrement64(&DeviceContextPtr->Stats.TxMsgCount);
+#endif
+
+    // VC reads everything up to TxPos on a single trigger, so published
+    // messages can share a doorbell. The first message of a batch arms the
+    // timer that bounds how long it waits for the rest.
+    pendingCount = InterlockedIncrement(&DeviceContextPtr->DoorbellPendingCount);
+    if ((ULONG)pendingCount >= DeviceContextPtr->DoorbellBatchCount) {
+        VchiqRingTxDoorbell(DeviceContextPtr);
+    } else if (pendingCount == 1) {
+        (void)ExSetTimer(
+            DeviceContextPtr->DoorbellTimer,
+            DeviceContextPtr->DoorbellBatchTimeout.QuadPart,
+            0,
+            NULL);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+
 Routine Description:
 
      Process the slot when VC fires a trigger interrupt
@@ -466,6 +704,7 @@ NTSTATUS VchiqProcessRxSlot (
     
     slotZeroPtr = DeviceContextPtr->SlotZeroPtr;
 
+ProcessMessages:
     // Attempt to parse updated received messages
     while (DeviceContextPtr->CurrentRxPos < slotZeroPtr->Master.TxPos) {
         if (DeviceContextPtr->MasterCurrentSlot == NULL) {
@@ -661,32 +900,11 @@ NTSTATUS VchiqProcessRxSlot (
                     if (*respondMsg == 0xFFFFFFFF) {
                         WdfRequestComplete(nextRequest, STATUS_UNSUCCESSFUL);
                     } else {
-
-                        VCHIQ_TX_REQUEST_CONTEXT* vchiqTxRequestContextPtr =
-                            VchiqGetTxRequestContext(nextRequest);
-                        if (vchiqTxRequestContextPtr != NULL) {
-
-                            DMA_ADAPTER* dmaAdapterPtr =
-                                vchiqFileContextPtr->DmaAdapterPtr;
-
-                            dmaAdapterPtr->DmaOperations->FreeAdapterObject(
-                                vchiqFileContextPtr->DmaAdapterPtr,
-                                DeallocateObjectKeepRegisters);
-
-                            dmaAdapterPtr->DmaOperations->PutScatterGatherList(
-                                vchiqFileContextPtr->DmaAdapterPtr,
-                                vchiqTxRequestContextPtr->ScatterGatherListPtr,
-                                FALSE);
-
-                            vchiqTxRequestContextPtr->ScatterGatherListPtr = NULL;
-
-                            WdfRequestCompleteWithInformation(
-                                nextRequest,
-                                STATUS_SUCCESS,
-                                MmGetMdlByteCount(vchiqTxRequestContextPtr->BufferMdlPtr));
-                        } else {
-                            WdfRequestComplete(nextRequest, STATUS_UNSUCCESSFUL);
-                        }
+                        VchiqCompleteBulkTransfer(
+                            vchiqFileContextPtr,
+                            nextRequest,
+                            VCHIQ_MSG_BULK_RX,
+                            *respondMsg);
                     }
                 }
 
@@ -729,32 +947,11 @@ NTSTATUS VchiqProcessRxSlot (
                     if (*respondMsg == 0xFFFFFFFF) {
                         WdfRequestComplete(nextRequest, STATUS_UNSUCCESSFUL);
                     } else {
-
-                        VCHIQ_TX_REQUEST_CONTEXT* vchiqTxRequestContextPtr =
-                            VchiqGetTxRequestContext(nextRequest);
-                        if (vchiqTxRequestContextPtr != NULL) {
-
-                            DMA_ADAPTER* dmaAdapterPtr =
-                                vchiqFileContextPtr->DmaAdapterPtr;
-
-                            dmaAdapterPtr->DmaOperations->FreeAdapterObject(
-                                vchiqFileContextPtr->DmaAdapterPtr,
-                                DeallocateObjectKeepRegisters);
-
-                            dmaAdapterPtr->DmaOperations->PutScatterGatherList(
-                                vchiqFileContextPtr->DmaAdapterPtr,
-                                vchiqTxRequestContextPtr->ScatterGatherListPtr,
-                                TRUE);
-
-                            vchiqTxRequestContextPtr->ScatterGatherListPtr = NULL;
-
-                            WdfRequestCompleteWithInformation(
-                                nextRequest,
-                                STATUS_SUCCESS,
-                                MmGetMdlByteCount(vchiqTxRequestContextPtr->BufferMdlPtr));
-                        } else {
-                            WdfRequestComplete(nextRequest, STATUS_UNSUCCESSFUL);
-                        }
+                        VchiqCompleteBulkTransfer(
+                            vchiqFileContextPtr,
+                            nextRequest,
+                            VCHIQ_MSG_BULK_TX,
+                            *respondMsg);
                     }
                 }
 
@@ -811,6 +1008,23 @@ NTSTATUS VchiqProcessRxSlot (
         }
 
         VCHIQ_RESET_EVENT_SIGNAL(&slotZeroPtr->Slave.Trigger);
+
+#if VCHIQ_ENABLE_STATS
+        ++DeviceContextPtr->Stats.RxMsgCount;
+#endif
+    }
+
+    // VC tends to send messages in bursts. Keep the trigger interrupt
+    // disarmed for a short while so messages that follow shortly after are
+    // drained without another interrupt.
+    for (ULONG pollCount = 0;
+         pollCount < DeviceContextPtr->RxPollCount;
+         ++pollCount) {
+
+        if (DeviceContextPtr->CurrentRxPos < slotZeroPtr->Master.TxPos) {
+            goto ProcessMessages;
+        }
+        YieldProcessor();
     }
 
     VCHIQ_ENABLE_EVENT_INTERRUPT(&slotZeroPtr->Slave.Trigger);
@@ -907,17 +1121,18 @@ NTSTATUS VchiqQueueMessageAsync (
 {
     NTSTATUS status;
     VCHIQ_HEADER* msgHeaderPtr;
+    ULONG reserveStart;
+    ULONG reserveEnd;
 
     PAGED_CODE();
 
-    ExAcquireFastMutex(&DeviceContextPtr->TxSlotMutex);
-
-    status = VchiqAcquireTxSpace(
+    status = VchiqReserveTxSpace(
         DeviceContextPtr,
         VchiqFileContextPtr,
         sizeof(*msgHeaderPtr) + BufferSize,
-        FALSE,
-        &msgHeaderPtr);
+        &msgHeaderPtr,
+        &reserveStart,
+        &reserveEnd);
     if (!NT_SUCCESS(status)) {
         VCHIQ_LOG_ERROR(
             "Fail to acquire a transfer slot %!STATUS!",
@@ -939,29 +1154,13 @@ NTSTATUS VchiqQueueMessageAsync (
         RtlCopyMemory(msgHeaderPtr, BufferPtr, BufferSize);
     }
 
-    // Safe to release mutex once we copied all the data over
-    ExReleaseFastMutex(&DeviceContextPtr->TxSlotMutex);
-
     // Update transfer position and signal VC
-    {
-        VCHIQ_SLOT_ZERO* slotZeroPtr = DeviceContextPtr->SlotZeroPtr;
-        slotZeroPtr->Slave.TxPos = DeviceContextPtr->CurrentTxPos;
-
-        status = VchiqSignalVC(
-            DeviceContextPtr,
-            &slotZeroPtr->Master.Trigger);
-        if (!NT_SUCCESS(status)) {
-            VCHIQ_LOG_ERROR(
-                "Fail to signal VC %!STATUS!",
-                status);
-        }
-    }
-
-    return status;
+    status = VchiqPublishTxSpace(
+        DeviceContextPtr,
+        reserveStart,
+        reserveEnd);
 
 End:
-    ExReleaseFastMutex(&DeviceContextPtr->TxSlotMutex);
-
     return status;
 }
 
@@ -1001,6 +1200,9 @@ NTSTATUS VchiqQueueMultiElementAsync (
     NTSTATUS status;
     ULONG totalMsgSize = 0;
     VCHIQ_HEADER* msgHeaderPtr;
+    UCHAR* msgDataPtr;
+    ULONG reserveStart;
+    ULONG reserveEnd;
 
     PAGED_CODE();
 
@@ -1012,20 +1214,19 @@ NTSTATUS VchiqQueueMultiElementAsync (
             if (ElementsPtr[elementIndex].Data == NULL) {
                 VCHIQ_LOG_ERROR("Invalid element data pointer");
                 status = STATUS_INVALID_PARAMETER;
-                goto EndNoMutexLock;
+                goto End;
             }
             totalMsgSize += ElementsPtr[elementIndex].Size;
         }
     }
 
-    ExAcquireFastMutex(&DeviceContextPtr->TxSlotMutex);
-
-    status = VchiqAcquireTxSpace(
+    status = VchiqReserveTxSpace(
         DeviceContextPtr,
         VchiqFileContextPtr,
         sizeof(*msgHeaderPtr) + totalMsgSize,
-        FALSE,
-        &msgHeaderPtr);
+        &msgHeaderPtr,
+        &reserveStart,
+        &reserveEnd);
     if (!NT_SUCCESS(status)) {
         VCHIQ_LOG_ERROR(
             "Fail to acquire a transfer slot %!STATUS!",
@@ -1042,42 +1243,25 @@ NTSTATUS VchiqQueueMultiElementAsync (
         VCHIQ_MESSAGE_NAME(msgHeaderPtr->MsgId),
         msgHeaderPtr->Size);
 
-    ++msgHeaderPtr;
+    msgDataPtr = (UCHAR*)(msgHeaderPtr + 1);
 
     for (ULONG elementIndex = 0; elementIndex < Count; ++elementIndex) {
         if (ElementsPtr[elementIndex].Size) {
             RtlCopyMemory(
-                msgHeaderPtr,
+                msgDataPtr,
                 ElementsPtr[elementIndex].Data,
                 ElementsPtr[elementIndex].Size);
-            msgHeaderPtr += ElementsPtr[elementIndex].Size;
+            msgDataPtr += ElementsPtr[elementIndex].Size;
         }
     }
 
-    // Safe to release mutex once we copied all the data over
-    ExReleaseFastMutex(&DeviceContextPtr->TxSlotMutex);
-
     // Update transfer position and signal VC
-    {
-        VCHIQ_SLOT_ZERO* slotZeroPtr = DeviceContextPtr->SlotZeroPtr;
-        slotZeroPtr->Slave.TxPos = DeviceContextPtr->CurrentTxPos;
-
-        status = VchiqSignalVC(
-            DeviceContextPtr,
-            &slotZeroPtr->Master.Trigger);
-        if (!NT_SUCCESS(status)) {
-            VCHIQ_LOG_ERROR(
-                "Fail to signal VC %!STATUS!",
-                status);
-        }
-    }
-
-EndNoMutexLock:
-    return status;
+    status = VchiqPublishTxSpace(
+        DeviceContextPtr,
+        reserveStart,
+        reserveEnd);
 
 End:
-    ExReleaseFastMutex(&DeviceContextPtr->TxSlotMutex);
-
     return status;
 }
 
@@ -1192,38 +1376,189 @@ NTSTATUS VchiqProcessBulkTransfer (
             "VchiqBulkTransfer failed (%!STATUS!)",
             status);
 
-        tempStatus = VchiqRemovePendingBulkMsg(
-            VchiqFileContextPtr,
-            NULL,
-            bulkType,
-            FALSE,
-            NULL);
-        if (!NT_SUCCESS(tempStatus)) {
-            VCHIQ_LOG_ERROR(
-                "VchiqRemovePendingBulkMsg failed (%!STATUS!)",
-                tempStatus);
-            NT_ASSERT(NT_SUCCESS(tempStatus));
-        }
+        tempStatus = VchiqRemovePendingBulkMsg(
+            VchiqFileContextPtr,
+            NULL,
+            bulkType,
+            FALSE,
+            NULL);
+        if (!NT_SUCCESS(tempStatus)) {
+            VCHIQ_LOG_ERROR(
+                "VchiqRemovePendingBulkMsg failed (%!STATUS!)",
+                tempStatus);
+            NT_ASSERT(NT_SUCCESS(tempStatus));
+        }
+
+        // Remove the request that was just inserted
+        tempStatus = WdfIoQueueRetrieveFoundRequest(
+            VchiqFileContextPtr->FileQueue[transactionType],
+            WdfRequest,
+            &removeRequest);
+        if (tempStatus == STATUS_NOT_FOUND) {
+            // Request not found, framework has has cancel the request just
+            // return success and request would not be completed
+            status = STATUS_SUCCESS;
+        } else if (!NT_SUCCESS(tempStatus)) {
+            VCHIQ_LOG_ERROR(
+                "WdfIoQueueRetrieveFoundRequest failed (%!STATUS!)",
+                tempStatus);
+            NT_ASSERT(NT_SUCCESS(tempStatus));
+        }
+    }
+
+End:
+    ExReleaseFastMutex(&VchiqFileContextPtr->PendingBulkMsgMutex[bulkType]);
+
+    return status;
+}
+
+/*++
+
+Routine Description:
+
+    VchiqBuildDirectPageList builds the page list of a bulk transfer
+        straight from the MDL page frame numbers. This avoids building and
+        later releasing a scatter gather list for every bulk transfer.
+
+Arguments:
+
+    DeviceContextPtr - A pointer to the device context.
+
+    VchiqFileContextPtr - File context pointer returned to caller
+
+    MsgDirection - Specify the direction of the bulk transfer
+
+    BufferMdl - Mdl pointer structer of the buffer
+
+    BufferSize - Size of data that would be transfered
+
+    PageListPPtr - Page list allocated by the function
+
+    PageListSizePtr - Size of the page list
+
+    PageListPhyAddressPtr - Physical address of the page list
+
+    FragmentsPPtr - Fragments allocated for an unaligned bulk receive or NULL
+
+Return Value:
+
+    STATUS_NOT_SUPPORTED if the buffer has to go through the DMA api,
+    otherwise NTSTATUS
+
+--*/
+_Use_decl_annotations_
+NTSTATUS VchiqBuildDirectPageList (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    ULONG MsgDirection,
+    MDL* BufferMdl,
+    ULONG BufferSize,
+    VCHIQ_PAGELIST** PageListPPtr,
+    ULONG* PageListSizePtr,
+    PHYSICAL_ADDRESS* PageListPhyAddressPtr,
+    FRAGMENTS** FragmentsPPtr
+    )
+{
+    NTSTATUS status;
+    PFN_NUMBER* pfnArrayPtr = MmGetMdlPfnArray(BufferMdl);
+    ULONG byteOffset = MmGetMdlByteOffset(BufferMdl);
+    ULONG numPages = ADDRESS_AND_SIZE_TO_SPAN_PAGES(
+        MmGetMdlVirtualAddress(BufferMdl),
+        BufferSize);
+    VCHIQ_PAGELIST* pageListPtr = NULL;
+    ULONG pageListSize = 0;
+    PHYSICAL_ADDRESS pageListPhyAddress = { 0 };
+    FRAGMENTS* fragmentsPtr = NULL;
+    ULONG i;
+
+    PAGED_CODE();
+
+    // The firmware can only reach the first 1GB of memory, buffers beyond
+    // that need the DMA api.
+    for (i = 0; i < numPages; ++i) {
+        if (pfnArrayPtr[i] >= (MEMORY_SIZE_1_G >> PAGE_SHIFT)) {
+            status = STATUS_NOT_SUPPORTED;
+            goto End;
+        }
+    }
+
+    // A receive buffer that does not start and end on a cache line boundary
+    // shares those cache lines with other data. The firmware writes the
+    // partial cache lines into fragments instead, which are copied into the
+    // buffer when the transfer completes.
+    if ((MsgDirection == VCHIQ_MSG_BULK_RX) &&
+        (((byteOffset | (byteOffset + BufferSize)) &
+            (CACHE_LINE_SIZE - 1)) != 0)) {
+        fragmentsPtr = VchiqAllocateFragments(DeviceContextPtr);
+        if (fragmentsPtr == NULL) {
+            status = STATUS_NOT_SUPPORTED;
+            goto End;
+        }
+    }
+
+    pageListSize = (numPages * sizeof(ULONG)) + sizeof(VCHIQ_PAGELIST);
+
+    status = VchiqAllocateCommonBuffer(
+        VchiqFileContextPtr,
+        pageListSize,
+        &pageListPtr,
+        &pageListPhyAddress);
+    if (!NT_SUCCESS(status)) {
+        VCHIQ_LOG_ERROR("Fail to alloc page list memory");
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        goto End;
+    }
+
+    pageListPtr->Length = BufferSize;
+    pageListPtr->Offset = (USHORT)byteOffset;
+    if (fragmentsPtr != NULL) {
+        pageListPtr->Type = (USHORT)(PAGELIST_READ_WITH_FRAGMENTS +
+            (fragmentsPtr - DeviceContextPtr->FragmentBasePtr));
+    } else {
+        pageListPtr->Type =
+            (MsgDirection == VCHIQ_MSG_BULK_TX) ?
+            PAGELIST_WRITE : PAGELIST_READ;
+    }
+
+    // Merge physically contiguous pages into a single entry, the 12 LSBs
+    // hold the number of pages that follow the first one.
+    {
+        ULONG* pageListAddrPtr = pageListPtr->Addrs;
+        ULONG runStart = 0;
 
-        // Remove the request that was just inserted
-        tempStatus = WdfIoQueueRetrieveFoundRequest(
-            VchiqFileContextPtr->FileQueue[transactionType],
-            WdfRequest,
-            &removeRequest);
-        if (tempStatus == STATUS_NOT_FOUND) {
-            // Request not found, framework has has cancel the request just
-            // return success and request would not be completed
-            status = STATUS_SUCCESS;
-        } else if (!NT_SUCCESS(tempStatus)) {
-            VCHIQ_LOG_ERROR(
-                "WdfIoQueueRetrieveFoundRequest failed (%!STATUS!)",
-                tempStatus);
-            NT_ASSERT(NT_SUCCESS(tempStatus));
+        for (i = 1; i <= numPages; ++i) {
+            if ((i < numPages) &&
+                (pfnArrayPtr[i] == pfnArrayPtr[i - 1] + 1) &&
+                ((i - runStart) < VCHIQ_PAGELIST_MAX_RUN_PAGES)) {
+                continue;
+            }
+
+            *pageListAddrPtr =
+                ((ULONG)pfnArrayPtr[runStart] << PAGE_SHIFT) |
+                OFFSET_DIRECT_SDRAM |
+                (i - runStart - 1);
+            ++pageListAddrPtr;
+            runStart = i;
         }
     }
 
+    // Without the DMA api cache maintenance is up to us
+    KeFlushIoBuffers(
+        BufferMdl,
+        (MsgDirection == VCHIQ_MSG_BULK_RX) ? TRUE : FALSE,
+        TRUE);
+
+    *PageListPPtr = pageListPtr;
+    *PageListSizePtr = pageListSize;
+    *PageListPhyAddressPtr = pageListPhyAddress;
+    *FragmentsPPtr = fragmentsPtr;
+
 End:
-    ExReleaseFastMutex(&VchiqFileContextPtr->PendingBulkMsgMutex[bulkType]);
+    if (!NT_SUCCESS(status)) {
+        if (fragmentsPtr != NULL) {
+            VchiqFreeFragments(DeviceContextPtr, fragmentsPtr);
+        }
+    }
 
     return status;
 }
@@ -1232,7 +1567,8 @@ End:
 
 Routine Description:
 
-    Implementation of bulk transaction for both transmit and receive
+    VchiqBuildDmaPageList builds the page list of a bulk transfer from a
+        scatter gather list obtained through the DMA api.
 
 Arguments:
 
@@ -1248,9 +1584,13 @@ Arguments:
 
     BufferSize - Size of data that would be transfered
 
-    ArmPortNumber - Slave port number of the transfer
+    PageListPPtr - Page list allocated by the function
 
-    VchiqPortNumber - Master port number of the transfer
+    PageListSizePtr - Size of the page list
+
+    PageListPhyAddressPtr - Physical address of the page list
+
+    ScatterGatherListPPtr - Scatter gather list backing the page list
 
 Return Value:
 
@@ -1258,20 +1598,21 @@ Return Value:
 
 --*/
 _Use_decl_annotations_
-NTSTATUS VchiqBulkTransfer (
+NTSTATUS VchiqBuildDmaPageList (
     DEVICE_CONTEXT* DeviceContextPtr,
     VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
     WDFREQUEST WdfRequest,
     ULONG MsgDirection,
     MDL* BufferMdl,
     ULONG BufferSize,
-    ULONG ArmPortNumber,
-    ULONG VchiqPortNumber
+    VCHIQ_PAGELIST** PageListPPtr,
+    ULONG* PageListSizePtr,
+    PHYSICAL_ADDRESS* PageListPhyAddressPtr,
+    SCATTER_GATHER_LIST** ScatterGatherListPPtr
     )
 {
     NTSTATUS status;
     VCHIQ_PAGELIST* pageListPtr = NULL;
-    VCHIQ_TX_REQUEST_CONTEXT* vchiqTxRequestContextPtr;
     DMA_ADAPTER* dmaAdapterPtr = VchiqFileContextPtr->DmaAdapterPtr;
     ULONG scatterGatherListSize, numberOfMapRegisters;
     WDFMEMORY scatterGatherWdfMemory = NULL;
@@ -1420,6 +1761,98 @@ NTSTATUS VchiqBulkTransfer (
         }
     }
 
+    *PageListPPtr = pageListPtr;
+    *PageListSizePtr = pageListSize;
+    *PageListPhyAddressPtr = pageListPhyAddress;
+    *ScatterGatherListPPtr = (SCATTER_GATHER_LIST*)scatterGatherBufferPtr;
+
+End:
+    return status;
+}
+
+/*++
+
+Routine Description:
+
+    Implementation of bulk transaction for both transmit and receive
+
+Arguments:
+
+    DeviceContextPtr - A pointer to the device context.
+
+    VchiqFileContextPtr - File context pointer returned to caller
+
+    WdfRequest - Request framework object tied to this bulk transfer
+
+    MsgDirection - Specify the direction of the bulk transfer
+
+    BufferMdl - Mdl pointer structer of the buffer
+
+    BufferSize - Size of data that would be transfered
+
+    ArmPortNumber - Slave port number of the transfer
+
+    VchiqPortNumber - Master port number of the transfer
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+_Use_decl_annotations_
+NTSTATUS VchiqBulkTransfer (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    WDFREQUEST WdfRequest,
+    ULONG MsgDirection,
+    MDL* BufferMdl,
+    ULONG BufferSize,
+    ULONG ArmPortNumber,
+    ULONG VchiqPortNumber
+    )
+{
+    NTSTATUS status;
+    VCHIQ_PAGELIST* pageListPtr = NULL;
+    VCHIQ_TX_REQUEST_CONTEXT* vchiqTxRequestContextPtr;
+    SCATTER_GATHER_LIST* scatterGatherListPtr = NULL;
+    FRAGMENTS* fragmentsPtr = NULL;
+    ULONG pageListSize = 0;
+    PHYSICAL_ADDRESS pageListPhyAddress = { 0 };
+
+    PAGED_CODE();
+
+    // Most buffers can be handed to the firmware as they are, only fall
+    // back to the DMA api when that is not possible.
+    status = VchiqBuildDirectPageList(
+        DeviceContextPtr,
+        VchiqFileContextPtr,
+        MsgDirection,
+        BufferMdl,
+        BufferSize,
+        &pageListPtr,
+        &pageListSize,
+        &pageListPhyAddress,
+        &fragmentsPtr);
+    if (status == STATUS_NOT_SUPPORTED) {
+        status = VchiqBuildDmaPageList(
+            DeviceContextPtr,
+            VchiqFileContextPtr,
+            WdfRequest,
+            MsgDirection,
+            BufferMdl,
+            BufferSize,
+            &pageListPtr,
+            &pageListSize,
+            &pageListPhyAddress,
+            &scatterGatherListPtr);
+    }
+    if (!NT_SUCCESS(status)) {
+        VCHIQ_LOG_ERROR(
+            "Fail to build bulk transfer page list (%!STATUS!)",
+            status);
+        goto End;
+    }
+
     status = VchiqAllocateTransferRequestObjContext(
         DeviceContextPtr,
         VchiqFileContextPtr,
@@ -1428,7 +1861,8 @@ NTSTATUS VchiqBulkTransfer (
         pageListPtr,
         pageListSize,
         pageListPhyAddress,
-        (SCATTER_GATHER_LIST* )scatterGatherBufferPtr,
+        scatterGatherListPtr,
+        fragmentsPtr,
         &vchiqTxRequestContextPtr);
     if (!NT_SUCCESS(status)) {
         VCHIQ_LOG_ERROR(
@@ -1437,8 +1871,9 @@ NTSTATUS VchiqBulkTransfer (
         goto End;
     }
 
-    // Buffer will be free when request object is released
+    // Buffer and fragments will be free when request object is released
     pageListPtr = NULL;
+    fragmentsPtr = NULL;
 
     // Dispatch message
     {
@@ -1470,6 +1905,10 @@ End:
                 pageListPhyAddress,
                 pageListPtr);
         }
+
+        if (fragmentsPtr) {
+            VchiqFreeFragments(DeviceContextPtr, fragmentsPtr);
+        }
     }
 
     return status;
@@ -1780,29 +2219,18 @@ NTSTATUS VchiqAddPendingMsg (
 
     PAGED_CODE();
 
-    NT_ASSERT(VchiqFileContextPtr->PendingMsgLookAsideMemory != NULL);
-
-    status = WdfMemoryCreateFromLookaside(
-        VchiqFileContextPtr->PendingMsgLookAsideMemory,
+    VCHIQ_PENDING_MSG* newPendingMsgPtr;
+    status = VchiqAllocMsgPoolRecord(
+        &VchiqFileContextPtr->PendingMsgPool,
+        (VOID**)&newPendingMsgPtr,
         &wdfMemoryNewPendingMsg);
     if (!NT_SUCCESS(status)) {
         VCHIQ_LOG_ERROR(
-            "WdfMemoryCreateFromLookaside failed %!STATUS!)",
+            "VchiqAllocMsgPoolRecord failed %!STATUS!)",
             status);
         goto End;
     }
 
-    size_t bufferSize;
-    VCHIQ_PENDING_MSG* newPendingMsgPtr;
-    newPendingMsgPtr = WdfMemoryGetBuffer(wdfMemoryNewPendingMsg, &bufferSize);
-    if (!NT_SUCCESS(status) || (bufferSize != sizeof(*newPendingMsgPtr))) {
-        VCHIQ_LOG_ERROR(
-            "WdfMemoryGetBuffer failed %!STATUS! size %d)",
-            status,
-            bufferSize);
-        goto End;
-    }
-
     newPendingMsgPtr->Msg = Msg;
     newPendingMsgPtr->SlotNumber = SlotNumber;
     newPendingMsgPtr->WdfMemory = wdfMemoryNewPendingMsg;
@@ -1813,12 +2241,6 @@ NTSTATUS VchiqAddPendingMsg (
     VchiqAddRefMsg(DeviceContextPtr, SlotNumber);
 
 End:
-    if (!NT_SUCCESS(status)) {
-        if (wdfMemoryNewPendingMsg != NULL) {
-            WdfObjectDelete(wdfMemoryNewPendingMsg);
-        }
-    }
-
     return status;
 }
 
@@ -1869,8 +2291,10 @@ NTSTATUS VchiqRemovePendingMsg (
                 CONTAINING_RECORD(
                     nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry)->SlotNumber;
             VchiqReleaseMsg(DeviceContextPtr, nextMsgSlotNumber);
-            WdfObjectDelete(CONTAINING_RECORD(
-                nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry)->WdfMemory);
+            VchiqFreePendingMsg(
+                VchiqFileContextPtr,
+                CONTAINING_RECORD(
+                    nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry));
         } while (nextListEntryPtr != NULL);
         status = STATUS_SUCCESS;
         goto End;
@@ -2075,8 +2499,10 @@ NTSTATUS VchiqRemovePendingMsg (
             ExReleaseFastMutex(&VchiqFileContextPtr->PendingVchiMsgMutex);
         }
 
-        WdfObjectDelete(CONTAINING_RECORD(
-            nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry)->WdfMemory);
+        VchiqFreePendingMsg(
+            VchiqFileContextPtr,
+            CONTAINING_RECORD(
+                nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry));
 
         VchiqReleaseMsg(DeviceContextPtr, nextMsgSlotNumber);
 
@@ -2158,30 +2584,18 @@ NTSTATUS VchiqAddPendingBulkMsg (
 
     PAGED_CODE();
 
-    NT_ASSERT(VchiqFileContextPtr->PendingBulkMsgLookAsideMemory != NULL);
-
-    status = WdfMemoryCreateFromLookaside(
-        VchiqFileContextPtr->PendingBulkMsgLookAsideMemory,
+    VCHIQ_PENDING_BULK_MSG* newPendingBulkTransferPtr;
+    status = VchiqAllocMsgPoolRecord(
+        &VchiqFileContextPtr->PendingBulkMsgPool,
+        (VOID**)&newPendingBulkTransferPtr,
         &wdfMemoryNewPendingMsg);
     if (!NT_SUCCESS(status)) {
         VCHIQ_LOG_ERROR(
-            "WdfMemoryCreateFromLookaside failed %!STATUS!)",
+            "VchiqAllocMsgPoolRecord failed %!STATUS!)",
             status);
         goto End;
     }
 
-    size_t bufferSize;
-    VCHIQ_PENDING_BULK_MSG* newPendingBulkTransferPtr;
-    newPendingBulkTransferPtr =
-        WdfMemoryGetBuffer(wdfMemoryNewPendingMsg, &bufferSize);
-    if (!NT_SUCCESS(status) || (bufferSize != sizeof(*newPendingBulkTransferPtr))) {
-        VCHIQ_LOG_ERROR(
-            "WdfMemoryGetBuffer failed %!STATUS! size %d)",
-            status,
-            bufferSize);
-        goto End;
-    }
-
     newPendingBulkTransferPtr->WdfMemory = wdfMemoryNewPendingMsg;
     newPendingBulkTransferPtr->Mode = BulkTransferPtr->Mode;
     newPendingBulkTransferPtr->BulkUserData =
@@ -2192,12 +2606,6 @@ NTSTATUS VchiqAddPendingBulkMsg (
         &newPendingBulkTransferPtr->ListEntry);
 
 End:
-    if (!NT_SUCCESS(status)) {
-        if (wdfMemoryNewPendingMsg != NULL) {
-            WdfObjectDelete(wdfMemoryNewPendingMsg);
-        }
-    }
-
     return status;
 }
 
@@ -2257,8 +2665,10 @@ NTSTATUS VchiqRemovePendingBulkMsg (
                 break;
             }
 
-            WdfObjectDelete(CONTAINING_RECORD(
-                nextListEntryPtr, VCHIQ_PENDING_BULK_MSG, ListEntry)->WdfMemory);
+            VchiqFreePendingBulkMsg(
+                VchiqFileContextPtr,
+                CONTAINING_RECORD(
+                    nextListEntryPtr, VCHIQ_PENDING_BULK_MSG, ListEntry));
         } while (nextListEntryPtr != NULL && RemoveAll);
 
         status = STATUS_SUCCESS;
@@ -2284,6 +2694,11 @@ NTSTATUS VchiqRemovePendingBulkMsg (
             nextListEntryPtr, VCHIQ_PENDING_BULK_MSG, ListEntry)->Mode;
     }
 
+    VchiqFreePendingBulkMsg(
+        VchiqFileContextPtr,
+        CONTAINING_RECORD(
+            nextListEntryPtr, VCHIQ_PENDING_BULK_MSG, ListEntry));
+
 End:
 
     return status;
@@ -2323,28 +2738,19 @@ NTSTATUS VchiqAddPendingVchiMsg (
 
     PAGED_CODE();
     
-    // Reuse the same look aside for pending message
-    status = WdfMemoryCreateFromLookaside(
-        VchiqFileContextPtr->PendingMsgLookAsideMemory,
+    // Reuse the same record pool for pending message
+    VCHIQ_PENDING_MSG* newPendingMsgPtr;
+    status = VchiqAllocMsgPoolRecord(
+        &VchiqFileContextPtr->PendingMsgPool,
+        (VOID**)&newPendingMsgPtr,
         &wdfMemoryNewPendingMsg);
     if (!NT_SUCCESS(status)) {
         VCHIQ_LOG_ERROR(
-            "WdfMemoryCreateFromLookaside failed %!STATUS!)",
+            "VchiqAllocMsgPoolRecord failed %!STATUS!)",
             status);
         goto End;
     }
 
-    size_t bufferSize;
-    VCHIQ_PENDING_MSG* newPendingMsgPtr;
-    newPendingMsgPtr = WdfMemoryGetBuffer(wdfMemoryNewPendingMsg, &bufferSize);
-    if (!NT_SUCCESS(status) || (bufferSize != sizeof(*newPendingMsgPtr))) {
-        VCHIQ_LOG_ERROR(
-            "WdfMemoryGetBuffer failed %!STATUS! size %d)",
-            status,
-            bufferSize);
-        goto End;
-    }
-
     newPendingMsgPtr->Msg = Msg;
     newPendingMsgPtr->SlotNumber = SlotNumber;
     newPendingMsgPtr->WdfMemory = wdfMemoryNewPendingMsg;
@@ -2355,12 +2761,6 @@ NTSTATUS VchiqAddPendingVchiMsg (
     VchiqAddRefMsg(DeviceContextPtr, SlotNumber);
 
 End:
-    if (!NT_SUCCESS(status)) {
-        if (wdfMemoryNewPendingMsg != NULL) {
-            WdfObjectDelete(wdfMemoryNewPendingMsg);
-        }
-    }
-
     return status;
 }
 
@@ -2411,8 +2811,10 @@ NTSTATUS VchiqRemovePendingVchiMsg (
                 CONTAINING_RECORD(
                     nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry)->SlotNumber;
             VchiqReleaseMsg(DeviceContextPtr, nextMsgSlotNumber);
-            WdfObjectDelete(CONTAINING_RECORD(
-                nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry)->WdfMemory);
+            VchiqFreePendingMsg(
+                VchiqFileContextPtr,
+                CONTAINING_RECORD(
+                    nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry));
         } while (nextListEntryPtr != NULL);
         status = STATUS_SUCCESS;
         goto End;
@@ -2487,8 +2889,10 @@ NTSTATUS VchiqRemovePendingVchiMsg (
         nextMsgHeaderPtr,
         pendingVchiMsgSize);
 
-    WdfObjectDelete(CONTAINING_RECORD(
-        nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry)->WdfMemory);
+    VchiqFreePendingMsg(
+        VchiqFileContextPtr,
+        CONTAINING_RECORD(
+            nextListEntryPtr, VCHIQ_PENDING_MSG, ListEntry));
 
     *totalMsgSizePtr = pendingVchiMsgSize;
 
@@ -2847,6 +3251,114 @@ VCHIQ_NONPAGED_SEGMENT_BEGIN
 
 /*++
 
+Routine Description:
+
+     Signals VC that there is a pending slot to be processed.
+
+Arguments:
+
+     DeviceContextPtr - A pointer to the device context.
+
+     EventPtr - Pointer to the event to be signalled
+
+Return Value:
+
+     NTSTATUS
+
+--*/
+_Use_decl_annotations_
+NTSTATUS VchiqSignalVC (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    VCHIQ_REMOTE_EVENT* EventPtr
+    )
+{
+    // Indicate that we to VC side that the event has been triggered
+    EventPtr->Fired = 1;
+
+    if (EventPtr->Armed) {
+        WRITE_REGISTER_NOFENCE_ULONG(
+            (ULONG*)(DeviceContextPtr->VchiqRegisterPtr + BELL2), 0);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+
+Routine Description:
+
+     Rings the doorbell for all published messages VC has not been
+     signalled for yet.
+
+Arguments:
+
+     DeviceContextPtr - A pointer to the device context.
+
+Return Value:
+
+     VOID
+
+--*/
+_Use_decl_annotations_
+VOID VchiqRingTxDoorbell (
+    DEVICE_CONTEXT* DeviceContextPtr
+    )
+{
+    NTSTATUS status;
+
+    // Cancel the timer before taking the pending messages. A message
+    // published after the exchange below arms the timer again.
+    (void)ExCancelTimer(DeviceContextPtr->DoorbellTimer, NULL);
+
+    if (InterlockedExchange(&DeviceContextPtr->DoorbellPendingCount, 0) == 0) {
+        return;
+    }
+
+#if VCHIQ_ENABLE_STATS
+    InterlockedIncrement64(&DeviceContextPtr->Stats.TxDoorbellCount);
+#endif
+
+    status = VchiqSignalVC(
+        DeviceContextPtr,
+        &DeviceContextPtr->SlotZeroPtr->Master.Trigger);
+    if (!NT_SUCCESS(status)) {
+        VCHIQ_LOG_ERROR(
+            "Fail to signal VC %!STATUS!",
+            status);
+    }
+}
+
+/*++
+
+Routine Description:
+
+     Doorbell timer callback, rings the doorbell for messages that did not
+     fill up a batch in time.
+
+Arguments:
+
+     Timer - Pointer to the doorbell timer
+
+     Context - Device context pointer
+
+Return Value:
+
+     VOID
+
+--*/
+_Use_decl_annotations_
+VOID VchiqDoorbellTimerCallback (
+    EX_TIMER* Timer,
+    VOID* Context
+    )
+{
+    UNREFERENCED_PARAMETER(Timer);
+
+    VchiqRingTxDoorbell((DEVICE_CONTEXT*)Context);
+}
+
+/*++
+
 Routine Description:
 
     Utility function to wait for dispatcher object to be signalled or stop 
@@ -30,6 +30,29 @@ EXTERN_C_START
 #define SLOT_MSG_SIZE_ALIGN            8
 #define SLOT_MSG_SIZE_MASK_ALIGN     (SLOT_MSG_SIZE_ALIGN - 1)
 
+// Number of spins waiting for earlier reservations to be published before
+// blocking on TxPublishedEvent. The wait is bounded because the event is
+// pulsed, so a publish between the check and the wait is only seen on the
+// next pulse or the timeout.
+#define VCHIQ_TX_PUBLISH_SPIN_COUNT    1000
+#define VCHIQ_TX_PUBLISH_WAIT_US       1000
+
+// Doorbell coalescing defaults, each can be overridden through the driver
+// Parameters registry key. A batch count of 1 signals VC for every message.
+#define VCHIQ_DOORBELL_BATCH_COUNT_DEFAULT      1
+#define VCHIQ_DOORBELL_BATCH_COUNT_MAX          64
+#define VCHIQ_DOORBELL_BATCH_TIMEOUT_US_DEFAULT 500
+#define VCHIQ_RX_POLL_COUNT_DEFAULT             0
+#define VCHIQ_RX_POLL_COUNT_MAX                 100000
+
+#define VCHIQ_REG_DOORBELL_BATCH_COUNT      L"DoorbellBatchCount"
+#define VCHIQ_REG_DOORBELL_BATCH_TIMEOUT_US L"DoorbellBatchTimeoutUs"
+#define VCHIQ_REG_RX_POLL_COUNT             L"RxPollCount"
+
+// Maximum number of physically contiguous pages a single page list entry
+// can describe, the count is held in the 12 LSBs of the entry
+#define VCHIQ_PAGELIST_MAX_RUN_PAGES   0x1000
+
 #define VCHIQ_GET_CURRENT_TX_HEADER(a) \
      (VCHIQ_HEADER*)((UCHAR*)a->SlaveCurrentSlot + \
           (a->CurrentTxPos & VCHIQ_SLOT_MASK))
@@ -142,7 +165,12 @@ NTSTATUS VchiqRelease (
     _In_ DEVICE_CONTEXT* DeviceContextPtr
     );
 
-_IRQL_requires_max_(APC_LEVEL)
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID VchiqReadCoalescingParameters (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
 NTSTATUS VchiqSignalVC (
     _In_ DEVICE_CONTEXT* DeviceContextPtr,
     _In_ VCHIQ_REMOTE_EVENT* EventPtr
@@ -158,6 +186,23 @@ NTSTATUS VchiqAcquireTxSpace (
     _Outptr_ VCHIQ_HEADER** HeaderPPtr
     );
 
+_IRQL_requires_max_(APC_LEVEL)
+NTSTATUS VchiqReserveTxSpace (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    _In_ ULONG RequestSize,
+    _Outptr_ VCHIQ_HEADER** HeaderPPtr,
+    _Out_ ULONG* ReserveStartPtr,
+    _Out_ ULONG* ReserveEndPtr
+    );
+
+_IRQL_requires_max_(APC_LEVEL)
+NTSTATUS VchiqPublishTxSpace (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ ULONG ReserveStart,
+    _In_ ULONG ReserveEnd
+    );
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS VchiqProcessRxSlot (
     _In_ DEVICE_CONTEXT* DeviceContextPtr
@@ -197,6 +242,33 @@ NTSTATUS VchiqProcessBulkTransfer (
     _In_ ULONG BufferSize
     );
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS VchiqBuildDirectPageList (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    _In_ ULONG MsgDirection,
+    _In_ MDL* BufferMdl,
+    _In_ ULONG BufferSize,
+    _Outptr_ VCHIQ_PAGELIST** PageListPPtr,
+    _Out_ ULONG* PageListSizePtr,
+    _Out_ PHYSICAL_ADDRESS* PageListPhyAddressPtr,
+    _Outptr_result_maybenull_ FRAGMENTS** FragmentsPPtr
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS VchiqBuildDmaPageList (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    _In_ WDFREQUEST Request,
+    _In_ ULONG MsgDirection,
+    _In_ MDL* BufferMdl,
+    _In_ ULONG BufferSize,
+    _Outptr_ VCHIQ_PAGELIST** PageListPPtr,
+    _Out_ ULONG* PageListSizePtr,
+    _Out_ PHYSICAL_ADDRESS* PageListPhyAddressPtr,
+    _Outptr_ SCATTER_GATHER_LIST** ScatterGatherListPPtr
+    );
+
 _IRQL_requires_max_(APC_LEVEL)
 NTSTATUS VchiqBulkTransfer (
     _In_ DEVICE_CONTEXT* DeviceContextPtr,
@@ -310,6 +382,13 @@ KSTART_ROUTINE VchiqSyncThreadRoutine;
 
 KSTART_ROUTINE VchiqSyncReleaseThreadRoutine;
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID VchiqRingTxDoorbell (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr
+    );
+
+EXT_CALLBACK VchiqDoorbellTimerCallback;
+
 _IRQL_requires_max_(APC_LEVEL)
 NTSTATUS VchiqWaitForEvents (
     _In_ VOID* MainEventPtr,
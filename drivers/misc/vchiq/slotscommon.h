@@ -20,15 +20,31 @@ typedef struct _SLOT_INFO {
     BOOLEAN SlotInUse;
 }SLOT_INFO, *PSLOT_INFO;
 
+// Pool of pending message records. Records come from a slab allocated with
+// the file object, the lookaside list is only used once the slab runs out.
+// Free slab records are linked through their first pointer.
+typedef struct _VCHIQ_MSG_POOL {
+    FAST_MUTEX Mutex;
+    VOID* FreeListPtr;
+    WDFLOOKASIDE LookAsideMemory;
+
+    // Statistics
+    ULONG InUseCount;
+    ULONG HighWaterMark;
+    ULONG LookAsideAllocCount;
+}VCHIQ_MSG_POOL, *PVCHIQ_MSG_POOL;
+
 typedef struct _VCHIQ_PENDING_MSG {
     VCHIQ_HEADER* Msg;
     ULONG SlotNumber;
+    // NULL for records taken from the pool slab
     WDFMEMORY WdfMemory;
     LIST_ENTRY ListEntry;
 }VCHIQ_PENDING_MSG, *PVCHIQ_PENDING_MSG;
 
 typedef struct _VCHIQ_PENDING_BULK_MSG {
     VOID* BulkUserData;
+    // NULL for records taken from the pool slab
     WDFMEMORY WdfMemory;
     LIST_ENTRY ListEntry;
     VCHIQ_BULK_MODE_T Mode;
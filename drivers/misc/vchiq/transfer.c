@@ -47,7 +47,11 @@ Arguments:
     
     PageListPhyAddr - Page list physical address
 
-    ScatterGatherListPtr - Scatter gather list allocated for this transfer
+    ScatterGatherListPtr - Scatter gather list allocated for this transfer,
+        NULL when the page list was built directly from the MDL
+
+    FragmentsPtr - Fragments holding the partial cache lines of a bulk
+        receive, NULL if none were needed
 
     VchiqTxRequestContextPPtr - TX request context allocatec by the function
           and returned to caller
@@ -67,6 +71,7 @@ NTSTATUS VchiqAllocateTransferRequestObjContext (
     ULONG PageListSize,
     PHYSICAL_ADDRESS PageListPhyAddr,
     SCATTER_GATHER_LIST* ScatterGatherListPtr,
+    FRAGMENTS* FragmentsPtr,
     VCHIQ_TX_REQUEST_CONTEXT** VchiqTxRequestContextPPtr
     )
 {
@@ -95,6 +100,7 @@ NTSTATUS VchiqAllocateTransferRequestObjContext (
     (*VchiqTxRequestContextPPtr)->PageListSize = PageListSize;
     (*VchiqTxRequestContextPPtr)->PageListPhyAddr = PageListPhyAddr;
     (*VchiqTxRequestContextPPtr)->ScatterGatherListPtr = ScatterGatherListPtr;
+    (*VchiqTxRequestContextPPtr)->FragmentsPtr = FragmentsPtr;
     (*VchiqTxRequestContextPPtr)->DeviceContextPtr = DeviceContextPtr;
     (*VchiqTxRequestContextPPtr)->VchiqFileContextPtr = VchiqFileContextPtr;
 
@@ -102,6 +108,119 @@ End:
     return status;
 }
 
+/*++
+
+Routine Description:
+
+    VchiqCompleteBulkTransfer releases the DMA resources of a bulk
+        transfer the firmware has finished and completes the request.
+
+Arguments:
+
+    VchiqFileContextPtr - File context pointer returned to caller
+
+    WdfRequest - Request framework object tied to this bulk transfer
+
+    MsgDirection - Specify the direction of the bulk transfer
+
+    ActualSize - Number of bytes transfered as reported by the firmware
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID VchiqCompleteBulkTransfer (
+    VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    WDFREQUEST WdfRequest,
+    ULONG MsgDirection,
+    ULONG ActualSize
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    VCHIQ_TX_REQUEST_CONTEXT* vchiqTxRequestContextPtr =
+        VchiqGetTxRequestContext(WdfRequest);
+    BOOLEAN readOperation =
+        (MsgDirection == VCHIQ_MSG_BULK_RX) ? TRUE : FALSE;
+
+    PAGED_CODE();
+
+    if (vchiqTxRequestContextPtr == NULL) {
+        WdfRequestComplete(WdfRequest, STATUS_UNSUCCESSFUL);
+        return;
+    }
+
+    if (vchiqTxRequestContextPtr->ScatterGatherListPtr != NULL) {
+        DMA_ADAPTER* dmaAdapterPtr = VchiqFileContextPtr->DmaAdapterPtr;
+
+        dmaAdapterPtr->DmaOperations->FreeAdapterObject(
+            dmaAdapterPtr,
+            DeallocateObjectKeepRegisters);
+
+        dmaAdapterPtr->DmaOperations->PutScatterGatherList(
+            dmaAdapterPtr,
+            vchiqTxRequestContextPtr->ScatterGatherListPtr,
+            !readOperation);
+
+        vchiqTxRequestContextPtr->ScatterGatherListPtr = NULL;
+    } else if (readOperation) {
+        // The page list was built directly from the MDL so the DMA api did
+        // not perform any cache maintenance on our behalf.
+        KeFlushIoBuffers(vchiqTxRequestContextPtr->BufferMdlPtr, TRUE, TRUE);
+    }
+
+    // The firmware writes the partial cache lines at both ends of an
+    // unaligned receive buffer into the fragments, copy them over.
+    if (vchiqTxRequestContextPtr->FragmentsPtr != NULL) {
+        VCHIQ_PAGELIST* pageListPtr = vchiqTxRequestContextPtr->PageListPtr;
+        FRAGMENTS* fragmentsPtr = vchiqTxRequestContextPtr->FragmentsPtr;
+        ULONG actualSize = min(ActualSize, pageListPtr->Length);
+        ULONG headBytes =
+            (CACHE_LINE_SIZE - pageListPtr->Offset) & (CACHE_LINE_SIZE - 1);
+        ULONG tailBytes =
+            (pageListPtr->Offset + actualSize) & (CACHE_LINE_SIZE - 1);
+
+        UCHAR* bufferPtr = MmGetSystemAddressForMdlSafe(
+            vchiqTxRequestContextPtr->BufferMdlPtr,
+            NormalPagePriority | MdlMappingNoExecute);
+        if (bufferPtr == NULL) {
+            VCHIQ_LOG_ERROR("Fail to map bulk receive buffer");
+            status = STATUS_INSUFFICIENT_RESOURCES;
+        } else {
+            if (headBytes > actualSize) {
+                headBytes = actualSize;
+            }
+
+            if (headBytes != 0) {
+                RtlCopyMemory(bufferPtr, fragmentsPtr->Headbuf, headBytes);
+            }
+
+            if ((headBytes < actualSize) && (tailBytes != 0)) {
+                RtlCopyMemory(
+                    bufferPtr + actualSize - tailBytes,
+                    fragmentsPtr->Tailbuf,
+                    tailBytes);
+            }
+        }
+
+        VchiqFreeFragments(
+            vchiqTxRequestContextPtr->DeviceContextPtr,
+            fragmentsPtr);
+        vchiqTxRequestContextPtr->FragmentsPtr = NULL;
+    }
+
+    if (!NT_SUCCESS(status)) {
+        WdfRequestComplete(WdfRequest, status);
+        return;
+    }
+
+    WdfRequestCompleteWithInformation(
+        WdfRequest,
+        STATUS_SUCCESS,
+        MmGetMdlByteCount(vchiqTxRequestContextPtr->BufferMdlPtr));
+}
+
 VCHIQ_PAGED_SEGMENT_END
 
 VCHIQ_NONPAGED_SEGMENT_BEGIN
@@ -160,7 +279,83 @@ VOID VchiqTransferRequestContextCleanup (
         vchiqTxRequestContextPtr->ScatterGatherListPtr = NULL;
     }
 
+    if (vchiqTxRequestContextPtr->FragmentsPtr) {
+        VchiqFreeFragments(
+            vchiqTxRequestContextPtr->DeviceContextPtr,
+            vchiqTxRequestContextPtr->FragmentsPtr);
+        vchiqTxRequestContextPtr->FragmentsPtr = NULL;
+    }
+
     return;
 }
 
+/*++
+
+Routine Description:
+
+    VchiqAllocateFragments takes a fragment from the pool shared with the
+        firmware through slot zero.
+
+Arguments:
+
+    DeviceContextPtr - Device context pointer
+
+Return Value:
+
+    Pointer to the fragments or NULL if all fragments are in use
+
+--*/
+_Use_decl_annotations_
+FRAGMENTS* VchiqAllocateFragments (
+    DEVICE_CONTEXT* DeviceContextPtr
+    )
+{
+    KIRQL oldIrql;
+    FRAGMENTS* fragmentsPtr;
+
+    KeAcquireSpinLock(&DeviceContextPtr->FragmentLock, &oldIrql);
+
+    fragmentsPtr = DeviceContextPtr->FreeFragmentPtr;
+    if (fragmentsPtr != NULL) {
+        DeviceContextPtr->FreeFragmentPtr = *(FRAGMENTS**)fragmentsPtr;
+    }
+
+    KeReleaseSpinLock(&DeviceContextPtr->FragmentLock, oldIrql);
+
+    return fragmentsPtr;
+}
+
+/*++
+
+Routine Description:
+
+    VchiqFreeFragments returns a fragment to the pool.
+
+Arguments:
+
+    DeviceContextPtr - Device context pointer
+
+    FragmentsPtr - Fragments previously returned by VchiqAllocateFragments
+
+Return Value:
+
+    VOID
+
+--*/
+_Use_decl_annotations_
+VOID VchiqFreeFragments (
+    DEVICE_CONTEXT* DeviceContextPtr,
+    FRAGMENTS* FragmentsPtr
+    )
+{
+    KIRQL oldIrql;
+
+    KeAcquireSpinLock(&DeviceContextPtr->FragmentLock, &oldIrql);
+
+    *(FRAGMENTS**)FragmentsPtr = DeviceContextPtr->FreeFragmentPtr;
+    DeviceContextPtr->FreeFragmentPtr = FragmentsPtr;
+
+    KeReleaseSpinLock(&DeviceContextPtr->FragmentLock, oldIrql);
+}
+
 VCHIQ_NONPAGED_SEGMENT_END
\ No newline at end of file
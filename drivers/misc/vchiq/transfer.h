@@ -20,6 +20,7 @@ typedef struct _VCHIQ_TX_REQUEST_CONTEXT {
      ULONG PageListSize;
      PHYSICAL_ADDRESS PageListPhyAddr;
      SCATTER_GATHER_LIST* ScatterGatherListPtr;
+     FRAGMENTS* FragmentsPtr;
      DEVICE_CONTEXT* DeviceContextPtr;
      VCHIQ_FILE_CONTEXT* VchiqFileContextPtr;
 } VCHIQ_TX_REQUEST_CONTEXT, *PVCHIQ_TX_REQUEST_CONTEXT;
@@ -37,10 +38,30 @@ NTSTATUS VchiqAllocateTransferRequestObjContext (
     _In_ VOID* PageListPtr,
     _In_ ULONG PageListSize,
     _In_ PHYSICAL_ADDRESS PageListPhyAddr,
-    _In_ SCATTER_GATHER_LIST* ScatterGatherListPtr,
+    _In_opt_ SCATTER_GATHER_LIST* ScatterGatherListPtr,
+    _In_opt_ FRAGMENTS* FragmentsPtr,
     _Outptr_ VCHIQ_TX_REQUEST_CONTEXT** VchiqTxRequestContextPPtr
     );
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID VchiqCompleteBulkTransfer (
+    _In_ VCHIQ_FILE_CONTEXT* VchiqFileContextPtr,
+    _In_ WDFREQUEST Request,
+    _In_ ULONG MsgDirection,
+    _In_ ULONG ActualSize
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+FRAGMENTS* VchiqAllocateFragments (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID VchiqFreeFragments (
+    _In_ DEVICE_CONTEXT* DeviceContextPtr,
+    _In_ FRAGMENTS* FragmentsPtr
+    );
+
 EVT_WDF_OBJECT_CONTEXT_CLEANUP VchiqTransferRequestContextCleanup;
 
 EXTERN_C_END
@@ -253,6 +253,48 @@ extern "C" {
 //
 #define IOCTL_BCM_PWM_RESUME_AUDIO                  CTL_CODE(FILE_DEVICE_PWM_PERIPHERAL, 0x710, METHOD_BUFFERED, FILE_WRITE_DATA)
 
+//
+// Start a GPIO waveform. The DMA channel replays the steps into the GPIO set and clear registers of one bank, paced
+// by the PWM FIFO. Each step sets the pins of SetMask, clears the pins of ClearMask and then waits DelayTicks periods
+// of TickNs nanoseconds before the next step. The pins must be configured as outputs through the GPIO driver.
+// PWM channel 1 runs from the FIFO to generate the ticks and its output stays low. PWM clock and channel settings are
+// saved and restored in the IOCTL_BCM_PWM_STOP_WAVEFORM call. Only allowed if PWM is in register mode and no channel
+// is running, or if the previous waveform is done. The waveform is stopped when the handle is closed. The buffer for
+// the control blocks is allocated by the first call, which fails with STATUS_INSUFFICIENT_RESOURCES if it cannot be.
+// 
+// Input buffer:
+// lpInBuffer - pointer to a variable of type BCM_PWM_WAVEFORM
+// nInBufferSize - FIELD_OFFSET(BCM_PWM_WAVEFORM, Steps[StepCount])
+//
+// Output buffer:
+// None
+//
+#define IOCTL_BCM_PWM_START_WAVEFORM                CTL_CODE(FILE_DEVICE_PWM_PERIPHERAL, 0x711, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+//
+// Stop the GPIO waveform, leaving the pins at their current level, and put PWM back into register operation mode.
+// 
+// Input buffer:
+// None
+//
+// Output buffer:
+// None
+//
+#define IOCTL_BCM_PWM_STOP_WAVEFORM                 CTL_CODE(FILE_DEVICE_PWM_PERIPHERAL, 0x712, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+//
+// Get the progress of the GPIO waveform. Error is set if the DMA stopped on a bus error. CurrentStep is
+// the step the DMA is at or stopped at, or StepCount once a waveform without repeat is done.
+// 
+// Input buffer:
+// None
+//
+// Output buffer:
+// lpOutBuffer - pointer to a variable of type BCM_PWM_WAVEFORM_STATUS
+// nOutBufferSize - sizeof(BCM_PWM_WAVEFORM_STATUS)
+//
+#define IOCTL_BCM_PWM_GET_WAVEFORM_STATUS           CTL_CODE(FILE_DEVICE_PWM_PERIPHERAL, 0x713, METHOD_BUFFERED, FILE_WRITE_DATA)
+
 
 typedef enum _BCM_PWM_CHANNEL {
     BCM_PWM_CHANNEL_CHANNEL1,
@@ -329,6 +371,37 @@ typedef struct _BCM_PWM_AUDIO_CONFIG {
     PLARGE_INTEGER          DmaLastProcessedPacketTime;
 } BCM_PWM_AUDIO_CONFIG, *PBCM_PWM_AUDIO_CONFIG;
 
+#define BCM_PWM_WAVEFORM_MAX_STEPS          1024
+#define BCM_PWM_WAVEFORM_MAX_STEP_TICKS     16383
+#define BCM_PWM_WAVEFORM_MIN_TICK_NS        250
+#define BCM_PWM_WAVEFORM_MAX_TICK_NS        1000000
+#define BCM_PWM_WAVEFORM_TICK_NS_STEP       10
+
+//
+// Restart with the first step after the last step, until the waveform is stopped.
+//
+#define BCM_PWM_WAVEFORM_FLAG_REPEAT        0x00000001
+
+typedef struct _BCM_PWM_WAVEFORM_STEP {
+    ULONG                   SetMask;
+    ULONG                   ClearMask;
+    ULONG                   DelayTicks;
+} BCM_PWM_WAVEFORM_STEP, *PBCM_PWM_WAVEFORM_STEP;
+
+typedef struct _BCM_PWM_WAVEFORM {
+    ULONG                   Bank;
+    ULONG                   TickNs;
+    ULONG                   Flags;
+    ULONG                   StepCount;
+    BCM_PWM_WAVEFORM_STEP   Steps[1];
+} BCM_PWM_WAVEFORM, *PBCM_PWM_WAVEFORM;
+
+typedef struct _BCM_PWM_WAVEFORM_STATUS {
+    BOOLEAN                 Running;
+    BOOLEAN                 Error;
+    ULONG                   CurrentStep;
+} BCM_PWM_WAVEFORM_STATUS, *PBCM_PWM_WAVEFORM_STATUS;
+
 #ifdef __cplusplus
 } // extern "C"
 #endif // __cplusplus
@@ -62,6 +62,19 @@ Return Value:
 
     WdfDeviceInitSetExclusive(DeviceInit, TRUE);
 
+    //
+    // Stop a waveform that is still running when the handle is closed.
+    //
+
+    WDF_FILEOBJECT_CONFIG fileObjectConfig;
+    WDF_FILEOBJECT_CONFIG_INIT(
+        &fileObjectConfig,
+        WDF_NO_EVENT_CALLBACK,
+        WDF_NO_EVENT_CALLBACK,
+        OnFileCleanup
+        );
+    WdfDeviceInitSetFileObjectConfig(DeviceInit, &fileObjectConfig, WDF_NO_OBJECT_ATTRIBUTES);
+
     //
     // Create device object.
     //
@@ -458,6 +471,44 @@ Return Value:
         deviceContext->dmaPacketsProcessed = 0;
         deviceContext->dmaAudioNotifcationCount = 0;
         deviceContext->dmaRestartRequired = FALSE;
+
+        //
+        // Read the pins a GPIO waveform may drive. None are allowed unless configured, as the
+        // pins may belong to other drivers.
+        //
+
+        RtlZeroMemory(deviceContext->waveformPinMask, sizeof(deviceContext->waveformPinMask));
+        {
+            WDFKEY parametersKey;
+
+            if (NT_SUCCESS(WdfDeviceOpenRegistryKey(
+                Device,
+                PLUGPLAY_REGKEY_DEVICE,
+                KEY_QUERY_VALUE,
+                WDF_NO_OBJECT_ATTRIBUTES,
+                &parametersKey)))
+            {
+                DECLARE_CONST_UNICODE_STRING(pinMask0Name, REGSTR_VAL_WAVEFORM_PIN_MASK0);
+                DECLARE_CONST_UNICODE_STRING(pinMask1Name, REGSTR_VAL_WAVEFORM_PIN_MASK1);
+                ULONG value;
+
+                if (NT_SUCCESS(WdfRegistryQueryULong(parametersKey, &pinMask0Name, &value)))
+                {
+                    deviceContext->waveformPinMask[0] = value;
+                }
+                if (NT_SUCCESS(WdfRegistryQueryULong(parametersKey, &pinMask1Name, &value)))
+                {
+                    deviceContext->waveformPinMask[1] = value & WAVEFORM_GPIO_BANK1_PIN_MASK;
+                }
+
+                WdfRegistryClose(parametersKey);
+            }
+        }
+
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_INIT, "Waveform pin masks (bank 0: 0x%08x, bank 1: 0x%08x)",
+            deviceContext->waveformPinMask[0],
+            deviceContext->waveformPinMask[1]
+            );
     }
     else
     {
@@ -499,6 +550,15 @@ Return Value:
 
     deviceContext = GetContext(Device);
 
+    //
+    // A waveform may be repeating. Stop the DMA so it does not keep writing the GPIO registers.
+    //
+
+    if (deviceContext->dmaChannelRegs && deviceContext->pwmMode == PWM_MODE_WAVEFORM)
+    {
+        StopDma(deviceContext);
+    }
+
     if (deviceContext->dmaChannelRegs)
     {
         MmUnmapIoSpace(deviceContext->dmaChannelRegs, sizeof(DMA_CHANNEL_REGS));
@@ -629,6 +689,18 @@ Return Value:
         status = StopAudio(device);
         break;
 
+    case IOCTL_BCM_PWM_START_WAVEFORM:
+        status = StartWaveform(device, Request);
+        break;
+
+    case IOCTL_BCM_PWM_STOP_WAVEFORM:
+        status = StopWaveform(device);
+        break;
+
+    case IOCTL_BCM_PWM_GET_WAVEFORM_STATUS:
+        status = GetWaveformStatus(device, Request);
+        break;
+
     default:
         status = STATUS_INVALID_DEVICE_REQUEST;
         TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Unexpected IO code in request. Request: 0x%08x, Code: 0x%08x", (ULONG)Request, IoControlCode);
@@ -638,6 +710,34 @@ Return Value:
     WdfRequestComplete(Request, status);
 }
 
+#pragma code_seg("PAGE")
+_Use_decl_annotations_
+VOID
+OnFileCleanup(
+    WDFFILEOBJECT FileObject
+)
+/*++
+
+Routine Description:
+
+    This event is called when the handle to the device is closed. The device is exclusive, so
+    this is the only handle. A waveform keeps running without the client, so stop it.
+
+Arguments:
+
+    FileObject - Pointer to the file object of the handle
+
+Return Value:
+
+    None
+
+--*/
+{
+    PAGED_CODE();
+
+    (VOID)StopWaveform(WdfFileObjectGetDevice(FileObject));
+}
+
 #pragma code_seg()
 _Use_decl_annotations_
 VOID
@@ -681,4 +781,11 @@ Return Value:
         MmFreeContiguousMemorySpecifyCache(deviceContext->dmaCb, deviceContext->dmaControlDataSize, MmNonCached);
         #pragma warning(pop)
     }
+    if (deviceContext->waveform)
+    {
+        #pragma warning(push)
+        #pragma warning(disable:28118)
+        MmFreeContiguousMemorySpecifyCache(deviceContext->waveform, sizeof(WAVEFORM_BUFFER), MmNonCached);
+        #pragma warning(pop)
+    }
 }
\ No newline at end of file
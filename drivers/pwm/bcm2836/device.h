@@ -57,6 +57,15 @@ typedef struct _DEVICE_CONTEXT
     ULONG                       dmaUnderflowErrorCount;
     BOOLEAN                     dmaRestartRequired;
 
+    //
+    // GPIO waveform.
+    //
+
+    PWAVEFORM_BUFFER            waveform;
+    PHYSICAL_ADDRESS            waveformPa;
+    ULONG                       waveformStepCount;
+    ULONG                       waveformPinMask[WAVEFORM_GPIO_BANK_COUNT];
+
     //
     // PWM configuration.
     //
@@ -82,4 +91,5 @@ EVT_WDF_DRIVER_DEVICE_ADD           OnDeviceAdd;
 EVT_WDF_DEVICE_PREPARE_HARDWARE     PrepareHardware;
 EVT_WDF_DEVICE_RELEASE_HARDWARE     ReleaseHardware;
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL  OnIoDeviceControl;
+EVT_WDF_FILE_CLEANUP                OnFileCleanup;
 EVT_WDF_DEVICE_CONTEXT_CLEANUP      OnDeviceContextCleanup;
\ No newline at end of file
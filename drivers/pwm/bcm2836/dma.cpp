@@ -84,6 +84,48 @@ Return Value:
     return status;
 }
 
+#pragma code_seg()
+_Use_decl_annotations_
+NTSTATUS
+AllocateWaveformBuffer(
+    PDEVICE_CONTEXT DeviceContext
+)
+/*++
+
+Routine Description:
+
+    Allocate a noncached buffer for the GPIO waveform control blocks and GPIO data. The buffer is
+    only allocated for the first waveform, so audio does not depend on it.
+
+Arguments:
+
+    DeviceContext - pointer to the device context
+
+Return Value:
+
+    Status
+
+--*/
+{
+    if (DeviceContext->waveform != NULL)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    PHYSICAL_ADDRESS lowAddress = { 0, 0 };
+    PHYSICAL_ADDRESS highAddress = { 0, 0 };
+    PHYSICAL_ADDRESS boundaryAddress = { 0, 0 };
+    highAddress.LowPart = 0xffffffff;
+    if (NULL == (DeviceContext->waveform = (PWAVEFORM_BUFFER)MmAllocateContiguousNodeMemory(sizeof(WAVEFORM_BUFFER), lowAddress, highAddress, boundaryAddress, PAGE_READWRITE | PAGE_NOCACHE, MM_ANY_NODE_OK)))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IO, "Can not allocate %d bytes of non paged memory for waveform control blocks.", sizeof(WAVEFORM_BUFFER));
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    DeviceContext->waveformPa = MmGetPhysicalAddress(DeviceContext->waveform);
+    return STATUS_SUCCESS;
+}
+
 #pragma code_seg()
 VOID
 StopDma(
@@ -887,3 +929,483 @@ Return Value:
     return status;
 }
 
+#pragma code_seg()
+_Must_inspect_result_
+NTSTATUS
+ValidateWaveform(
+    _In_ PDEVICE_CONTEXT DeviceContext,
+    _In_ PBCM_PWM_WAVEFORM Waveform,
+    _In_ size_t WaveformSize
+)
+/*++
+
+Routine Description:
+
+    This function checks if the requested GPIO waveform is valid and only drives pins the
+    waveform is allowed to.
+
+Arguments:
+
+    DeviceContext - a pointer to the device context
+    Waveform - a pointer to the waveform
+    WaveformSize - size of the input buffer holding the waveform
+
+Return Value:
+
+    Status
+
+--*/
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG stepIndex;
+    ULONG totalTicks = 0;
+
+    if (Waveform->StepCount == 0 ||
+        Waveform->StepCount > BCM_PWM_WAVEFORM_MAX_STEPS ||
+        WaveformSize < FIELD_OFFSET(BCM_PWM_WAVEFORM, Steps) + Waveform->StepCount * sizeof(BCM_PWM_WAVEFORM_STEP))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Invalid waveform step count. (%d, buffer size: %d)", Waveform->StepCount, (ULONG)WaveformSize);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (Waveform->Bank >= WAVEFORM_GPIO_BANK_COUNT)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Invalid GPIO bank in waveform. (%d)", Waveform->Bank);
+    }
+
+    if (Waveform->TickNs < BCM_PWM_WAVEFORM_MIN_TICK_NS ||
+        Waveform->TickNs > BCM_PWM_WAVEFORM_MAX_TICK_NS ||
+        (Waveform->TickNs % BCM_PWM_WAVEFORM_TICK_NS_STEP) != 0)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Invalid tick period in waveform. (%d ns)", Waveform->TickNs);
+    }
+
+    if ((Waveform->Flags & ~BCM_PWM_WAVEFORM_FLAG_REPEAT) != 0)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Invalid flags in waveform. (0x%08x)", Waveform->Flags);
+    }
+
+    for (stepIndex = 0; NT_SUCCESS(status) && stepIndex < Waveform->StepCount; stepIndex++)
+    {
+        PBCM_PWM_WAVEFORM_STEP step = &Waveform->Steps[stepIndex];
+        ULONG pinMask = step->SetMask | step->ClearMask;
+
+        //
+        // A pin can not be set and cleared by the same step, because the set and clear
+        // registers are written in a single transfer. Pins outside the configured allow-list
+        // may belong to other drivers.
+        //
+
+        if ((step->SetMask & step->ClearMask) != 0 ||
+            (pinMask & ~DeviceContext->waveformPinMask[Waveform->Bank]) != 0)
+        {
+            status = STATUS_INVALID_PARAMETER;
+            TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Invalid pin masks in waveform step %d. (set: 0x%08x, clear: 0x%08x)", stepIndex, step->SetMask, step->ClearMask);
+        }
+
+        if (step->DelayTicks > BCM_PWM_WAVEFORM_MAX_STEP_TICKS)
+        {
+            status = STATUS_INVALID_PARAMETER;
+            TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Invalid delay in waveform step %d. (%d ticks)", stepIndex, step->DelayTicks);
+        }
+        totalTicks += step->DelayTicks;
+    }
+
+    //
+    // A repeating waveform without delays would keep the DMA channel busy without pacing.
+    //
+
+    if (NT_SUCCESS(status) && (Waveform->Flags & BCM_PWM_WAVEFORM_FLAG_REPEAT) && totalTicks == 0)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Repeating waveform has no delay.");
+    }
+
+    return status;
+}
+
+#pragma code_seg()
+_Use_decl_annotations_
+NTSTATUS
+StartWaveform(
+    WDFDEVICE Device,
+    WDFREQUEST Request
+)
+/*++
+
+Routine Description:
+
+    This function builds the control blocks for a GPIO waveform and starts the DMA. PWM channel 1 is
+    run from the FIFO with a range of one tick, so each word the DMA writes to the FIFO after the
+    FIFO has been primed delays the next step by one tick.
+
+Arguments:
+
+    Device - a pointer to the WDFDEVICE object
+    Request - a pointer to the WDFREQUEST object
+
+Return Value:
+
+    Status
+
+--*/
+{
+    PDEVICE_CONTEXT deviceContext;
+    NTSTATUS status = STATUS_SUCCESS;
+    PBCM_PWM_WAVEFORM waveformIn;
+    size_t waveformSize;
+
+    //
+    // Validate the request parameter.
+    //
+
+    status = WdfRequestRetrieveInputBuffer(
+        Request,
+        sizeof(*waveformIn),
+        (PVOID *)&waveformIn,
+        &waveformSize
+        );
+
+    if (NT_SUCCESS(status))
+    {
+        deviceContext = GetContext(Device);
+        status = ValidateWaveform(deviceContext, waveformIn, waveformSize);
+    }
+    else
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_IO, "Error retrieving waveform input buffer. (0x%08x)", status);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    WdfSpinLockAcquire(deviceContext->pwmLock);
+
+    //
+    // Only allow a waveform if PWM is not used for audio or register operation, and if the
+    // previous waveform is done.
+    //
+
+    if (deviceContext->pwmMode == PWM_MODE_AUDIO)
+    {
+        status = STATUS_OPERATION_IN_PROGRESS;
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "PWM is in audio mode. Could not start waveform.");
+    }
+    else if (deviceContext->pwmMode == PWM_MODE_REGISTER && (PWM_CHANNEL1_IS_RUNNING(deviceContext) || PWM_CHANNEL2_IS_RUNNING(deviceContext)))
+    {
+        status = STATUS_OPERATION_IN_PROGRESS;
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Device is running. Could not start waveform.");
+    }
+    else if (deviceContext->pwmMode == PWM_MODE_WAVEFORM && (READ_REGISTER_ULONG(&deviceContext->dmaChannelRegs->CS) & DMA_CS_ACTIVE))
+    {
+        status = STATUS_OPERATION_IN_PROGRESS;
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Waveform is running. Could not start waveform.");
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        status = AllocateWaveformBuffer(deviceContext);
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        if (deviceContext->pwmMode == PWM_MODE_REGISTER)
+        {
+            //
+            // Move PWM into waveform mode and save PWM clock and channel configuration.
+            //
+
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_IOCTL, "Save PWM configuration to restore.");
+            deviceContext->pwmMode = PWM_MODE_WAVEFORM;
+            deviceContext->pwmSavedClockConfig = deviceContext->pwmClockConfig;
+            deviceContext->pwmSavedChannel1Config = deviceContext->pwmChannel1Config;
+            deviceContext->pwmSavedChannel2Config = deviceContext->pwmChannel2Config;
+        }
+        else
+        {
+            //
+            // Stop the previous waveform. The DMA is done, but PWM still consumes the FIFO.
+            //
+
+            StopDma(deviceContext);
+            StopChannel(deviceContext, BCM_PWM_CHANNEL_ALLCHANNELS);
+        }
+
+        //
+        // Use a 100 MHz PWM clock, so the range of channel 1 is the tick period in 10 ns units.
+        //
+
+        deviceContext->pwmClockConfig.ClockSource = BCM_PWM_CLOCKSOURCE_PLLC;
+        deviceContext->pwmClockConfig.Divisor = 10;
+        SetClockConfig(deviceContext);
+
+        deviceContext->pwmChannel1Config.Range = waveformIn->TickNs / BCM_PWM_WAVEFORM_TICK_NS_STEP;
+        deviceContext->pwmChannel1Config.DutyMode = BCM_PWM_DUTYMODE_MARKSPACE;
+        deviceContext->pwmChannel1Config.Mode = BCM_PWM_MODE_PWM;
+        deviceContext->pwmChannel1Config.Polarity = BCM_PWM_POLARITY_NORMAL;
+        deviceContext->pwmChannel1Config.Repeat = BCM_PWM_REPEATMODE_OFF;
+        deviceContext->pwmChannel1Config.Silence = BCM_PWM_SILENCELEVEL_LOW;
+        SetChannelConfig(deviceContext);
+
+        //
+        // Build the control blocks. All addresses are bus addresses. The FIFO words are 0, so the
+        // output of channel 1 stays low.
+        //
+
+        PWAVEFORM_BUFFER waveform = deviceContext->waveform;
+        ULONG waveformBusAddress = deviceContext->waveformPa.LowPart + deviceContext->memUncachedOffset;
+        ULONG stepsBusAddress = waveformBusAddress + FIELD_OFFSET(WAVEFORM_BUFFER, Steps);
+        ULONG fifoDataBusAddress = waveformBusAddress + FIELD_OFFSET(WAVEFORM_BUFFER, FifoData);
+        ULONG fifoBusAddress = deviceContext->pwmRegsBusPa.LowPart + FIELD_OFFSET(PWM_REGS, FIF1);
+        ULONG gpioBusAddress = deviceContext->pwmRegsBusPa.LowPart - WAVEFORM_GPIO_REGS_BUS_OFFSET + WAVEFORM_GPIO_GPSET0_OFFSET;
+        ULONG delayTi = DMA_TI_DEST_DREQ | (deviceContext->dmaDreq << DMA_TI_PERMAP_SHIFT) | DMA_TI_WAIT_RESP;
+        ULONG stepIndex;
+
+        waveform->FifoData = 0;
+
+        waveform->PrimeCb.TI = DMA_TI_WAIT_RESP;
+        waveform->PrimeCb.SOURCE_AD = fifoDataBusAddress;
+        waveform->PrimeCb.DEST_AD = fifoBusAddress;
+        waveform->PrimeCb.TXFR_LEN = WAVEFORM_FIFO_THRESHOLD * sizeof(ULONG);
+        waveform->PrimeCb.STRIDE = 0;
+        waveform->PrimeCb.NEXTCONBK = stepsBusAddress;
+
+        for (stepIndex = 0; stepIndex < waveformIn->StepCount; stepIndex++)
+        {
+            PBCM_PWM_WAVEFORM_STEP stepIn = &waveformIn->Steps[stepIndex];
+            PWAVEFORM_STEP step = &waveform->Steps[stepIndex];
+            ULONG stepBusAddress = stepsBusAddress + stepIndex * sizeof(WAVEFORM_STEP);
+            ULONG nextStepBusAddress;
+
+            if (stepIndex + 1 < waveformIn->StepCount)
+            {
+                nextStepBusAddress = stepBusAddress + sizeof(WAVEFORM_STEP);
+            }
+            else if (waveformIn->Flags & BCM_PWM_WAVEFORM_FLAG_REPEAT)
+            {
+                nextStepBusAddress = stepsBusAddress;
+            }
+            else
+            {
+                nextStepBusAddress = 0;
+            }
+
+            RtlZeroMemory(&step->GpioWrite, sizeof(step->GpioWrite));
+            step->GpioWrite.GPSET[waveformIn->Bank] = stepIn->SetMask;
+            step->GpioWrite.GPCLR[waveformIn->Bank] = stepIn->ClearMask;
+
+            step->WriteCb.TI = DMA_TI_SRC_INC | DMA_TI_DEST_INC | DMA_TI_WAIT_RESP;
+            step->WriteCb.SOURCE_AD = stepBusAddress + FIELD_OFFSET(WAVEFORM_STEP, GpioWrite);
+            step->WriteCb.DEST_AD = gpioBusAddress;
+            step->WriteCb.TXFR_LEN = sizeof(WAVEFORM_GPIO_WRITE);
+            step->WriteCb.STRIDE = 0;
+
+            //
+            // Steps without a delay skip their delay CB.
+            //
+
+            if (stepIn->DelayTicks == 0)
+            {
+                step->WriteCb.NEXTCONBK = nextStepBusAddress;
+            }
+            else
+            {
+                step->WriteCb.NEXTCONBK = stepBusAddress + FIELD_OFFSET(WAVEFORM_STEP, DelayCb);
+            }
+
+            step->DelayCb.TI = delayTi;
+            step->DelayCb.SOURCE_AD = fifoDataBusAddress;
+            step->DelayCb.DEST_AD = fifoBusAddress;
+            step->DelayCb.TXFR_LEN = stepIn->DelayTicks * sizeof(ULONG);
+            step->DelayCb.STRIDE = 0;
+            step->DelayCb.NEXTCONBK = nextStepBusAddress;
+        }
+        deviceContext->waveformStepCount = waveformIn->StepCount;
+
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_IO, "Start waveform with %d steps on bank %d, tick: %d ns, flags: 0x%08x",
+            waveformIn->StepCount, waveformIn->Bank, waveformIn->TickNs, waveformIn->Flags
+            );
+
+        //
+        // Clear the FIFO, let PWM request DMA below the FIFO threshold and start channel 1 from the
+        // FIFO before the DMA, so the prime CB is the only one that is not paced.
+        //
+
+        WRITE_REGISTER_ULONG(&deviceContext->pwmRegs->CTL, PWM_CTL_CLRF1);
+        WRITE_REGISTER_ULONG(&deviceContext->pwmRegs->DMAC,
+            (ULONG)(PWM_DMAC_ENAB | (WAVEFORM_FIFO_THRESHOLD << PWM_DMAC_DREQ_SHIFT) | (WAVEFORM_FIFO_THRESHOLD << PWM_DMAC_PANIC_SHIFT))
+            );
+        WRITE_REGISTER_ULONG(&deviceContext->pwmRegs->CTL, PWM_CTL_USEF1 | PWM_CTL_MSEN1 | PWM_CTL_PWEN1);
+
+        StartDma(deviceContext, deviceContext->waveformPa);
+    }
+
+    WdfSpinLockRelease(deviceContext->pwmLock);
+
+    return status;
+}
+
+#pragma code_seg()
+_Use_decl_annotations_
+NTSTATUS
+StopWaveform(
+    WDFDEVICE Device
+)
+/*++
+
+Routine Description:
+
+    This function stops the GPIO waveform and puts the PWM driver back into register mode.
+
+Arguments:
+
+    Device - a pointer to the WDFDEVICE object
+
+Return Value:
+
+    Status
+
+--*/
+{
+    PDEVICE_CONTEXT deviceContext;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    deviceContext = GetContext(Device);
+
+    WdfSpinLockAcquire(deviceContext->pwmLock);
+
+    //
+    // If PWM is not in waveform mode, no need to stop the waveform.
+    //
+
+    if (deviceContext->pwmMode != PWM_MODE_WAVEFORM)
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_IO, "PWM is not in waveform mode.");
+    }
+    else
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_IO, "Stop waveform.");
+
+        StopDma(deviceContext);
+        StopChannel(deviceContext, BCM_PWM_CHANNEL_ALLCHANNELS);
+        WRITE_REGISTER_ULONG(&deviceContext->pwmRegs->DMAC, 0);
+        deviceContext->waveformStepCount = 0;
+
+        //
+        // Move PWM into register mode and restore PWM clock and channel configuration.
+        //
+
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_IOCTL, "Restore PWM configuration.");
+        deviceContext->pwmMode = PWM_MODE_REGISTER;
+        deviceContext->pwmClockConfig = deviceContext->pwmSavedClockConfig;
+        deviceContext->pwmChannel1Config = deviceContext->pwmSavedChannel1Config;
+        deviceContext->pwmChannel2Config = deviceContext->pwmSavedChannel2Config;
+        SetClockConfig(deviceContext);
+        SetChannelConfig(deviceContext);
+    }
+
+    WdfSpinLockRelease(deviceContext->pwmLock);
+
+    return status;
+}
+
+#pragma code_seg()
+_Use_decl_annotations_
+NTSTATUS
+GetWaveformStatus(
+    WDFDEVICE Device,
+    WDFREQUEST Request
+)
+/*++
+
+Routine Description:
+
+    This function returns whether the GPIO waveform is running, whether the DMA stopped on an
+    error, and the step the DMA is at. The step is taken from the control block address of the
+    DMA channel.
+
+Arguments:
+
+    Device - a pointer to the WDFDEVICE object
+    Request - a pointer to the WDFREQUEST object
+
+Return Value:
+
+    Status
+
+--*/
+{
+    PDEVICE_CONTEXT deviceContext;
+    NTSTATUS status = STATUS_SUCCESS;
+    PBCM_PWM_WAVEFORM_STATUS waveformStatus;
+
+    status = WdfRequestRetrieveOutputBuffer(
+        Request,
+        sizeof(*waveformStatus),
+        (PVOID *)&waveformStatus,
+        NULL
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_IO, "Error retrieving waveform status output buffer. (0x%08x)", status);
+        return status;
+    }
+
+    deviceContext = GetContext(Device);
+
+    WdfSpinLockAcquire(deviceContext->pwmLock);
+
+    if (deviceContext->pwmMode != PWM_MODE_WAVEFORM)
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IO, "PWM is not in waveform mode.");
+        status = STATUS_DEVICE_CONFIGURATION_ERROR;
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        ULONG cs = READ_REGISTER_ULONG(&deviceContext->dmaChannelRegs->CS);
+        ULONG cbBusAddress = READ_REGISTER_ULONG(&deviceContext->dmaChannelRegs->CONBLK_AD);
+        ULONG stepsBusAddress = deviceContext->waveformPa.LowPart + deviceContext->memUncachedOffset + FIELD_OFFSET(WAVEFORM_BUFFER, Steps);
+
+        waveformStatus->Running = (cs & DMA_CS_ACTIVE) ? TRUE : FALSE;
+        waveformStatus->Error = (cs & DMA_CS_ERROR) ? TRUE : FALSE;
+
+        if (waveformStatus->Error)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, TRACE_IO, "Waveform DMA error. (CS: 0x%08x, CONBLK_AD: 0x%08x, DEBUG: 0x%08x)",
+                cs, cbBusAddress, READ_REGISTER_ULONG(&deviceContext->dmaChannelRegs->DEBUG)
+                );
+        }
+
+        //
+        // The DMA clears the CB address after the last CB of the chain. If the DMA stopped before
+        // that, the CB address still points into the step it stopped at.
+        //
+
+        if (cbBusAddress == 0)
+        {
+            waveformStatus->CurrentStep = deviceContext->waveformStepCount;
+        }
+        else if (cbBusAddress < stepsBusAddress)
+        {
+            waveformStatus->CurrentStep = 0;
+        }
+        else
+        {
+            ULONG stepIndex = (ULONG)((cbBusAddress - stepsBusAddress) / sizeof(WAVEFORM_STEP));
+            waveformStatus->CurrentStep = min(stepIndex, deviceContext->waveformStepCount - 1);
+        }
+
+        WdfRequestSetInformation(Request, sizeof(*waveformStatus));
+    }
+
+    WdfSpinLockRelease(deviceContext->pwmLock);
+
+    return status;
+}
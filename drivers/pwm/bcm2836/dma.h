@@ -46,6 +46,59 @@ typedef struct _DMA_CB
     ULONG RSVD1;
 } DMA_CB,*PDMA_CB;
 
+//
+// GPIO waveform. Each step is a CB that writes the step's masks to the GPIO set and clear
+// registers, followed by a CB that writes DelayTicks words to the PWM FIFO. The DMA is paced
+// by the PWM DREQ, so the second CB takes one PWM period per word. The GPIO controller
+// registers are at a fixed distance below the PWM registers in the peripheral bus address space.
+//
+
+#define WAVEFORM_GPIO_REGS_BUS_OFFSET   0xC000
+#define WAVEFORM_GPIO_GPSET0_OFFSET     0x1C
+#define WAVEFORM_GPIO_BANK_COUNT        2
+#define WAVEFORM_GPIO_BANK1_PIN_MASK    0x003FFFFF  // pins 32-53
+
+//
+// REG_DWORD values in the device parameters key with the pins of bank 0 and bank 1 a waveform
+// may drive. A waveform is rejected if it touches any other pin. No pin is allowed by default.
+//
+
+#define REGSTR_VAL_WAVEFORM_PIN_MASK0   L"WaveformPinMask0"
+#define REGSTR_VAL_WAVEFORM_PIN_MASK1   L"WaveformPinMask1"
+
+//
+// GPIO registers written by a step, starting at GPSET0. Writing 0 to a set or clear
+// register has no effect, so the registers of the other bank are written with 0.
+//
+
+typedef struct _WAVEFORM_GPIO_WRITE
+{
+    ULONG GPSET[WAVEFORM_GPIO_BANK_COUNT];
+    ULONG RSVD0;
+    ULONG GPCLR[WAVEFORM_GPIO_BANK_COUNT];
+} WAVEFORM_GPIO_WRITE, *PWAVEFORM_GPIO_WRITE;
+
+typedef struct _WAVEFORM_STEP
+{
+    DMA_CB WriteCb;
+    DMA_CB DelayCb;
+    WAVEFORM_GPIO_WRITE GpioWrite;
+} WAVEFORM_STEP, *PWAVEFORM_STEP;
+
+//
+// The prime CB fills the PWM FIFO up to the DREQ threshold before the first step, so that
+// every FIFO word written by a step waits for one PWM period.
+//
+
+typedef struct _WAVEFORM_BUFFER
+{
+    DMA_CB PrimeCb;
+    ULONG FifoData;
+    WAVEFORM_STEP Steps[BCM_PWM_WAVEFORM_MAX_STEPS];
+} WAVEFORM_BUFFER, *PWAVEFORM_BUFFER;
+
+#define WAVEFORM_FIFO_THRESHOLD         7
+
 //
 // List for notification events
 //
@@ -208,6 +261,12 @@ AllocateDmaBuffer(
     _Inout_ PDEVICE_CONTEXT DeviceContext
 );
 
+_Must_inspect_result_
+NTSTATUS
+AllocateWaveformBuffer(
+    _Inout_ PDEVICE_CONTEXT DeviceContext
+);
+
 VOID
 StopDma(
     _In_ PDEVICE_CONTEXT DeviceContext
@@ -266,3 +325,20 @@ NTSTATUS
 ResumeAudio(
     _In_ WDFDEVICE Device
 );
+
+NTSTATUS
+StartWaveform(
+    _In_ WDFDEVICE Device,
+    _In_ WDFREQUEST Request
+);
+
+NTSTATUS
+StopWaveform(
+    _In_ WDFDEVICE Device
+);
+
+NTSTATUS
+GetWaveformStatus(
+    _In_ WDFDEVICE Device,
+    _In_ WDFREQUEST Request
+);
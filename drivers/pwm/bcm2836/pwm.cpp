@@ -1281,7 +1281,7 @@ Return Value:
     WdfSpinLockAcquire(deviceContext->pwmLock);
 
     //
-    // Only allow audio operation if PWM is not running in register mode.
+    // Only allow audio operation if PWM is not running in register mode and is not generating a waveform.
     //
 
     if (deviceContext->pwmMode == PWM_MODE_REGISTER && (PWM_CHANNEL1_IS_RUNNING(deviceContext) || PWM_CHANNEL2_IS_RUNNING(deviceContext)))
@@ -1290,6 +1290,12 @@ Return Value:
         TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "Device is running. Could not aquire PWM for audio operation.");
     }
 
+    if (deviceContext->pwmMode == PWM_MODE_WAVEFORM)
+    {
+        status = STATUS_OPERATION_IN_PROGRESS;
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_IOCTL, "PWM is in waveform mode. Could not aquire PWM for audio operation.");
+    }
+
     if (NT_SUCCESS(status))
     {
         //
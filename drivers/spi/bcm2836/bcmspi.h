@@ -136,5 +136,102 @@ BCM_SPI_REGISTERS, *PBCM_SPI_REGISTERS;
 // The SPI HW waits an extra clock after each byte transfered
 #define BCM_SPI_SCLK_TICKS_PER_BYTE 9
 
+// DREQ thresholds used in DMA mode, in FIFO entries
+#define BCM_SPI_REG_DC_DMA_DEFAULT      \
+    (BCM_SPI_REG_DC_RPANIC_SET(0x30) |  \
+     BCM_SPI_REG_DC_RDREQ_SET(0x20) |   \
+     BCM_SPI_REG_DC_TPANIC_SET(0x10) |  \
+     BCM_SPI_REG_DC_TDREQ_SET(0x20))
+
+// In DMA mode the FIFO is accessed as 32 bit words carrying 4 bytes each
+#define BCM_SPI_DMA_WORD_SIZE           4
+
+//
+// Broadcom DMA controller registers.
+//
+
+// SPI0 uses two full DMA channels, one paced by the TX DREQ writing
+// the FIFO and one paced by the RX DREQ draining it.
+
+#define BCM_DMA_DREQ_SPI_TX             6
+#define BCM_DMA_DREQ_SPI_RX             7
+
+// the DMA engine sees memory through the uncached VC bus alias,
+// which only covers the first GB of physical memory
+#define BCM_DMA_SDRAM_BUS_UNCACHED      0xC0000000
+#define BCM_DMA_SDRAM_PHYSICAL_MAX      0x3FFFFFFF
+
+// define DMA channel register map
+
+typedef struct BCM_DMA_CHANNEL_REGISTERS
+{
+    __declspec(align(4)) ULONG CS;        // DMA Channel Control and Status
+    __declspec(align(4)) ULONG CONBLK_AD; // DMA Channel Control Block Address
+    __declspec(align(4)) ULONG TI;        // DMA Channel CB Word 0 (Transfer Information)
+    __declspec(align(4)) ULONG SOURCE_AD; // DMA Channel CB Word 1 (Source Address)
+    __declspec(align(4)) ULONG DEST_AD;   // DMA Channel CB Word 2 (Destination Address)
+    __declspec(align(4)) ULONG TXFR_LEN;  // DMA Channel CB Word 3 (Transfer Length)
+    __declspec(align(4)) ULONG STRIDE;    // DMA Channel CB Word 4 (2D Stride)
+    __declspec(align(4)) ULONG NEXTCONBK; // DMA Channel CB Word 5 (Next CB Address)
+    __declspec(align(4)) ULONG DEBUG;     // DMA Channel Debug
+}
+BCM_DMA_CHANNEL_REGISTERS, *PBCM_DMA_CHANNEL_REGISTERS;
+
+// DMA control block, must be 256 bit aligned
+
+typedef struct BCM_DMA_CB
+{
+    __declspec(align(32)) ULONG TI;
+    ULONG SOURCE_AD;
+    ULONG DEST_AD;
+    ULONG TXFR_LEN;
+    ULONG STRIDE;
+    ULONG NEXTCONBK;
+    ULONG RSVD0;
+    ULONG RSVD1;
+}
+BCM_DMA_CB, *PBCM_DMA_CB;
+
+//
+// DMA CS register bits.
+//
+
+#define BCM_DMA_REG_CS_RESET                0x80000000
+#define BCM_DMA_REG_CS_ABORT                0x40000000
+#define BCM_DMA_REG_CS_DISDEBUG             0x20000000
+#define BCM_DMA_REG_CS_WAIT_FOR_WRITES      0x10000000
+#define BCM_DMA_REG_CS_PANIC_PRIORITY_SET(v) (((v) << 20) & 0x00f00000)
+#define BCM_DMA_REG_CS_PRIORITY_SET(v)      (((v) << 16) & 0x000f0000)
+#define BCM_DMA_REG_CS_ERROR                0x00000100
+#define BCM_DMA_REG_CS_INT                  0x00000004
+#define BCM_DMA_REG_CS_END                  0x00000002
+#define BCM_DMA_REG_CS_ACTIVE               0x00000001
+
+#define BCM_DMA_REG_CS_START                    \
+    (BCM_DMA_REG_CS_ACTIVE |                    \
+     BCM_DMA_REG_CS_END |                       \
+     BCM_DMA_REG_CS_INT |                       \
+     BCM_DMA_REG_CS_PRIORITY_SET(8) |           \
+     BCM_DMA_REG_CS_PANIC_PRIORITY_SET(0xf) |   \
+     BCM_DMA_REG_CS_WAIT_FOR_WRITES |           \
+     BCM_DMA_REG_CS_DISDEBUG)
+
+//
+// DMA TI bits.
+//
+
+#define BCM_DMA_TI_PERMAP_SET(v)            (((v) << 16) & 0x001f0000)
+#define BCM_DMA_TI_SRC_DREQ                 0x00000400
+#define BCM_DMA_TI_SRC_INC                  0x00000100
+#define BCM_DMA_TI_DEST_DREQ                0x00000040
+#define BCM_DMA_TI_DEST_INC                 0x00000010
+#define BCM_DMA_TI_WAIT_RESP                0x00000008
+
+//
+// DMA TXFR_LEN bits.
+//
+
+#define BCM_DMA_TXFR_LEN_XLENGTH            0x0000ffff
+
 #endif
 
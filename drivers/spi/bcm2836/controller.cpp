@@ -75,6 +75,54 @@ ControllerFlushFifos(
     }
 }
 
+static VOID
+ControllerWaitForFifoInterrupt(
+    _In_ PPBC_DEVICE pDevice
+    )
+/*++
+
+    Routine Description:
+
+        This routine arms the FIFO threshold and done interrupts and
+        sleeps until either fires. A timeout is not an error, the
+        caller polls the FIFO state again either way.
+
+    Arguments:
+
+        pDevice - a pointer to the PBC device context
+
+    Return Value:
+
+        None.
+
+--*/
+{
+    LARGE_INTEGER timeout;
+    timeout.QuadPart = LONGLONG(WDF_REL_TIMEOUT_IN_US(BCM_SPI_FIFO_FLUSH_TIMEOUT_US));
+
+    LARGE_INTEGER waitStart = KeQueryPerformanceCounter(NULL);
+
+    KeClearEvent(&pDevice->TransferInterruptEvt);
+    WRITE_REGISTER_ULONG(
+        &pDevice->pSPIRegisters->CS,
+        pDevice->SPI_CS_COPY | BCM_SPI_REG_CS_INTR | BCM_SPI_REG_CS_INTD);
+
+    NTSTATUS status = KeWaitForSingleObject(
+        &pDevice->TransferInterruptEvt,
+        Executive,
+        KernelMode,
+        FALSE,
+        &timeout);
+
+    if (status == STATUS_TIMEOUT)
+    {
+        // disarm, the ISR did not do it
+        WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->CS, pDevice->SPI_CS_COPY);
+    }
+
+    pDevice->TransferWaitTicks += KeQueryPerformanceCounter(NULL).QuadPart - waitStart.QuadPart;
+}
+
 _Use_decl_annotations_
 VOID
 ControllerInitialize(
@@ -103,9 +151,16 @@ ControllerInitialize(
 
     pDevice->SPI_CS_COPY = BCM_SPI_REG_CS_POLL_DEFAULT;
     pDevice->CurrentConnectionSpeed = BCM_SPI_REG_CLK_DEFAULT;
+    pDevice->pConfiguredTarget = NULL;
+    pDevice->pBurstTarget = NULL;
     WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->CS, pDevice->SPI_CS_COPY);
     ControllerConfigClock(pDevice, BCM_SPI_REG_CLK_DEFAULT);
 
+    if (pDevice->DmaEnabled)
+    {
+        WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->DC, BCM_SPI_REG_DC_DMA_DEFAULT);
+    }
+
     FuncExit(TRACE_FLAG_PBCLOADING);
 }
 
@@ -135,7 +190,15 @@ ControllerUninitialize(
     NT_ASSERT(pDevice != NULL);
 
     // make sure pending transactions are stopped
+    if (pDevice->DmaEnabled)
+    {
+        ControllerStopDma(pDevice);
+    }
+
+    WdfSpinLockAcquire(pDevice->Lock);
+    pDevice->pBurstTarget = NULL;
     ControllerDeactivateTransfer(pDevice);
+    WdfSpinLockRelease(pDevice->Lock);
 
     FuncExit(TRACE_FLAG_PBCLOADING);
 }
@@ -231,6 +294,37 @@ ControllerDoOneTransferPollMode(
     size_t readByteIndex = 0;
     size_t writeByteIndex = 0;
     size_t transferByteLength = max(bytesToWrite, bytesToRead);
+
+    //
+    // Large transfers are handed to the DMA engine except for the
+    // last bytes not filling a FIFO word, which are transferred below
+    //
+
+    if (pDevice->DmaEnabled &&
+        (pDevice->DmaThresholdBytes != 0) &&
+        (transferByteLength >= pDevice->DmaThresholdBytes) &&
+        (transferByteLength >= BCM_SPI_DMA_WORD_SIZE))
+    {
+        size_t dmaByteLength = transferByteLength & ~size_t(BCM_SPI_DMA_WORD_SIZE - 1);
+
+        status = ControllerDoOneTransferDmaMode(
+            pDevice,
+            pRequest,
+            bytesToWrite,
+            bytesToRead,
+            dmaByteLength);
+        if (!NT_SUCCESS(status))
+        {
+            goto exit;
+        }
+
+        writeByteIndex = min(bytesToWrite, dmaByteLength);
+        readByteIndex = min(bytesToRead, dmaByteLength);
+        bytesToWrite -= writeByteIndex;
+        bytesToRead -= readByteIndex;
+        transferByteLength -= dmaByteLength;
+    }
+
     size_t zeroBytesToWrite = transferByteLength - bytesToWrite;
     size_t readBytesToDiscard = transferByteLength - bytesToRead;
     UCHAR nextByte;
@@ -323,6 +417,18 @@ ControllerDoOneTransferPollMode(
             }
         }
 
+        //
+        // Nothing to write and nothing to read, in interrupt mode
+        // sleep until the FIFO needs service instead of spinning
+        //
+
+        if ((pDevice->TransferMode == PbcTransferModeInterrupt) &&
+            ((CS & BCM_SPI_REG_CS_RXD) == 0) &&
+            (((CS & BCM_SPI_REG_CS_TXD) == 0) || ((bytesToWrite == 0) && (zeroBytesToWrite == 0))))
+        {
+            ControllerWaitForFifoInterrupt(pDevice);
+        }
+
     #ifdef DBG
         ++numPolls;
     #endif
@@ -350,6 +456,350 @@ exit:
     return status;
 }
 
+inline void
+ControllerStartDma(
+    _In_ PBCM_DMA_CHANNEL_REGISTERS pDmaRegisters,
+    _In_ ULONG ControlBlockBusAddress
+    )
+/*++
+
+    Routine Description:
+
+        This routine starts a DMA channel on the given control block
+
+    Arguments:
+
+        pDmaRegisters - a pointer to the DMA channel registers
+        ControlBlockBusAddress - the bus address of the control block
+
+    Return Value:
+
+        None.
+
+--*/
+{
+    WRITE_REGISTER_ULONG(&pDmaRegisters->CONBLK_AD, ControlBlockBusAddress);
+    WRITE_REGISTER_ULONG(&pDmaRegisters->CS, BCM_DMA_REG_CS_START);
+}
+
+_Use_decl_annotations_
+VOID
+ControllerStopDma(
+    PPBC_DEVICE pDevice
+    )
+/*++
+
+  Routine Description:
+
+    This routine stops and resets the TX and RX DMA channels.
+
+  Arguments:
+
+    pDevice - a pointer to the PBC device context
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    PBCM_DMA_CHANNEL_REGISTERS dmaRegisters[] = { pDevice->pDmaTxRegisters, pDevice->pDmaRxRegisters };
+
+    for (ULONG i = 0; i < ARRAYSIZE(dmaRegisters); i++)
+    {
+        if (dmaRegisters[i] == NULL)
+        {
+            continue;
+        }
+
+        WRITE_REGISTER_ULONG(
+            &dmaRegisters[i]->CS,
+            READ_REGISTER_ULONG(&dmaRegisters[i]->CS) & ~BCM_DMA_REG_CS_ACTIVE);
+        WRITE_REGISTER_ULONG(&dmaRegisters[i]->CONBLK_AD, 0);
+        WRITE_REGISTER_ULONG(&dmaRegisters[i]->CS, BCM_DMA_REG_CS_RESET);
+    }
+}
+
+static NTSTATUS
+ControllerWaitForDma(
+    _In_ PPBC_DEVICE pDevice,
+    _In_ PPBC_REQUEST pRequest,
+    _In_ size_t Length
+    )
+/*++
+
+  Routine Description:
+
+    This routine waits for the RX DMA channel to finish, which
+    happens once the last byte has been clocked in. Unlike the FIFO
+    transfer the thread does not poll for the whole transfer, it
+    sleeps through most of the expected transfer time and only
+    polls for the remainder.
+
+  Arguments:
+
+    pDevice - a pointer to the PBC device context
+    pRequest - a pointer to the PBC request context
+    Length - number of bytes of the running DMA transfer
+
+  Return Value:
+
+    STATUS_CANCELLED if the request was cancelled, STATUS_IO_TIMEOUT
+    or STATUS_DEVICE_DATA_ERROR if the transfer did not complete,
+    otherwise STATUS_SUCCESS
+
+--*/
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG connectionSpeed = max(pDevice->CurrentConnectionSpeed, ULONG(BCM_SPI_CLK_MIN_HZ));
+    ULONGLONG transferTimeUs =
+        (ULONGLONG(Length) * ULONGLONG(BCM_SPI_SCLK_TICKS_PER_BYTE) * 1000000ull) / ULONGLONG(connectionSpeed);
+
+    if (transferTimeUs > BCM_SPI_DMA_SLEEP_THRESHOLD_US)
+    {
+        LARGE_INTEGER wait = { 0 };
+        wait.QuadPart = LONGLONG(WDF_REL_TIMEOUT_IN_US(transferTimeUs - BCM_SPI_DMA_SLEEP_THRESHOLD_US));
+
+        LARGE_INTEGER waitStart = KeQueryPerformanceCounter(NULL);
+
+        (void)KeDelayExecutionThread(KernelMode, FALSE, &wait);
+
+        pDevice->TransferWaitTicks += KeQueryPerformanceCounter(NULL).QuadPart - waitStart.QuadPart;
+    }
+
+    ULONGLONG deadline = KeQueryInterruptTime() +
+        WDF_ABS_TIMEOUT_IN_US(BCM_SPI_DMA_SLEEP_THRESHOLD_US + BCM_SPI_DMA_TIMEOUT_MARGIN_US);
+
+    for (;;)
+    {
+        ULONG txCS = READ_REGISTER_ULONG(&pDevice->pDmaTxRegisters->CS);
+        ULONG rxCS = READ_REGISTER_ULONG(&pDevice->pDmaRxRegisters->CS);
+
+        if ((txCS | rxCS) & BCM_DMA_REG_CS_ERROR)
+        {
+            status = STATUS_DEVICE_DATA_ERROR;
+
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_FLAG_TRANSFER,
+                "DMA error (TX CS 0x%lx, RX CS 0x%lx) for SPBREQUEST %p",
+                txCS,
+                rxCS,
+                pRequest->SpbRequest);
+
+            break;
+        }
+
+        if ((rxCS & BCM_DMA_REG_CS_ACTIVE) == 0)
+        {
+            break;
+        }
+
+        if (WdfRequestIsCanceled(pRequest->SpbRequest))
+        {
+            status = STATUS_CANCELLED;
+
+            Trace(
+                TRACE_LEVEL_INFORMATION,
+                TRACE_FLAG_TRANSFER,
+                "Terminating DMA transfer due to request cancelled SPBREQUEST %p",
+                pRequest->SpbRequest);
+
+            break;
+        }
+
+        if (KeQueryInterruptTime() > deadline)
+        {
+            status = STATUS_IO_TIMEOUT;
+
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_FLAG_TRANSFER,
+                "DMA transfer of %Iu byte(s) timed out (TX CS 0x%lx, RX CS 0x%lx) for SPBREQUEST %p",
+                Length,
+                txCS,
+                rxCS,
+                pRequest->SpbRequest);
+
+            break;
+        }
+
+        // do not flood the I/O bus
+        KeStallExecutionProcessor(1);
+    }
+
+    return status;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+ControllerDoOneTransferDmaMode(
+    PPBC_DEVICE pDevice,
+    PPBC_REQUEST pRequest,
+    size_t BytesToWrite,
+    size_t BytesToRead,
+    size_t Length
+    )
+/*++
+ 
+  Routine Description:
+
+    This routine transfers the first Length bytes of the current
+    transfer using the TX and RX DMA channels. Both channels run
+    for every transfer: the TX channel sends zeros past the end of
+    the write buffer and only the read part of the RX bounce buffer
+    is copied out, so write, read and fullduplex transfers share
+    the same pair of control blocks.
+
+  Arguments:
+
+    pDevice - a pointer to the PBC device context
+    pRequest - a pointer to the PBC request context
+    BytesToWrite - number of bytes to write in the current transfer
+    BytesToRead - number of bytes to read in the current transfer
+    Length - number of bytes to transfer, a multiple of the FIFO word size
+
+  Return Value:
+
+    Status
+
+--*/
+{
+    FuncEntry(TRACE_FLAG_TRANSFER);
+
+    NTSTATUS status = STATUS_SUCCESS;
+    size_t offset = 0;
+
+    NT_ASSERT(pDevice->DmaEnabled);
+    NT_ASSERT((Length % BCM_SPI_DMA_WORD_SIZE) == 0);
+
+    ULONG fifoBusAddress =
+        pDevice->SPIRegistersBusAddress.LowPart + FIELD_OFFSET(BCM_SPI_REGISTERS, FIFO);
+    ULONG memoryBusAddress =
+        pDevice->DmaMemoryPhysicalAddress.LowPart | BCM_DMA_SDRAM_BUS_UNCACHED;
+    ULONG txCbBusAddress =
+        memoryBusAddress + ULONG((PUCHAR)pDevice->pDmaTxCb - (PUCHAR)pDevice->pDmaMemory);
+    ULONG rxCbBusAddress =
+        memoryBusAddress + ULONG((PUCHAR)pDevice->pDmaRxCb - (PUCHAR)pDevice->pDmaMemory);
+
+    //
+    // TX channel feeds the FIFO from the TX bounce buffer paced
+    // by the TX DREQ, the RX channel drains the FIFO into the RX
+    // bounce buffer paced by the RX DREQ
+    //
+
+    pDevice->pDmaTxCb->TI =
+        BCM_DMA_TI_PERMAP_SET(BCM_DMA_DREQ_SPI_TX) |
+        BCM_DMA_TI_DEST_DREQ |
+        BCM_DMA_TI_SRC_INC |
+        BCM_DMA_TI_WAIT_RESP;
+    pDevice->pDmaTxCb->SOURCE_AD =
+        memoryBusAddress + ULONG(pDevice->pDmaTxBuffer - (PUCHAR)pDevice->pDmaMemory);
+    pDevice->pDmaTxCb->DEST_AD = fifoBusAddress;
+    pDevice->pDmaTxCb->STRIDE = 0;
+    pDevice->pDmaTxCb->NEXTCONBK = 0;
+
+    pDevice->pDmaRxCb->TI =
+        BCM_DMA_TI_PERMAP_SET(BCM_DMA_DREQ_SPI_RX) |
+        BCM_DMA_TI_SRC_DREQ |
+        BCM_DMA_TI_DEST_INC |
+        BCM_DMA_TI_WAIT_RESP;
+    pDevice->pDmaRxCb->SOURCE_AD = fifoBusAddress;
+    pDevice->pDmaRxCb->DEST_AD =
+        memoryBusAddress + ULONG(pDevice->pDmaRxBuffer - (PUCHAR)pDevice->pDmaMemory);
+    pDevice->pDmaRxCb->STRIDE = 0;
+    pDevice->pDmaRxCb->NEXTCONBK = 0;
+
+    while (offset < Length)
+    {
+        size_t chunkLength = min(Length - offset, size_t(BCM_SPI_DMA_MAX_TRANSFER));
+        size_t writeLength = (offset < BytesToWrite) ? min(chunkLength, BytesToWrite - offset) : 0;
+        size_t readLength = (offset < BytesToRead) ? min(chunkLength, BytesToRead - offset) : 0;
+
+        if (writeLength > 0)
+        {
+            status = MdlCopyToBuffer(
+                pRequest->pCurrentTransferWriteMdlChain,
+                offset,
+                writeLength,
+                pDevice->pDmaTxBuffer);
+            if (!NT_SUCCESS(status))
+            {
+                NT_ASSERTMSG("MDL size must match request set write buffer length", false);
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+        }
+
+        if (writeLength < chunkLength)
+        {
+            RtlZeroMemory(pDevice->pDmaTxBuffer + writeLength, chunkLength - writeLength);
+        }
+
+        NT_ASSERT(chunkLength <= BCM_DMA_TXFR_LEN_XLENGTH);
+        pDevice->pDmaTxCb->TXFR_LEN = ULONG(chunkLength);
+        pDevice->pDmaRxCb->TXFR_LEN = ULONG(chunkLength);
+
+        //
+        // Switch the FIFO to DMA mode for DLEN bytes, TA stays
+        // set so CS remains asserted across chunks and transfers.
+        // The RX channel is started first so it is ready to
+        // drain the FIFO as soon as the TX channel fills it.
+        //
+
+        WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->DLEN, BCM_SPI_REG_DLEN_LEN_SET(ULONG(chunkLength)));
+        WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->CS, pDevice->SPI_CS_COPY | BCM_SPI_REG_CS_DMAEN);
+
+        ControllerStartDma(pDevice->pDmaRxRegisters, rxCbBusAddress);
+        ControllerStartDma(pDevice->pDmaTxRegisters, txCbBusAddress);
+
+        status = ControllerWaitForDma(pDevice, pRequest, chunkLength);
+
+        if (!NT_SUCCESS(status))
+        {
+            ControllerStopDma(pDevice);
+            WRITE_REGISTER_ULONG(
+                &pDevice->pSPIRegisters->CS,
+                pDevice->SPI_CS_COPY | BCM_SPI_REG_CS_FIFO_RESET);
+            goto exit;
+        }
+
+        WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->CS, pDevice->SPI_CS_COPY);
+
+        if (readLength > 0)
+        {
+            status = MdlCopyFromBuffer(
+                pRequest->pCurrentTransferReadMdlChain,
+                offset,
+                readLength,
+                pDevice->pDmaRxBuffer);
+            if (!NT_SUCCESS(status))
+            {
+                NT_ASSERTMSG("MDL size must match request set read buffer length", false);
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+        }
+
+        offset += chunkLength;
+    }
+
+exit:
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_FLAG_TRANSFER,
+        "DMA transferred %Iu of %Iu byte(s) for device 0x%lx - %!STATUS!",
+        offset,
+        Length,
+        pDevice->pCurrentTarget->Settings.DeviceSelection,
+        status);
+
+    FuncExit(TRACE_FLAG_TRANSFER);
+
+    return status;
+}
+
 _Use_decl_annotations_
 bool
 ControllerCompleteTransfer(
@@ -425,7 +875,15 @@ ControllerCompleteTransfer(
             (pRequest->CurrentTransferSequencePosition == SpbRequestSequencePositionLast) ||
             (TransferStatus == STATUS_CANCELLED))
         {
-            ControllerDeactivateTransfer(pDevice);
+            if (NT_SUCCESS(TransferStatus) && ControllerCanCombineWrite(pDevice, pRequest))
+            {
+                // keep CS asserted for the next write to this target
+                pDevice->pBurstTarget = pDevice->pCurrentTarget;
+            }
+            else
+            {
+                ControllerDeactivateTransfer(pDevice);
+            }
         }
     }
 
@@ -524,52 +982,175 @@ ControllerUnlockTransfer(
 
 _Use_decl_annotations_
 VOID
-ControllerConfigForTargetAndActivate(
-    PPBC_DEVICE pDevice
+ControllerComputeTargetRegisters(
+    PPBC_TARGET pTarget
     )
-{
-    FuncEntry(TRACE_FLAG_TRANSFER);
+/*++
 
-    PPBC_TARGET_SETTINGS pSettings = &pDevice->pCurrentTarget->Settings;
+  Routine Description:
 
-    if (pDevice->CurrentConnectionSpeed != pSettings->ConnectionSpeed)
-    {
-        pDevice->CurrentConnectionSpeed = pSettings->ConnectionSpeed;
+    This routine precomputes the CS and CLK register image
+    for a target from its settings.
 
-        // set clock
-        ControllerConfigClock(pDevice, pSettings->ConnectionSpeed);
-    }
+  Arguments:
+
+    pTarget - a pointer to the PBC target context
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    PPBC_TARGET_SETTINGS pSettings = &pTarget->Settings;
+    PPBC_TARGET_REGISTERS pRegisters = &pTarget->Registers;
+
+    // WireMode, only 4 wire supported yet
+    NT_ASSERT((pSettings->TypeSpecificFlags & SPI_WIREMODE_BIT) == 0);
+
+    ULONG csPolarityBit = BCM_SPI_REG_CS_CSPOL0 << pSettings->DeviceSelection;
+
+    pRegisters->CSMask =
+        BCM_SPI_REG_CS_CS |
+        BCM_SPI_REG_CS_CPHA |
+        BCM_SPI_REG_CS_CPOL |
+        BCM_SPI_REG_CS_CSPOL |
+        csPolarityBit;
 
     // set chip select, CPHA and CPOL
-    pDevice->SPI_CS_COPY &= ~(BCM_SPI_REG_CS_CS | BCM_SPI_REG_CS_CPHA | BCM_SPI_REG_CS_CPOL);
-    pDevice->SPI_CS_COPY |= BCM_SPI_REG_CS_CS_SET(pSettings->DeviceSelection);
+    pRegisters->CS = BCM_SPI_REG_CS_CS_SET(pSettings->DeviceSelection);
 
     // CPOL
     if (pSettings->Polarity)
     {
-        pDevice->SPI_CS_COPY |= BCM_SPI_REG_CS_CPOL;
+        pRegisters->CS |= BCM_SPI_REG_CS_CPOL;
     }
 
     // CPHA
     if (pSettings->Phase)
     {
-        pDevice->SPI_CS_COPY |= BCM_SPI_REG_CS_CPHA;
+        pRegisters->CS |= BCM_SPI_REG_CS_CPHA;
     }
 
-    // WireMode, only 4 wire supported yet
-    NT_ASSERT((pSettings->TypeSpecificFlags & SPI_WIREMODE_BIT) == 0);
-
-    // DevicePolarity
-    ULONG csPolarityBit = BCM_SPI_REG_CS_CSPOL0 << pSettings->DeviceSelection;
+    // DevicePolarity, active low unless set
     if (pSettings->TypeSpecificFlags & SPI_DEVICEPOLARITY_BIT)
-    {   // active high
-        pDevice->SPI_CS_COPY |= csPolarityBit | BCM_SPI_REG_CS_CSPOL;
+    {
+        pRegisters->CS |= csPolarityBit | BCM_SPI_REG_CS_CSPOL;
+    }
+
+    pRegisters->CLK = BCM_SPI_REG_CLK_CDIV_SET(ControllerComputeClockDivider(pSettings->ConnectionSpeed));
+}
+
+_Use_decl_annotations_
+bool
+ControllerCanCombineWrite(
+    PPBC_DEVICE pDevice,
+    PPBC_REQUEST pRequest
+    )
+/*++
+
+  Routine Description:
+
+    This routine checks whether a request may be part of a write
+    burst to the current target. Only single writes outside of a
+    lock/unlock pair to targets on write combining chip selects
+    qualify.
+
+  Arguments:
+
+    pDevice - a pointer to the PBC device context
+    pRequest - a pointer to the PBC request context
+
+  Return Value:
+
+    true if the request may be part of a write burst.
+
+--*/
+{
+    return (pRequest->Type == SpbRequestTypeWrite) &&
+           (pRequest->CurrentTransferSequencePosition == SpbRequestSequencePositionSingle) &&
+           !pDevice->Locked &&
+           ((pDevice->WriteCombiningChipSelects & (1ul << pDevice->pCurrentTarget->Settings.DeviceSelection)) != 0);
+}
+
+_Use_decl_annotations_
+VOID
+ControllerEndWriteBurst(
+    PPBC_DEVICE pDevice
+    )
+/*++
+
+  Routine Description:
+
+    This routine deasserts CS if a write burst is in progress.
+    Must be called with the controller driver spinlock held.
+
+  Arguments:
+
+    pDevice - a pointer to the PBC device context
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    if (pDevice->pBurstTarget != NULL)
+    {
+        ControllerDeactivateTransfer(pDevice);
+        pDevice->pBurstTarget = NULL;
+    }
+}
+
+_Use_decl_annotations_
+VOID
+ControllerConfigForTargetAndActivate(
+    PPBC_DEVICE pDevice
+    )
+{
+    FuncEntry(TRACE_FLAG_TRANSFER);
+
+    PPBC_TARGET pTarget = pDevice->pCurrentTarget;
+
+    //
+    // Only reprogram the registers that differ from the target's
+    // register image, and nothing if the controller is still
+    // configured for this target.
+    //
+
+    if (pDevice->pConfiguredTarget != pTarget)
+    {
+        PPBC_TARGET_REGISTERS pRegisters = &pTarget->Registers;
+        bool reconfigured = false;
+
+        if (pDevice->SPI_CLK_COPY != pRegisters->CLK)
+        {
+            pDevice->SPI_CLK_COPY = pRegisters->CLK;
+            WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->CLK, pDevice->SPI_CLK_COPY);
+            reconfigured = true;
+        }
+        pDevice->CurrentConnectionSpeed = pTarget->Settings.ConnectionSpeed;
+
+        ULONG csCopy = (pDevice->SPI_CS_COPY & ~pRegisters->CSMask) | pRegisters->CS;
+        if (pDevice->SPI_CS_COPY != csCopy)
+        {
+            // written along with the FIFO reset below
+            pDevice->SPI_CS_COPY = csCopy;
+            reconfigured = true;
+        }
+
+        if (reconfigured)
+        {
+            ++pDevice->TargetReconfigurations;
+        }
+
+        pDevice->pConfiguredTarget = pTarget;
     }
     else
-    {   // active low
-        pDevice->SPI_CS_COPY &= ~(csPolarityBit | BCM_SPI_REG_CS_CSPOL);
+    {
+        ++pDevice->TargetConfigurationsSkipped;
     }
-    
+
     // reset Tx/Rx Fifos
     WRITE_REGISTER_ULONG(
         &pDevice->pSPIRegisters->CS,
@@ -649,14 +1230,11 @@ exit:
     return status;
 }
 
-VOID
-ControllerConfigClock(
-    PPBC_DEVICE pDevice,
+ULONG
+ControllerComputeClockDivider(
     ULONG clockHz
     )
 {
-    FuncEntry(TRACE_FLAG_TRANSFER);
-
     ULONG cdiv;
 
     if (clockHz <= BCM_SPI_CLK_MIN_HZ)
@@ -678,7 +1256,21 @@ ControllerConfigClock(
         cdiv = (BCM_APB_CLK / clockHz) & ULONG(~1);
     }
 
-    WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->CLK, BCM_SPI_REG_CLK_CDIV_SET(cdiv));
+    return cdiv;
+}
+
+VOID
+ControllerConfigClock(
+    PPBC_DEVICE pDevice,
+    ULONG clockHz
+    )
+{
+    FuncEntry(TRACE_FLAG_TRANSFER);
+
+    ULONG cdiv = ControllerComputeClockDivider(clockHz);
+
+    pDevice->SPI_CLK_COPY = BCM_SPI_REG_CLK_CDIV_SET(cdiv);
+    WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->CLK, pDevice->SPI_CLK_COPY);
 
     Trace(
         TRACE_LEVEL_INFORMATION,
@@ -772,4 +1364,335 @@ ControllerEstimateRequestCompletionTimeUs(
     FuncExit(TRACE_FLAG_TRANSFER);
 
     return allTransfersTimeEstimateUs;
-}
\ No newline at end of file
+}
+
+_Use_decl_annotations_
+BOOLEAN
+OnInterruptIsr(
+    WDFINTERRUPT Interrupt,
+    ULONG MessageID
+    )
+/*++
+
+  Routine Description:
+
+    This routine services the FIFO threshold and done interrupts.
+    Both are disarmed and the transfer thread is woken from the DPC,
+    the FIFO itself is serviced by the transfer thread.
+
+  Arguments:
+
+    Interrupt - a handle to the framework interrupt object
+    MessageID - message number identifying the device's
+        hardware interrupt message (if using MSI)
+
+  Return Value:
+
+    TRUE if the interrupt was raised by the controller.
+
+--*/
+{
+    UNREFERENCED_PARAMETER(MessageID);
+
+    PPBC_DEVICE pDevice = GetDeviceContext(WdfInterruptGetDevice(Interrupt));
+
+    ULONG CS = READ_REGISTER_ULONG(&pDevice->pSPIRegisters->CS);
+
+    bool thresholdInterrupt = (CS & BCM_SPI_REG_CS_INTR) && (CS & BCM_SPI_REG_CS_RXR);
+    bool doneInterrupt = (CS & BCM_SPI_REG_CS_INTD) && (CS & BCM_SPI_REG_CS_DONE);
+
+    if (!thresholdInterrupt && !doneInterrupt)
+    {
+        return FALSE;
+    }
+
+    WRITE_REGISTER_ULONG(&pDevice->pSPIRegisters->CS, pDevice->SPI_CS_COPY);
+
+    (void)WdfInterruptQueueDpcForIsr(Interrupt);
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+VOID
+OnInterruptDpc(
+    WDFINTERRUPT Interrupt,
+    WDFOBJECT AssociatedObject
+    )
+/*++
+
+  Routine Description:
+
+    This routine wakes the transfer thread waiting for the FIFO.
+
+  Arguments:
+
+    Interrupt - a handle to the framework interrupt object
+    AssociatedObject - the framework device object
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    UNREFERENCED_PARAMETER(AssociatedObject);
+
+    PPBC_DEVICE pDevice = GetDeviceContext(WdfInterruptGetDevice(Interrupt));
+
+    (void)KeSetEvent(&pDevice->TransferInterruptEvt, 0, FALSE);
+}
+
+_Use_decl_annotations_
+VOID
+ControllerCalibrateTransferModes(
+    PPBC_DEVICE pDevice
+    )
+/*++
+
+  Routine Description:
+
+    This routine measures how long it takes the transfer thread
+    to wake up through the interrupt DPC and derives the estimated
+    request time above which interrupt mode is used. The DPC is
+    queued directly so the bus is not touched. Must be called on
+    the transfer thread.
+
+  Arguments:
+
+    pDevice - a pointer to the PBC device context
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    FuncEntry(TRACE_FLAG_PBCLOADING);
+
+    ULONG samples[BCM_SPI_CALIBRATION_SAMPLES];
+
+    KeQueryPerformanceCounter(&pDevice->PerformanceFrequency);
+
+    for (ULONG i = 0; i < ARRAYSIZE(samples); i++)
+    {
+        KeClearEvent(&pDevice->TransferInterruptEvt);
+
+        LARGE_INTEGER start = KeQueryPerformanceCounter(NULL);
+
+        (void)WdfInterruptQueueDpcForIsr(pDevice->Interrupt);
+        (void)KeWaitForSingleObject(
+            &pDevice->TransferInterruptEvt,
+            Executive,
+            KernelMode,
+            FALSE,
+            nullptr);
+
+        LONGLONG ticks = KeQueryPerformanceCounter(NULL).QuadPart - start.QuadPart;
+        ULONG sampleUs = ULONG((ticks * 1000000ll) / pDevice->PerformanceFrequency.QuadPart);
+
+        // insertion sort, the median is used
+        ULONG j = i;
+        for (; (j > 0) && (samples[j - 1] > sampleUs); j--)
+        {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = sampleUs;
+    }
+
+    pDevice->InterruptWakeLatencyUs = max(samples[ARRAYSIZE(samples) / 2], ULONG(1));
+    pDevice->InterruptCrossoverUs = max(
+        pDevice->InterruptWakeLatencyUs * BCM_SPI_INTERRUPT_CROSSOVER_WAKES,
+        ULONG(BCM_SPI_INTERRUPT_CROSSOVER_MIN_US));
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_FLAG_PBCLOADING,
+        "Interrupt wake latency %lu us (min %lu us, max %lu us), interrupt mode for requests from %lu us. WDFDEVICE %p",
+        pDevice->InterruptWakeLatencyUs,
+        samples[0],
+        samples[ARRAYSIZE(samples) - 1],
+        pDevice->InterruptCrossoverUs,
+        pDevice->FxDevice);
+
+    FuncExit(TRACE_FLAG_PBCLOADING);
+}
+
+_Use_decl_annotations_
+PBC_TRANSFER_MODE
+ControllerSelectTransferMode(
+    PPBC_DEVICE pDevice,
+    PPBC_TARGET pTarget,
+    ULONGLONG RequestTimeUs
+    )
+/*++
+
+  Routine Description:
+
+    This routine selects how the transfer thread waits for the FIFO
+    during a request. Short requests spin. Requests long enough to
+    amortize the wake ups sleep on the FIFO interrupts, as long as
+    the FIFO takes longer to drain than the thread takes to wake up.
+
+  Arguments:
+
+    pDevice - a pointer to the PBC device context
+    pTarget - a pointer to the PBC target of the request
+    RequestTimeUs - estimated request time without delays
+
+  Return Value:
+
+    The transfer mode.
+
+--*/
+{
+    if (pDevice->InterruptCrossoverUs == 0)
+    {
+        return PbcTransferModeSpin;
+    }
+
+    ULONG connectionSpeed = max(pTarget->Settings.ConnectionSpeed, ULONG(BCM_SPI_CLK_MIN_HZ));
+    ULONGLONG fifoTimeUs =
+        (ULONGLONG(BCM_SPI_FIFO_BYTE_SIZE) * ULONGLONG(BCM_SPI_SCLK_TICKS_PER_BYTE) * 1000000ull) /
+        ULONGLONG(connectionSpeed);
+
+    if ((RequestTimeUs >= pDevice->InterruptCrossoverUs) &&
+        (fifoTimeUs >= pDevice->InterruptWakeLatencyUs))
+    {
+        return PbcTransferModeInterrupt;
+    }
+
+    return PbcTransferModeSpin;
+}
+
+inline ULONG
+ControllerHistogramBucket(
+    _In_ ULONGLONG ValueUs
+    )
+{
+    if (ValueUs == 0)
+    {
+        return 0;
+    }
+
+    ULONG bucket = ULONG(RtlFindMostSignificantBit(ValueUs)) + 1;
+
+    return min(bucket, ULONG(PBC_HISTOGRAM_BUCKETS - 1));
+}
+
+_Use_decl_annotations_
+VOID
+ControllerRecordTransferStats(
+    PPBC_DEVICE pDevice,
+    PBC_TRANSFER_MODE Mode,
+    LONGLONG RequestTicks
+    )
+/*++
+
+  Routine Description:
+
+    This routine adds a completed request to the latency and CPU
+    time histograms of its transfer mode. CPU time is the request
+    time the transfer thread did not spend sleeping.
+
+  Arguments:
+
+    pDevice - a pointer to the PBC device context
+    Mode - the transfer mode used for the request
+    RequestTicks - performance counter ticks spent on the request
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    PPBC_TRANSFER_MODE_STATS pStats = &pDevice->TransferModeStats[Mode];
+    LONGLONG frequency = pDevice->PerformanceFrequency.QuadPart;
+
+    if (frequency == 0)
+    {
+        return;
+    }
+
+    LONGLONG cpuTicks = max(RequestTicks - pDevice->TransferWaitTicks, 0ll);
+
+    ULONGLONG latencyUs = ULONGLONG(RequestTicks * 1000000ll / frequency);
+    ULONGLONG cpuUs = ULONGLONG(cpuTicks * 1000000ll / frequency);
+
+    pStats->Requests++;
+    pStats->LatencyHistogram[ControllerHistogramBucket(latencyUs)]++;
+    pStats->CpuHistogram[ControllerHistogramBucket(cpuUs)]++;
+}
+
+_Use_decl_annotations_
+VOID
+ControllerTraceTransferStats(
+    PPBC_DEVICE pDevice
+    )
+/*++
+
+  Routine Description:
+
+    This routine traces the target configuration counters and
+    the non empty latency and CPU time histogram buckets of each
+    transfer mode.
+
+  Arguments:
+
+    pDevice - a pointer to the PBC device context
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    static const char* modeNames[PbcTransferModeMax] = { "spin", "interrupt" };
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_FLAG_TRANSFER,
+        "Target configuration: %lu reconfiguration(s), %lu skipped. WDFDEVICE %p",
+        pDevice->TargetReconfigurations,
+        pDevice->TargetConfigurationsSkipped,
+        pDevice->FxDevice);
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_FLAG_TRANSFER,
+        "Write combining: %lu write(s) continued a burst. WDFDEVICE %p",
+        pDevice->CombinedWrites,
+        pDevice->FxDevice);
+
+    for (ULONG mode = 0; mode < PbcTransferModeMax; mode++)
+    {
+        PPBC_TRANSFER_MODE_STATS pStats = &pDevice->TransferModeStats[mode];
+
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_FLAG_TRANSFER,
+            "%s mode: %lu request(s). WDFDEVICE %p",
+            modeNames[mode],
+            pStats->Requests,
+            pDevice->FxDevice);
+
+        for (ULONG i = 0; i < PBC_HISTOGRAM_BUCKETS; i++)
+        {
+            if ((pStats->LatencyHistogram[i] == 0) && (pStats->CpuHistogram[i] == 0))
+            {
+                continue;
+            }
+
+            Trace(
+                TRACE_LEVEL_INFORMATION,
+                TRACE_FLAG_TRANSFER,
+                "%s mode [%lu us, %lu us): latency %lu, CPU %lu request(s)",
+                modeNames[mode],
+                (i == 0) ? 0 : (1ul << (i - 1)),
+                1ul << i,
+                pStats->LatencyHistogram[i],
+                pStats->CpuHistogram[i]);
+        }
+    }
+}
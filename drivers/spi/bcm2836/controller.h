@@ -46,6 +46,20 @@ ControllerDoOneTransferPollMode(
     _Inout_ PPBC_REQUEST pRequest
     );
 
+NTSTATUS
+ControllerDoOneTransferDmaMode(
+    _Inout_ PPBC_DEVICE pDevice,
+    _Inout_ PPBC_REQUEST pRequest,
+    _In_ size_t BytesToWrite,
+    _In_ size_t BytesToRead,
+    _In_ size_t Length
+    );
+
+VOID
+ControllerStopDma(
+    _In_ PPBC_DEVICE pDevice
+    );
+
 bool
 ControllerCompleteTransfer(
     _Inout_ PPBC_DEVICE pDevice,
@@ -58,6 +72,17 @@ ControllerUnlockTransfer(
     _Inout_ PPBC_DEVICE pDevice
     );
 
+bool
+ControllerCanCombineWrite(
+    _In_ PPBC_DEVICE pDevice,
+    _In_ PPBC_REQUEST pRequest
+    );
+
+VOID
+ControllerEndWriteBurst(
+    _Inout_ PPBC_DEVICE pDevice
+    );
+
 VOID
 ControllerConfigForTargetAndActivate(
     _In_ PPBC_DEVICE pDevice
@@ -75,6 +100,16 @@ ControllerDelayTransfer(
     _In_ PPBC_REQUEST pRequest
     );
 
+VOID
+ControllerComputeTargetRegisters(
+    _Inout_ PPBC_TARGET pTarget
+    );
+
+ULONG
+ControllerComputeClockDivider(
+    ULONG clockHz
+    );
+
 VOID
 ControllerConfigClock(
     _In_ PPBC_DEVICE pDevice,
@@ -91,6 +126,30 @@ ControllerDeactivateTransfer(
     _In_ PPBC_DEVICE pDevice
     );
 
+VOID
+ControllerCalibrateTransferModes(
+    _Inout_ PPBC_DEVICE pDevice
+    );
+
+PBC_TRANSFER_MODE
+ControllerSelectTransferMode(
+    _In_ PPBC_DEVICE pDevice,
+    _In_ PPBC_TARGET pTarget,
+    _In_ ULONGLONG RequestTimeUs
+    );
+
+VOID
+ControllerRecordTransferStats(
+    _Inout_ PPBC_DEVICE pDevice,
+    _In_ PBC_TRANSFER_MODE Mode,
+    _In_ LONGLONG RequestTicks
+    );
+
+VOID
+ControllerTraceTransferStats(
+    _In_ PPBC_DEVICE pDevice
+    );
+
 ULONGLONG
 ControllerEstimateRequestCompletionTimeUs(
     _In_ PPBC_TARGET pTarget,
@@ -66,6 +66,8 @@ OnPrepareHardware(
     NT_ASSERT(pDevice != NULL);
 
     ULONG irqCount = 0;
+    ULONG memoryCount = 0;
+    ULONG dmaCount = 0;
     NTSTATUS status = STATUS_SUCCESS; 
 
     UNREFERENCED_PARAMETER(FxResourcesRaw);
@@ -83,22 +85,76 @@ OnPrepareHardware(
 
             res = WdfCmResourceListGetDescriptor(FxResourcesTranslated, i);
 
-            if (res->Type == CmResourceTypeMemory)
+            //
+            // Memory resources are, in order, the controller registers and
+            // optionally the controller registers bus address, the TX DMA
+            // channel registers and the RX DMA channel registers.
+            //
+
+            if ((res->Type == CmResourceTypeMemory) && (memoryCount == 1))
+            {
+                pDevice->SPIRegistersBusAddress = res->u.Memory.Start;
+                memoryCount++;
+            }
+            else if ((res->Type == CmResourceTypeMemory) && (memoryCount > 1))
             {
-                if (pDevice->pSPIRegisters != NULL)
+                if ((memoryCount > 3) || (res->u.Memory.Length < sizeof(BCM_DMA_CHANNEL_REGISTERS)))
                 {
                     status = STATUS_DEVICE_CONFIGURATION_ERROR;
                     Trace(
                         TRACE_LEVEL_ERROR,
                         TRACE_FLAG_WDFLOADING,
-                        "Error multiple memory regions assigned (PA:%I64x, length:%d) for WDFDEVICE %p - %!STATUS!",
+                        "Error unexpected memory region assigned (PA:%I64x, length:%d) for WDFDEVICE %p - %!STATUS!",
+                        res->u.Memory.Start.QuadPart,
+                        res->u.Memory.Length,
+                        pDevice->FxDevice,
+                        status);
+                    goto exit;
+                }
+
+                PBCM_DMA_CHANNEL_REGISTERS pDmaRegisters =
+#if (NTDDI_VERSION > NTDDI_WINBLUE)
+                    (PBCM_DMA_CHANNEL_REGISTERS)MmMapIoSpaceEx(
+                    res->u.Memory.Start,
+                    res->u.Memory.Length,
+                    PAGE_READWRITE | PAGE_NOCACHE);
+#else
+                    (PBCM_DMA_CHANNEL_REGISTERS)MmMapIoSpace(
+                    res->u.Memory.Start,
+                    res->u.Memory.Length,
+                    MmNonCached);
+#endif
+
+                if (pDmaRegisters == NULL)
+                {
+                    status = STATUS_INSUFFICIENT_RESOURCES;
+
+                    Trace(
+                        TRACE_LEVEL_ERROR,
+                        TRACE_FLAG_WDFLOADING,
+                        "Error mapping DMA channel registers (PA:%I64x, length:%d) for WDFDEVICE %p - %!STATUS!",
                         res->u.Memory.Start.QuadPart,
                         res->u.Memory.Length,
                         pDevice->FxDevice,
                         status);
+
                     goto exit;
                 }
 
+                if (memoryCount == 2)
+                {
+                    pDevice->pDmaTxRegisters = pDmaRegisters;
+                    pDevice->DmaTxRegistersCb = res->u.Memory.Length;
+                }
+                else
+                {
+                    pDevice->pDmaRxRegisters = pDmaRegisters;
+                    pDevice->DmaRxRegistersCb = res->u.Memory.Length;
+                }
+                memoryCount++;
+            }
+            else if (res->Type == CmResourceTypeMemory)
+            {
                 if (res->u.Memory.Length < sizeof(BCM_SPI_REGISTERS))
                 {
                     status = STATUS_DEVICE_CONFIGURATION_ERROR;
@@ -153,11 +209,45 @@ OnPrepareHardware(
                     pDevice->pSPIRegistersPhysicalAddress.QuadPart,
                     pDevice->pSPIRegisters,
                     pDevice->FxDevice);
+
+                memoryCount++;
             }
             else if (res->Type == CmResourceTypeInterrupt)
             {
                 irqCount++;
             }
+            else if (res->Type == CmResourceTypeDma)
+            {
+                //
+                // Optional TX and RX DMA channels, in this order.
+                //
+
+                ULONG expectedDreq = (dmaCount == 0) ? BCM_DMA_DREQ_SPI_TX : BCM_DMA_DREQ_SPI_RX;
+
+                if ((dmaCount > 1) || (res->u.DmaV3.RequestLine != expectedDreq))
+                {
+                    status = STATUS_DEVICE_CONFIGURATION_ERROR;
+                    Trace(
+                        TRACE_LEVEL_ERROR,
+                        TRACE_FLAG_WDFLOADING,
+                        "Error unexpected DMA channel %lu assigned (DREQ:%lu) for WDFDEVICE %p - %!STATUS!",
+                        res->u.DmaV3.Channel,
+                        res->u.DmaV3.RequestLine,
+                        pDevice->FxDevice,
+                        status);
+                    goto exit;
+                }
+
+                if (dmaCount == 0)
+                {
+                    pDevice->DmaTxChannel = res->u.DmaV3.Channel;
+                }
+                else
+                {
+                    pDevice->DmaRxChannel = res->u.DmaV3.Channel;
+                }
+                dmaCount++;
+            }
         }
     }
 
@@ -186,6 +276,69 @@ OnPrepareHardware(
         goto exit;
     }
 
+    //
+    // DMA transfers need both DMA channels, their registers and the
+    // bus address of the FIFO, otherwise all transfers use the FIFO.
+    //
+
+    if ((dmaCount == 2) && (memoryCount == 4) && (pDevice->DmaThresholdBytes != 0))
+    {
+        PHYSICAL_ADDRESS lowAddress = { 0 };
+        PHYSICAL_ADDRESS highAddress = { 0 };
+        PHYSICAL_ADDRESS boundaryAddress = { 0 };
+        highAddress.QuadPart = BCM_DMA_SDRAM_PHYSICAL_MAX;
+
+        pDevice->pDmaMemory = MmAllocateContiguousNodeMemory(
+            BCM_SPI_DMA_MEMORY_SIZE,
+            lowAddress,
+            highAddress,
+            boundaryAddress,
+            PAGE_READWRITE | PAGE_NOCACHE,
+            MM_ANY_NODE_OK);
+
+        if (pDevice->pDmaMemory == NULL)
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_FLAG_WDFLOADING,
+                "Error allocating %lu bytes of DMA memory for WDFDEVICE %p - %!STATUS!",
+                ULONG(BCM_SPI_DMA_MEMORY_SIZE),
+                pDevice->FxDevice,
+                status);
+            goto exit;
+        }
+
+        RtlZeroMemory(pDevice->pDmaMemory, BCM_SPI_DMA_MEMORY_SIZE);
+
+        pDevice->DmaMemoryPhysicalAddress = MmGetPhysicalAddress(pDevice->pDmaMemory);
+        pDevice->pDmaTxCb = (PBCM_DMA_CB)pDevice->pDmaMemory;
+        pDevice->pDmaRxCb = pDevice->pDmaTxCb + 1;
+        pDevice->pDmaTxBuffer = (PUCHAR)pDevice->pDmaMemory + PAGE_SIZE;
+        pDevice->pDmaRxBuffer = pDevice->pDmaTxBuffer + BCM_SPI_DMA_BUFFER_SIZE;
+        pDevice->DmaEnabled = TRUE;
+
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_FLAG_WDFLOADING,
+            "DMA enabled for transfers of %lu byte(s) or more using TX channel %lu and RX channel %lu for WDFDEVICE %p",
+            pDevice->DmaThresholdBytes,
+            pDevice->DmaTxChannel,
+            pDevice->DmaRxChannel,
+            pDevice->FxDevice);
+    }
+    else if ((dmaCount != 0) || (memoryCount > 1))
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_FLAG_WDFLOADING,
+            "DMA disabled (%lu DMA channels, %lu memory regions, threshold %lu) for WDFDEVICE %p",
+            dmaCount,
+            memoryCount,
+            pDevice->DmaThresholdBytes,
+            pDevice->FxDevice);
+    }
+
 exit:
 
     if (!NT_SUCCESS(status))
@@ -241,6 +394,32 @@ OnReleaseHardware(
         pDevice->SPIRegistersCb = 0;
     }
 
+    pDevice->DmaEnabled = FALSE;
+
+    if (pDevice->pDmaMemory != NULL)
+    {
+        MmFreeContiguousMemory(pDevice->pDmaMemory);
+        pDevice->pDmaMemory = NULL;
+        pDevice->pDmaTxCb = NULL;
+        pDevice->pDmaRxCb = NULL;
+        pDevice->pDmaTxBuffer = NULL;
+        pDevice->pDmaRxBuffer = NULL;
+    }
+
+    if (pDevice->pDmaTxRegisters != NULL)
+    {
+        MmUnmapIoSpace(pDevice->pDmaTxRegisters, pDevice->DmaTxRegistersCb);
+        pDevice->pDmaTxRegisters = NULL;
+        pDevice->DmaTxRegistersCb = 0;
+    }
+
+    if (pDevice->pDmaRxRegisters != NULL)
+    {
+        MmUnmapIoSpace(pDevice->pDmaRxRegisters, pDevice->DmaRxRegistersCb);
+        pDevice->pDmaRxRegisters = NULL;
+        pDevice->DmaRxRegistersCb = 0;
+    }
+
     FuncExit(TRACE_FLAG_WDFLOADING);
 
     return status;
@@ -432,6 +611,8 @@ OnSelfManagedIoCleanup(
         pDevice->pMonitorPowerSettingHandle = NULL;
     }
 
+    ControllerTraceTransferStats(pDevice);
+
     FuncExit(TRACE_FLAG_WDFLOADING);
 }
 
@@ -621,6 +802,7 @@ OnTargetConnect(
     {
         pTarget->SpbTarget = SpbTarget;
         pTarget->pCurrentRequest = NULL;
+        ControllerComputeTargetRegisters(pTarget);
 
         Trace(
             TRACE_LEVEL_INFORMATION,
@@ -636,6 +818,59 @@ OnTargetConnect(
     return status;
 }
 
+_Use_decl_annotations_
+VOID
+OnTargetDisconnect(
+    WDFDEVICE SpbController,
+    SPBTARGET SpbTarget
+    )
+/*++
+ 
+  Routine Description:
+
+    This routine is invoked whenever a peripheral driver closes
+    a target. The controller must not treat a later target that
+    reuses the context memory as already configured.
+
+  Arguments:
+
+    SpbController - a handle to the framework device object
+        representing an SPB controller
+    SpbTarget - a handle to the SPBTARGET object
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    FuncEntry(TRACE_FLAG_SPBDDI);
+
+    PPBC_DEVICE pDevice  = GetDeviceContext(SpbController);
+    PPBC_TARGET pTarget  = GetTargetContext(SpbTarget);
+
+    (void)InterlockedCompareExchangePointer(
+        (PVOID volatile*)&pDevice->pConfiguredTarget,
+        NULL,
+        pTarget);
+
+    //
+    // End a write burst still open for this target, a later
+    // target must not continue it without configuring CS
+    //
+
+    WdfSpinLockAcquire(pDevice->Lock);
+
+    if (pDevice->pBurstTarget == pTarget)
+    {
+        ControllerEndWriteBurst(pDevice);
+    }
+
+    WdfSpinLockRelease(pDevice->Lock);
+
+    FuncExit(TRACE_FLAG_SPBDDI);
+}
+
 _Use_decl_annotations_
 VOID
 OnControllerLock(
@@ -685,6 +920,9 @@ OnControllerLock(
     NT_ASSERT(pDevice->pCurrentTarget == NULL);
     NT_ASSERT(!pDevice->Locked);
 
+    // the locked transfers assert CS themselves
+    ControllerEndWriteBurst(pDevice);
+
     pDevice->pCurrentTarget = pTarget;
     pDevice->Locked = TRUE;
 
@@ -1658,28 +1896,70 @@ OnRequestPollMode(
     )
 {
     PPBC_REQUEST pRequest = pDevice->pCurrentTarget->pCurrentRequest;
+    LARGE_INTEGER requestStart = KeQueryPerformanceCounter(NULL);
 
-#if DBG
     ULONGLONG requestTimeNoDelayUs = ControllerEstimateRequestCompletionTimeUs(pDevice->pCurrentTarget, pRequest, false);
+
+    //
+    // Select whether to spin or sleep on FIFO interrupts
+    // based on the estimated request time
+    //
+
+    PBC_TRANSFER_MODE transferMode = ControllerSelectTransferMode(
+        pDevice,
+        pDevice->pCurrentTarget,
+        requestTimeNoDelayUs);
+
+    pDevice->TransferMode = transferMode;
+    pDevice->TransferWaitTicks = 0;
+
+#if DBG
     ULONGLONG requestTimeWithDelayUs = ControllerEstimateRequestCompletionTimeUs(pDevice->pCurrentTarget, pRequest, true);
 
     Trace(
         TRACE_LEVEL_INFORMATION,
         TRACE_FLAG_TRANSFER,
-        "Controller estimated request time to be %I64u us for %Iu bytes, with %I64u us spent in delays (SPBREQUEST %p, WDFDEVICE %p)",
+        "Controller estimated request time to be %I64u us for %Iu bytes, with %I64u us spent in delays, using %s mode (SPBREQUEST %p, WDFDEVICE %p)",
         requestTimeWithDelayUs,
         pRequest->RequestLength,
         requestTimeWithDelayUs - requestTimeNoDelayUs,
+        (transferMode == PbcTransferModeInterrupt) ? "interrupt" : "spin",
         pRequest->SpbRequest,
         pDevice->FxDevice);
 #endif
 
+    //
+    // A write to the target of a write burst continues the burst
+    // with CS still asserted, anything else ends it first
+    //
+
+    bool bContinueBurst = false;
+
+    if (pDevice->pBurstTarget != NULL)
+    {
+        WdfSpinLockAcquire(pDevice->Lock);
+
+        if ((pDevice->pBurstTarget == pDevice->pCurrentTarget) &&
+            ControllerCanCombineWrite(pDevice, pRequest))
+        {
+            bContinueBurst = true;
+            ++pDevice->CombinedWrites;
+        }
+        else
+        {
+            ControllerEndWriteBurst(pDevice);
+        }
+
+        WdfSpinLockRelease(pDevice->Lock);
+    }
+
     //
     // Configure controller HW if necessary and kick-off transfer
     //
 
-    if (pRequest->CurrentTransferSequencePosition == SpbRequestSequencePositionSingle ||
-        pRequest->CurrentTransferSequencePosition == SpbRequestSequencePositionFirst)
+    if (!bContinueBurst &&
+        (pRequest->CurrentTransferSequencePosition == SpbRequestSequencePositionSingle ||
+         pRequest->CurrentTransferSequencePosition == SpbRequestSequencePositionFirst))
     {
         ControllerConfigForTargetAndActivate(pDevice);
     }
@@ -1713,6 +1993,11 @@ OnRequestPollMode(
             bIsRequestComplete = ControllerCompleteTransfer(pDevice, pRequest, status);
         } while (!bIsRequestComplete);
     }
+
+    ControllerRecordTransferStats(
+        pDevice,
+        transferMode,
+        KeQueryPerformanceCounter(NULL).QuadPart - requestStart.QuadPart);
 }
 
 _Use_decl_annotations_
@@ -1747,21 +2032,36 @@ TransferPollModeThread(
         KeGetCurrentProcessorNumberEx(NULL),
         pDevice->FxDevice);
 
+    ControllerCalibrateTransferModes(pDevice);
+
     NTSTATUS status;
 
     for (;;)
     {
         //
         // Wait until waken up to either shutdown or 
-        // handle a request transfer
+        // handle a request transfer. During a write burst
+        // only wait for the linger time, then end the burst.
         //
 
+        LARGE_INTEGER lingerTimeout;
+        lingerTimeout.QuadPart = LONGLONG(WDF_REL_TIMEOUT_IN_US(BCM_SPI_WRITE_COMBINE_LINGER_US));
+
         status = KeWaitForSingleObject(
             &pDevice->TransferThreadWakeEvt,
             Executive,
             KernelMode,
             FALSE,
-            nullptr);
+            (pDevice->pBurstTarget != NULL) ? &lingerTimeout : nullptr);
+
+        if (status == STATUS_TIMEOUT)
+        {
+            WdfSpinLockAcquire(pDevice->Lock);
+            ControllerEndWriteBurst(pDevice);
+            WdfSpinLockRelease(pDevice->Lock);
+            continue;
+        }
+
         NT_ASSERTMSG(
             "KeWaitForSingleObject non-success wake reason is not possible",
             status == STATUS_SUCCESS);
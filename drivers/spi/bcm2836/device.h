@@ -35,6 +35,9 @@ EVT_WDF_DEVICE_SELF_MANAGED_IO_CLEANUP  OnSelfManagedIoCleanup;
 
 EVT_WDF_REQUEST_CANCEL                  OnCancel;
 
+EVT_WDF_INTERRUPT_ISR                   OnInterruptIsr;
+EVT_WDF_INTERRUPT_DPC                   OnInterruptDpc;
+
 //
 // Power framework event callbacks.
 //
@@ -54,6 +57,7 @@ OnMonitorPowerSettingCallback(
 //
 
 EVT_SPB_TARGET_CONNECT               OnTargetConnect;
+EVT_SPB_TARGET_DISCONNECT            OnTargetDisconnect;
 EVT_SPB_CONTROLLER_LOCK              OnControllerLock;
 EVT_SPB_CONTROLLER_UNLOCK            OnControllerUnlock;
 EVT_SPB_CONTROLLER_READ              OnRead;
@@ -262,4 +266,144 @@ MdlSetByte(
     return status;
 }
 
+NTSTATUS
+FORCEINLINE
+MdlCopyToBuffer(
+    _In_ PMDL mdl,
+    _In_ size_t Offset,
+    _In_ size_t Length,
+    _Out_writes_bytes_(Length) PUCHAR pBuffer
+    )
+/*++
+ 
+  Routine Description:
+
+    This is a helper routine used to copy a range of the
+    current transfer descriptor buffer into a flat buffer.
+
+  Arguments:
+
+    mdl - the MDL chain of the transfer descriptor buffer
+
+    Offset - offset of the first byte to copy
+
+    Length - number of bytes to copy
+
+    pBuffer - the destination buffer
+
+  Return Value:
+
+    STATUS_INFO_LENGTH_MISMATCH if the MDL chain is too short
+    or cannot be mapped, otherwise STATUS_SUCCESS
+
+--*/
+{
+    size_t mdlByteCount;
+    size_t currentOffset = Offset;
+    size_t bytesToCopy;
+    PUCHAR pMdlBuffer;
+
+    while ((mdl != NULL) && (Length > 0))
+    {
+        mdlByteCount = MmGetMdlByteCount(mdl);
+
+        if (currentOffset < mdlByteCount)
+        {
+            pMdlBuffer = (PUCHAR) MmGetSystemAddressForMdlSafe(
+                mdl,
+                NormalPagePriority);
+
+            if (pMdlBuffer == NULL)
+            {
+                break;
+            }
+
+            bytesToCopy = min(Length, mdlByteCount - currentOffset);
+            RtlCopyMemory(pBuffer, pMdlBuffer + currentOffset, bytesToCopy);
+
+            pBuffer += bytesToCopy;
+            Length -= bytesToCopy;
+            currentOffset = 0;
+        }
+        else
+        {
+            currentOffset -= mdlByteCount;
+        }
+
+        mdl = mdl->Next;
+    }
+
+    return (Length == 0) ? STATUS_SUCCESS : STATUS_INFO_LENGTH_MISMATCH;
+}
+
+NTSTATUS
+FORCEINLINE
+MdlCopyFromBuffer(
+    _In_ PMDL mdl,
+    _In_ size_t Offset,
+    _In_ size_t Length,
+    _In_reads_bytes_(Length) const UCHAR* pBuffer
+    )
+/*++
+ 
+  Routine Description:
+
+    This is a helper routine used to copy a flat buffer into
+    a range of the current transfer descriptor buffer.
+
+  Arguments:
+
+    mdl - the MDL chain of the transfer descriptor buffer
+
+    Offset - offset of the first byte to set
+
+    Length - number of bytes to copy
+
+    pBuffer - the source buffer
+
+  Return Value:
+
+    STATUS_INFO_LENGTH_MISMATCH if the MDL chain is too short
+    or cannot be mapped, otherwise STATUS_SUCCESS
+
+--*/
+{
+    size_t mdlByteCount;
+    size_t currentOffset = Offset;
+    size_t bytesToCopy;
+    PUCHAR pMdlBuffer;
+
+    while ((mdl != NULL) && (Length > 0))
+    {
+        mdlByteCount = MmGetMdlByteCount(mdl);
+
+        if (currentOffset < mdlByteCount)
+        {
+            pMdlBuffer = (PUCHAR) MmGetSystemAddressForMdlSafe(
+                mdl,
+                NormalPagePriority);
+
+            if (pMdlBuffer == NULL)
+            {
+                break;
+            }
+
+            bytesToCopy = min(Length, mdlByteCount - currentOffset);
+            RtlCopyMemory(pMdlBuffer + currentOffset, pBuffer, bytesToCopy);
+
+            pBuffer += bytesToCopy;
+            Length -= bytesToCopy;
+            currentOffset = 0;
+        }
+        else
+        {
+            currentOffset -= mdlByteCount;
+        }
+
+        mdl = mdl->Next;
+    }
+
+    return (Length == 0) ? STATUS_SUCCESS : STATUS_INFO_LENGTH_MISMATCH;
+}
+
 #endif
@@ -120,8 +120,6 @@ OnDeviceAdd(
 
     PPBC_DEVICE pDevice;
     NTSTATUS status;
-    
-    UNREFERENCED_PARAMETER(FxDriver);
 
     //
     // Configure DeviceInit structure
@@ -191,6 +189,53 @@ OnDeviceAdd(
 
         pDevice->FxDevice = fxDevice;
     }
+
+    //
+    // Read the DMA threshold and write combining chip selects,
+    // missing values keep the defaults.
+    //
+
+    {
+        pDevice->DmaThresholdBytes = BCM_SPI_DMA_THRESHOLD_DEFAULT;
+        pDevice->WriteCombiningChipSelects = 0;
+
+        WDFKEY parametersKey;
+        NTSTATUS regStatus = WdfDriverOpenParametersRegistryKey(
+            FxDriver,
+            KEY_QUERY_VALUE,
+            WDF_NO_OBJECT_ATTRIBUTES,
+            &parametersKey);
+
+        if (NT_SUCCESS(regStatus))
+        {
+            DECLARE_CONST_UNICODE_STRING(valueName, REGSTR_VAL_DMA_THRESHOLD);
+            ULONG value;
+
+            regStatus = WdfRegistryQueryULong(parametersKey, &valueName, &value);
+            if (NT_SUCCESS(regStatus))
+            {
+                pDevice->DmaThresholdBytes = value;
+            }
+
+            DECLARE_CONST_UNICODE_STRING(writeCombiningValueName, REGSTR_VAL_WRITE_COMBINING);
+
+            regStatus = WdfRegistryQueryULong(parametersKey, &writeCombiningValueName, &value);
+            if (NT_SUCCESS(regStatus))
+            {
+                pDevice->WriteCombiningChipSelects = value;
+            }
+
+            WdfRegistryClose(parametersKey);
+        }
+
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_FLAG_WDFLOADING,
+            "DMA threshold %lu byte(s), write combining chip selects 0x%lx for WDFDEVICE %p",
+            pDevice->DmaThresholdBytes,
+            pDevice->WriteCombiningChipSelects,
+            pDevice->FxDevice);
+    }
         
     //
     // Ensure device is disable-able
@@ -213,11 +258,12 @@ OnDeviceAdd(
         SPB_CONTROLLER_CONFIG_INIT(&spbConfig);
 
         //
-        // Register for target connect callback.  The driver
-        // does not need to respond to target disconnect.
+        // Register for target connect and disconnect callbacks.
+        // Disconnect drops the target's cached configuration.
         //
 
         spbConfig.EvtSpbTargetConnect    = OnTargetConnect;
+        spbConfig.EvtSpbTargetDisconnect = OnTargetDisconnect;
 
         //
         // Register for IO callbacks.
@@ -344,6 +390,42 @@ OnDeviceAdd(
         }
     }
 
+    //
+    // Create the FIFO interrupt, the transfer thread
+    // sleeps on it for long requests.
+    //
+
+    {
+        WDF_INTERRUPT_CONFIG interruptConfig;
+        WDF_INTERRUPT_CONFIG_INIT(
+            &interruptConfig,
+            OnInterruptIsr,
+            OnInterruptDpc);
+
+        status = WdfInterruptCreate(
+            pDevice->FxDevice,
+            &interruptConfig,
+            WDF_NO_OBJECT_ATTRIBUTES,
+            &pDevice->Interrupt);
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_FLAG_WDFLOADING,
+                "Failed to create interrupt for WDFDEVICE %p - %!STATUS!",
+                pDevice->FxDevice,
+                status);
+
+            goto exit;
+        }
+
+        KeInitializeEvent(
+            &pDevice->TransferInterruptEvt,
+            SynchronizationEvent,
+            FALSE);
+    }
+
     {
         KeInitializeEvent(
             &pDevice->TransferThreadWakeEvt,
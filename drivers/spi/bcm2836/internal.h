@@ -105,6 +105,73 @@ typedef struct _PNP_SPI_SERIAL_BUS_DESCRIPTOR {
 #define IDLE_TIMEOUT_MONITOR_ON  2000
 #define IDLE_TIMEOUT_MONITOR_OFF 50
 
+//
+// DMA settings.
+//
+
+// Transfers of at least this many bytes use DMA, can be overridden
+// with the DmaThresholdBytes value under the driver Parameters key,
+// 0 disables DMA
+#define REGSTR_VAL_DMA_THRESHOLD            L"DmaThresholdBytes"
+#define BCM_SPI_DMA_THRESHOLD_DEFAULT       64
+
+// Bounce buffers for each direction, a single DMA transfer is limited
+// by the buffer and the 16 bit DLEN register
+#define BCM_SPI_DMA_BUFFER_SIZE             (16 * PAGE_SIZE)
+#define BCM_SPI_DMA_MAX_TRANSFER            \
+    (min(BCM_SPI_DMA_BUFFER_SIZE, BCM_SPI_REG_DLEN_LEN) & ~(BCM_SPI_DMA_WORD_SIZE - 1))
+#define BCM_SPI_DMA_MEMORY_SIZE             (PAGE_SIZE + (2 * BCM_SPI_DMA_BUFFER_SIZE))
+
+// The transfer thread sleeps through the expected transfer time
+// of longer DMA transfers and polls for the remainder
+#define BCM_SPI_DMA_SLEEP_THRESHOLD_US      1000
+#define BCM_SPI_DMA_TIMEOUT_MARGIN_US       10000
+
+//
+// Write combining settings.
+//
+
+// Bit n of the WriteCombiningChipSelects value under the driver
+// Parameters key allows single writes to the target on CSn to keep
+// CS asserted after completion, so the next write to the same
+// target continues the burst without reconfiguring the controller.
+// CS is deasserted once no such write follows within the linger time.
+#define REGSTR_VAL_WRITE_COMBINING          L"WriteCombiningChipSelects"
+#define BCM_SPI_WRITE_COMBINE_LINGER_US     200
+
+//
+// Transfer scheduling settings.
+//
+
+// Requests are either transferred by spinning on the FIFO or by
+// sleeping until the FIFO threshold or done interrupt. Interrupts
+// pay off once a request takes this many thread wake latencies,
+// measured at start-up, and a FIFO takes longer to drain than a wake.
+#define BCM_SPI_CALIBRATION_SAMPLES         16
+#define BCM_SPI_INTERRUPT_CROSSOVER_WAKES   4
+#define BCM_SPI_INTERRUPT_CROSSOVER_MIN_US  100
+
+// Latency and CPU time histograms have power of 2 us buckets,
+// bucket i counts requests taking [2^(i-1), 2^i) us, the last
+// bucket also counts all longer requests
+#define PBC_HISTOGRAM_BUCKETS               20
+
+typedef enum PBC_TRANSFER_MODE
+{
+    PbcTransferModeSpin = 0,
+    PbcTransferModeInterrupt,
+    PbcTransferModeMax
+}
+PBC_TRANSFER_MODE;
+
+typedef struct PBC_TRANSFER_MODE_STATS
+{
+    ULONG                           Requests;
+    ULONG                           LatencyHistogram[PBC_HISTOGRAM_BUCKETS];
+    ULONG                           CpuHistogram[PBC_HISTOGRAM_BUCKETS];
+}
+PBC_TRANSFER_MODE_STATS, *PPBC_TRANSFER_MODE_STATS;
+
 //
 // Target settings.
 //
@@ -147,10 +214,23 @@ struct PBC_DEVICE
     ULONG                           SPIRegistersCb;
     PHYSICAL_ADDRESS                pSPIRegistersPhysicalAddress;
 
-    // shadow copy of CS hardware register and clock speed
+    // shadow copy of CS and CLK hardware registers and clock speed
     ULONG                           SPI_CS_COPY;                 
+    ULONG                           SPI_CLK_COPY;
     ULONG                           CurrentConnectionSpeed;
 
+    // Target whose register image was last programmed, requests
+    // to the same target skip the controller configuration
+    PPBC_TARGET                     pConfiguredTarget;
+    ULONG                           TargetReconfigurations;
+    ULONG                           TargetConfigurationsSkipped;
+
+    // Target of the write burst keeping CS asserted, protected
+    // by the controller driver spinlock
+    ULONG                           WriteCombiningChipSelects;
+    PPBC_TARGET                     pBurstTarget;
+    ULONG                           CombinedWrites;
+
     // Target that the controller is currently
     // configured for. In most cases this value is only
     // set when there is a request being handled, however,
@@ -168,8 +248,58 @@ struct PBC_DEVICE
     PVOID                           pTransferThread;
     KEVENT                          TransferThreadWakeEvt;
     LONG                            TransferThreadShutdown;
+
+    // FIFO interrupt, signals TransferInterruptEvt from its DPC
+    WDFINTERRUPT                    Interrupt;
+    KEVENT                          TransferInterruptEvt;
+
+    // Transfer mode of the current request, the calibrated
+    // crossover and per mode statistics, only accessed by
+    // the transfer thread
+    PBC_TRANSFER_MODE               TransferMode;
+    ULONG                           InterruptWakeLatencyUs;
+    ULONG                           InterruptCrossoverUs;
+    LARGE_INTEGER                   PerformanceFrequency;
+    LONGLONG                        TransferWaitTicks;
+    PBC_TRANSFER_MODE_STATS         TransferModeStats[PbcTransferModeMax];
+
+    // DMA transfer engine, only enabled if the SPI TX and RX
+    // DMA channels are assigned to the controller
+    BOOLEAN                         DmaEnabled;
+    ULONG                           DmaThresholdBytes;
+    PHYSICAL_ADDRESS                SPIRegistersBusAddress;
+    PBCM_DMA_CHANNEL_REGISTERS      pDmaTxRegisters;
+    PBCM_DMA_CHANNEL_REGISTERS      pDmaRxRegisters;
+    ULONG                           DmaTxRegistersCb;
+    ULONG                           DmaRxRegistersCb;
+    ULONG                           DmaTxChannel;
+    ULONG                           DmaRxChannel;
+
+    // TX and RX control blocks followed by the TX and RX
+    // bounce buffers in one contiguous uncached allocation
+    PVOID                           pDmaMemory;
+    PHYSICAL_ADDRESS                DmaMemoryPhysicalAddress;
+    PBCM_DMA_CB                     pDmaTxCb;
+    PBCM_DMA_CB                     pDmaRxCb;
+    PUCHAR                          pDmaTxBuffer;
+    PUCHAR                          pDmaRxBuffer;
 };
 
+//
+// Target register image, precomputed from the target settings
+// when the target connects. CSMask selects the CS register bits
+// owned by the target, the polarity of the other chip selects
+// is left alone.
+//
+
+typedef struct PBC_TARGET_REGISTERS
+{
+    ULONG                          CS;
+    ULONG                          CSMask;
+    ULONG                          CLK;
+}
+PBC_TARGET_REGISTERS, *PPBC_TARGET_REGISTERS;
+
 //
 // Target context.
 //
@@ -181,6 +311,9 @@ struct PBC_TARGET
 
     // Target specific settings.
     PBC_TARGET_SETTINGS            Settings;
+
+    // Controller registers for this target.
+    PBC_TARGET_REGISTERS           Registers;
     
     // Current request associated with the 
     // target. This value should only be non-null
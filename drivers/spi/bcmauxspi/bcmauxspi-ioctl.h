@@ -0,0 +1,125 @@
+#ifndef _BCMAUXSPI_IOCTL_H_
+#define _BCMAUXSPI_IOCTL_H_
+//
+// Copyright (C) Microsoft.  All rights reserved.
+//
+//
+// Module Name:
+//
+//   bcmauxspi-ioctl.h
+//
+// Abstract:
+//
+//   BCM AUX SPI public IOCTL definitions. The IOCTLs are sent to an SPB
+//   target (i.e. a connection opened through the resource hub) and are
+//   handled by the controller between transfers.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//
+// IOCTL codes
+//
+
+#define FILE_DEVICE_AUXSPI_PERIPHERAL 0x400
+
+//
+// Get AUXSPI controller telemetry
+// Returns the counters accumulated since the device was started or the
+// counters were last reset.
+//
+// Input buffer:
+// None
+//
+// Output buffer:
+// lpOutBuffer - pointer to a variable of type AUXSPI_TELEMETRY
+// nOutBufferSize - sizeof(AUXSPI_TELEMETRY)
+//
+#define IOCTL_AUXSPI_GET_TELEMETRY              CTL_CODE(FILE_DEVICE_AUXSPI_PERIPHERAL, 0x700, METHOD_BUFFERED, FILE_READ_DATA)
+
+//
+// Reset AUXSPI controller telemetry
+//
+// Input buffer:
+// None
+//
+// Output buffer:
+// None
+//
+#define IOCTL_AUXSPI_RESET_TELEMETRY            CTL_CODE(FILE_DEVICE_AUXSPI_PERIPHERAL, 0x701, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+//
+// Histograms have power of 2 buckets, bucket i counts values in
+// [2^(i-1), 2^i), bucket 0 counts zero and the last bucket also counts
+// all larger values.
+//
+#define AUXSPI_TELEMETRY_HISTOGRAM_BUCKETS 16
+
+//
+// FIFO modes, in the order of AUXSPI_TELEMETRY::FifoModeBytes
+//   0 - fixed 32-bit
+//   1 - variable width, 3 bytes per entry
+//   2 - fixed 24-bit, shifted (SPI modes 1 and 3)
+//   3 - variable width, 2 bytes per entry, shifted (SPI modes 1 and 3)
+//
+#define AUXSPI_TELEMETRY_FIFO_MODES 4
+
+#define AUXSPI_TELEMETRY_CHIP_SELECTS 3
+
+//
+// Completions whose DPC ran at least this long after the ISR queued it
+// are counted as delayed.
+//
+#define AUXSPI_TELEMETRY_DELAYED_COMPLETION_US 100
+
+typedef struct _AUXSPI_CHIP_SELECT_TELEMETRY {
+    ULONGLONG Transfers;
+    ULONGLONG Bytes;            // bytes clocked over the bus
+    ULONGLONG BusyTimeUs;       // CS assertion to request completion
+} AUXSPI_CHIP_SELECT_TELEMETRY, *PAUXSPI_CHIP_SELECT_TELEMETRY;
+
+typedef struct _AUXSPI_TELEMETRY {
+    ULONG Size;                 // sizeof(AUXSPI_TELEMETRY)
+    ULONG Reserved;
+
+    //
+    // Utilization of a chip select line is its BusyTimeUs / ElapsedTimeUs
+    //
+    ULONGLONG ElapsedTimeUs;
+
+    ULONGLONG Transfers;
+    ULONGLONG StreamedTransfers;
+    ULONGLONG CancelledTransfers;
+
+    //
+    // Interrupts taken by completed transfers. Every interrupt but the last
+    // one of a transfer refills the FIFO.
+    //
+    ULONGLONG Interrupts;
+    ULONGLONG FifoRefills;
+    ULONGLONG FifoRefillHistogram[AUXSPI_TELEMETRY_HISTOGRAM_BUCKETS];
+
+    //
+    // Time spent in the ISR and the DPC by completed transfers
+    //
+    ULONGLONG IsrTimeUs;
+    ULONGLONG DpcTimeUs;
+
+    //
+    // Time from the ISR queuing the DPC to the DPC running
+    //
+    ULONGLONG DelayedCompletions;
+    ULONGLONG MaxIsrToDpcLatencyUs;
+    ULONGLONG IsrToDpcLatencyHistogram[AUXSPI_TELEMETRY_HISTOGRAM_BUCKETS];
+
+    ULONGLONG FifoModeBytes[AUXSPI_TELEMETRY_FIFO_MODES];
+    AUXSPI_CHIP_SELECT_TELEMETRY ChipSelect[AUXSPI_TELEMETRY_CHIP_SELECTS];
+} AUXSPI_TELEMETRY, *PAUXSPI_TELEMETRY;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // _BCMAUXSPI_IOCTL_H_
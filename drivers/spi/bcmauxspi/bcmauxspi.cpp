@@ -17,6 +17,7 @@
 #include "bcmauxspi.tmh"
 
 #include "bcmauxspi-hw.h"
+#include "bcmauxspi-ioctl.h"
 #include "bcmauxspi.h"
 
 namespace { // static
@@ -67,6 +68,24 @@ BOOLEAN AUXSPI_DEVICE::EvtInterruptIsr (
 
     NT_ASSERT(interruptContextPtr->Request.SpbRequest);
 
+    //
+    // Account the time spent in the ISR to telemetry
+    //
+    struct _ISR_TIMER {
+        _TELEMETRY& Telemetry;
+        const LONGLONG StartTicks;
+
+        ~_ISR_TIMER ()
+        {
+            this->Telemetry.IsrTicks +=
+                KeQueryPerformanceCounter(nullptr).QuadPart - this->StartTicks;
+        }
+    } isrTimer = {
+        interruptContextPtr->Telemetry,
+        KeQueryPerformanceCounter(nullptr).QuadPart};
+
+    ++interruptContextPtr->Telemetry.TransferInterrupts;
+
     //
     // Tx FIFO should ALWAYS be empty when an interrupt occurs
     //
@@ -175,6 +194,10 @@ BOOLEAN AUXSPI_DEVICE::EvtInterruptIsr (
         interruptContextPtr->Request.FifoMode = newFifoMode;
         interruptContextPtr->ControlRegs = controlRegs;
 
+        interruptContextPtr->Telemetry.FifoModeBytes[ULONG(newFifoMode)] +=
+            bytesToRead;
+        interruptContextPtr->Telemetry.TransferBytes += bytesToRead;
+
         // after kicking off the read portion of the transfer, advance to
         // the reading state
         interruptContextPtr->Request.TransferState =
@@ -237,25 +260,16 @@ BOOLEAN AUXSPI_DEVICE::EvtInterruptIsr (
             interruptContextPtr->Request.Sequence.BytesWritten = bytesWritten;
         }
 
-        const size_t fifoCapacity = getFifoCapacity(fifoMode);
-        const size_t bytesToReadChunk = min(fifoCapacity, bytesToRead - bytesRead);
+        const size_t bytesToReadChunk =
+            min(getFifoCapacity(fifoMode), bytesToRead - bytesRead);
 
-        // extract bytes from fifo buffer into intermediate buffer
-        ULONG buf[BCM_AUXSPI_FIFO_DEPTH];
-        size_t bytesExtracted = extractFifoBuffer(
-                fifoBuffer,
-                reinterpret_cast<BYTE*>(buf),
-                bytesToReadChunk,
-                fifoMode);
-        NT_ASSERT(bytesExtracted == bytesToReadChunk);
-
-        // copy bytes from intermediate buffer to MDL
-        size_t bytesCopied = copyBytesToMdl(
+        // extract bytes from fifo buffer into the MDL
+        size_t bytesCopied = getFifoOps(fifoMode).ExtractMdl(
+            fifoBuffer,
+            bytesToReadChunk,
             &interruptContextPtr->Request.Sequence.CurrentReadMdl,
-            &interruptContextPtr->Request.Sequence.CurrentReadMdlOffset,
-            reinterpret_cast<const BYTE*>(buf),
-            bytesExtracted);
-        NT_ASSERT(bytesCopied == bytesExtracted);
+            &interruptContextPtr->Request.Sequence.CurrentReadMdlOffset);
+        NT_ASSERT(bytesCopied == bytesToReadChunk);
 
         bytesRead += bytesCopied;
         NT_ASSERT(bytesRead > interruptContextPtr->Request.Sequence.BytesRead);
@@ -264,6 +278,16 @@ BOOLEAN AUXSPI_DEVICE::EvtInterruptIsr (
 
         return TRUE;
     }
+    case _TRANSFER_STATE::STREAM_WRITE:
+    case _TRANSFER_STATE::STREAM_READ:
+    case _TRANSFER_STATE::STREAM_FULL_DUPLEX:
+    {
+        // keep the FIFO topped up from the prepacked words, go to DPC
+        // once the whole stream has been transferred
+        if (streamFifo(interruptContextPtr)) break;
+
+        return TRUE;
+    }
     default:
         NT_ASSERT(FALSE);
         WRITE_REGISTER_NOFENCE_ULONG(&registersPtr->Cntl0Reg, 0);
@@ -290,6 +314,8 @@ BOOLEAN AUXSPI_DEVICE::EvtInterruptIsr (
     }
 
     // Queue DPC
+    interruptContextPtr->Telemetry.DpcQueuedTicks =
+        KeQueryPerformanceCounter(nullptr).QuadPart;
     WdfInterruptQueueDpcForIsr(WdfInterrupt);
     return TRUE;
 }
@@ -305,6 +331,7 @@ VOID AUXSPI_DEVICE::EvtInterruptDpc (
     )
 {
     NT_ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    const LONGLONG dpcStartTicks = KeQueryPerformanceCounter(nullptr).QuadPart;
     _INTERRUPT_CONTEXT* interruptContextPtr = GetInterruptContext(WdfInterrupt);
     volatile BCM_AUXSPI_REGISTERS* registersPtr =
             interruptContextPtr->RegistersPtr;
@@ -352,6 +379,9 @@ VOID AUXSPI_DEVICE::EvtInterruptDpc (
     cntl0Reg.ClearFifos = 1;
     WRITE_REGISTER_NOFENCE_ULONG(&registersPtr->Cntl0Reg, cntl0Reg.AsUlong);
 
+    // must be recorded before completing, which lets the next request start
+    recordTransferTelemetry(interruptContextPtr, dpcStartTicks);
+
     interruptContextPtr->Request.TransferState = _TRANSFER_STATE::INVALID;
     WdfRequestSetInformation(spbRequest, information);
     SpbRequestComplete(spbRequest, status);
@@ -458,10 +488,33 @@ VOID AUXSPI_DEVICE::EvtSpbIoRead (
     const _TARGET_CONTEXT* targetContextPtr = GetTargetContext(SpbTarget);
 
     _FIFO_MODE fifoMode = selectFifoMode(targetContextPtr->DataMode, Length);
+
+    if (thisPtr->shouldStream(targetContextPtr, Length, fifoMode)) {
+        const size_t wordCount = packStream(
+                interruptContextPtr->StreamTxBufferPtr,
+                nullptr,            // WriteBufferPtr (dummy bytes)
+                Length,
+                fifoMode);
+
+        thisPtr->startStreamTransfer(
+            SpbRequest,
+            targetContextPtr,
+            _TRANSFER_STATE::STREAM_READ,
+            fifoMode,
+            _STREAM_CONTEXT{
+                static_cast<BYTE*>(outputBufferPtr),
+                nullptr,            // ReadMdl
+                Length,
+                wordCount});
+        return;
+    }
+
     _CONTROL_REGS controlRegs = computeControlRegisters(
             targetContextPtr,
             fifoMode);
 
+    beginTransferTelemetry(interruptContextPtr, fifoMode, Length);
+
     //
     // Assert CS and do some useful work (i.e. setting up the request context)
     // while we're waiting for CS to assert
@@ -548,10 +601,33 @@ VOID AUXSPI_DEVICE::EvtSpbIoWrite (
     const _TARGET_CONTEXT* targetContextPtr = GetTargetContext(SpbTarget);
 
     _FIFO_MODE fifoMode = selectFifoMode(targetContextPtr->DataMode, Length);
+
+    if (thisPtr->shouldStream(targetContextPtr, Length, fifoMode)) {
+        const size_t wordCount = packStream(
+                interruptContextPtr->StreamTxBufferPtr,
+                writeBufferPtr,
+                Length,
+                fifoMode);
+
+        thisPtr->startStreamTransfer(
+            SpbRequest,
+            targetContextPtr,
+            _TRANSFER_STATE::STREAM_WRITE,
+            fifoMode,
+            _STREAM_CONTEXT{
+                nullptr,            // ReadBufferPtr
+                nullptr,            // ReadMdl
+                Length,
+                wordCount});
+        return;
+    }
+
     _CONTROL_REGS controlRegs = computeControlRegisters(
             targetContextPtr,
             fifoMode);
 
+    beginTransferTelemetry(interruptContextPtr, fifoMode, Length);
+
     //
     // Assert CS and do some useful work (i.e. setting up the request context)
     // while we're waiting for CS to assert
@@ -728,6 +804,8 @@ VOID AUXSPI_DEVICE::EvtSpbIoSequence (
             targetContextPtr,
             fifoMode);
 
+    beginTransferTelemetry(interruptContextPtr, fifoMode, bytesToWrite);
+
     // Assert CS
     {
         assertCsBegin(registersPtr, controlRegs);
@@ -799,8 +877,21 @@ VOID AUXSPI_DEVICE::EvtSpbIoOther (
     AUXSPI_ASSERT_MAX_IRQL(DISPATCH_LEVEL);
 
     // All other IOCTLs should have been filtered out in EvtIoInCallerContext
-    UNREFERENCED_PARAMETER(IoControlCode);
-    NT_ASSERT(IoControlCode == IOCTL_SPB_FULL_DUPLEX);
+    switch (IoControlCode) {
+    case IOCTL_SPB_FULL_DUPLEX:
+        break;
+    case IOCTL_AUXSPI_GET_TELEMETRY:
+    case IOCTL_AUXSPI_RESET_TELEMETRY:
+        processTelemetryRequest(
+            GetDeviceContext(WdfDevice)->interruptContextPtr,
+            SpbRequest,
+            IoControlCode);
+        return;
+    default:
+        NT_ASSERT(FALSE);
+        SpbRequestComplete(SpbRequest, STATUS_NOT_SUPPORTED);
+        return;
+    }
 
     PMDL writeMdl;
     PMDL readMdl;
@@ -928,10 +1019,33 @@ VOID AUXSPI_DEVICE::EvtSpbIoOther (
     const _TARGET_CONTEXT* targetContextPtr = GetTargetContext(SpbTarget);
 
     _FIFO_MODE fifoMode = selectFifoMode(targetContextPtr->DataMode, length);
+
+    if (thisPtr->shouldStream(targetContextPtr, length, fifoMode)) {
+        const size_t wordCount = packStreamMdl(
+                interruptContextPtr->StreamTxBufferPtr,
+                writeMdl,
+                length,
+                fifoMode);
+
+        thisPtr->startStreamTransfer(
+            SpbRequest,
+            targetContextPtr,
+            _TRANSFER_STATE::STREAM_FULL_DUPLEX,
+            fifoMode,
+            _STREAM_CONTEXT{
+                nullptr,            // ReadBufferPtr
+                readMdl,
+                length,
+                wordCount});
+        return;
+    }
+
     _CONTROL_REGS controlRegs = computeControlRegisters(
             targetContextPtr,
             fifoMode);
 
+    beginTransferTelemetry(interruptContextPtr, fifoMode, length);
+
     //
     // Prepare request context while asserting CS
     //
@@ -1007,24 +1121,29 @@ VOID AUXSPI_DEVICE::EvtIoInCallerContext (
         return;
     }
 
+    NTSTATUS status;
     switch (params.Parameters.DeviceIoControl.IoControlCode) {
     case IOCTL_SPB_FULL_DUPLEX:
+        status = SpbRequestCaptureIoOtherTransferList(
+                static_cast<SPBREQUEST>(WdfRequest));
+        if (!NT_SUCCESS(status)) {
+            AUXSPI_LOG_ERROR(
+                "SpbRequestCaptureIoOtherTransferList(...) failed. (status = %!STATUS!)",
+                status);
+            WdfRequestComplete(WdfRequest, status);
+            return;
+        }
+        break;
+    case IOCTL_AUXSPI_GET_TELEMETRY:
+    case IOCTL_AUXSPI_RESET_TELEMETRY:
+        // buffered IOCTLs without a transfer list, handled in EvtSpbIoOther
+        // so that they are serialized with transfers
         break;
     default:
         WdfRequestComplete(WdfRequest, STATUS_NOT_SUPPORTED);
         return;
     }
 
-    NTSTATUS status = SpbRequestCaptureIoOtherTransferList(
-            static_cast<SPBREQUEST>(WdfRequest));
-    if (!NT_SUCCESS(status)) {
-        AUXSPI_LOG_ERROR(
-            "SpbRequestCaptureIoOtherTransferList(...) failed. (status = %!STATUS!)",
-            status);
-        WdfRequestComplete(WdfRequest, status);
-        return;
-    }
-
     status = WdfDeviceEnqueueRequest(WdfDevice, WdfRequest);
     if (!NT_SUCCESS(status)) {
         AUXSPI_LOG_ERROR(
@@ -1069,6 +1188,7 @@ VOID AUXSPI_DEVICE::EvtRequestCancel ( WDFREQUEST  WdfRequest )
             return;
         }
         NT_ASSERT(WdfRequest == currentRequest);
+        ++interruptContextPtr->Telemetry.CancelledTransfers;
 
         // read current value of control registers
         controlRegs = interruptContextPtr->ControlRegs;
@@ -1094,49 +1214,16 @@ VOID AUXSPI_DEVICE::EvtRequestCancel ( WDFREQUEST  WdfRequest )
 _Use_decl_annotations_
 size_t AUXSPI_DEVICE::writeFifo (
     volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
-    _In_reads_(Length) const BYTE* WriteBufferPtr,
+    const BYTE* WriteBufferPtr,
     size_t Length,
     _FIFO_MODE FifoMode
     )
 {
     NT_ASSERT(Length != 0);
-
-    switch (FifoMode) {
-    case _FIFO_MODE::FIXED_4:
-
-        ASSERT_ULONG_ALIGNED(WriteBufferPtr, Length);
-        return sizeof(ULONG) * _FIFO_FIXED_4::Write(
-                RegistersPtr,
-                reinterpret_cast<const ULONG*>(WriteBufferPtr),
-                Length / sizeof(ULONG));
-
-    case _FIFO_MODE::VARIABLE_3:
-
-        return _FIFO_VARIABLE_3::Write(
-                    RegistersPtr,
-                    WriteBufferPtr,
-                    Length);
-
-    case _FIFO_MODE::FIXED_3_SHIFTED:
-
-        return _FIFO_FIXED_3_SHIFTED::Write(
-                RegistersPtr,
-                WriteBufferPtr,
-                Length);
-
-    case _FIFO_MODE::VARIABLE_2_SHIFTED:
-
-        return _FIFO_VARIABLE_2_SHIFTED::Write(
-                RegistersPtr,
-                WriteBufferPtr,
-                Length);
-
-    default:
-        NT_ASSERT(FALSE);
-        return 0;
-    }
+    return getFifoOps(FifoMode).Write(RegistersPtr, WriteBufferPtr, Length);
 }
 
+_Use_decl_annotations_
 size_t AUXSPI_DEVICE::writeFifoMdl (
     volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
     PMDL* MdlPtr,
@@ -1144,20 +1231,7 @@ size_t AUXSPI_DEVICE::writeFifoMdl (
     _FIFO_MODE FifoMode
     )
 {
-    const size_t fifoCapacity = getFifoCapacity(FifoMode);
-
-    ULONG fifoBuffer[BCM_AUXSPI_FIFO_DEPTH];
-    size_t bytesCopied = copyBytesFromMdl(
-            MdlPtr,
-            OffsetPtr,
-            reinterpret_cast<BYTE*>(fifoBuffer),
-            fifoCapacity);
-
-    return writeFifo(
-            RegistersPtr,
-            reinterpret_cast<const BYTE*>(fifoBuffer),
-            bytesCopied,
-            FifoMode);
+    return getFifoOps(FifoMode).WriteMdl(RegistersPtr, MdlPtr, OffsetPtr);
 }
 
 size_t AUXSPI_DEVICE::writeFifoZeros (
@@ -1166,13 +1240,12 @@ size_t AUXSPI_DEVICE::writeFifoZeros (
     _FIFO_MODE FifoMode
     )
 {
-    // must be ULONG-aligned
-    ULONG zeros[BCM_AUXSPI_FIFO_DEPTH] = {0};
-    return writeFifo(
-        RegistersPtr,
-        reinterpret_cast<const BYTE*>(zeros),
-        MaxCount,
-        FifoMode);
+    // large enough for any FIFO mode
+    static const ULONG zeros[BCM_AUXSPI_FIFO_DEPTH] = {0};
+    return getFifoOps(FifoMode).Write(
+            RegistersPtr,
+            reinterpret_cast<const BYTE*>(zeros),
+            MaxCount);
 }
 
 _Use_decl_annotations_
@@ -1184,31 +1257,7 @@ size_t AUXSPI_DEVICE::readFifo (
     )
 {
     NT_ASSERT(Length != 0);
-
-    // Read raw FIFO contents into local buffer, then queue next batch of
-    // bytes to get read going again as soon as possible
-    ULONG fifoBuffer[BCM_AUXSPI_FIFO_DEPTH];
-    for (int i = 0; i < ARRAYSIZE(fifoBuffer); ++i) {
-        fifoBuffer[i] = READ_REGISTER_NOFENCE_ULONG(&RegistersPtr->IoReg);
-    }
-
-    const size_t fifoCapacity = getFifoCapacity(FifoMode);
-    const size_t bytesToReadChunk = min(Length, fifoCapacity);
-
-    // get the next chunk going now that we've drained the read buffer
-    NT_ASSERT(Length >= bytesToReadChunk);
-    const size_t remainingBytesToWrite = Length - bytesToReadChunk;
-    if (remainingBytesToWrite) {
-        writeFifoZeros(RegistersPtr, remainingBytesToWrite, FifoMode);
-    }
-
-    size_t bytesExtracted = extractFifoBuffer(
-            fifoBuffer,
-            ReadBufferPtr,
-            bytesToReadChunk,
-            FifoMode);
-    NT_ASSERT(bytesExtracted == bytesToReadChunk);
-    return bytesExtracted;
+    return getFifoOps(FifoMode).Read(RegistersPtr, ReadBufferPtr, Length);
 }
 
 _Use_decl_annotations_
@@ -1220,18 +1269,8 @@ size_t AUXSPI_DEVICE::readFifoMdl (
     _FIFO_MODE FifoMode
     )
 {
-    ULONG buf[BCM_AUXSPI_FIFO_DEPTH];
-    const size_t bytesRead = readFifo(
-            RegistersPtr,
-            reinterpret_cast<BYTE*>(buf),
-            Length,
-            FifoMode);
-
-    return copyBytesToMdl(
-            MdlPtr,
-            OffsetPtr,
-            reinterpret_cast<const BYTE*>(buf),
-            bytesRead);
+    NT_ASSERT(Length != 0);
+    return getFifoOps(FifoMode).ReadMdl(RegistersPtr, Length, MdlPtr, OffsetPtr);
 }
 
 _Use_decl_annotations_
@@ -1242,210 +1281,571 @@ size_t AUXSPI_DEVICE::extractFifoBuffer (
     _FIFO_MODE FifoMode
     )
 {
-    switch (FifoMode) {
-    case _FIFO_MODE::FIXED_4:
-
-        ASSERT_ULONG_ALIGNED(ReadBufferPtr, Length);
-        _FIFO_FIXED_4::Extract(
-            FifoBuffer,
-            reinterpret_cast<ULONG*>(ReadBufferPtr),
-            Length / sizeof(ULONG));
-
-        break;
-
-    case _FIFO_MODE::VARIABLE_3:
-
-        _FIFO_VARIABLE_3::Extract(
-            FifoBuffer,
-            ReadBufferPtr,
-            Length);
-
-        break;
-
-    case _FIFO_MODE::FIXED_3_SHIFTED:
-
-        _FIFO_FIXED_3_SHIFTED::Extract(
-            FifoBuffer,
-            ReadBufferPtr,
-            Length);
-
-        break;
+    return getFifoOps(FifoMode).Extract(FifoBuffer, ReadBufferPtr, Length);
+}
 
-    case _FIFO_MODE::VARIABLE_2_SHIFTED:
+//
+// Returns a pointer to the next Length bytes of the MDL chain and consumes
+// them if they are contiguous in the current MDL. Otherwise returns nullptr
+// and only skips over exhausted MDLs.
+//
+_Use_decl_annotations_
+BYTE* AUXSPI_DEVICE::getMdlSpan (
+    PMDL* MdlPtr,
+    size_t* MdlOffsetPtr,
+    size_t Length
+    )
+{
+    PMDL currentMdl = *MdlPtr;
+    size_t offset = *MdlOffsetPtr;
 
-        _FIFO_VARIABLE_2_SHIFTED::Extract(
-            FifoBuffer,
-            ReadBufferPtr,
-            Length);
+    NT_ASSERT(currentMdl);
 
-        break;
+    while ((offset == MmGetMdlByteCount(currentMdl)) && currentMdl->Next) {
+        currentMdl = currentMdl->Next;
+        offset = 0;
+    }
 
-    default:
-        NT_ASSERT(FALSE);
+    *MdlPtr = currentMdl;
+    if ((MmGetMdlByteCount(currentMdl) - offset) < Length) {
+        *MdlOffsetPtr = offset;
+        return nullptr;
     }
 
-    return Length;
+    *MdlOffsetPtr = offset + Length;
+    return static_cast<BYTE*>(currentMdl->MappedSystemVa) + offset;
 }
 
-//
-// Writes a ULONG-aligned buffer to the FIFO in fixed 32-bit mode
-//
-_Use_decl_annotations_
-size_t AUXSPI_DEVICE::_FIFO_FIXED_4::Write(
+void AUXSPI_DEVICE::writeFifoWords (
     volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
-    const ULONG* WriteBufferPtr,
-    size_t Length
+    const ULONG* FifoBuffer,
+    size_t Count
     )
 {
-    NT_ASSERT(Length != 0);
+    NT_ASSERT(Count <= BCM_AUXSPI_FIFO_DEPTH);
 
-    const size_t count = min(Length, BCM_AUXSPI_FIFO_DEPTH);
-    for (size_t i = count; i; --i) {
-        // Input sequence: 0x78563412
-        // Output sequence: 0x12345678
+    for (size_t i = 0; i < Count; ++i) {
         WRITE_REGISTER_NOFENCE_ULONG(
             &RegistersPtr->TxHoldReg,               // keep CS asserted
-            RtlUlongByteSwap(*WriteBufferPtr++));
+            FifoBuffer[i]);
     }
-    return count;
 }
 
+//
+// Packs up to one FIFO load of bytes into FIFO entries. Returns the number
+// of FIFO entries produced.
+//
 _Use_decl_annotations_
-void AUXSPI_DEVICE::_FIFO_FIXED_4::Extract (
-    const ULONG* FifoBuffer,
-    ULONG* ReadBufferPtr,
-    size_t Length
+size_t AUXSPI_DEVICE::packFifo (
+    ULONG* FifoBuffer,
+    const BYTE* WriteBufferPtr,
+    size_t Length,
+    _FIFO_MODE FifoMode
     )
 {
-    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY));
-
-    for (size_t i = 0; i < Length; ++i) {
-        // Input sequence: 0x12345678
-        // Output sequence: 0x78563412
-        ReadBufferPtr[i] = RtlUlongByteSwap(FifoBuffer[i]);
-    }
+    return getFifoOps(FifoMode).Pack(FifoBuffer, WriteBufferPtr, Length);
 }
 
 //
-// Write bytes to the FIFO in variable shift mode
+// Packs a whole transfer into FIFO entries, one FIFO load at a time. If
+// WriteBufferPtr is null, dummy (zero) bytes are packed. Returns the number
+// of FIFO entries produced.
 //
 _Use_decl_annotations_
-size_t AUXSPI_DEVICE::_FIFO_VARIABLE_3::Write (
-    volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+size_t AUXSPI_DEVICE::packStream (
+    ULONG* WordBufferPtr,
     const BYTE* WriteBufferPtr,
-    size_t Length
+    size_t Length,
+    _FIFO_MODE FifoMode
     )
 {
-    NT_ASSERT(Length != 0);
-
-    const size_t bytesToQueue = min(FIFO_CAPACITY, Length);
-    for (size_t i = 0; i < (bytesToQueue / 3); ++i) {
-        // Input Sequence: 12 34 56 ab cd
-        // Output Sequence: 0x00123456 0x00abcd00
-        BCM_AUXSPI_IO_REG dataReg = {0};
-        dataReg.Width = 24;
-        dataReg.Data = (WriteBufferPtr[i * 3] << 16) |
-            (WriteBufferPtr[i * 3 + 1] << 8) | WriteBufferPtr[i * 3 + 2];
-
-        WRITE_REGISTER_NOFENCE_ULONG(&RegistersPtr->TxHoldReg, dataReg.AsUlong);
-    }
+    // must be ULONG-aligned
+    const ULONG zeros[BCM_AUXSPI_FIFO_DEPTH] = {0};
+    const size_t fifoCapacity = getFifoCapacity(FifoMode);
 
-    // Handle last one or two bytes
-    switch (bytesToQueue % 3) {
-    case 0: break;
-    case 1:
-    {
-        BCM_AUXSPI_IO_REG dataReg = {0};
-        dataReg.Width = 8;
-        dataReg.Data = WriteBufferPtr[bytesToQueue - 1] << 16;
-        WRITE_REGISTER_NOFENCE_ULONG(&RegistersPtr->TxHoldReg, dataReg.AsUlong);
-        break;
+    size_t wordCount = 0;
+    for (size_t offset = 0; offset < Length; offset += fifoCapacity) {
+        const size_t chunkLength = min(fifoCapacity, Length - offset);
+        wordCount += packFifo(
+                WordBufferPtr + wordCount,
+                WriteBufferPtr ?
+                    WriteBufferPtr + offset :
+                    reinterpret_cast<const BYTE*>(zeros),
+                chunkLength,
+                FifoMode);
     }
-    case 2:
-    {
-        BCM_AUXSPI_IO_REG dataReg = {0};
-        dataReg.Width = 16;
-        dataReg.Data = (WriteBufferPtr[bytesToQueue - 1] << 8) |
-                       (WriteBufferPtr[bytesToQueue - 2] << 16);
-        WRITE_REGISTER_NOFENCE_ULONG(&RegistersPtr->TxHoldReg, dataReg.AsUlong);
-        break;
-    }
-    } // switch
 
-    return bytesToQueue;
+    NT_ASSERT(wordCount <= AUXSPI_STREAM_BUFFER_WORDS);
+    return wordCount;
 }
 
 _Use_decl_annotations_
-#pragma prefast(suppress:6101, "ReadBufferPtr is always written to")
-void AUXSPI_DEVICE::_FIFO_VARIABLE_3::Extract (
-    const ULONG* FifoBuffer,
-    BYTE* ReadBufferPtr,
-    size_t Length
+size_t AUXSPI_DEVICE::packStreamMdl (
+    ULONG* WordBufferPtr,
+    PMDL Mdl,
+    size_t Length,
+    _FIFO_MODE FifoMode
     )
 {
-    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY));
+    const size_t fifoCapacity = getFifoCapacity(FifoMode);
+    PMDL currentMdl = Mdl;
+    size_t mdlOffset = 0;
 
-    // each fifo entry contains up to 3 byte-reversed words
-    for (size_t i = 0; i < (Length / 3); ++i) {
-        // Input sequence: 0x00123456 0x0000abcd
-        // Output sequence: 12 34 56 ab cd
-        ULONG data = FifoBuffer[i];
-        ReadBufferPtr[i * 3] = static_cast<BYTE>(data >> 16);
-        ReadBufferPtr[i * 3 + 1] = static_cast<BYTE>(data >> 8);
-        ReadBufferPtr[i * 3 + 2] = static_cast<BYTE>(data);
-    }
+    size_t wordCount = 0;
+    for (size_t offset = 0; offset < Length; offset += fifoCapacity) {
+        ULONG buf[BCM_AUXSPI_FIFO_DEPTH];
+        const size_t bytesCopied = copyBytesFromMdl(
+                &currentMdl,
+                &mdlOffset,
+                reinterpret_cast<BYTE*>(buf),
+                min(fifoCapacity, Length - offset));
+        NT_ASSERT(bytesCopied == min(fifoCapacity, Length - offset));
 
-    // handle last 1 or 2 bytes
-    ULONG data = FifoBuffer[(Length - 1) / 3];
-    switch (Length % 3) {
-    case 0:
-        break;
-    case 2:
-        ReadBufferPtr[Length - 2] = static_cast<BYTE>(data >> 8);
-        __fallthrough;
-    case 1:
-        ReadBufferPtr[Length - 1] = static_cast<BYTE>(data);
+        wordCount += packFifo(
+                WordBufferPtr + wordCount,
+                reinterpret_cast<const BYTE*>(buf),
+                bytesCopied,
+                FifoMode);
     }
+
+    NT_ASSERT(wordCount <= AUXSPI_STREAM_BUFFER_WORDS);
+    return wordCount;
 }
 
 //
-// Write bytes to the FIFO in 24-bit fixed width mode with data shift
+// Moves prepacked words into the TX FIFO and received words out of the RX
+// FIFO for as long as the FIFO keeps up, bounded by StreamSpinTicks. At most
+// BCM_AUXSPI_FIFO_DEPTH words are kept outstanding so that the RX FIFO
+// cannot overflow. Words are always left in flight when returning early,
+// so the done interrupt will bring us back. Returns true once the stream
+// is complete.
 //
-_Use_decl_annotations_
-size_t AUXSPI_DEVICE::_FIFO_FIXED_3_SHIFTED::Write (
-    volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
-    const BYTE* WriteBufferPtr,
-    size_t Length
-    )
+bool AUXSPI_DEVICE::streamFifo ( _INTERRUPT_CONTEXT* InterruptContextPtr )
 {
-    NT_ASSERT((Length != 0) && ((Length % 3) == 0));
+    volatile BCM_AUXSPI_REGISTERS* registersPtr = InterruptContextPtr->RegistersPtr;
+    _STREAM_CONTEXT* streamPtr = &InterruptContextPtr->Request.Stream;
+    const ULONG* txWordsPtr = InterruptContextPtr->StreamTxBufferPtr;
+    ULONG* rxWordsPtr = InterruptContextPtr->StreamRxBufferPtr;
 
-    const size_t bytesToQueue = min(Length, FIFO_CAPACITY);
-    for (size_t i = 0; i < (bytesToQueue / 3); ++i) {
-        // Input sequence: ab cd ef 12 34 56 ...
-        // Output sequence: (0xabcdef00 >> 1), (0x12345600 >> 1) ...
-        ULONG data = (WriteBufferPtr[i * 3] << 23) |
-                     (WriteBufferPtr[i * 3 + 1] << 15) |
-                     (WriteBufferPtr[i * 3 + 2] << 7);
+    const bool captureInput =
+        InterruptContextPtr->Request.TransferState != _TRANSFER_STATE::STREAM_WRITE;
+    const size_t wordCount = streamPtr->WordCount;
+    size_t wordsWritten = streamPtr->WordsWritten;
+    size_t wordsRead = streamPtr->WordsRead;
+
+    // the controller is idle, so everything written so far has shifted out
+    if (!captureInput && (wordsWritten == wordCount)) return true;
+
+    const LONGLONG deadline =
+        KeQueryPerformanceCounter(nullptr).QuadPart +
+        InterruptContextPtr->StreamSpinTicks;
 
-        WRITE_REGISTER_NOFENCE_ULONG(&RegistersPtr->TxHoldReg, data);
+    for (;;) {
+        BCM_AUXSPI_STAT_REG statReg =
+            {READ_REGISTER_NOFENCE_ULONG(&registersPtr->StatReg)};
+
+        if (captureInput) {
+            while (!statReg.RxEmpty && (wordsRead < wordsWritten)) {
+                rxWordsPtr[wordsRead++] =
+                    READ_REGISTER_NOFENCE_ULONG(&registersPtr->IoReg);
+                statReg.AsUlong = READ_REGISTER_NOFENCE_ULONG(&registersPtr->StatReg);
+            }
+
+            if (wordsRead == wordCount) break;
+        }
+
+        while (!statReg.TxFull &&
+               (wordsWritten < wordCount) &&
+               (!captureInput ||
+                ((wordsWritten - wordsRead) < BCM_AUXSPI_FIFO_DEPTH))) {
+
+            WRITE_REGISTER_NOFENCE_ULONG(
+                &registersPtr->TxHoldReg,           // keep CS asserted
+                txWordsPtr[wordsWritten++]);
+            statReg.AsUlong = READ_REGISTER_NOFENCE_ULONG(&registersPtr->StatReg);
+        }
+
+        // writes complete on the next done interrupt
+        if (!captureInput && (wordsWritten == wordCount)) break;
+
+        if (KeQueryPerformanceCounter(nullptr).QuadPart >= deadline) break;
     }
 
-    return bytesToQueue;
+    streamPtr->WordsWritten = wordsWritten;
+    streamPtr->WordsRead = wordsRead;
+    return captureInput && (wordsRead == wordCount);
 }
 
-_Use_decl_annotations_
-void AUXSPI_DEVICE::_FIFO_FIXED_3_SHIFTED::Extract (
-    const ULONG* FifoBuffer,
-    BYTE* ReadBufferPtr,
-    size_t Length
+//
+// Extracts the received FIFO words of a completed stream into the caller's
+// buffer. Every full FIFO load occupies exactly BCM_AUXSPI_FIFO_DEPTH words.
+//
+void AUXSPI_DEVICE::unpackStream ( const _INTERRUPT_CONTEXT* InterruptContextPtr )
+{
+    const _STREAM_CONTEXT& stream = InterruptContextPtr->Request.Stream;
+    const _FIFO_OPS& ops = getFifoOps(InterruptContextPtr->Request.FifoMode);
+    const ULONG* rxWordsPtr = InterruptContextPtr->StreamRxBufferPtr;
+
+    PMDL currentMdl = stream.ReadMdl;
+    size_t mdlOffset = 0;
+
+    for (size_t offset = 0;
+         offset < stream.Length;
+         offset += ops.FifoCapacity, rxWordsPtr += BCM_AUXSPI_FIFO_DEPTH) {
+
+        const size_t chunkLength = min(ops.FifoCapacity, stream.Length - offset);
+        if (stream.ReadBufferPtr) {
+            ops.Extract(rxWordsPtr, stream.ReadBufferPtr + offset, chunkLength);
+            continue;
+        }
+
+        size_t bytesCopied = ops.ExtractMdl(
+                rxWordsPtr,
+                chunkLength,
+                &currentMdl,
+                &mdlOffset);
+        UNREFERENCED_PARAMETER(bytesCopied);
+        NT_ASSERT(bytesCopied == chunkLength);
+    }
+}
+
+//
+// Streaming is used for long transfers that fit in the stream buffer. It only
+// pays off when the FIFO drains faster than an interrupt round trip, so slow
+// clocks stay on the interrupt-per-FIFO-load path.
+//
+bool AUXSPI_DEVICE::shouldStream (
+    const _TARGET_CONTEXT* TargetContextPtr,
+    size_t Length,
+    _FIFO_MODE FifoMode
+    ) const
+{
+    if (!this->streamBufferPtr ||
+        (this->streamThresholdBytes == 0) ||
+        (Length < this->streamThresholdBytes) ||
+        (TargetContextPtr->ClockFrequency < AUXSPI_STREAM_MIN_CLOCK)) {
+
+        return false;
+    }
+
+    const size_t fifoCapacity = getFifoCapacity(FifoMode);
+    const size_t fifoLoads = (Length + fifoCapacity - 1) / fifoCapacity;
+    return (fifoLoads * BCM_AUXSPI_FIFO_DEPTH) <= AUXSPI_STREAM_BUFFER_WORDS;
+}
+
+//
+// Starts a transfer whose TX words have already been packed into the stream
+// buffer. The first FIFO load is queued here, the ISR streams the rest.
+//
+void AUXSPI_DEVICE::startStreamTransfer (
+    SPBREQUEST SpbRequest,
+    const _TARGET_CONTEXT* TargetContextPtr,
+    _TRANSFER_STATE TransferState,
+    _FIFO_MODE FifoMode,
+    const _STREAM_CONTEXT& StreamContext
     )
 {
-    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY) && ((Length % 3) == 0));
+    volatile BCM_AUXSPI_REGISTERS* registersPtr = this->registersPtr;
+    _INTERRUPT_CONTEXT* interruptContextPtr = this->interruptContextPtr;
+
+    _CONTROL_REGS controlRegs = computeControlRegisters(
+            TargetContextPtr,
+            FifoMode);
+
+    beginTransferTelemetry(interruptContextPtr, FifoMode, StreamContext.Length);
+
+    //
+    // Assert CS and prepare the request context while we're waiting for
+    // CS to assert
+    //
+    {
+        assertCsBegin(registersPtr, controlRegs);
+
+        new (&interruptContextPtr->Request) _INTERRUPT_CONTEXT::_REQUEST(
+            TransferState,
+            FifoMode,
+            SpbRequest,
+            TargetContextPtr);
+
+        new (&interruptContextPtr->Request.Stream) _STREAM_CONTEXT(StreamContext);
+
+        interruptContextPtr->ControlRegs = controlRegs;
+
+        assertCsComplete(registersPtr, controlRegs);
+    }
+
+    const size_t count = min(
+            interruptContextPtr->Request.Stream.WordCount,
+            BCM_AUXSPI_FIFO_DEPTH);
+    writeFifoWords(registersPtr, interruptContextPtr->StreamTxBufferPtr, count);
+    interruptContextPtr->Request.Stream.WordsWritten = count;
+
+    NTSTATUS status = WdfRequestMarkCancelableEx(SpbRequest, EvtRequestCancel);
+    if (!NT_SUCCESS(status)) {
+        AUXSPI_LOG_ERROR(
+            "WdfRequestMarkCancelableEx(...) failed. (SpbRequest = %p, status = %!STATUS!)",
+            SpbRequest,
+            status);
+        abortTransfer(interruptContextPtr);
+        SpbRequestComplete(SpbRequest, status);
+        return;
+    }
+
+    // enable interrupts
+    controlRegs.Cntl1Reg.DoneIrq = 1;
+    WRITE_REGISTER_NOFENCE_ULONG(
+        &registersPtr->Cntl1Reg,
+        controlRegs.Cntl1Reg.AsUlong);
+}
+
+//
+// Fixed 32-bit mode. Buffers need not be ULONG-aligned.
+//
+_Use_decl_annotations_
+void AUXSPI_DEVICE::_FIFO_FIXED_4::PackFull (
+    ULONG* FifoBuffer,
+    const BYTE* WriteBufferPtr
+    )
+{
+    const ULONG UNALIGNED* wordPtr =
+        reinterpret_cast<const ULONG UNALIGNED*>(WriteBufferPtr);
+
+    // Input sequence: 0x78563412
+    // Output sequence: 0x12345678
+    FifoBuffer[0] = RtlUlongByteSwap(wordPtr[0]);
+    FifoBuffer[1] = RtlUlongByteSwap(wordPtr[1]);
+    FifoBuffer[2] = RtlUlongByteSwap(wordPtr[2]);
+    FifoBuffer[3] = RtlUlongByteSwap(wordPtr[3]);
+}
+
+_Use_decl_annotations_
+size_t AUXSPI_DEVICE::_FIFO_FIXED_4::Pack (
+    ULONG* FifoBuffer,
+    const BYTE* WriteBufferPtr,
+    size_t Length
+    )
+{
+    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY));
+    NT_ASSERT((Length % sizeof(ULONG)) == 0);
+
+    const ULONG UNALIGNED* wordPtr =
+        reinterpret_cast<const ULONG UNALIGNED*>(WriteBufferPtr);
+
+    const size_t count = Length / sizeof(ULONG);
+    for (size_t i = 0; i < count; ++i) {
+        FifoBuffer[i] = RtlUlongByteSwap(wordPtr[i]);
+    }
+    return count;
+}
+
+_Use_decl_annotations_
+void AUXSPI_DEVICE::_FIFO_FIXED_4::ExtractFull (
+    const ULONG* FifoBuffer,
+    BYTE* ReadBufferPtr
+    )
+{
+    ULONG UNALIGNED* wordPtr = reinterpret_cast<ULONG UNALIGNED*>(ReadBufferPtr);
+
+    // Input sequence: 0x12345678
+    // Output sequence: 0x78563412
+    wordPtr[0] = RtlUlongByteSwap(FifoBuffer[0]);
+    wordPtr[1] = RtlUlongByteSwap(FifoBuffer[1]);
+    wordPtr[2] = RtlUlongByteSwap(FifoBuffer[2]);
+    wordPtr[3] = RtlUlongByteSwap(FifoBuffer[3]);
+}
+
+_Use_decl_annotations_
+void AUXSPI_DEVICE::_FIFO_FIXED_4::Extract (
+    const ULONG* FifoBuffer,
+    BYTE* ReadBufferPtr,
+    size_t Length
+    )
+{
+    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY));
+    NT_ASSERT((Length % sizeof(ULONG)) == 0);
+
+    ULONG UNALIGNED* wordPtr = reinterpret_cast<ULONG UNALIGNED*>(ReadBufferPtr);
+    for (size_t i = 0; i < (Length / sizeof(ULONG)); ++i) {
+        wordPtr[i] = RtlUlongByteSwap(FifoBuffer[i]);
+    }
+}
+
+//
+// Variable shift mode, up to 3 bytes per FIFO entry
+//
+_Use_decl_annotations_
+void AUXSPI_DEVICE::_FIFO_VARIABLE_3::PackFull (
+    ULONG* FifoBuffer,
+    const BYTE* WriteBufferPtr
+    )
+{
+    // Input Sequence: 12 34 56 ab cd ef ...
+    // Output Sequence: 0x18123456 0x18abcdef ...
+    const ULONG width = 24 << 24;
+    for (size_t i = 0; i < BCM_AUXSPI_FIFO_DEPTH; ++i) {
+        FifoBuffer[i] = width |
+            (WriteBufferPtr[i * 3] << 16) |
+            (WriteBufferPtr[i * 3 + 1] << 8) |
+            WriteBufferPtr[i * 3 + 2];
+    }
+}
+
+_Use_decl_annotations_
+size_t AUXSPI_DEVICE::_FIFO_VARIABLE_3::Pack (
+    ULONG* FifoBuffer,
+    const BYTE* WriteBufferPtr,
+    size_t Length
+    )
+{
+    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY));
 
+    size_t count = 0;
     for (size_t i = 0; i < (Length / 3); ++i) {
+        // Input Sequence: 12 34 56 ab cd
+        // Output Sequence: 0x00123456 0x00abcd00
+        BCM_AUXSPI_IO_REG dataReg = {0};
+        dataReg.Width = 24;
+        dataReg.Data = (WriteBufferPtr[i * 3] << 16) |
+            (WriteBufferPtr[i * 3 + 1] << 8) | WriteBufferPtr[i * 3 + 2];
+
+        FifoBuffer[count++] = dataReg.AsUlong;
+    }
+
+    // Handle last one or two bytes
+    switch (Length % 3) {
+    case 0: break;
+    case 1:
+    {
+        BCM_AUXSPI_IO_REG dataReg = {0};
+        dataReg.Width = 8;
+        dataReg.Data = WriteBufferPtr[Length - 1] << 16;
+        FifoBuffer[count++] = dataReg.AsUlong;
+        break;
+    }
+    case 2:
+    {
+        BCM_AUXSPI_IO_REG dataReg = {0};
+        dataReg.Width = 16;
+        dataReg.Data = (WriteBufferPtr[Length - 1] << 8) |
+                       (WriteBufferPtr[Length - 2] << 16);
+        FifoBuffer[count++] = dataReg.AsUlong;
+        break;
+    }
+    } // switch
+
+    return count;
+}
+
+_Use_decl_annotations_
+void AUXSPI_DEVICE::_FIFO_VARIABLE_3::ExtractFull (
+    const ULONG* FifoBuffer,
+    BYTE* ReadBufferPtr
+    )
+{
+    for (size_t i = 0; i < BCM_AUXSPI_FIFO_DEPTH; ++i) {
+        const ULONG data = FifoBuffer[i];
+        ReadBufferPtr[i * 3] = static_cast<BYTE>(data >> 16);
+        ReadBufferPtr[i * 3 + 1] = static_cast<BYTE>(data >> 8);
+        ReadBufferPtr[i * 3 + 2] = static_cast<BYTE>(data);
+    }
+}
+
+_Use_decl_annotations_
+#pragma prefast(suppress:6101, "ReadBufferPtr is always written to")
+void AUXSPI_DEVICE::_FIFO_VARIABLE_3::Extract (
+    const ULONG* FifoBuffer,
+    BYTE* ReadBufferPtr,
+    size_t Length
+    )
+{
+    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY));
+
+    // each fifo entry contains up to 3 byte-reversed words
+    for (size_t i = 0; i < (Length / 3); ++i) {
+        // Input sequence: 0x00123456 0x0000abcd
+        // Output sequence: 12 34 56 ab cd
+        ULONG data = FifoBuffer[i];
+        ReadBufferPtr[i * 3] = static_cast<BYTE>(data >> 16);
+        ReadBufferPtr[i * 3 + 1] = static_cast<BYTE>(data >> 8);
+        ReadBufferPtr[i * 3 + 2] = static_cast<BYTE>(data);
+    }
+
+    // handle last 1 or 2 bytes
+    ULONG data = FifoBuffer[(Length - 1) / 3];
+    switch (Length % 3) {
+    case 0:
+        break;
+    case 2:
+        ReadBufferPtr[Length - 2] = static_cast<BYTE>(data >> 8);
+        __fallthrough;
+    case 1:
+        ReadBufferPtr[Length - 1] = static_cast<BYTE>(data);
+    }
+}
+
+//
+// 24-bit fixed width mode with data shift
+//
+_Use_decl_annotations_
+void AUXSPI_DEVICE::_FIFO_FIXED_3_SHIFTED::PackFull (
+    ULONG* FifoBuffer,
+    const BYTE* WriteBufferPtr
+    )
+{
+    for (size_t i = 0; i < BCM_AUXSPI_FIFO_DEPTH; ++i) {
+        // Input sequence: ab cd ef 12 34 56 ...
+        // Output sequence: (0xabcdef00 >> 1), (0x12345600 >> 1) ...
+        FifoBuffer[i] = (WriteBufferPtr[i * 3] << 23) |
+                        (WriteBufferPtr[i * 3 + 1] << 15) |
+                        (WriteBufferPtr[i * 3 + 2] << 7);
+    }
+}
+
+_Use_decl_annotations_
+size_t AUXSPI_DEVICE::_FIFO_FIXED_3_SHIFTED::Pack (
+    ULONG* FifoBuffer,
+    const BYTE* WriteBufferPtr,
+    size_t Length
+    )
+{
+    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY) && ((Length % 3) == 0));
+
+    const size_t count = Length / 3;
+    for (size_t i = 0; i < count; ++i) {
+        FifoBuffer[i] = (WriteBufferPtr[i * 3] << 23) |
+                        (WriteBufferPtr[i * 3 + 1] << 15) |
+                        (WriteBufferPtr[i * 3 + 2] << 7);
+    }
+
+    return count;
+}
+
+_Use_decl_annotations_
+void AUXSPI_DEVICE::_FIFO_FIXED_3_SHIFTED::ExtractFull (
+    const ULONG* FifoBuffer,
+    BYTE* ReadBufferPtr
+    )
+{
+    for (size_t i = 0; i < BCM_AUXSPI_FIFO_DEPTH; ++i) {
         // Input Sequence: 0x00123456 0x00abcdef
         // Output Sequence: 12 34 56 ab cd ef
+        const ULONG data = FifoBuffer[i];
+        ReadBufferPtr[i * 3] = static_cast<BYTE>(data >> 16);
+        ReadBufferPtr[i * 3 + 1] = static_cast<BYTE>(data >> 8);
+        ReadBufferPtr[i * 3 + 2] = static_cast<BYTE>(data);
+    }
+}
+
+_Use_decl_annotations_
+void AUXSPI_DEVICE::_FIFO_FIXED_3_SHIFTED::Extract (
+    const ULONG* FifoBuffer,
+    BYTE* ReadBufferPtr,
+    size_t Length
+    )
+{
+    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY) && ((Length % 3) == 0));
+
+    for (size_t i = 0; i < (Length / 3); ++i) {
         ULONG data = FifoBuffer[i];
         ReadBufferPtr[i * 3] = static_cast<BYTE>(data >> 16);
         ReadBufferPtr[i * 3 + 1] = static_cast<BYTE>(data >> 8);
@@ -1454,37 +1854,66 @@ void AUXSPI_DEVICE::_FIFO_FIXED_3_SHIFTED::Extract (
 }
 
 //
-// Write bytes to the FIFO in variable shift mode
+// Variable shift mode with data shift, up to 2 bytes per FIFO entry
 //
 _Use_decl_annotations_
-size_t AUXSPI_DEVICE::_FIFO_VARIABLE_2_SHIFTED::Write (
-    volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+void AUXSPI_DEVICE::_FIFO_VARIABLE_2_SHIFTED::PackFull (
+    ULONG* FifoBuffer,
+    const BYTE* WriteBufferPtr
+    )
+{
+    // Input Sequence: 12 34 56 78 ...
+    // Output Sequence: 0x10000000 | (0x00123400 >> 1) ...
+    const ULONG width = 16 << 24;
+    for (size_t i = 0; i < BCM_AUXSPI_FIFO_DEPTH; ++i) {
+        FifoBuffer[i] = width |
+            (WriteBufferPtr[i * 2] << 15) |
+            (WriteBufferPtr[i * 2 + 1] << 7);
+    }
+}
+
+_Use_decl_annotations_
+size_t AUXSPI_DEVICE::_FIFO_VARIABLE_2_SHIFTED::Pack (
+    ULONG* FifoBuffer,
     const BYTE* WriteBufferPtr,
     size_t Length
     )
 {
-    NT_ASSERT(Length != 0);
+    NT_ASSERT((Length != 0) && (Length <= FIFO_CAPACITY));
 
     // Input Sequence: 12 34 56 78 ab
     // Output Sequence: (0x00123400 >> 1) (0x00567800 >> 1) (0x00ab0000 >> 1)
-    const size_t bytesToQueue = min(FIFO_CAPACITY, Length);
-    for (size_t i = 0; i < (bytesToQueue / 2); ++i) {
+    size_t count = 0;
+    for (size_t i = 0; i < (Length / 2); ++i) {
         BCM_AUXSPI_IO_REG dataReg = {0};
         dataReg.Width = 16;
         dataReg.Data = (WriteBufferPtr[i * 2] << 15) |
                        (WriteBufferPtr[i * 2 + 1] << 7);
-        WRITE_REGISTER_NOFENCE_ULONG(&RegistersPtr->TxHoldReg, dataReg.AsUlong);
+        FifoBuffer[count++] = dataReg.AsUlong;
     }
 
     // handle last byte
-    if ((bytesToQueue % 2) != 0) {
+    if ((Length % 2) != 0) {
         BCM_AUXSPI_IO_REG dataReg = {0};
         dataReg.Width = 8;
-        dataReg.Data = (WriteBufferPtr[bytesToQueue - 1] << 15);
-        WRITE_REGISTER_NOFENCE_ULONG(&RegistersPtr->TxHoldReg, dataReg.AsUlong);
+        dataReg.Data = (WriteBufferPtr[Length - 1] << 15);
+        FifoBuffer[count++] = dataReg.AsUlong;
     }
 
-    return bytesToQueue;
+    return count;
+}
+
+_Use_decl_annotations_
+void AUXSPI_DEVICE::_FIFO_VARIABLE_2_SHIFTED::ExtractFull (
+    const ULONG* FifoBuffer,
+    BYTE* ReadBufferPtr
+    )
+{
+    for (size_t i = 0; i < BCM_AUXSPI_FIFO_DEPTH; ++i) {
+        const ULONG data = FifoBuffer[i];
+        ReadBufferPtr[i * 2] = static_cast<BYTE>(data >> 8);
+        ReadBufferPtr[i * 2 + 1] = static_cast<BYTE>(data);
+    }
 }
 
 _Use_decl_annotations_
@@ -1511,6 +1940,192 @@ void AUXSPI_DEVICE::_FIFO_VARIABLE_2_SHIFTED::Extract (
     }
 }
 
+//
+// FIFO kernels for a single FIFO mode. Full FIFO loads, which make up all
+// but the last FIFO load of a transfer, go through the branch-free
+// PackFull/ExtractFull, and are moved directly to or from the MDL when the
+// load does not straddle an MDL boundary.
+//
+template <typename TFifo>
+struct AUXSPI_DEVICE::_FIFO_KERNEL {
+
+    static size_t Pack (
+        _Out_writes_to_(BCM_AUXSPI_FIFO_DEPTH, return) ULONG* FifoBuffer,
+        _In_reads_(Length) const BYTE* WriteBufferPtr,
+        size_t Length
+        )
+    {
+        if (Length >= TFifo::FIFO_CAPACITY) {
+            TFifo::PackFull(FifoBuffer, WriteBufferPtr);
+            return BCM_AUXSPI_FIFO_DEPTH;
+        }
+
+        return TFifo::Pack(FifoBuffer, WriteBufferPtr, Length);
+    }
+
+    static size_t Write (
+        volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+        _In_reads_(Length) const BYTE* WriteBufferPtr,
+        size_t Length
+        )
+    {
+        ULONG fifoBuffer[BCM_AUXSPI_FIFO_DEPTH];
+        writeFifoWords(
+            RegistersPtr,
+            fifoBuffer,
+            Pack(fifoBuffer, WriteBufferPtr, Length));
+
+        return min(Length, size_t(TFifo::FIFO_CAPACITY));
+    }
+
+    static size_t WriteMdl (
+        volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+        _Inout_ PMDL* MdlPtr,
+        _Inout_ size_t* OffsetPtr
+        )
+    {
+        const BYTE* spanPtr = getMdlSpan(MdlPtr, OffsetPtr, TFifo::FIFO_CAPACITY);
+        if (spanPtr) {
+            ULONG fifoBuffer[BCM_AUXSPI_FIFO_DEPTH];
+            TFifo::PackFull(fifoBuffer, spanPtr);
+            writeFifoWords(RegistersPtr, fifoBuffer, BCM_AUXSPI_FIFO_DEPTH);
+            return TFifo::FIFO_CAPACITY;
+        }
+
+        ULONG buf[BCM_AUXSPI_FIFO_DEPTH];
+        const size_t bytesCopied = copyBytesFromMdl(
+                MdlPtr,
+                OffsetPtr,
+                reinterpret_cast<BYTE*>(buf),
+                TFifo::FIFO_CAPACITY);
+
+        return Write(RegistersPtr, reinterpret_cast<const BYTE*>(buf), bytesCopied);
+    }
+
+    static size_t Extract (
+        _In_reads_(BCM_AUXSPI_FIFO_DEPTH) const ULONG* FifoBuffer,
+        _Out_writes_to_(Length, return) BYTE* ReadBufferPtr,
+        size_t Length
+        )
+    {
+        if (Length >= TFifo::FIFO_CAPACITY) {
+            TFifo::ExtractFull(FifoBuffer, ReadBufferPtr);
+            return TFifo::FIFO_CAPACITY;
+        }
+
+        TFifo::Extract(FifoBuffer, ReadBufferPtr, Length);
+        return Length;
+    }
+
+    static size_t ExtractMdl (
+        _In_reads_(BCM_AUXSPI_FIFO_DEPTH) const ULONG* FifoBuffer,
+        size_t Length,
+        _Inout_ PMDL* MdlPtr,
+        _Inout_ size_t* OffsetPtr
+        )
+    {
+        const size_t bytesToExtract = min(Length, size_t(TFifo::FIFO_CAPACITY));
+
+        BYTE* spanPtr = getMdlSpan(MdlPtr, OffsetPtr, bytesToExtract);
+        if (spanPtr) {
+            return Extract(FifoBuffer, spanPtr, bytesToExtract);
+        }
+
+        ULONG buf[BCM_AUXSPI_FIFO_DEPTH];
+        const size_t bytesExtracted = Extract(
+                FifoBuffer,
+                reinterpret_cast<BYTE*>(buf),
+                bytesToExtract);
+
+        return copyBytesToMdl(
+                MdlPtr,
+                OffsetPtr,
+                reinterpret_cast<const BYTE*>(buf),
+                bytesExtracted);
+    }
+
+    //
+    // Reads raw FIFO contents into FifoBuffer, then queues the next batch of
+    // dummy bytes to get the read going again as soon as possible. Returns
+    // the number of bytes in FifoBuffer.
+    //
+    static size_t Drain (
+        volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+        _Out_writes_(BCM_AUXSPI_FIFO_DEPTH) ULONG* FifoBuffer,
+        size_t Length
+        )
+    {
+        NT_ASSERT(Length != 0);
+
+        for (int i = 0; i < BCM_AUXSPI_FIFO_DEPTH; ++i) {
+            FifoBuffer[i] = READ_REGISTER_NOFENCE_ULONG(&RegistersPtr->IoReg);
+        }
+
+        const size_t bytesToReadChunk = min(Length, size_t(TFifo::FIFO_CAPACITY));
+        if (Length != bytesToReadChunk) {
+            static const ULONG zeros[BCM_AUXSPI_FIFO_DEPTH] = {0};
+            Write(
+                RegistersPtr,
+                reinterpret_cast<const BYTE*>(zeros),
+                Length - bytesToReadChunk);
+        }
+
+        return bytesToReadChunk;
+    }
+
+    static size_t Read (
+        volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+        _Out_writes_to_(Length, return) BYTE* ReadBufferPtr,
+        size_t Length
+        )
+    {
+        ULONG fifoBuffer[BCM_AUXSPI_FIFO_DEPTH];
+        return Extract(
+                fifoBuffer,
+                ReadBufferPtr,
+                Drain(RegistersPtr, fifoBuffer, Length));
+    }
+
+    static size_t ReadMdl (
+        volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+        size_t Length,
+        _Inout_ PMDL* MdlPtr,
+        _Inout_ size_t* OffsetPtr
+        )
+    {
+        ULONG fifoBuffer[BCM_AUXSPI_FIFO_DEPTH];
+        return ExtractMdl(
+                fifoBuffer,
+                Drain(RegistersPtr, fifoBuffer, Length),
+                MdlPtr,
+                OffsetPtr);
+    }
+};
+
+//
+// Indexed by _FIFO_MODE. Must be constant-initialized since there is no
+// CRT to run dynamic initializers.
+//
+#define AUXSPI_FIFO_OPS(TFifo) {                \
+        TFifo::FIFO_CAPACITY,                   \
+        _FIFO_KERNEL<TFifo>::Pack,              \
+        _FIFO_KERNEL<TFifo>::Write,             \
+        _FIFO_KERNEL<TFifo>::WriteMdl,          \
+        _FIFO_KERNEL<TFifo>::Read,              \
+        _FIFO_KERNEL<TFifo>::ReadMdl,           \
+        _FIFO_KERNEL<TFifo>::Extract,           \
+        _FIFO_KERNEL<TFifo>::ExtractMdl,        \
+    }
+
+const AUXSPI_DEVICE::_FIFO_OPS AUXSPI_DEVICE::fifoOps[] = {
+    AUXSPI_FIFO_OPS(_FIFO_FIXED_4),                 // FIXED_4
+    AUXSPI_FIFO_OPS(_FIFO_VARIABLE_3),              // VARIABLE_3
+    AUXSPI_FIFO_OPS(_FIFO_FIXED_3_SHIFTED),         // FIXED_3_SHIFTED
+    AUXSPI_FIFO_OPS(_FIFO_VARIABLE_2_SHIFTED),      // VARIABLE_2_SHIFTED
+};
+
+#undef AUXSPI_FIFO_OPS
+
 _Use_decl_annotations_
 size_t AUXSPI_DEVICE::copyBytesToMdl (
     PMDL* MdlPtr,
@@ -1536,11 +2151,17 @@ size_t AUXSPI_DEVICE::copyBytesToMdl (
 
         if (bytesCopied == Length) break;
 
-        reinterpret_cast<BYTE*>(currentMdl->MappedSystemVa)[offset] =
-            reinterpret_cast<const BYTE*>(Buffer)[bytesCopied];
+        // copy as much as fits in the current MDL
+        const size_t chunkLength = min(
+                Length - bytesCopied,
+                MmGetMdlByteCount(currentMdl) - offset);
+        RtlCopyMemory(
+            static_cast<BYTE*>(currentMdl->MappedSystemVa) + offset,
+            Buffer + bytesCopied,
+            chunkLength);
 
-        ++offset;
-        ++bytesCopied;
+        offset += chunkLength;
+        bytesCopied += chunkLength;
     }
 
     *MdlPtr = currentMdl;
@@ -1572,11 +2193,17 @@ size_t AUXSPI_DEVICE::copyBytesFromMdl (
 
         if (bytesCopied == Length) break;
 
-        Buffer[bytesCopied] = reinterpret_cast<const BYTE*>(
-                currentMdl->MappedSystemVa)[offset];
+        // copy as much as is left in the current MDL
+        const size_t chunkLength = min(
+                Length - bytesCopied,
+                MmGetMdlByteCount(currentMdl) - offset);
+        RtlCopyMemory(
+            Buffer + bytesCopied,
+            static_cast<const BYTE*>(currentMdl->MappedSystemVa) + offset,
+            chunkLength);
 
-        ++offset;
-        ++bytesCopied;
+        offset += chunkLength;
+        bytesCopied += chunkLength;
     }
 
     *MdlPtr = currentMdl;
@@ -1623,6 +2250,28 @@ NTSTATUS AUXSPI_DEVICE::processRequestCompletion (
             InterruptContextPtr->Request.Sequence.BytesWritten +
             InterruptContextPtr->Request.Sequence.BytesRead;
         return STATUS_SUCCESS;
+    case _TRANSFER_STATE::STREAM_WRITE:
+        NT_ASSERT(
+            InterruptContextPtr->Request.Stream.WordsWritten ==
+            InterruptContextPtr->Request.Stream.WordCount);
+        *InformationPtr = InterruptContextPtr->Request.Stream.Length;
+        return STATUS_SUCCESS;
+    case _TRANSFER_STATE::STREAM_READ:
+    case _TRANSFER_STATE::STREAM_FULL_DUPLEX:
+        NT_ASSERT(
+            InterruptContextPtr->Request.Stream.WordsRead ==
+            InterruptContextPtr->Request.Stream.WordCount);
+
+        unpackStream(InterruptContextPtr);
+
+        *InformationPtr = InterruptContextPtr->Request.Stream.Length;
+        if (InterruptContextPtr->Request.TransferState ==
+            _TRANSFER_STATE::STREAM_FULL_DUPLEX) {
+
+            // bytes written + bytes read
+            *InformationPtr *= 2;
+        }
+        return STATUS_SUCCESS;
     default:
         NT_ASSERT(FALSE);
         *InformationPtr = 0;
@@ -1630,6 +2279,160 @@ NTSTATUS AUXSPI_DEVICE::processRequestCompletion (
     }
 }
 
+//
+// Called by the dispatch routines right before asserting CS. Bytes are
+// accounted to the FIFO mode they are queued with.
+//
+void AUXSPI_DEVICE::beginTransferTelemetry (
+    _INTERRUPT_CONTEXT* InterruptContextPtr,
+    _FIFO_MODE FifoMode,
+    size_t Length
+    )
+{
+    _TELEMETRY* telemetryPtr = &InterruptContextPtr->Telemetry;
+
+    telemetryPtr->TransferStartTicks = KeQueryPerformanceCounter(nullptr).QuadPart;
+    telemetryPtr->TransferBytes = Length;
+    telemetryPtr->TransferInterrupts = 0;
+    telemetryPtr->FifoModeBytes[ULONG(FifoMode)] += Length;
+}
+
+//
+// Called by the DPC once it owns the request. Every interrupt of a transfer
+// except the final one refilled the FIFO.
+//
+void AUXSPI_DEVICE::recordTransferTelemetry (
+    _INTERRUPT_CONTEXT* InterruptContextPtr,
+    LONGLONG DpcStartTicks
+    )
+{
+    _TELEMETRY* telemetryPtr = &InterruptContextPtr->Telemetry;
+    const LONGLONG performanceFrequency = InterruptContextPtr->PerformanceFrequency;
+    const LONGLONG nowTicks = KeQueryPerformanceCounter(nullptr).QuadPart;
+
+    const ULONGLONG latencyUs = ticksToMicroseconds(
+            max(DpcStartTicks - telemetryPtr->DpcQueuedTicks, 0LL),
+            performanceFrequency);
+    ++telemetryPtr->IsrToDpcLatencyHistogram[getHistogramBucket(latencyUs)];
+    if (latencyUs > telemetryPtr->MaxIsrToDpcLatencyUs) {
+        telemetryPtr->MaxIsrToDpcLatencyUs = latencyUs;
+    }
+    if (latencyUs >= AUXSPI_TELEMETRY_DELAYED_COMPLETION_US) {
+        ++telemetryPtr->DelayedCompletions;
+    }
+
+    const ULONG interrupts = telemetryPtr->TransferInterrupts;
+    const ULONG refills = interrupts ? interrupts - 1 : 0;
+    telemetryPtr->Interrupts += interrupts;
+    telemetryPtr->FifoRefills += refills;
+    ++telemetryPtr->FifoRefillHistogram[getHistogramBucket(refills)];
+
+    ++telemetryPtr->Transfers;
+    switch (InterruptContextPtr->Request.TransferState) {
+    case _TRANSFER_STATE::STREAM_WRITE:
+    case _TRANSFER_STATE::STREAM_READ:
+    case _TRANSFER_STATE::STREAM_FULL_DUPLEX:
+        ++telemetryPtr->StreamedTransfers;
+        break;
+    default:
+        break;
+    }
+
+    auto& chipSelect = telemetryPtr->ChipSelect[
+        ULONG(InterruptContextPtr->Request.TargetContextPtr->ChipSelectLine)];
+    ++chipSelect.Transfers;
+    chipSelect.Bytes += telemetryPtr->TransferBytes;
+    chipSelect.BusyTicks += nowTicks - telemetryPtr->TransferStartTicks;
+
+    telemetryPtr->DpcTicks += nowTicks - DpcStartTicks;
+}
+
+//
+// Handles the telemetry IOCTLs. SpbCx does not dispatch the next request
+// until this one is completed, so no transfer updates the counters while
+// they are copied or reset.
+//
+void AUXSPI_DEVICE::processTelemetryRequest (
+    _INTERRUPT_CONTEXT* InterruptContextPtr,
+    SPBREQUEST SpbRequest,
+    ULONG IoControlCode
+    )
+{
+    _TELEMETRY* telemetryPtr = &InterruptContextPtr->Telemetry;
+    const LONGLONG nowTicks = KeQueryPerformanceCounter(nullptr).QuadPart;
+
+    if (IoControlCode == IOCTL_AUXSPI_RESET_TELEMETRY) {
+        RtlZeroMemory(telemetryPtr, sizeof(*telemetryPtr));
+        telemetryPtr->ResetTicks = nowTicks;
+
+        AUXSPI_LOG_INFORMATION("Telemetry reset.");
+        SpbRequestComplete(SpbRequest, STATUS_SUCCESS);
+        return;
+    }
+
+    NT_ASSERT(IoControlCode == IOCTL_AUXSPI_GET_TELEMETRY);
+
+    PVOID outputBufferPtr;
+    NTSTATUS status = WdfRequestRetrieveOutputBuffer(
+            SpbRequest,
+            sizeof(AUXSPI_TELEMETRY),
+            &outputBufferPtr,
+            nullptr);
+    if (!NT_SUCCESS(status)) {
+        AUXSPI_LOG_ERROR(
+            "Failed to retrieve output buffer from telemetry request. (SpbRequest = %p, status = %!STATUS!)",
+            SpbRequest,
+            status);
+        SpbRequestComplete(SpbRequest, status);
+        return;
+    }
+
+    const LONGLONG performanceFrequency = InterruptContextPtr->PerformanceFrequency;
+    AUXSPI_TELEMETRY* outputPtr = static_cast<AUXSPI_TELEMETRY*>(outputBufferPtr);
+    RtlZeroMemory(outputPtr, sizeof(*outputPtr));
+
+    outputPtr->Size = sizeof(*outputPtr);
+    outputPtr->ElapsedTimeUs = ticksToMicroseconds(
+            nowTicks - telemetryPtr->ResetTicks,
+            performanceFrequency);
+    outputPtr->Transfers = telemetryPtr->Transfers;
+    outputPtr->StreamedTransfers = telemetryPtr->StreamedTransfers;
+    outputPtr->CancelledTransfers = telemetryPtr->CancelledTransfers;
+    outputPtr->Interrupts = telemetryPtr->Interrupts;
+    outputPtr->FifoRefills = telemetryPtr->FifoRefills;
+    RtlCopyMemory(
+        outputPtr->FifoRefillHistogram,
+        telemetryPtr->FifoRefillHistogram,
+        sizeof(outputPtr->FifoRefillHistogram));
+    outputPtr->IsrTimeUs = ticksToMicroseconds(
+            telemetryPtr->IsrTicks,
+            performanceFrequency);
+    outputPtr->DpcTimeUs = ticksToMicroseconds(
+            telemetryPtr->DpcTicks,
+            performanceFrequency);
+    outputPtr->DelayedCompletions = telemetryPtr->DelayedCompletions;
+    outputPtr->MaxIsrToDpcLatencyUs = telemetryPtr->MaxIsrToDpcLatencyUs;
+    RtlCopyMemory(
+        outputPtr->IsrToDpcLatencyHistogram,
+        telemetryPtr->IsrToDpcLatencyHistogram,
+        sizeof(outputPtr->IsrToDpcLatencyHistogram));
+    RtlCopyMemory(
+        outputPtr->FifoModeBytes,
+        telemetryPtr->FifoModeBytes,
+        sizeof(outputPtr->FifoModeBytes));
+
+    for (ULONG i = 0; i < AUXSPI_TELEMETRY_CHIP_SELECTS; ++i) {
+        outputPtr->ChipSelect[i].Transfers = telemetryPtr->ChipSelect[i].Transfers;
+        outputPtr->ChipSelect[i].Bytes = telemetryPtr->ChipSelect[i].Bytes;
+        outputPtr->ChipSelect[i].BusyTimeUs = ticksToMicroseconds(
+                telemetryPtr->ChipSelect[i].BusyTicks,
+                performanceFrequency);
+    }
+
+    WdfRequestSetInformation(SpbRequest, sizeof(*outputPtr));
+    SpbRequestComplete(SpbRequest, STATUS_SUCCESS);
+}
+
 AUXSPI_DEVICE::_CONTROL_REGS AUXSPI_DEVICE::computeControlRegisters (
     const _TARGET_CONTEXT* TargetContextPtr,
     _FIFO_MODE FifoMode
@@ -2171,11 +2974,40 @@ NTSTATUS AUXSPI_DEVICE::EvtDevicePrepareHardware (
     BCM_AUXSPI_CNTL1_REG cntl1Reg = {0};
     WRITE_REGISTER_NOFENCE_ULONG(&registersPtr->Cntl1Reg, cntl1Reg.AsUlong);
 
+    //
+    // Allocate the stream buffer (TX words followed by RX words). Streaming
+    // is an optimization, so the device still starts without it.
+    //
+    thisPtr->streamThresholdBytes =
+        queryStreamThresholdSetting(WdfDeviceGetDriver(WdfDevice));
+    if (thisPtr->streamThresholdBytes != 0) {
+        thisPtr->streamBufferPtr = static_cast<ULONG*>(ExAllocatePoolWithTag(
+                NonPagedPoolNx,
+                2 * AUXSPI_STREAM_BUFFER_WORDS * sizeof(ULONG),
+                AUXSPI_POOL_TAG));
+        if (!thisPtr->streamBufferPtr) {
+            AUXSPI_LOG_LOW_MEMORY(
+                "Failed to allocate stream buffer - streaming disabled. (AUXSPI_STREAM_BUFFER_WORDS = %lu)",
+                AUXSPI_STREAM_BUFFER_WORDS);
+        }
+    }
+
+    LARGE_INTEGER performanceFrequency;
+    KeQueryPerformanceCounter(&performanceFrequency);
+
     // initialize interrupt context
     thisPtr->interruptContextPtr =
         new (GetInterruptContext(thisPtr->wdfInterrupt)) _INTERRUPT_CONTEXT(
             thisPtr->auxRegistersPtr,
-            registersPtr);
+            registersPtr,
+            thisPtr->streamBufferPtr,
+            thisPtr->streamBufferPtr ?
+                thisPtr->streamBufferPtr + AUXSPI_STREAM_BUFFER_WORDS :
+                nullptr,
+            (performanceFrequency.QuadPart * AUXSPI_STREAM_SPIN_LIMIT_US) / 1000000,
+            performanceFrequency.QuadPart);
+    thisPtr->interruptContextPtr->Telemetry.ResetTicks =
+        KeQueryPerformanceCounter(nullptr).QuadPart;
 
     return STATUS_SUCCESS;
 }
@@ -2199,6 +3031,11 @@ NTSTATUS AUXSPI_DEVICE::EvtDeviceReleaseHardware (
         thisPtr->registersPtr = nullptr;
     }
 
+    if (thisPtr->streamBufferPtr) {
+        ExFreePoolWithTag(thisPtr->streamBufferPtr, AUXSPI_POOL_TAG);
+        thisPtr->streamBufferPtr = nullptr;
+    }
+
     return STATUS_SUCCESS;
 }
 
@@ -2250,6 +3087,55 @@ NTSTATUS AUXSPI_DEVICE::queryForceEnableSetting ( WDFDRIVER WdfDriver )
     return (forceEnable != 0) ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
 }
 
+//
+// Returns:
+//   The stream threshold from the registry, or AUXSPI_STREAM_THRESHOLD_DEFAULT
+//   if the value is not present or cannot be read.
+//
+_IRQL_requires_max_(PASSIVE_LEVEL)
+ULONG AUXSPI_DEVICE::queryStreamThresholdSetting ( WDFDRIVER WdfDriver )
+{
+    PAGED_CODE();
+    AUXSPI_ASSERT_MAX_IRQL(PASSIVE_LEVEL);
+
+    struct _LOCAL_KEY {
+        WDFKEY WdfKey = WDF_NO_HANDLE;
+        ~_LOCAL_KEY ()
+        {
+            PAGED_CODE();
+            if (WdfKey == WDF_NO_HANDLE) return;
+            WdfRegistryClose(WdfKey);
+        }
+    } key;
+    NTSTATUS status = WdfDriverOpenParametersRegistryKey(
+            WdfDriver,
+            KEY_QUERY_VALUE,
+            WDF_NO_OBJECT_ATTRIBUTES,
+            &key.WdfKey);
+    if (!NT_SUCCESS(status)) {
+        AUXSPI_LOG_ERROR(
+            "Failed to open driver registry key. (status = %!STATUS!)",
+            status);
+        return AUXSPI_STREAM_THRESHOLD_DEFAULT;
+    }
+
+    DECLARE_CONST_UNICODE_STRING(valueName, REGSTR_VAL_AUXSPI_STREAM_THRESHOLD);
+    ULONG streamThreshold;
+    status = WdfRegistryQueryULong(
+            key.WdfKey,
+            &valueName,
+            &streamThreshold);
+    if (!NT_SUCCESS(status)) {
+        return AUXSPI_STREAM_THRESHOLD_DEFAULT;
+    }
+
+    AUXSPI_LOG_INFORMATION(
+        "Using stream threshold from registry. (streamThreshold = %lu)",
+        streamThreshold);
+
+    return streamThreshold;
+}
+
 _Use_decl_annotations_
 NTSTATUS AUXSPI_DRIVER::EvtDriverDeviceAdd (
     WDFDRIVER /*WdfDriver*/,
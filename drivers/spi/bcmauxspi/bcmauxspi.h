@@ -50,8 +50,25 @@
 //
 #define REGSTR_VAL_AUXSPI_FORCE_ENABLE L"ForceEnable"
 
+//
+// Transfers of at least this many bytes are prepacked into FIFO words and
+// streamed from the interrupt handler instead of being packed one FIFO load
+// per interrupt. Zero disables streaming.
+//
+//   Key: Driver Parameters Subkey
+//   Type: REG_DWORD
+//
+#define REGSTR_VAL_AUXSPI_STREAM_THRESHOLD L"StreamThresholdBytes"
+
 enum : ULONG { AUXSPI_POOL_TAG = 'IPSA' };
 
+enum : ULONG {
+    AUXSPI_STREAM_THRESHOLD_DEFAULT = 64,
+    AUXSPI_STREAM_BUFFER_WORDS = (4 * PAGE_SIZE) / sizeof(ULONG),
+    AUXSPI_STREAM_SPIN_LIMIT_US = 25,
+    AUXSPI_STREAM_MIN_CLOCK = 8000000,      // 8Mhz, a FIFO load in 16us
+};
+
 //
 // Placement new operator
 //
@@ -87,6 +104,9 @@ public: // NONPAGED
         SEQUENCE_READ_INIT,
         SEQUENCE_READ,
         FULL_DUPLEX,
+        STREAM_WRITE,
+        STREAM_READ,
+        STREAM_FULL_DUPLEX,
     };
 
     enum class _FIFO_MODE {
@@ -94,6 +114,7 @@ public: // NONPAGED
         VARIABLE_3,
         FIXED_3_SHIFTED,
         VARIABLE_2_SHIFTED,
+        COUNT,
     };
 
     enum class _SPI_DATA_MODE : UCHAR { Mode0, Mode1, Mode2, Mode3 };
@@ -135,6 +156,63 @@ public: // NONPAGED
         size_t CurrentReadMdlOffset;
     };
 
+    //
+    // Streamed transfers are packed into FIFO words up front. Every full
+    // FIFO load occupies BCM_AUXSPI_FIFO_DEPTH words, so the received words
+    // can be extracted in FIFO load sized chunks once the transfer is done.
+    //
+    struct _STREAM_CONTEXT {
+        BYTE* const ReadBufferPtr;      // STREAM_READ
+        const PMDL ReadMdl;             // STREAM_FULL_DUPLEX
+        const size_t Length;
+        const size_t WordCount;
+        size_t WordsWritten;
+        size_t WordsRead;
+    };
+
+    //
+    // Telemetry counters. Transfers are serialized by SpbCx, so the counters
+    // of a transfer are updated by whoever owns the transfer at the time
+    // (dispatch routine, ISR, DPC) without interlocked operations, and
+    // telemetry IOCTLs see them while no transfer is in flight. Times are
+    // kept in performance counter ticks and converted when queried.
+    //
+    struct _TELEMETRY {
+        LONGLONG ResetTicks;
+
+        // current transfer
+        LONGLONG TransferStartTicks;
+        LONGLONG DpcQueuedTicks;
+        size_t TransferBytes;
+        ULONG TransferInterrupts;
+
+        ULONGLONG Transfers;
+        ULONGLONG StreamedTransfers;
+        ULONGLONG CancelledTransfers;
+        ULONGLONG Interrupts;
+        ULONGLONG FifoRefills;
+        ULONGLONG FifoRefillHistogram[AUXSPI_TELEMETRY_HISTOGRAM_BUCKETS];
+        LONGLONG IsrTicks;
+        LONGLONG DpcTicks;
+        ULONGLONG DelayedCompletions;
+        ULONGLONG MaxIsrToDpcLatencyUs;
+        ULONGLONG IsrToDpcLatencyHistogram[AUXSPI_TELEMETRY_HISTOGRAM_BUCKETS];
+        ULONGLONG FifoModeBytes[AUXSPI_TELEMETRY_FIFO_MODES];
+
+        struct {
+            ULONGLONG Transfers;
+            ULONGLONG Bytes;
+            LONGLONG BusyTicks;
+        } ChipSelect[AUXSPI_TELEMETRY_CHIP_SELECTS];
+    };
+
+    static_assert(
+        ULONG(_FIFO_MODE::COUNT) == AUXSPI_TELEMETRY_FIFO_MODES,
+        "Telemetry must have one byte counter per FIFO mode");
+    static_assert(
+        ULONG(_CHIP_SELECT_LINE::CE2) + 1 == AUXSPI_TELEMETRY_CHIP_SELECTS,
+        "Telemetry must have one entry per chip select line");
+
     struct _INTERRUPT_CONTEXT {
         volatile BCM_AUX_REGISTERS* const AuxRegistersPtr;
         volatile BCM_AUXSPI_REGISTERS* const RegistersPtr;
@@ -146,6 +224,7 @@ public: // NONPAGED
                 _WRITE_CONTEXT Write;
                 _READ_CONTEXT Read;
                 _SEQUENCE_CONTEXT Sequence;
+                _STREAM_CONTEXT Stream;
             } DUMMYUNIONNAME;
             SPBREQUEST volatile SpbRequest;
             const _TARGET_CONTEXT* TargetContextPtr;
@@ -174,14 +253,30 @@ public: // NONPAGED
         _CONTROL_REGS ControlRegs;
         bool SpbControllerLocked;
 
+        ULONG* const StreamTxBufferPtr;
+        ULONG* const StreamRxBufferPtr;
+        const LONGLONG StreamSpinTicks;
+
+        const LONGLONG PerformanceFrequency;
+        _TELEMETRY Telemetry;
+
         __forceinline _INTERRUPT_CONTEXT (
             volatile BCM_AUX_REGISTERS* auxRegistersPtr,
-            volatile BCM_AUXSPI_REGISTERS* registersPtr
+            volatile BCM_AUXSPI_REGISTERS* registersPtr,
+            ULONG* streamTxBufferPtr,
+            ULONG* streamRxBufferPtr,
+            LONGLONG streamSpinTicks,
+            LONGLONG performanceFrequency
             ) :
             AuxRegistersPtr(auxRegistersPtr),
             RegistersPtr(registersPtr),
             ControlRegs(),
-            SpbControllerLocked(false) {}
+            SpbControllerLocked(false),
+            StreamTxBufferPtr(streamTxBufferPtr),
+            StreamRxBufferPtr(streamRxBufferPtr),
+            StreamSpinTicks(streamSpinTicks),
+            PerformanceFrequency(performanceFrequency),
+            Telemetry() {}
     };
 
     static EVT_WDF_INTERRUPT_ISR EvtInterruptIsr;
@@ -193,8 +288,8 @@ public: // NONPAGED
     static EVT_SPB_CONTROLLER_READ EvtSpbIoRead;
     static EVT_SPB_CONTROLLER_WRITE EvtSpbIoWrite;
     static EVT_SPB_CONTROLLER_SEQUENCE EvtSpbIoSequence;
-    static EVT_SPB_CONTROLLER_OTHER EvtSpbIoOther;              // FullDuplex
-    static EVT_WDF_IO_IN_CALLER_CONTEXT EvtIoInCallerContext;   // FullDuplex
+    static EVT_SPB_CONTROLLER_OTHER EvtSpbIoOther;              // FullDuplex, Telemetry
+    static EVT_WDF_IO_IN_CALLER_CONTEXT EvtIoInCallerContext;   // FullDuplex, Telemetry
 
     static EVT_WDF_REQUEST_CANCEL EvtRequestCancel;
 
@@ -203,11 +298,58 @@ public: // NONPAGED
         WDFINTERRUPT WdfInterrupt
         ) :
         wdfDevice(WdfDevice),
-        wdfInterrupt(WdfInterrupt)
+        wdfInterrupt(WdfInterrupt),
+        streamBufferPtr(),
+        streamThresholdBytes()
         {}
 
 private: // NONPAGED
 
+    static void writeFifoWords (
+        volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+        _In_reads_(Count) const ULONG* FifoBuffer,
+        _In_range_(0, BCM_AUXSPI_FIFO_DEPTH) size_t Count
+        );
+
+    static size_t packFifo (
+        _Out_writes_to_(BCM_AUXSPI_FIFO_DEPTH, return) ULONG* FifoBuffer,
+        _In_reads_(Length) const BYTE* WriteBufferPtr,
+        size_t Length,
+        _FIFO_MODE FifoMode
+        );
+
+    static size_t packStream (
+        _Out_writes_to_(AUXSPI_STREAM_BUFFER_WORDS, return) ULONG* WordBufferPtr,
+        _In_reads_opt_(Length) const BYTE* WriteBufferPtr,
+        size_t Length,
+        _FIFO_MODE FifoMode
+        );
+
+    static size_t packStreamMdl (
+        _Out_writes_to_(AUXSPI_STREAM_BUFFER_WORDS, return) ULONG* WordBufferPtr,
+        PMDL Mdl,
+        size_t Length,
+        _FIFO_MODE FifoMode
+        );
+
+    static bool streamFifo ( _INTERRUPT_CONTEXT* InterruptContextPtr );
+
+    static void unpackStream ( const _INTERRUPT_CONTEXT* InterruptContextPtr );
+
+    bool shouldStream (
+        const _TARGET_CONTEXT* TargetContextPtr,
+        size_t Length,
+        _FIFO_MODE FifoMode
+        ) const;
+
+    void startStreamTransfer (
+        SPBREQUEST SpbRequest,
+        const _TARGET_CONTEXT* TargetContextPtr,
+        _TRANSFER_STATE TransferState,
+        _FIFO_MODE FifoMode,
+        const _STREAM_CONTEXT& StreamContext
+        );
+
     static size_t writeFifo (
         volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
         _In_reads_(Length) const BYTE* WriteBufferPtr,
@@ -250,29 +392,56 @@ private: // NONPAGED
         _FIFO_MODE FifoMode
         );
 
+    //
+    // Each FIFO mode packs bytes into FIFO entries and extracts bytes from
+    // FIFO entries. PackFull/ExtractFull handle exactly one full FIFO load
+    // (BCM_AUXSPI_FIFO_DEPTH entries) without branching, Pack/Extract handle
+    // the final partial load of a transfer.
+    //
+
     struct _FIFO_FIXED_4 {
         enum { FIFO_CAPACITY = BCM_AUXSPI_FIFO_DEPTH * sizeof(ULONG) };
 
-        static size_t Write (
-            volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
-            _In_reads_(Length) const ULONG* WriteBufferPtr,
-            size_t Length
+        static void PackFull (
+            _Out_writes_(BCM_AUXSPI_FIFO_DEPTH) ULONG* FifoBuffer,
+            _In_reads_(FIFO_CAPACITY) const BYTE* WriteBufferPtr
+            );
+
+        static size_t Pack (
+            _Out_writes_to_(BCM_AUXSPI_FIFO_DEPTH, return) ULONG* FifoBuffer,
+            _In_reads_(Length) const BYTE* WriteBufferPtr,
+            _In_range_(1, FIFO_CAPACITY) size_t Length
+            );
+
+        static void ExtractFull (
+            _In_reads_(BCM_AUXSPI_FIFO_DEPTH) const ULONG* FifoBuffer,
+            _Out_writes_(FIFO_CAPACITY) BYTE* ReadBufferPtr
             );
 
         static void Extract (
             _In_reads_(BCM_AUXSPI_FIFO_DEPTH) const ULONG* FifoBuffer,
-            _Out_writes_(Length) ULONG* ReadBufferPtr,
-            _In_range_(1, BCM_AUXSPI_FIFO_DEPTH) size_t Length
+            _Out_writes_(Length) BYTE* ReadBufferPtr,
+            _In_range_(1, FIFO_CAPACITY) size_t Length
             );
     };
 
     struct _FIFO_VARIABLE_3 {
         enum { FIFO_CAPACITY = BCM_AUXSPI_FIFO_DEPTH * 3 };
 
-        static size_t Write (
-            volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+        static void PackFull (
+            _Out_writes_(BCM_AUXSPI_FIFO_DEPTH) ULONG* FifoBuffer,
+            _In_reads_(FIFO_CAPACITY) const BYTE* WriteBufferPtr
+            );
+
+        static size_t Pack (
+            _Out_writes_to_(BCM_AUXSPI_FIFO_DEPTH, return) ULONG* FifoBuffer,
             _In_reads_(Length) const BYTE* WriteBufferPtr,
-            size_t Length
+            _In_range_(1, FIFO_CAPACITY) size_t Length
+            );
+
+        static void ExtractFull (
+            _In_reads_(BCM_AUXSPI_FIFO_DEPTH) const ULONG* FifoBuffer,
+            _Out_writes_(FIFO_CAPACITY) BYTE* ReadBufferPtr
             );
 
         static void Extract (
@@ -291,10 +460,20 @@ private: // NONPAGED
     struct _FIFO_FIXED_3_SHIFTED {
         enum { FIFO_CAPACITY = BCM_AUXSPI_FIFO_DEPTH * 3 };
 
-        static size_t Write (
-            volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+        static void PackFull (
+            _Out_writes_(BCM_AUXSPI_FIFO_DEPTH) ULONG* FifoBuffer,
+            _In_reads_(FIFO_CAPACITY) const BYTE* WriteBufferPtr
+            );
+
+        static size_t Pack (
+            _Out_writes_to_(BCM_AUXSPI_FIFO_DEPTH, return) ULONG* FifoBuffer,
             _In_reads_(Length) const BYTE* WriteBufferPtr,
-            size_t Length
+            _In_range_(3, FIFO_CAPACITY) size_t Length
+            );
+
+        static void ExtractFull (
+            _In_reads_(BCM_AUXSPI_FIFO_DEPTH) const ULONG* FifoBuffer,
+            _Out_writes_(FIFO_CAPACITY) BYTE* ReadBufferPtr
             );
 
         static void Extract (
@@ -307,10 +486,20 @@ private: // NONPAGED
     struct _FIFO_VARIABLE_2_SHIFTED {
         enum { FIFO_CAPACITY = BCM_AUXSPI_FIFO_DEPTH * 2 };
 
-        static size_t Write (
-            volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+        static void PackFull (
+            _Out_writes_(BCM_AUXSPI_FIFO_DEPTH) ULONG* FifoBuffer,
+            _In_reads_(FIFO_CAPACITY) const BYTE* WriteBufferPtr
+            );
+
+        static size_t Pack (
+            _Out_writes_to_(BCM_AUXSPI_FIFO_DEPTH, return) ULONG* FifoBuffer,
             _In_reads_(Length) const BYTE* WriteBufferPtr,
-            size_t Length
+            _In_range_(1, FIFO_CAPACITY) size_t Length
+            );
+
+        static void ExtractFull (
+            _In_reads_(BCM_AUXSPI_FIFO_DEPTH) const ULONG* FifoBuffer,
+            _Out_writes_(FIFO_CAPACITY) BYTE* ReadBufferPtr
             );
 
         static void Extract (
@@ -320,6 +509,75 @@ private: // NONPAGED
             );
     };
 
+    //
+    // FIFO kernels specialized for one FIFO mode, defined in bcmauxspi.cpp.
+    // A table of kernels indexed by _FIFO_MODE replaces the per-refill
+    // switch on the FIFO mode.
+    //
+    template <typename TFifo> struct _FIFO_KERNEL;
+
+    struct _FIFO_OPS {
+        size_t FifoCapacity;
+
+        size_t (*Pack) (
+            _Out_writes_to_(BCM_AUXSPI_FIFO_DEPTH, return) ULONG* FifoBuffer,
+            _In_reads_(Length) const BYTE* WriteBufferPtr,
+            size_t Length
+            );
+
+        size_t (*Write) (
+            volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+            _In_reads_(Length) const BYTE* WriteBufferPtr,
+            size_t Length
+            );
+
+        size_t (*WriteMdl) (
+            volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+            _Inout_ PMDL* MdlPtr,
+            _Inout_ size_t* OffsetPtr
+            );
+
+        size_t (*Read) (
+            volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+            _Out_writes_to_(Length, return) BYTE* ReadBufferPtr,
+            size_t Length
+            );
+
+        size_t (*ReadMdl) (
+            volatile BCM_AUXSPI_REGISTERS* RegistersPtr,
+            size_t Length,
+            _Inout_ PMDL* MdlPtr,
+            _Inout_ size_t* OffsetPtr
+            );
+
+        size_t (*Extract) (
+            _In_reads_(BCM_AUXSPI_FIFO_DEPTH) const ULONG* FifoBuffer,
+            _Out_writes_to_(Length, return) BYTE* ReadBufferPtr,
+            size_t Length
+            );
+
+        size_t (*ExtractMdl) (
+            _In_reads_(BCM_AUXSPI_FIFO_DEPTH) const ULONG* FifoBuffer,
+            size_t Length,
+            _Inout_ PMDL* MdlPtr,
+            _Inout_ size_t* OffsetPtr
+            );
+    };
+
+    static const _FIFO_OPS fifoOps[ULONG(_FIFO_MODE::COUNT)];
+
+    __forceinline static const _FIFO_OPS& getFifoOps ( _FIFO_MODE FifoMode )
+    {
+        NT_ASSERT(ULONG(FifoMode) < ULONG(_FIFO_MODE::COUNT));
+        return fifoOps[ULONG(FifoMode)];
+    }
+
+    static BYTE* getMdlSpan (
+        _Inout_ PMDL* MdlPtr,
+        _Inout_ size_t* MdlOffsetPtr,
+        size_t Length
+        );
+
     static size_t copyBytesToMdl (
         _Inout_ PMDL* MdlPtr,
         _Inout_ size_t* MdlOffsetPtr,
@@ -339,6 +597,42 @@ private: // NONPAGED
         _Out_ ULONG_PTR* InformationPtr
         );
 
+    static void beginTransferTelemetry (
+        _INTERRUPT_CONTEXT* InterruptContextPtr,
+        _FIFO_MODE FifoMode,
+        size_t Length
+        );
+
+    static void recordTransferTelemetry (
+        _INTERRUPT_CONTEXT* InterruptContextPtr,
+        LONGLONG DpcStartTicks
+        );
+
+    static void processTelemetryRequest (
+        _INTERRUPT_CONTEXT* InterruptContextPtr,
+        SPBREQUEST SpbRequest,
+        ULONG IoControlCode
+        );
+
+    __forceinline static ULONG getHistogramBucket ( ULONGLONG Value )
+    {
+        if (Value == 0) return 0;
+
+        const ULONG bucket = ULONG(RtlFindMostSignificantBit(Value)) + 1;
+        return min(bucket, ULONG(AUXSPI_TELEMETRY_HISTOGRAM_BUCKETS - 1));
+    }
+
+    __forceinline static ULONGLONG ticksToMicroseconds (
+        LONGLONG Ticks,
+        LONGLONG PerformanceFrequency
+        )
+    {
+        // split to not overflow on long running totals
+        return ULONGLONG(
+            ((Ticks / PerformanceFrequency) * 1000000) +
+            (((Ticks % PerformanceFrequency) * 1000000) / PerformanceFrequency));
+    }
+
     static _CONTROL_REGS computeControlRegisters (
         const _TARGET_CONTEXT* TargetContextPtr,
         _FIFO_MODE FifoMode
@@ -372,22 +666,7 @@ private: // NONPAGED
     _Ret_range_(<=, 16)
     __forceinline static size_t getFifoCapacity ( _FIFO_MODE FifoMode )
     {
-        switch (FifoMode) {
-        case _FIFO_MODE::FIXED_4: return _FIFO_FIXED_4::FIFO_CAPACITY;
-        case _FIFO_MODE::VARIABLE_3: return _FIFO_VARIABLE_3::FIFO_CAPACITY;
-        case _FIFO_MODE::FIXED_3_SHIFTED: return _FIFO_FIXED_3_SHIFTED::FIFO_CAPACITY;
-        case _FIFO_MODE::VARIABLE_2_SHIFTED: return _FIFO_VARIABLE_2_SHIFTED::FIFO_CAPACITY;
-        default: NT_ASSERT(FALSE); return 0;
-        }
-    }
-
-    static void ASSERT_ULONG_ALIGNED (const BYTE* BufferPtr, size_t Length)
-    {
-        UNREFERENCED_PARAMETER(BufferPtr);
-        UNREFERENCED_PARAMETER(Length);
-        NT_ASSERT((reinterpret_cast<ULONG>(BufferPtr) &
-                FILE_LONG_ALIGNMENT) == 0);
-        NT_ASSERT((Length % sizeof(ULONG)) == 0);
+        return getFifoOps(FifoMode).FifoCapacity;
     }
 
     volatile BCM_AUXSPI_REGISTERS* registersPtr;
@@ -397,6 +676,9 @@ private: // NONPAGED
 
     volatile BCM_AUX_REGISTERS* auxRegistersPtr;
 
+    ULONG* streamBufferPtr;
+    ULONG streamThresholdBytes;
+
 public: // PAGED
 
     static EVT_SPB_TARGET_CONNECT EvtSpbTargetConnect;
@@ -408,6 +690,9 @@ private: // PAGED
 
     _IRQL_requires_max_(PASSIVE_LEVEL)
     static NTSTATUS queryForceEnableSetting ( WDFDRIVER WdfDevice );
+
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    static ULONG queryStreamThresholdSetting ( WDFDRIVER WdfDriver );
 };
 
 extern "C" DRIVER_INITIALIZE DriverEntry;